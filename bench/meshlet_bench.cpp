@@ -0,0 +1,164 @@
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <math.h>
+#include <HandmadeMath.h>
+
+#include "../src/engine/gfx/meshlet.h"
+#include "../src/engine/scene/scene_systems.h"
+
+// Meshlet build cost and fill, and the share of triangles the GPU culling
+// pass would reject by normal cone and by frustum, for procedural meshes
+// seen from a ring of cameras close enough to clip them.
+
+struct BenchMesh
+{
+    const char* m_name;
+    std::vector<hmm_vec3> m_positions;
+    std::vector<uint32_t> m_indices;
+};
+
+static double v_now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Quads of a (columns + 1) x (rows + 1) vertex grid, front facing (clockwise)
+// seen from +Y for x along +X and y along +Z
+static void v_add_grid_indices(BenchMesh& mesh, uint32_t columns, uint32_t rows)
+{
+    for(uint32_t y=0; y < rows; y++)
+    {
+        for(uint32_t x=0; x < columns; x++)
+        {
+            uint32_t i0 = y * (columns + 1) + x;
+            uint32_t i1 = i0 + 1;
+            uint32_t i2 = i0 + columns + 1;
+            uint32_t i3 = i2 + 1;
+            uint32_t quad[] = {i0, i1, i2, i1, i3, i2};
+            mesh.m_indices.insert(mesh.m_indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+static BenchMesh v_make_sphere(uint32_t columns, uint32_t rows)
+{
+    BenchMesh mesh;
+    mesh.m_name = "sphere";
+    for(uint32_t y=0; y <= rows; y++)
+    {
+        float theta = HMM_PI32 * (float)y / (float)rows;
+        for(uint32_t x=0; x <= columns; x++)
+        {
+            float phi = 2.0f * HMM_PI32 * (float)x / (float)columns;
+            mesh.m_positions.push_back(HMM_Vec3(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi)));
+        }
+    }
+    v_add_grid_indices(mesh, columns, rows);
+    return mesh;
+}
+
+static BenchMesh v_make_torus(uint32_t columns, uint32_t rows)
+{
+    BenchMesh mesh;
+    mesh.m_name = "torus";
+    for(uint32_t y=0; y <= rows; y++)
+    {
+        float theta = 2.0f * HMM_PI32 * (float)y / (float)rows;
+        for(uint32_t x=0; x <= columns; x++)
+        {
+            float phi = 2.0f * HMM_PI32 * (float)x / (float)columns;
+            float ring = 1.0f + 0.35f * cosf(theta);
+            mesh.m_positions.push_back(HMM_Vec3(ring * cosf(phi), 0.35f * sinf(theta), ring * sinf(phi)));
+        }
+    }
+    v_add_grid_indices(mesh, columns, rows);
+    return mesh;
+}
+
+// Rolling terrain, mostly facing up
+static BenchMesh v_make_terrain(uint32_t columns, uint32_t rows)
+{
+    BenchMesh mesh;
+    mesh.m_name = "terrain";
+    for(uint32_t y=0; y <= rows; y++)
+    {
+        for(uint32_t x=0; x <= columns; x++)
+        {
+            float u = (float)x / (float)columns * 2.0f - 1.0f;
+            float v = (float)y / (float)rows * 2.0f - 1.0f;
+            float height = 0.08f * sinf(u * 9.0f) * cosf(v * 7.0f);
+            mesh.m_positions.push_back(HMM_Vec3(u, height, v));
+        }
+    }
+    v_add_grid_indices(mesh, columns, rows);
+    return mesh;
+}
+
+static void v_run(BenchMesh& mesh)
+{
+    uint32_t triangle_count = (uint32_t)mesh.m_indices.size() / 3;
+    MeshletData data;
+
+    double start = v_now();
+    v_build_meshlets(data, mesh.m_positions.data(), sizeof(hmm_vec3), (uint32_t)mesh.m_positions.size(), mesh.m_indices);
+    double build_time = v_now() - start;
+
+    uint32_t meshlet_count = (uint32_t)data.m_meshlets.size();
+    uint32_t cone_cullable = 0;
+    for(const auto& meshlet : data.m_meshlets) cone_cullable += meshlet.m_cone_axis_cutoff.W < 1.0f;
+
+    // Every camera sits on a ring at 1.3 units, looking at the center
+    const uint32_t views = 16;
+    hmm_mat4 projection = HMM_Perspective(70.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+    hmm_vec4 no_planes[6];
+    for(uint32_t p=0; p < 6; p++) no_planes[p] = HMM_Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    uint64_t cone_rejected = 0;
+    uint64_t frustum_rejected = 0;
+    uint64_t total_rejected = 0;
+    for(uint32_t view_index=0; view_index < views; view_index++)
+    {
+        float angle = 2.0f * HMM_PI32 * (float)view_index / (float)views;
+        hmm_vec3 camera = HMM_Vec3(1.3f * cosf(angle), 0.5f, 1.3f * sinf(angle));
+        hmm_mat4 view = HMM_LookAt(camera, HMM_Vec3(0.0f, 0.0f, 0.0f), HMM_Vec3(0.0f, 1.0f, 0.0f));
+
+        hmm_vec4 planes[6];
+        v_extract_frustum(projection * view, planes);
+
+        for(const auto& meshlet : data.m_meshlets)
+        {
+            uint32_t triangles = meshlet.m_index_count / 3;
+            // A cutoff of 1 turns the cone test off, leaving the frustum test
+            Meshlet sphere_only = meshlet;
+            sphere_only.m_cone_axis_cutoff.W = 1.0f;
+
+            if(!v_is_meshlet_visible(meshlet, no_planes, camera)) cone_rejected += triangles;
+            if(!v_is_meshlet_visible(sphere_only, planes, camera)) frustum_rejected += triangles;
+            if(!v_is_meshlet_visible(meshlet, planes, camera)) total_rejected += triangles;
+        }
+    }
+
+    double view_triangles = (double)triangle_count * views;
+    printf("%-8s %7u tris: build %7.2f ms, %5u meshlets, %5.1f verts %5.1f tris avg, cone usable %5.1f%%, "
+        "rejected by cone %5.1f%% frustum %5.1f%% either %5.1f%%\n",
+        mesh.m_name, triangle_count, build_time * 1000.0, meshlet_count,
+        (double)data.m_vertices.size() / meshlet_count, (double)triangle_count / meshlet_count,
+        100.0 * cone_cullable / meshlet_count,
+        100.0 * cone_rejected / view_triangles,
+        100.0 * frustum_rejected / view_triangles,
+        100.0 * total_rejected / view_triangles
+    );
+}
+
+int main()
+{
+    BenchMesh meshes[] = {
+        v_make_sphere(256, 128),
+        v_make_torus(384, 96),
+        v_make_terrain(256, 256)
+    };
+    for(auto& mesh : meshes) v_run(mesh);
+    return 0;
+}
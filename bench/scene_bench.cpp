@@ -0,0 +1,117 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <HandmadeMath.h>
+
+#include "../src/engine/core/job.h"
+#include "../src/engine/scene/scene.h"
+#include "../src/engine/scene/scene_systems.h"
+
+// Entity creation/destruction throughput and per-frame system cost of the
+// sparse set scene storage.
+
+static double v_now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static Entity v_spawn(Scene& scene, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+
+    MeshComponent mesh{};
+    mesh.m_lods[0] = nullptr;
+    mesh.m_lods[1] = nullptr;
+    mesh.m_lod_distances[0] = 30.0f;
+    mesh.m_lod_distances[1] = 120.0f;
+    mesh.m_lod_count = 2;
+
+    MaterialComponent material{};
+    material.m_material_id = rng() % 16;
+
+    BoundsComponent bounds{};
+    bounds.m_radius = 1.0f;
+
+    Entity entity = v_create_entity(scene);
+    TransformComponent& transform = v_add_transform(scene, entity, Entity{ENTITY_NONE, 0});
+    v_set_position(scene.m_transform_system, transform.m_transform, HMM_Vec3(position(rng), position(rng), position(rng)));
+    v_add_component(scene.m_meshes, entity, mesh);
+    v_add_component(scene.m_materials, entity, material);
+    v_add_component(scene.m_bounds, entity, bounds);
+    return entity;
+}
+
+static void v_run(uint32_t count)
+{
+    std::mt19937 rng(42);
+    Scene scene;
+    v_init_scene(scene, count);
+
+    std::vector<Entity> entities(count);
+    double start = v_now();
+    for(uint32_t i=0; i < count; i++) entities[i] = v_spawn(scene, rng);
+    double create_time = v_now() - start;
+
+    start = v_now();
+    v_update_transforms(scene.m_transform_system, nullptr, 0);
+    double first_update_time = v_now() - start;
+
+    SceneView view;
+    view.m_camera_position = HMM_Vec3(0.0f, 0.0f, 0.0f);
+    view.m_view_projection = HMM_Perspective(70.0f, 16.0f / 9.0f, 0.1f, 200.0f);
+
+    const uint32_t frames = 20;
+    start = v_now();
+    for(uint32_t frame=0; frame < frames; frame++) v_cull_scene(scene, view);
+    double cull_time = (v_now() - start) / frames;
+
+    start = v_now();
+    for(uint32_t frame=0; frame < frames; frame++) v_select_lods(scene, view);
+    double lod_time = (v_now() - start) / frames;
+
+    // Plain walk over one dense array, the floor for any system
+    start = v_now();
+    uint64_t checksum = 0;
+    for(uint32_t frame=0; frame < frames; frame++)
+    {
+        for(const auto& material : scene.m_materials.m_data) checksum += material.m_material_id;
+    }
+    double iterate_time = (v_now() - start) / frames;
+
+    // Churn a tenth of the scene, the way spawners and despawners would
+    uint32_t churn = count / 10;
+    start = v_now();
+    for(uint32_t i=0; i < churn; i++)
+    {
+        uint32_t victim = rng() % count;
+        v_destroy_entity(scene, entities[victim]);
+        entities[victim] = v_spawn(scene, rng);
+    }
+    double churn_time = v_now() - start;
+
+    start = v_now();
+    v_update_transforms(scene.m_transform_system, nullptr, 0);
+    double churn_update_time = v_now() - start;
+
+    printf("%8u entities: create %6.1f M/s, first update %7.2f ms, cull %7.2f ms, lod %6.2f ms, "
+        "iterate %6.2f ms, destroy+create %6.1f M/s, resort %7.2f ms (%u visible, checksum %llu)\n",
+        count, count / create_time / 1e6, first_update_time * 1000.0,
+        cull_time * 1000.0, lod_time * 1000.0, iterate_time * 1000.0,
+        churn / churn_time / 1e6, churn_update_time * 1000.0,
+        view.m_stats.m_visible, (unsigned long long)checksum
+    );
+}
+
+int main()
+{
+    v_init_job_system(0);
+    printf("%u worker(s)\n", v_get_worker_count());
+
+    uint32_t counts[] = {100000, 250000, 500000, 1000000};
+    for(uint32_t count : counts) v_run(count);
+
+    v_destroy_job_system();
+    return 0;
+}
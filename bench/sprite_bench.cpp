@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/engine/gfx/sprite_batch.h"
+
+// CPU cost of a frame of sprites: filling the batch and writing it in layer order to
+// what would be the mapped buffer. Compared against sorting the same sprites
+// with std::stable_sort, the obvious way to order them by layer.
+
+struct LayeredSprite
+{
+    Sprite m_sprite;
+    uint8_t m_layer;
+};
+
+static double v_now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void v_run(uint32_t count, uint32_t layer_count, bool in_order, uint32_t iterations)
+{
+    SpriteBatch batch;
+    v_init_sprite_batch(batch, count);
+    std::vector<Sprite> mapped(count);
+    std::vector<LayeredSprite> baseline(count);
+    SpriteRegion region = v_make_sprite_region(1, 0, 0, 16, 16, 256);
+
+    // What a game would add every frame, generated up front so only the
+    // batch is timed
+    std::vector<float> positions(count * 2);
+    std::vector<uint32_t> colors(count);
+    std::vector<uint8_t> layers(count);
+    for(uint32_t i=0; i < count; i++)
+    {
+        uint32_t hash = i * 2654435761u;
+        positions[i * 2] = (float)(hash & 1023);
+        positions[i * 2 + 1] = (float)((hash >> 10) & 1023);
+        colors[i] = hash;
+        layers[i] = (uint8_t)(in_order ? (uint64_t)i * layer_count / count : (hash >> 24) % layer_count);
+    }
+
+    double batch_time = 0.0;
+    double baseline_time = 0.0;
+    uint32_t written = 0;
+    for(uint32_t iteration=0; iteration < iterations; iteration++)
+    {
+        double start = v_now();
+        v_clear_sprite_batch(batch);
+        for(uint32_t i=0; i < count; i++)
+        {
+            v_add_sprite(batch, positions[i * 2], positions[i * 2 + 1], 8.0f, 8.0f, region, colors[i], layers[i]);
+        }
+        written = v_write_sprite_batch(batch, mapped.data());
+        batch_time += v_now() - start;
+
+        start = v_now();
+        for(uint32_t i=0; i < count; i++)
+        {
+            LayeredSprite& layered = baseline[i];
+            layered.m_sprite.m_rect[0] = positions[i * 2];
+            layered.m_sprite.m_rect[1] = positions[i * 2 + 1];
+            layered.m_sprite.m_rect[2] = positions[i * 2] + 8.0f;
+            layered.m_sprite.m_rect[3] = positions[i * 2 + 1] + 8.0f;
+            std::copy(region.m_uv, region.m_uv + 4, layered.m_sprite.m_uv);
+            layered.m_sprite.m_color = colors[i];
+            layered.m_sprite.m_texture = region.m_texture;
+            layered.m_layer = layers[i];
+        }
+        std::stable_sort(baseline.begin(), baseline.end(), [](const LayeredSprite& a, const LayeredSprite& b) {
+            return a.m_layer < b.m_layer;
+        });
+        for(uint32_t i=0; i < count; i++) mapped[i] = baseline[i].m_sprite;
+        baseline_time += v_now() - start;
+    }
+
+    // Both must agree, the counting sort is stable as well
+    written = v_write_sprite_batch(batch, mapped.data());
+    bool match = written == count;
+    for(uint32_t i=0; match && i < count; i++) match = mapped[i].m_color == baseline[i].m_sprite.m_color;
+
+    printf("%8u sprites, %3u layers, %s: batch %7.3f ms, stable_sort %7.3f ms, %5.2fx, 1 draw%s\n",
+        count, layer_count, in_order ? "in order" : "shuffled",
+        batch_time * 1000.0 / iterations, baseline_time * 1000.0 / iterations,
+        baseline_time / batch_time, match ? "" : ", ORDER MISMATCH"
+    );
+
+    v_destroy_sprite_batch(batch);
+}
+
+int main()
+{
+    uint32_t counts[] = {1000, 10000, 100000};
+    for(uint32_t count : counts)
+    {
+        v_run(count, 4, true, 50);
+        v_run(count, 4, false, 50);
+        v_run(count, 256, false, 50);
+    }
+    return 0;
+}
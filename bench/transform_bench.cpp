@@ -0,0 +1,127 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <math.h>
+#include <HandmadeMath.h>
+
+#include "../src/engine/core/job.h"
+#include "../src/engine/scene/transform.h"
+
+// Compares the batch transform system against composing every matrix with
+// scalar HandmadeMath calls, the way main.cpp used to.
+
+struct ScalarObject
+{
+    uint32_t m_parent;
+    hmm_vec3 m_position;
+    hmm_quaternion m_rotation;
+    hmm_vec3 m_scale;
+    hmm_mat4 m_world;
+};
+
+static double v_now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static hmm_quaternion v_random_rotation(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> angle(0.0f, 2.0f * HMM_PI32);
+    return HMM_QuaternionFromAxisAngle(HMM_NormalizeVec3(HMM_Vec3(1.0f, 2.0f, 3.0f)), angle(rng));
+}
+
+static void v_run(uint32_t count, float dirty_fraction, uint32_t iterations)
+{
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Roughly a quarter of the objects are roots, the rest hang off earlier
+    // objects so the hierarchy ends up a few levels deep.
+    std::vector<ScalarObject> objects(count);
+    TransformSystem system;
+    v_init_transform_system(system, count);
+    std::vector<uint32_t> ids(count);
+    for(uint32_t i=0; i < count; i++)
+    {
+        ScalarObject& object = objects[i];
+        object.m_parent = (i < 4 || unit(rng) < 0.25f) ? TRANSFORM_NONE : (uint32_t)(unit(rng) * i);
+        object.m_position = HMM_Vec3(unit(rng), unit(rng), unit(rng));
+        object.m_rotation = v_random_rotation(rng);
+        object.m_scale = HMM_Vec3(1.0f, 1.0f, 1.0f);
+
+        ids[i] = v_create_transform(system, object.m_parent == TRANSFORM_NONE ? TRANSFORM_NONE : ids[object.m_parent]);
+        v_set_transform(system, ids[i], object.m_position, object.m_rotation, object.m_scale);
+    }
+
+    std::vector<hmm_mat4> instance_data(count);
+    v_update_transforms(system, instance_data.data(), count);
+
+    uint32_t dirty_count = (uint32_t)(count * dirty_fraction);
+    std::vector<uint32_t> dirty(dirty_count);
+    for(uint32_t i=0; i < dirty_count; i++) dirty[i] = (uint32_t)(unit(rng) * count);
+
+    double scalar_time = 0.0;
+    double batch_time = 0.0;
+    for(uint32_t iteration=0; iteration < iterations; iteration++)
+    {
+        hmm_quaternion rotation = v_random_rotation(rng);
+        for(uint32_t i : dirty)
+        {
+            objects[i].m_rotation = rotation;
+            v_set_rotation(system, ids[i], rotation);
+        }
+
+        // The scalar path has no dirty tracking, every object is rebuilt
+        double start = v_now();
+        for(uint32_t i=0; i < count; i++)
+        {
+            ScalarObject& object = objects[i];
+            hmm_mat4 local = HMM_Translate(object.m_position) * HMM_QuaternionToMat4(object.m_rotation) * HMM_Scale(object.m_scale);
+            object.m_world = object.m_parent == TRANSFORM_NONE ? local : objects[object.m_parent].m_world * local;
+        }
+        scalar_time += v_now() - start;
+
+        start = v_now();
+        v_update_transforms(system, instance_data.data(), count);
+        batch_time += v_now() - start;
+    }
+
+    float max_error = 0.0f;
+    for(uint32_t i=0; i < count; i++)
+    {
+        const hmm_mat4& world = instance_data[v_get_transform_slot(system, ids[i])];
+        for(int column=0; column < 4; column++)
+        {
+            for(int row=0; row < 4; row++)
+            {
+                float error = fabsf(world.Elements[column][row] - objects[i].m_world.Elements[column][row]);
+                if(error > max_error) max_error = error;
+            }
+        }
+    }
+
+    printf("%8u transforms, %5.1f%% dirty: scalar %8.3f ms, batch %8.3f ms, %5.2fx, max error %g\n",
+        count, dirty_fraction * 100.0f,
+        scalar_time * 1000.0 / iterations, batch_time * 1000.0 / iterations,
+        scalar_time / batch_time, max_error
+    );
+}
+
+int main()
+{
+    v_init_job_system(0);
+    printf("%u worker(s)\n", v_get_worker_count());
+
+    uint32_t counts[] = {1000, 10000, 100000, 1000000};
+    for(uint32_t count : counts)
+    {
+        v_run(count, 1.0f, 20);
+        v_run(count, 0.1f, 20);
+        v_run(count, 0.01f, 20);
+    }
+
+    v_destroy_job_system();
+    return 0;
+}
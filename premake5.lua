@@ -7,6 +7,20 @@ workspace "Game"
     }
 
 output_dir = "%{cfg.system}-%{cfg.architecture}-%{cfg.buildcfg}"
+glslc = "C:/VulkanSDK/1.2.162.0/Bin/glslc.exe"
+
+-- GLSL sources and the SPIR-V the engine loads from shaders/
+shaders = {
+    { "shader.vert", "vertex.spv" },
+    { "shader.frag", "frag.spv" },
+    { "cluster.comp", "cluster.spv" },
+    { "meshlet_cull.comp", "meshlet_cull.spv" },
+    { "depth_reduce.comp", "depth_reduce.spv" },
+    { "fullscreen.vert", "fullscreen.spv" },
+    { "upscale.frag", "upscale.spv" },
+    { "sprite.vert", "sprite_vert.spv" },
+    { "sprite.frag", "sprite_frag.spv" },
+}
 
 project "Game"
     location "projects"
@@ -32,4 +46,59 @@ project "Game"
     links {
         "vendor/GLFW/lib/glfw3",
         "C:/VulkanSDK/1.2.162.0/lib/vulkan-1",
-    }
\ No newline at end of file
+    }
+
+    -- Compiled with the game, so the SPIR-V always matches its pipeline layouts
+    for _, shader in ipairs(shaders) do
+        files { "shaders/" .. shader[1] }
+        filter ("files:shaders/" .. shader[1])
+            buildmessage ("Compiling " .. shader[1])
+            buildcommands { glslc .. ' "%{file.abspath}" -o "%{file.directory}/' .. shader[2] .. '"' }
+            buildoutputs { "%{file.directory}/" .. shader[2] }
+        filter {}
+    end
+
+    -- Debug builds validate and count heap allocations, release builds run
+    -- without layers or tracking. VIME_DIAGNOSTICS overrides the validation
+    -- level at runtime.
+    filter "configurations:Debug"
+        defines { "DEBUG", "VIME_HEAP_TRACKING" }
+        symbols "On"
+
+    filter "configurations:Release"
+        optimize "Speed"
+
+    filter {}
+
+-- One executable per benchmark, each has its own main
+for _, bench_file in ipairs(os.matchfiles("bench/*.cpp")) do
+project (path.getbasename(bench_file))
+    location "projects"
+    kind "ConsoleApp"
+    language "C++"
+
+    targetdir ("builds/bin/" .. output_dir .. "/%{prj.name}")
+    objdir ("builds/obj/" .. output_dir .. "/%{prj.name}")
+
+    -- Only the Vulkan-free parts of the engine
+    files {
+        bench_file,
+        "src/engine/core/**.cpp",
+        "src/engine/scene/**.cpp",
+        "src/engine/gfx/meshlet.cpp",
+        "src/engine/gfx/sprite_batch.cpp"
+    }
+
+    removefiles {
+        "src/engine/scene/scene_render.cpp"
+    }
+
+    includedirs {
+        "vendor/HandmadeMath"
+    }
+
+    filter "configurations:Release"
+        optimize "Speed"
+
+    filter {}
+end
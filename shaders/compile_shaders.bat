@@ -2,5 +2,12 @@
 
 C:/VulkanSDK/1.2.162.0/Bin/glslc.exe shader.vert -o vertex.spv
 C:/VulkanSDK/1.2.162.0/Bin/glslc.exe shader.frag -o frag.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe cluster.comp -o cluster.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe meshlet_cull.comp -o meshlet_cull.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe depth_reduce.comp -o depth_reduce.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe fullscreen.vert -o fullscreen.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe upscale.frag -o upscale.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe sprite.vert -o sprite_vert.spv
+C:/VulkanSDK/1.2.162.0/Bin/glslc.exe sprite.frag -o sprite_frag.spv
 
 pause
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 450
+
+layout(location=0) out vec2 frag_uv;
+
+// One triangle covering the viewport, UV 0..1 over the visible part
+void main()
+{
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    frag_uv = uv;
+    gl_Position = vec4(uv * 2.0f - 1.0f, 0.0f, 1.0f);
+}
@@ -1,9 +1,102 @@
 #version 450
 
+// Must match src/engine/gfx/lighting.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+
+struct Light
+{
+    vec4 position_range;
+    vec4 color_spot_scale;
+    vec4 direction_spot_offset;
+    vec4 bounds;
+};
+
 layout(location=0) in vec4 frag_color;
+layout(location=1) in vec3 frag_position;
+layout(location=2) in vec3 frag_normal;
 layout(location=0) out vec4 out_color;
 
+// Must match ShaderFeature in src/engine/gfx/pipeline.h
+layout(constant_id=0) const bool CLUSTERED_LIGHTING = true;
+layout(constant_id=1) const bool DEBUG_NORMALS = false;
+
+layout(set=1, binding=0) uniform ClusterParams
+{
+    mat4 view;
+    vec4 screen;
+    vec4 projection;
+    float slice_scale;
+    float slice_bias;
+    uint light_count;
+    // Read by cluster.comp, CLUSTERED_LIGHTING selects the path here
+    uint brute_force;
+} Params;
+
+layout(std430, set=1, binding=1) readonly buffer LightBuffer
+{
+    Light lights[];
+} Lights;
+
+layout(std430, set=1, binding=2) readonly buffer ClusterBuffer
+{
+    uint counts[];
+} Clusters;
+
+layout(std430, set=1, binding=3) readonly buffer LightIndexBuffer
+{
+    uint indices[];
+} LightIndices;
+
+vec3 shade(Light light, vec3 position, vec3 normal, vec3 albedo)
+{
+    vec3 to_light = light.position_range.xyz - position;
+    float distance_sq = dot(to_light, to_light);
+    float range = light.position_range.w;
+
+    // Inverse square, windowed to reach zero at the range
+    float ratio = distance_sq / (range * range);
+    float window = clamp(1.0f - ratio * ratio, 0.0f, 1.0f);
+    float attenuation = window * window / (distance_sq + 1.0f);
+
+    vec3 l = to_light * inversesqrt(max(distance_sq, 0.0001f));
+    float spot = clamp(dot(-l, light.direction_spot_offset.xyz) * light.color_spot_scale.w + light.direction_spot_offset.w, 0.0f, 1.0f);
+
+    return albedo * light.color_spot_scale.rgb * max(dot(normal, l), 0.0f) * attenuation * spot * spot;
+}
+
 void main()
 {
-    out_color = frag_color;
-}
\ No newline at end of file
+    vec3 normal = normalize(frag_normal);
+    if(DEBUG_NORMALS)
+    {
+        out_color = vec4(normal * 0.5f + 0.5f, frag_color.a);
+        return;
+    }
+
+    vec3 albedo = frag_color.rgb;
+    vec3 color = albedo * 0.1f;
+
+    if(!CLUSTERED_LIGHTING)
+    {
+        for(uint i=0; i < Params.light_count; i++) color += shade(Lights.lights[i], frag_position, normal, albedo);
+    }
+    else
+    {
+        float depth = -(Params.view * vec4(frag_position, 1.0f)).z;
+        uint slice = uint(clamp(log(depth) * Params.slice_scale - Params.slice_bias, 0.0f, float(CLUSTER_Z - 1)));
+        uvec2 tile = min(uvec2(gl_FragCoord.xy / Params.screen.zw), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+        uint cluster = tile.x + tile.y * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+
+        uint count = Clusters.counts[cluster];
+        for(uint i=0; i < count; i++)
+        {
+            uint index = LightIndices.indices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+            color += shade(Lights.lights[index], frag_position, normal, albedo);
+        }
+    }
+
+    out_color = vec4(color, frag_color.a);
+}
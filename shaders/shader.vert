@@ -5,15 +5,31 @@ layout(location=1) in vec3 gColor;
 layout(location=2) in vec3 gNormal;
 
 layout(location=0) out vec4 frag_color;
+layout(location=1) out vec3 frag_position;
+layout(location=2) out vec3 frag_normal;
 
 layout(push_constant) uniform constants
 {
     vec4 data;
-    mat4 render_matrix;
 } PushConstants;
 
+layout(std430, set=0, binding=0) readonly buffer InstanceBuffer
+{
+    mat4 model_matrix[];
+} Instances;
+
+layout(std140, set=0, binding=1) uniform ViewBuffer
+{
+    mat4 view_projection;
+} View;
+
 void main()
 {
-    gl_Position = PushConstants.render_matrix * vec4(gPosition, 1.0f);
+    mat4 model = Instances.model_matrix[gl_InstanceIndex];
+    vec4 world_position = model * vec4(gPosition, 1.0f);
+    gl_Position = View.view_projection * world_position;
     frag_color = vec4(gColor, 1.0f);
-}
\ No newline at end of file
+    frag_position = world_position.xyz;
+    // Transforms only use uniform scale
+    frag_normal = mat3(model) * gNormal;
+}
@@ -0,0 +1,14 @@
+#version 450
+
+layout(location=0) in vec2 frag_uv;
+layout(location=1) in flat uint frag_texture;
+layout(location=2) in vec4 frag_color;
+
+layout(location=0) out vec4 out_color;
+
+layout(set=0, binding=1) uniform sampler2DArray atlas;
+
+void main()
+{
+    out_color = texture(atlas, vec3(frag_uv, float(frag_texture))) * frag_color;
+}
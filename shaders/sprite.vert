@@ -0,0 +1,39 @@
+#version 450
+
+layout(location=0) out vec2 frag_uv;
+layout(location=1) out flat uint frag_texture;
+layout(location=2) out vec4 frag_color;
+
+// Must match Sprite in src/engine/gfx/sprite_batch.h
+struct Sprite
+{
+    vec4 rect;
+    uvec2 uv;
+    uint color;
+    uint texture;
+};
+
+layout(std430, set=0, binding=0) readonly buffer Sprites
+{
+    Sprite sprites[];
+};
+
+// Must match SpriteConstants in src/engine/gfx/sprite_renderer.cpp
+layout(push_constant) uniform constants
+{
+    vec2 scale;
+    vec2 offset;
+} PushConstants;
+
+// One 4 vertex strip per instance
+void main()
+{
+    Sprite sprite = sprites[gl_InstanceIndex];
+    vec2 corner = vec2(gl_VertexIndex & 1, gl_VertexIndex >> 1);
+    vec4 uv = vec4(unpackUnorm2x16(sprite.uv.x), unpackUnorm2x16(sprite.uv.y));
+
+    frag_uv = mix(uv.xy, uv.zw, corner);
+    frag_texture = sprite.texture;
+    frag_color = unpackUnorm4x8(sprite.color);
+    gl_Position = vec4(mix(sprite.rect.xy, sprite.rect.zw, corner) * PushConstants.scale + PushConstants.offset, 0.0f, 1.0f);
+}
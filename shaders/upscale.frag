@@ -0,0 +1,42 @@
+#version 450
+
+layout(location=0) in vec2 frag_uv;
+
+layout(location=0) out vec4 out_color;
+
+// Must match UpscaleConstants in src/engine/gfx/upscale.cpp
+layout(push_constant) uniform constants
+{
+    vec2 uv_scale;
+    vec2 uv_max;
+    vec2 texel_size;
+    float sharpness;
+} PushConstants;
+
+layout(set=0, binding=0) uniform sampler2D source;
+
+vec3 fetch(vec2 uv)
+{
+    return texture(source, min(uv, PushConstants.uv_max)).rgb;
+}
+
+void main()
+{
+    vec2 uv = frag_uv * PushConstants.uv_scale;
+    vec3 center = fetch(uv);
+
+    if(PushConstants.sharpness > 0.0f)
+    {
+        vec3 north = fetch(uv - vec2(0.0f, PushConstants.texel_size.y));
+        vec3 south = fetch(uv + vec2(0.0f, PushConstants.texel_size.y));
+        vec3 west = fetch(uv - vec2(PushConstants.texel_size.x, 0.0f));
+        vec3 east = fetch(uv + vec2(PushConstants.texel_size.x, 0.0f));
+
+        vec3 low = min(center, min(min(north, south), min(west, east)));
+        vec3 high = max(center, max(max(north, south), max(west, east)));
+        vec3 sharpened = center + PushConstants.sharpness * (4.0f * center - north - south - west - east) * 0.25f;
+        center = clamp(sharpened, low, high);
+    }
+
+    out_color = vec4(center, 1.0f);
+}
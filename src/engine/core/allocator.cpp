@@ -0,0 +1,253 @@
+#include <new>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#include "allocator.h"
+
+Arena g_frame_arena = {};
+Arena g_scratch_arena = {};
+
+static size_t v_align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void v_init_arena(Arena& arena, const char* name, size_t block_size)
+{
+    arena.m_name = name;
+    arena.m_block_size = block_size;
+    arena.m_block = 0;
+    arena.m_offset = 0;
+    arena.m_used = 0;
+    arena.m_peak = 0;
+
+    ArenaBlock block;
+    block.m_data = (uint8_t*)malloc(block_size);
+    block.m_size = block_size;
+    arena.m_blocks.push_back(block);
+}
+
+void v_destroy_arena(Arena& arena)
+{
+    for(auto& block : arena.m_blocks) free(block.m_data);
+    arena.m_blocks.clear();
+    arena.m_block = 0;
+    arena.m_offset = 0;
+}
+
+void* v_arena_alloc(Arena& arena, size_t size, size_t alignment)
+{
+    while(arena.m_block < arena.m_blocks.size())
+    {
+        ArenaBlock& block = arena.m_blocks[arena.m_block];
+        size_t offset = v_align_up(arena.m_offset, alignment);
+        if(offset + size <= block.m_size)
+        {
+            arena.m_offset = offset + size;
+            arena.m_used += size;
+            if(arena.m_used > arena.m_peak) arena.m_peak = arena.m_used;
+            return block.m_data + offset;
+        }
+
+        arena.m_block++;
+        arena.m_offset = 0;
+    }
+
+    // Blocks from malloc are aligned for any fundamental type
+    ArenaBlock block;
+    block.m_size = size > arena.m_block_size ? size : arena.m_block_size;
+    block.m_data = (uint8_t*)malloc(block.m_size);
+    arena.m_blocks.push_back(block);
+
+    arena.m_offset = size;
+    arena.m_used += size;
+    if(arena.m_used > arena.m_peak) arena.m_peak = arena.m_used;
+    return block.m_data;
+}
+
+void v_reset_arena(Arena& arena)
+{
+    arena.m_block = 0;
+    arena.m_offset = 0;
+    arena.m_used = 0;
+}
+
+ArenaMark v_get_arena_mark(const Arena& arena)
+{
+    return ArenaMark{arena.m_block, arena.m_offset, arena.m_used};
+}
+
+void v_rewind_arena(Arena& arena, ArenaMark mark)
+{
+    arena.m_block = mark.m_block;
+    arena.m_offset = mark.m_offset;
+    arena.m_used = mark.m_used;
+}
+
+void v_init_pool(Pool& pool, const char* name, uint32_t block_size, uint32_t blocks_per_chunk)
+{
+    pool.m_name = name;
+    pool.m_block_size = (uint32_t)v_align_up(block_size < sizeof(void*) ? sizeof(void*) : block_size, alignof(max_align_t));
+    pool.m_blocks_per_chunk = blocks_per_chunk;
+    pool.m_free_list = nullptr;
+    pool.m_used = 0;
+}
+
+void v_destroy_pool(Pool& pool)
+{
+    if(pool.m_used != 0) fprintf(stderr, "Pool %s destroyed with %u blocks in use\n", pool.m_name, pool.m_used);
+    for(uint8_t* chunk : pool.m_chunks) free(chunk);
+    pool.m_chunks.clear();
+    pool.m_free_list = nullptr;
+}
+
+void* v_pool_alloc(Pool& pool)
+{
+    if(!pool.m_free_list)
+    {
+        uint8_t* chunk = (uint8_t*)malloc((size_t)pool.m_block_size * pool.m_blocks_per_chunk);
+        pool.m_chunks.push_back(chunk);
+        // Thread the new blocks onto the free list, first block first
+        for(uint32_t i=pool.m_blocks_per_chunk; i > 0; i--)
+        {
+            void* block = chunk + (size_t)(i - 1) * pool.m_block_size;
+            *(void**)block = pool.m_free_list;
+            pool.m_free_list = block;
+        }
+    }
+
+    void* block = pool.m_free_list;
+    pool.m_free_list = *(void**)block;
+    pool.m_used++;
+    return block;
+}
+
+void v_pool_free(Pool& pool, void* block)
+{
+    if(!block) return;
+    *(void**)block = pool.m_free_list;
+    pool.m_free_list = block;
+    pool.m_used--;
+}
+
+#ifdef VIME_HEAP_TRACKING
+
+static std::atomic<uint64_t> g_heap_allocations(0);
+static std::atomic<uint64_t> g_heap_bytes(0);
+static std::atomic<bool> g_heap_forbidden(false);
+
+static void v_track_heap_allocation(size_t size)
+{
+    if(g_heap_forbidden.load(std::memory_order_relaxed))
+    {
+        // No stdio buffering, printing must not allocate either
+        fprintf(stderr, "Heap allocation of %zu bytes while the heap is forbidden\n", size);
+        abort();
+    }
+    g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_heap_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+static void* v_tracked_malloc(size_t size)
+{
+    v_track_heap_allocation(size);
+    return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size)
+{
+    void* pointer = v_tracked_malloc(size);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    void* pointer = v_tracked_malloc(size);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return v_tracked_malloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return v_tracked_malloc(size); }
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { free(pointer); }
+
+#ifdef __cpp_aligned_new
+
+// Types aligned beyond what malloc guarantees, e.g. alignas(64) members
+static void* v_tracked_aligned_malloc(size_t size, std::align_val_t alignment)
+{
+    v_track_heap_allocation(size);
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, (size_t)alignment);
+#else
+    void* pointer = nullptr;
+    if(posix_memalign(&pointer, (size_t)alignment, size ? size : 1) != 0) return nullptr;
+    return pointer;
+#endif
+}
+
+static void v_aligned_free(void* pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    free(pointer);
+#endif
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* pointer = v_tracked_aligned_malloc(size, alignment);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    void* pointer = v_tracked_aligned_malloc(size, alignment);
+    if(!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return v_tracked_aligned_malloc(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return v_tracked_aligned_malloc(size, alignment); }
+void operator delete(void* pointer, std::align_val_t) noexcept { v_aligned_free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { v_aligned_free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { v_aligned_free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { v_aligned_free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { v_aligned_free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { v_aligned_free(pointer); }
+
+#endif
+
+HeapStats v_get_heap_stats()
+{
+    return HeapStats{g_heap_allocations.load(), g_heap_bytes.load()};
+}
+
+void v_forbid_heap(bool forbidden)
+{
+    g_heap_forbidden = forbidden;
+}
+
+#else
+
+HeapStats v_get_heap_stats()
+{
+    return HeapStats{0, 0};
+}
+
+void v_forbid_heap(bool)
+{
+}
+
+#endif
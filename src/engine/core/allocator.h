@@ -0,0 +1,135 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU memory that does not go through the global heap in steady state.
+//   - Arenas hand out memory linearly from blocks they keep across resets.
+//     When a block runs out another one is chained from the heap, so after
+//     the first few frames or loads an arena stops touching the heap.
+//   - Pools hand out fixed size blocks that never move, through a free list.
+// With VIME_HEAP_TRACKING defined, global operator new is counted and can be
+// forbidden, which aborts on the first allocation.
+
+struct ArenaBlock
+{
+    uint8_t* m_data;
+    size_t m_size;
+};
+
+struct Arena
+{
+    const char* m_name;
+    std::vector<ArenaBlock> m_blocks;
+    size_t m_block_size;
+    uint32_t m_block;
+    size_t m_offset;
+    // Bytes handed out since the last reset, and the most ever
+    size_t m_used;
+    size_t m_peak;
+};
+
+struct ArenaMark
+{
+    uint32_t m_block;
+    size_t m_offset;
+    size_t m_used;
+};
+
+struct Pool
+{
+    const char* m_name;
+    std::vector<uint8_t*> m_chunks;
+    void* m_free_list;
+    uint32_t m_block_size;
+    uint32_t m_blocks_per_chunk;
+    uint32_t m_used;
+};
+
+struct HeapStats
+{
+    uint64_t m_allocations;
+    uint64_t m_bytes;
+};
+
+// Reset at v_begin_frame(), for temporaries of the frame. Main thread only.
+extern Arena g_frame_arena;
+// For loaders, which mark and rewind around each load. Main thread only.
+extern Arena g_scratch_arena;
+
+// Main API
+
+void v_init_arena(Arena& arena, const char* name, size_t block_size);
+void v_destroy_arena(Arena& arena);
+void* v_arena_alloc(Arena& arena, size_t size, size_t alignment);
+void v_reset_arena(Arena& arena);
+ArenaMark v_get_arena_mark(const Arena& arena);
+void v_rewind_arena(Arena& arena, ArenaMark mark);
+
+template<typename T>
+T* v_arena_push(Arena& arena, size_t count)
+{
+    return (T*)v_arena_alloc(arena, count * sizeof(T), alignof(T));
+}
+
+// Rewinds the arena when leaving the scope
+struct ArenaScope
+{
+    ArenaScope(Arena& arena) : m_arena(arena), m_mark(v_get_arena_mark(arena)) {}
+    ~ArenaScope() { v_rewind_arena(m_arena, m_mark); }
+
+    Arena& m_arena;
+    ArenaMark m_mark;
+};
+
+// For standard containers. Freeing is a no-op, the memory comes back when the
+// arena is reset or rewound, so reserve instead of growing.
+template<typename T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.m_arena) {}
+
+    T* allocate(size_t count) { return v_arena_push<T>(*m_arena, count); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.m_arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return m_arena != other.m_arena; }
+
+    Arena* m_arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+void v_init_pool(Pool& pool, const char* name, uint32_t block_size, uint32_t blocks_per_chunk);
+// Every block must have been freed
+void v_destroy_pool(Pool& pool);
+void* v_pool_alloc(Pool& pool);
+void v_pool_free(Pool& pool, void* block);
+
+template<typename T>
+T* v_pool_new(Pool& pool)
+{
+    return new(v_pool_alloc(pool)) T();
+}
+
+template<typename T>
+void v_pool_delete(Pool& pool, T* object)
+{
+    object->~T();
+    v_pool_free(pool, object);
+}
+
+// Totals since startup, zero without VIME_HEAP_TRACKING
+HeapStats v_get_heap_stats();
+// While forbidden, any global operator new prints and aborts. Covers every
+// thread, including the job workers.
+void v_forbid_heap(bool forbidden);
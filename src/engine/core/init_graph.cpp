@@ -0,0 +1,109 @@
+#include <assert.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <iostream>
+#include <condition_variable>
+#include "init_graph.h"
+
+static double v_now_ms()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+InitTask v_add_init_task(InitGraph& graph, const char* name, InitThread thread, std::initializer_list<InitTask> dependencies,
+    std::function<void()> run)
+{
+    InitTask task = (InitTask)graph.m_steps.size();
+    for(InitTask dependency : dependencies) assert(dependency < task);
+
+    InitStep step;
+    step.m_name = name;
+    step.m_run = std::move(run);
+    step.m_thread = thread;
+    step.m_dependencies = dependencies;
+    step.m_start_ms = 0.0;
+    step.m_end_ms = 0.0;
+    graph.m_steps.push_back(std::move(step));
+    return task;
+}
+
+void v_run_init_graph(InitGraph& graph)
+{
+    uint32_t step_count = (uint32_t)graph.m_steps.size();
+    std::vector<bool> started(step_count, false);
+    std::vector<bool> finished(step_count, false);
+    uint32_t finished_count = 0;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable step_done;
+    double start = v_now_ms();
+
+    auto is_ready = [&](InitTask task) {
+        if(started[task]) return false;
+        for(InitTask dependency : graph.m_steps[task].m_dependencies)
+        {
+            if(!finished[dependency]) return false;
+        }
+        return true;
+    };
+    auto run_step = [&](InitTask task) {
+        InitStep& step = graph.m_steps[task];
+        step.m_start_ms = v_now_ms() - start;
+        step.m_run();
+        step.m_end_ms = v_now_ms() - start;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished[task] = true;
+        finished_count++;
+        step_done.notify_one();
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(finished_count < step_count)
+    {
+        for(InitTask i=0; i < step_count; i++)
+        {
+            if(graph.m_steps[i].m_thread != INIT_WORKER_THREAD || !is_ready(i)) continue;
+            started[i] = true;
+            threads.emplace_back(run_step, i);
+        }
+
+        // One main thread step at a time, it may have made workers ready
+        InitTask main_step = step_count;
+        for(InitTask i=0; i < step_count && main_step == step_count; i++)
+        {
+            if(graph.m_steps[i].m_thread == INIT_MAIN_THREAD && is_ready(i)) main_step = i;
+        }
+        if(main_step < step_count)
+        {
+            started[main_step] = true;
+            lock.unlock();
+            run_step(main_step);
+            lock.lock();
+            continue;
+        }
+
+        uint32_t seen = finished_count;
+        step_done.wait(lock, [&] { return finished_count != seen; });
+    }
+    lock.unlock();
+
+    for(auto& thread : threads) thread.join();
+    graph.m_total_ms = v_now_ms() - start;
+}
+
+void v_print_init_report(const InitGraph& graph)
+{
+    double serial_ms = 0.0;
+    std::cout << "Startup:" << std::endl;
+    for(const InitStep& step : graph.m_steps)
+    {
+        double duration = step.m_end_ms - step.m_start_ms;
+        serial_ms += duration;
+        std::cout << "  " << step.m_name << (step.m_thread == INIT_WORKER_THREAD ? " (worker)" : "") << ": "
+            << duration << " ms, from " << step.m_start_ms << " ms" << std::endl;
+    }
+    std::cout << "  " << graph.m_total_ms << " ms in total, " << serial_ms << " ms one after another" << std::endl;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <stdint.h>
+
+// Startup as a graph of steps. A step starts as soon as every step it depends
+// on has finished, so independent ones overlap: worker steps each get a thread
+// of their own, main thread steps run one after another on the caller, which
+// is where the window and anything shared with the frame loop is created.
+// Steps can only depend on steps added before them, which keeps the graph
+// acyclic. Worker steps must not use v_parallel_for() or the main thread
+// arenas, and must not touch what a step running at the same time touches.
+
+typedef uint32_t InitTask;
+
+enum InitThread
+{
+    INIT_MAIN_THREAD,
+    INIT_WORKER_THREAD
+};
+
+struct InitStep
+{
+    const char* m_name;
+    std::function<void()> m_run;
+    InitThread m_thread;
+    std::vector<InitTask> m_dependencies;
+    // Milliseconds since v_run_init_graph() was called
+    double m_start_ms;
+    double m_end_ms;
+};
+
+struct InitGraph
+{
+    std::vector<InitStep> m_steps;
+    double m_total_ms;
+};
+
+// Main API
+
+InitTask v_add_init_task(InitGraph& graph, const char* name, InitThread thread, std::initializer_list<InitTask> dependencies,
+    std::function<void()> run);
+// Blocks until every step has run
+void v_run_init_graph(InitGraph& graph);
+// Every step with its start and duration, then how much of the time overlapped
+void v_print_init_report(const InitGraph& graph);
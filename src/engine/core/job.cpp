@@ -0,0 +1,141 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "job.h"
+
+struct JobSystem
+{
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const JobRange* m_job;
+    uint32_t m_count;
+    uint32_t m_batch_size;
+    uint32_t m_batch_count;
+    std::atomic<uint32_t> m_next_batch;
+    uint32_t m_active_workers;
+    uint64_t m_generation;
+    bool m_running;
+};
+
+static JobSystem g_jobs;
+static thread_local bool t_inside_job = false;
+
+// Claims batches of the current job until none are left
+static void v_run_batches(const JobRange& job, uint32_t count, uint32_t batch_size, uint32_t batch_count, uint32_t worker)
+{
+    uint32_t batch;
+    while((batch = g_jobs.m_next_batch.fetch_add(1)) < batch_count)
+    {
+        uint32_t begin = batch * batch_size;
+        uint32_t end = begin + batch_size < count ? begin + batch_size : count;
+        job(begin, end, worker);
+    }
+}
+
+static void v_worker_main(uint32_t worker)
+{
+    t_inside_job = true;
+    uint64_t seen_generation = 0;
+
+    while(true)
+    {
+        std::unique_lock<std::mutex> lock(g_jobs.m_mutex);
+        g_jobs.m_wake.wait(lock, [&] {
+            return !g_jobs.m_running || g_jobs.m_generation != seen_generation;
+        });
+        if(!g_jobs.m_running) return;
+
+        seen_generation = g_jobs.m_generation;
+        const JobRange* job = g_jobs.m_job;
+        if(job == nullptr) continue; // Woke up after the job already finished
+
+        uint32_t count = g_jobs.m_count;
+        uint32_t batch_size = g_jobs.m_batch_size;
+        uint32_t batch_count = g_jobs.m_batch_count;
+        g_jobs.m_active_workers++;
+        lock.unlock();
+
+        v_run_batches(*job, count, batch_size, batch_count, worker);
+
+        lock.lock();
+        g_jobs.m_active_workers--;
+        if(g_jobs.m_active_workers == 0) g_jobs.m_done.notify_one();
+    }
+}
+
+void v_init_job_system(uint32_t thread_count)
+{
+    if(thread_count == 0)
+    {
+        uint32_t hardware_threads = std::thread::hardware_concurrency();
+        thread_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+    }
+
+    g_jobs.m_job = nullptr;
+    g_jobs.m_next_batch = 0;
+    g_jobs.m_batch_count = 0;
+    g_jobs.m_active_workers = 0;
+    g_jobs.m_generation = 0;
+    g_jobs.m_running = true;
+
+    g_jobs.m_threads.reserve(thread_count);
+    for(uint32_t i=0; i < thread_count; i++)
+    {
+        g_jobs.m_threads.emplace_back(v_worker_main, i + 1);
+    }
+}
+
+void v_destroy_job_system()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_jobs.m_mutex);
+        g_jobs.m_running = false;
+    }
+    g_jobs.m_wake.notify_all();
+
+    for(auto& thread : g_jobs.m_threads) thread.join();
+    g_jobs.m_threads.clear();
+}
+
+uint32_t v_get_worker_count()
+{
+    return (uint32_t)g_jobs.m_threads.size() + 1;
+}
+
+void v_parallel_for(uint32_t count, uint32_t batch_size, const JobRange& job)
+{
+    if(count == 0) return;
+    if(batch_size == 0) batch_size = 1;
+
+    uint32_t batch_count = (count + batch_size - 1) / batch_size;
+    if(t_inside_job || batch_count == 1 || g_jobs.m_threads.empty())
+    {
+        job(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(g_jobs.m_mutex);
+        g_jobs.m_job = &job;
+        g_jobs.m_count = count;
+        g_jobs.m_batch_size = batch_size;
+        g_jobs.m_batch_count = batch_count;
+        g_jobs.m_next_batch = 0;
+        g_jobs.m_generation++;
+    }
+    g_jobs.m_wake.notify_all();
+
+    t_inside_job = true;
+    v_run_batches(job, count, batch_size, batch_count, 0);
+    t_inside_job = false;
+
+    // Workers that grabbed this job may still be finishing their last batch
+    std::unique_lock<std::mutex> lock(g_jobs.m_mutex);
+    g_jobs.m_done.wait(lock, [] { return g_jobs.m_active_workers == 0; });
+    g_jobs.m_job = nullptr;
+}
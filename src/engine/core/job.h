@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Called once per batch with the half-open range [begin, end) and the index
+// of the worker running it (0 is the calling thread). Only refers to the
+// callable: v_parallel_for() blocks until the job is done, so lambdas passed
+// to it live long enough and no std::function is allocated per job.
+struct JobRange
+{
+    template<typename F>
+    JobRange(const F& function) : m_function(&function), m_call(&v_call<F>) {}
+
+    void operator()(uint32_t begin, uint32_t end, uint32_t worker) const { m_call(m_function, begin, end, worker); }
+
+    template<typename F>
+    static void v_call(const void* function, uint32_t begin, uint32_t end, uint32_t worker)
+    {
+        (*(const F*)function)(begin, end, worker);
+    }
+
+    const void* m_function;
+    void (*m_call)(const void* function, uint32_t begin, uint32_t end, uint32_t worker);
+};
+
+// Main API
+
+// A thread_count of 0 picks hardware_concurrency - 1 helper threads.
+void v_init_job_system(uint32_t thread_count);
+void v_destroy_job_system();
+
+// Number of threads that can run a batch at the same time, including the caller.
+uint32_t v_get_worker_count();
+
+// Splits [0, count) into batches of batch_size and blocks until all of them ran.
+// Calls made from inside a job run inline on the current worker.
+void v_parallel_for(uint32_t count, uint32_t batch_size, const JobRange& job);
@@ -0,0 +1,241 @@
+#include "offset_allocator.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static const uint32_t MANTISSA_BITS = 3;
+static const uint32_t MANTISSA_VALUE = 1 << MANTISSA_BITS;
+static const uint32_t MANTISSA_MASK = MANTISSA_VALUE - 1;
+static const uint32_t BIN_COUNT = 256;
+
+static uint32_t v_leading_zeros(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanReverse(&index, value) ? 31 - index : 32;
+#else
+    return value ? __builtin_clz(value) : 32;
+#endif
+}
+
+static uint32_t v_trailing_zeros(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanForward(&index, value) ? index : 32;
+#else
+    return value ? __builtin_ctz(value) : 32;
+#endif
+}
+
+// Sizes below MANTISSA_VALUE map to their own bin, larger ones are stored as
+// a small float. Rounding up guarantees any range in the bin fits the size.
+static uint32_t v_size_to_bin(uint32_t size, bool round_up)
+{
+    if(size < MANTISSA_VALUE) return size;
+
+    uint32_t highest_bit = 31 - v_leading_zeros(size);
+    uint32_t mantissa_start = highest_bit - MANTISSA_BITS;
+    uint32_t exponent = mantissa_start + 1;
+    uint32_t mantissa = (size >> mantissa_start) & MANTISSA_MASK;
+
+    uint32_t low_bits = (1u << mantissa_start) - 1;
+    if(round_up && (size & low_bits)) mantissa++;
+
+    // A mantissa overflow carries into the exponent
+    return (exponent << MANTISSA_BITS) + mantissa;
+}
+
+static uint32_t v_bin_to_size(uint32_t bin)
+{
+    uint32_t exponent = bin >> MANTISSA_BITS;
+    uint32_t mantissa = bin & MANTISSA_MASK;
+    if(exponent == 0) return mantissa;
+    return (mantissa | MANTISSA_VALUE) << (exponent - 1);
+}
+
+static uint32_t v_find_free_bin(const OffsetAllocator& allocator, uint32_t min_bin)
+{
+    uint32_t top = min_bin >> MANTISSA_BITS;
+    uint32_t leaf = min_bin & MANTISSA_MASK;
+
+    uint32_t leaf_mask = allocator.m_used_bins[top] & (0xFFu << leaf);
+    if(leaf_mask) return (top << MANTISSA_BITS) + v_trailing_zeros(leaf_mask);
+
+    if(top + 1 >= 32) return OFFSET_ALLOCATOR_NONE;
+    uint32_t top_mask = allocator.m_used_bins_top & (0xFFFFFFFFu << (top + 1));
+    if(!top_mask) return OFFSET_ALLOCATOR_NONE;
+
+    top = v_trailing_zeros(top_mask);
+    return (top << MANTISSA_BITS) + v_trailing_zeros(allocator.m_used_bins[top]);
+}
+
+static uint32_t v_insert_node(OffsetAllocator& allocator, uint32_t offset, uint32_t size)
+{
+    uint32_t bin = v_size_to_bin(size, false);
+    uint32_t top = bin >> MANTISSA_BITS;
+    uint32_t leaf = bin & MANTISSA_MASK;
+
+    if(allocator.m_bin_heads[bin] == OFFSET_ALLOCATOR_NONE)
+    {
+        allocator.m_used_bins[top] |= 1 << leaf;
+        allocator.m_used_bins_top |= 1u << top;
+    }
+
+    uint32_t index;
+    if(!allocator.m_free_nodes.empty())
+    {
+        index = allocator.m_free_nodes.back();
+        allocator.m_free_nodes.pop_back();
+    } else {
+        index = (uint32_t)allocator.m_nodes.size();
+        allocator.m_nodes.push_back({});
+    }
+
+    uint32_t head = allocator.m_bin_heads[bin];
+    OffsetAllocatorNode& node = allocator.m_nodes[index];
+    node.m_offset = offset;
+    node.m_size = size;
+    node.m_bin_prev = OFFSET_ALLOCATOR_NONE;
+    node.m_bin_next = head;
+    node.m_neighbor_prev = OFFSET_ALLOCATOR_NONE;
+    node.m_neighbor_next = OFFSET_ALLOCATOR_NONE;
+    node.m_used = false;
+
+    if(head != OFFSET_ALLOCATOR_NONE) allocator.m_nodes[head].m_bin_prev = index;
+    allocator.m_bin_heads[bin] = index;
+    allocator.m_free_storage += size;
+
+    return index;
+}
+
+static void v_remove_node(OffsetAllocator& allocator, uint32_t index)
+{
+    OffsetAllocatorNode& node = allocator.m_nodes[index];
+
+    if(node.m_bin_prev != OFFSET_ALLOCATOR_NONE)
+    {
+        allocator.m_nodes[node.m_bin_prev].m_bin_next = node.m_bin_next;
+    } else {
+        uint32_t bin = v_size_to_bin(node.m_size, false);
+        allocator.m_bin_heads[bin] = node.m_bin_next;
+        if(node.m_bin_next == OFFSET_ALLOCATOR_NONE)
+        {
+            uint32_t top = bin >> MANTISSA_BITS;
+            allocator.m_used_bins[top] &= ~(1 << (bin & MANTISSA_MASK));
+            if(allocator.m_used_bins[top] == 0) allocator.m_used_bins_top &= ~(1u << top);
+        }
+    }
+    if(node.m_bin_next != OFFSET_ALLOCATOR_NONE) allocator.m_nodes[node.m_bin_next].m_bin_prev = node.m_bin_prev;
+
+    allocator.m_free_storage -= node.m_size;
+    allocator.m_free_nodes.push_back(index);
+}
+
+void v_init_offset_allocator(OffsetAllocator& allocator, uint32_t size)
+{
+    allocator.m_size = size;
+    allocator.m_free_storage = 0;
+    allocator.m_used_bins_top = 0;
+    for(uint32_t i=0; i < 32; i++) allocator.m_used_bins[i] = 0;
+    for(uint32_t i=0; i < BIN_COUNT; i++) allocator.m_bin_heads[i] = OFFSET_ALLOCATOR_NONE;
+    allocator.m_nodes.clear();
+    allocator.m_free_nodes.clear();
+
+    if(size > 0) v_insert_node(allocator, 0, size);
+}
+
+OffsetAllocation v_offset_allocate(OffsetAllocator& allocator, uint32_t size)
+{
+    OffsetAllocation allocation;
+    allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    allocation.m_node = OFFSET_ALLOCATOR_NONE;
+    if(size == 0) return allocation;
+
+    uint32_t min_bin = v_size_to_bin(size, true);
+    if(min_bin >= BIN_COUNT) return allocation;
+
+    uint32_t bin = v_find_free_bin(allocator, min_bin);
+    if(bin == OFFSET_ALLOCATOR_NONE) return allocation;
+
+    uint32_t index = allocator.m_bin_heads[bin];
+    v_remove_node(allocator, index);
+    // The node itself stays in use, take it back off the free list
+    allocator.m_free_nodes.pop_back();
+
+    OffsetAllocatorNode& node = allocator.m_nodes[index];
+    uint32_t remainder = node.m_size - size;
+    node.m_size = size;
+    node.m_used = true;
+
+    if(remainder > 0)
+    {
+        uint32_t offset = node.m_offset + size;
+        uint32_t next = node.m_neighbor_next;
+        uint32_t split = v_insert_node(allocator, offset, remainder);
+
+        // v_insert_node may have grown the node array
+        OffsetAllocatorNode& used = allocator.m_nodes[index];
+        OffsetAllocatorNode& free = allocator.m_nodes[split];
+        free.m_neighbor_prev = index;
+        free.m_neighbor_next = next;
+        if(next != OFFSET_ALLOCATOR_NONE) allocator.m_nodes[next].m_neighbor_prev = split;
+        used.m_neighbor_next = split;
+    }
+
+    allocation.m_offset = allocator.m_nodes[index].m_offset;
+    allocation.m_node = index;
+    return allocation;
+}
+
+void v_offset_free(OffsetAllocator& allocator, OffsetAllocation allocation)
+{
+    if(allocation.m_node == OFFSET_ALLOCATOR_NONE) return;
+
+    OffsetAllocatorNode node = allocator.m_nodes[allocation.m_node];
+    uint32_t offset = node.m_offset;
+    uint32_t size = node.m_size;
+    uint32_t prev = node.m_neighbor_prev;
+    uint32_t next = node.m_neighbor_next;
+
+    if(prev != OFFSET_ALLOCATOR_NONE && !allocator.m_nodes[prev].m_used)
+    {
+        offset = allocator.m_nodes[prev].m_offset;
+        size += allocator.m_nodes[prev].m_size;
+        uint32_t merged = prev;
+        prev = allocator.m_nodes[merged].m_neighbor_prev;
+        v_remove_node(allocator, merged);
+    }
+
+    if(next != OFFSET_ALLOCATOR_NONE && !allocator.m_nodes[next].m_used)
+    {
+        size += allocator.m_nodes[next].m_size;
+        uint32_t merged = next;
+        next = allocator.m_nodes[merged].m_neighbor_next;
+        v_remove_node(allocator, merged);
+    }
+
+    allocator.m_free_nodes.push_back(allocation.m_node);
+
+    uint32_t index = v_insert_node(allocator, offset, size);
+    allocator.m_nodes[index].m_neighbor_prev = prev;
+    allocator.m_nodes[index].m_neighbor_next = next;
+    if(prev != OFFSET_ALLOCATOR_NONE) allocator.m_nodes[prev].m_neighbor_next = index;
+    if(next != OFFSET_ALLOCATOR_NONE) allocator.m_nodes[next].m_neighbor_prev = index;
+}
+
+uint32_t v_get_allocation_size(const OffsetAllocator& allocator, OffsetAllocation allocation)
+{
+    if(allocation.m_node == OFFSET_ALLOCATOR_NONE) return 0;
+    return allocator.m_nodes[allocation.m_node].m_size;
+}
+
+uint32_t v_get_largest_free_range(const OffsetAllocator& allocator)
+{
+    if(allocator.m_used_bins_top == 0) return 0;
+
+    uint32_t top = 31 - v_leading_zeros(allocator.m_used_bins_top);
+    uint32_t leaf = 31 - v_leading_zeros(allocator.m_used_bins[top]);
+    return v_bin_to_size((top << MANTISSA_BITS) + leaf);
+}
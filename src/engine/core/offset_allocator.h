@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+// Two level segregated fit allocator for ranges of a buffer. It only hands
+// out offsets, the memory itself is owned by the caller. Free ranges are kept
+// in 256 size bins (5 bit exponent, 3 bit mantissa) with a bitmask per level,
+// so allocation and free are O(1). Freed ranges merge with free neighbours.
+
+#define OFFSET_ALLOCATOR_NONE 0xFFFFFFFF
+
+struct OffsetAllocation
+{
+    uint32_t m_offset;
+    uint32_t m_node;
+};
+
+struct OffsetAllocatorNode
+{
+    uint32_t m_offset;
+    uint32_t m_size;
+    uint32_t m_bin_prev;
+    uint32_t m_bin_next;
+    uint32_t m_neighbor_prev;
+    uint32_t m_neighbor_next;
+    bool m_used;
+};
+
+struct OffsetAllocator
+{
+    uint32_t m_size;
+    uint32_t m_free_storage;
+
+    uint32_t m_used_bins_top;
+    uint8_t m_used_bins[32];
+    uint32_t m_bin_heads[256];
+
+    std::vector<OffsetAllocatorNode> m_nodes;
+    std::vector<uint32_t> m_free_nodes;
+};
+
+void v_init_offset_allocator(OffsetAllocator& allocator, uint32_t size);
+
+// m_offset is OFFSET_ALLOCATOR_NONE when no free range is large enough
+OffsetAllocation v_offset_allocate(OffsetAllocator& allocator, uint32_t size);
+void v_offset_free(OffsetAllocator& allocator, OffsetAllocation allocation);
+
+uint32_t v_get_allocation_size(const OffsetAllocator& allocator, OffsetAllocation allocation);
+// Lower bound of the largest free range
+uint32_t v_get_largest_free_range(const OffsetAllocator& allocator);
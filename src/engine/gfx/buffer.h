@@ -7,4 +7,8 @@ struct AllocatedBuffer
 {
     VkBuffer m_buffer;
     VmaAllocation m_allocation;
-};
\ No newline at end of file
+    VkDeviceSize m_size;
+    VkBufferUsageFlags m_usage;
+    uint8_t m_category;
+    uint8_t m_flags;
+};
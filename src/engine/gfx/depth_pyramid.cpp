@@ -0,0 +1,286 @@
+#include <assert.h>
+#include "depth_pyramid.h"
+
+#include "renderer.h"
+#include "memory.h"
+#include "sync.h"
+
+DepthPyramid g_depth_pyramid = {};
+
+struct ReduceConstants
+{
+    int32_t m_src_size[2];
+    int32_t m_dst_size[2];
+};
+
+static uint32_t v_previous_power_of_two(uint32_t value)
+{
+    uint32_t result = 1;
+    while(result * 2 <= value) result *= 2;
+    return result;
+}
+
+static VkImageView v_create_level_view(uint32_t base_level, uint32_t level_count)
+{
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.pNext = nullptr;
+    view_info.image = g_depth_pyramid.m_image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = VK_FORMAT_R32_SFLOAT;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = base_level;
+    view_info.subresourceRange.levelCount = level_count;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView view;
+    vkCreateImageView(g_renderer.m_device, &view_info, nullptr, &view);
+    return view;
+}
+
+static void v_write_image_descriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkImageView view,
+    VkImageLayout layout)
+{
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = g_depth_pyramid.m_sampler;
+    image_info.imageView = view;
+    image_info.imageLayout = layout;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(g_renderer.m_device, 1, &write, 0, nullptr);
+}
+
+static void v_create_pyramid_image(VkExtent2D depth_extent)
+{
+    g_depth_pyramid.m_extent.width = v_previous_power_of_two(depth_extent.width);
+    g_depth_pyramid.m_extent.height = v_previous_power_of_two(depth_extent.height);
+    g_depth_pyramid.m_level_count = 1;
+    while((1u << g_depth_pyramid.m_level_count) <= HMM_MAX(g_depth_pyramid.m_extent.width, g_depth_pyramid.m_extent.height))
+    {
+        g_depth_pyramid.m_level_count++;
+    }
+    g_depth_pyramid.m_level_count = HMM_MIN(g_depth_pyramid.m_level_count, (uint32_t)DEPTH_PYRAMID_MAX_LEVELS);
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.pNext = nullptr;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = VK_FORMAT_R32_SFLOAT;
+    image_info.extent = {g_depth_pyramid.m_extent.width, g_depth_pyramid.m_extent.height, 1};
+    image_info.mipLevels = g_depth_pyramid.m_level_count;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VmaAllocationCreateInfo allocation_info{};
+    allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocationInfo allocation_result;
+    vmaCreateImage(g_renderer.m_allocator, &image_info, &allocation_info, &g_depth_pyramid.m_image,
+        &g_depth_pyramid.m_allocation, &allocation_result);
+    g_depth_pyramid.m_bytes = allocation_result.size;
+    v_track_allocation(MEMORY_TRANSIENT, g_depth_pyramid.m_bytes);
+
+    g_depth_pyramid.m_view = v_create_level_view(0, g_depth_pyramid.m_level_count);
+    for(uint32_t i=0; i < g_depth_pyramid.m_level_count; i++) g_depth_pyramid.m_level_views[i] = v_create_level_view(i, 1);
+
+    for(uint32_t i=0; i < g_depth_pyramid.m_level_count; i++)
+    {
+        v_write_image_descriptor(g_depth_pyramid.m_sets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            g_depth_pyramid.m_level_views[i], VK_IMAGE_LAYOUT_GENERAL);
+        if(i == 0) continue;
+        v_write_image_descriptor(g_depth_pyramid.m_sets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            g_depth_pyramid.m_level_views[i - 1], VK_IMAGE_LAYOUT_GENERAL);
+    }
+
+    g_depth_pyramid.m_valid = false;
+    g_depth_pyramid.m_layout_ready = false;
+}
+
+static void v_release_pyramid_image()
+{
+    // The last frame may still sample it
+    DepthPyramid pyramid = g_depth_pyramid;
+    v_defer_destruction(v_get_last_ticket(QUEUE_GRAPHICS), [pyramid]() {
+        for(uint32_t i=0; i < pyramid.m_level_count; i++) vkDestroyImageView(g_renderer.m_device, pyramid.m_level_views[i], nullptr);
+        vkDestroyImageView(g_renderer.m_device, pyramid.m_view, nullptr);
+        vmaDestroyImage(g_renderer.m_allocator, pyramid.m_image, pyramid.m_allocation);
+        v_untrack_allocation(MEMORY_TRANSIENT, pyramid.m_bytes);
+    });
+}
+
+void v_init_depth_pyramid(const char* reduce_shader_path)
+{
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.pNext = nullptr;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = (float)DEPTH_PYRAMID_MAX_LEVELS;
+
+    vkCreateSampler(g_renderer.m_device, &sampler_info, nullptr, &g_depth_pyramid.m_sampler);
+
+    // Source level, destination level
+    VkDescriptorSetLayoutBinding bindings[2];
+    for(uint32_t i=0; i < 2; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = 2;
+    set_layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_depth_pyramid.m_set_layout);
+
+    VkDescriptorPoolSize pool_sizes[2];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[0].descriptorCount = DEPTH_PYRAMID_MAX_LEVELS;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_sizes[1].descriptorCount = DEPTH_PYRAMID_MAX_LEVELS;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = DEPTH_PYRAMID_MAX_LEVELS;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_depth_pyramid.m_descriptor_pool);
+
+    VkDescriptorSetLayout set_layouts[DEPTH_PYRAMID_MAX_LEVELS];
+    for(uint32_t i=0; i < DEPTH_PYRAMID_MAX_LEVELS; i++) set_layouts[i] = g_depth_pyramid.m_set_layout;
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_depth_pyramid.m_descriptor_pool;
+    set_info.descriptorSetCount = DEPTH_PYRAMID_MAX_LEVELS;
+    set_info.pSetLayouts = set_layouts;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, g_depth_pyramid.m_sets);
+
+    g_depth_pyramid.m_bound_depth_view = VK_NULL_HANDLE;
+    g_depth_pyramid.m_reduce_pipeline = v_create_compute_pipeline(reduce_shader_path, 1, &g_depth_pyramid.m_set_layout,
+        sizeof(ReduceConstants));
+
+    v_create_pyramid_image(g_renderer.m_win_extent);
+}
+
+void v_destroy_depth_pyramid()
+{
+    v_release_pyramid_image();
+    v_destroy_compute_pipeline(g_depth_pyramid.m_reduce_pipeline);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_depth_pyramid.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_depth_pyramid.m_set_layout, nullptr);
+    vkDestroySampler(g_renderer.m_device, g_depth_pyramid.m_sampler, nullptr);
+}
+
+static void v_level_barrier(VkCommandBuffer command_buffer, uint32_t base_level, uint32_t level_count,
+    VkAccessFlags src_access, VkAccessFlags dst_access, VkImageLayout old_layout)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = g_depth_pyramid.m_image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = base_level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void v_resize_depth_pyramid(VkExtent2D depth_extent)
+{
+    VkExtent2D extent = {v_previous_power_of_two(depth_extent.width), v_previous_power_of_two(depth_extent.height)};
+    if(extent.width == g_depth_pyramid.m_extent.width && extent.height == g_depth_pyramid.m_extent.height) return;
+
+    // Nothing of this frame references the old one yet
+    v_release_pyramid_image();
+    v_create_pyramid_image(depth_extent);
+    g_depth_pyramid.m_bound_depth_view = VK_NULL_HANDLE;
+}
+
+bool v_is_depth_pyramid_usable(VkExtent2D depth_extent)
+{
+    return g_depth_pyramid.m_valid && g_depth_pyramid.m_extent.width == v_previous_power_of_two(depth_extent.width)
+        && g_depth_pyramid.m_extent.height == v_previous_power_of_two(depth_extent.height);
+}
+
+void v_build_depth_pyramid(VkCommandBuffer command_buffer, VkImageView depth_view, VkExtent2D depth_extent,
+    VkExtent2D rendered_extent)
+{
+    VkExtent2D extent = {v_previous_power_of_two(depth_extent.width), v_previous_power_of_two(depth_extent.height)};
+    assert(extent.width == g_depth_pyramid.m_extent.width && extent.height == g_depth_pyramid.m_extent.height);
+
+    // The previous frame has finished, the set is not in use
+    if(g_depth_pyramid.m_bound_depth_view != depth_view)
+    {
+        g_depth_pyramid.m_bound_depth_view = depth_view;
+        v_write_image_descriptor(g_depth_pyramid.m_sets[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            depth_view, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL);
+    }
+
+    // Earlier culling passes of this frame read the whole pyramid
+    v_level_barrier(command_buffer, 0, g_depth_pyramid.m_level_count, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        g_depth_pyramid.m_layout_ready ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED);
+    g_depth_pyramid.m_layout_ready = true;
+
+    ComputePipeline& pipeline = g_depth_pyramid.m_reduce_pipeline;
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.m_pipeline);
+
+    VkExtent2D src_extent = rendered_extent;
+    for(uint32_t i=0; i < g_depth_pyramid.m_level_count; i++)
+    {
+        VkExtent2D dst_extent = {HMM_MAX(extent.width >> i, 1u), HMM_MAX(extent.height >> i, 1u)};
+
+        ReduceConstants constants;
+        constants.m_src_size[0] = (int32_t)src_extent.width;
+        constants.m_src_size[1] = (int32_t)src_extent.height;
+        constants.m_dst_size[0] = (int32_t)dst_extent.width;
+        constants.m_dst_size[1] = (int32_t)dst_extent.height;
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.m_pipeline_layout,
+            0, 1, &g_depth_pyramid.m_sets[i], 0, nullptr);
+        vkCmdPushConstants(command_buffer, pipeline.m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(command_buffer, (dst_extent.width + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+            (dst_extent.height + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE, 1);
+
+        v_level_barrier(command_buffer, i, 1, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+        src_extent = dst_extent;
+    }
+
+    g_depth_pyramid.m_valid = true;
+}
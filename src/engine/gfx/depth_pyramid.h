@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "pipeline.h"
+
+// Hierarchical depth buffer for occlusion culling. Every texel of a level
+// holds the farthest depth of the texels it covers one level below, so a
+// bounding volume whose nearest depth is farther than a few texels of the
+// right level is hidden. Level 0 is the rendered part of the depth buffer
+// resampled to the depth buffer's size rounded down to powers of two, so the
+// pyramid keeps its size when the render scale changes. The image stays in
+// VK_IMAGE_LAYOUT_GENERAL.
+
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+#define DEPTH_PYRAMID_GROUP_SIZE 8
+
+struct DepthPyramid
+{
+    VkImage m_image;
+    VmaAllocation m_allocation;
+    VkDeviceSize m_bytes;
+    // All levels, for the culling shaders
+    VkImageView m_view;
+    VkImageView m_level_views[DEPTH_PYRAMID_MAX_LEVELS];
+    VkExtent2D m_extent;
+    uint32_t m_level_count;
+    VkSampler m_sampler;
+
+    // One set per level: the level below, or the depth buffer, and the level
+    VkDescriptorSetLayout m_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_sets[DEPTH_PYRAMID_MAX_LEVELS];
+    VkImageView m_bound_depth_view;
+    ComputePipeline m_reduce_pipeline;
+
+    // False until the first build after (re)creation
+    bool m_valid;
+    bool m_layout_ready;
+};
+
+extern DepthPyramid g_depth_pyramid;
+
+// Main API
+
+// Creates a pyramid for the current window extent, so the culling set can
+// reference it before the first build
+void v_init_depth_pyramid(const char* reduce_shader_path);
+void v_destroy_depth_pyramid();
+
+// Before anything of the frame is recorded, recreates the pyramid when the
+// depth extent changed. The new one is not usable until it was built.
+void v_resize_depth_pyramid(VkExtent2D depth_extent);
+// Built for a depth buffer of this extent
+bool v_is_depth_pyramid_usable(VkExtent2D depth_extent);
+// Outside of a render pass, with the depth buffer readable by compute
+// shaders. rendered_extent is the top left part of the depth buffer drawn
+// this frame, depth_extent the one given to v_resize_depth_pyramid(). Ends
+// with a barrier making every level visible to compute shaders.
+void v_build_depth_pyramid(VkCommandBuffer command_buffer, VkImageView depth_view, VkExtent2D depth_extent,
+    VkExtent2D rendered_extent);
@@ -0,0 +1,132 @@
+#include <chrono>
+#include "draw_cache.h"
+
+#include "renderer.h"
+#include "geometry.h"
+#include "meshlet_culling.h"
+
+DrawCache g_draw_cache = {};
+
+static double v_now_ms()
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+void v_init_draw_cache()
+{
+    g_draw_cache.m_command_pool = v_create_command_pool(QUEUE_GRAPHICS, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    g_draw_cache.m_version = 0;
+    g_draw_cache.m_built = false;
+    g_draw_cache.m_recording_count = 0;
+    g_draw_cache.m_next_eviction = 0;
+    g_draw_cache.m_enabled = true;
+    g_draw_cache.m_stats = {};
+}
+
+void v_destroy_draw_cache()
+{
+    vkDestroyCommandPool(g_renderer.m_device, g_draw_cache.m_command_pool, nullptr);
+    g_draw_cache.m_recording_count = 0;
+    v_clear_render_queue(g_draw_cache.m_queue);
+}
+
+static bool v_is_draw_cache_stale(uint64_t static_version)
+{
+    return !g_draw_cache.m_enabled || !g_draw_cache.m_built
+        || g_draw_cache.m_static_version != static_version
+        || g_draw_cache.m_bound_vertex_buffer != g_geometry.m_vertex_buffer.m_buffer
+        || g_draw_cache.m_bound_index_buffer != g_geometry.m_index_buffer.m_buffer
+        || g_draw_cache.m_meshlets != g_meshlet_culling.m_enabled;
+}
+
+void v_update_draw_cache(uint64_t static_version, const std::function<void(RenderQueue&)>& submit, RenderQueue& frame_queue)
+{
+    g_draw_cache.m_stats.m_recordings = 0;
+    g_draw_cache.m_stats.m_rebuild_ms = 0.0f;
+    g_draw_cache.m_stats.m_record_ms = 0.0f;
+
+    if(v_is_draw_cache_stale(static_version))
+    {
+        double start = v_now_ms();
+        RenderQueue& queue = g_draw_cache.m_queue;
+        v_clear_render_queue(queue);
+        submit(queue);
+        v_sort_render_queue(queue);
+        queue.m_first_command = 0;
+        queue.m_first_job = 0;
+        v_write_draw_ranges(queue);
+
+        g_draw_cache.m_version++;
+        g_draw_cache.m_static_version = static_version;
+        g_draw_cache.m_built = true;
+        g_draw_cache.m_bound_vertex_buffer = g_geometry.m_vertex_buffer.m_buffer;
+        g_draw_cache.m_bound_index_buffer = g_geometry.m_index_buffer.m_buffer;
+        g_draw_cache.m_meshlets = g_meshlet_culling.m_enabled;
+        g_draw_cache.m_stats.m_static_draws = (uint32_t)queue.m_entries.size();
+        g_draw_cache.m_stats.m_rebuild_ms = (float)(v_now_ms() - start);
+    }
+
+    frame_queue.m_first_command = g_draw_cache.m_queue.m_command_end;
+    frame_queue.m_first_job = g_draw_cache.m_queue.m_job_end;
+}
+
+void v_invalidate_draw_recordings()
+{
+    g_draw_cache.m_version++;
+}
+
+static DrawRecording& v_find_recording(VkRenderPass render_pass, uint32_t subpass, bool late)
+{
+    for(uint32_t i=0; i < g_draw_cache.m_recording_count; i++)
+    {
+        DrawRecording& recording = g_draw_cache.m_recordings[i];
+        if(recording.m_render_pass == render_pass && recording.m_subpass == subpass && recording.m_late == late) return recording;
+    }
+
+    // A recompiled graph brings new render passes, the old recordings are reused
+    DrawRecording* recording;
+    if(g_draw_cache.m_recording_count < DRAW_CACHE_MAX_RECORDINGS)
+    {
+        recording = &g_draw_cache.m_recordings[g_draw_cache.m_recording_count++];
+
+        VkCommandBufferAllocateInfo cmd_buffer_info{};
+        cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmd_buffer_info.pNext = nullptr;
+        cmd_buffer_info.commandBufferCount = 1;
+        cmd_buffer_info.commandPool = g_draw_cache.m_command_pool;
+        cmd_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        vkAllocateCommandBuffers(g_renderer.m_device, &cmd_buffer_info, &recording->m_command_buffer);
+    } else {
+        recording = &g_draw_cache.m_recordings[g_draw_cache.m_next_eviction];
+        g_draw_cache.m_next_eviction = (g_draw_cache.m_next_eviction + 1) % DRAW_CACHE_MAX_RECORDINGS;
+    }
+
+    recording->m_render_pass = render_pass;
+    recording->m_subpass = subpass;
+    recording->m_late = late;
+    // Never matches, so it is recorded below
+    recording->m_version = g_draw_cache.m_version - 1;
+    return *recording;
+}
+
+VkCommandBuffer v_get_static_draws(VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent, bool late)
+{
+    DrawRecording& recording = v_find_recording(render_pass, subpass, late);
+    bool stale = recording.m_version != g_draw_cache.m_version
+        || recording.m_extent.width != extent.width || recording.m_extent.height != extent.height;
+    if(!stale) return recording.m_command_buffer;
+
+    // The frame that last executed it has finished, see v_acquire_frame()
+    double start = v_now_ms();
+    vkResetCommandBuffer(recording.m_command_buffer, 0);
+    v_begin_secondary(recording.m_command_buffer, render_pass, subpass, extent, 0);
+    v_record_render_queue(g_draw_cache.m_queue, recording.m_command_buffer, late);
+    vkEndCommandBuffer(recording.m_command_buffer);
+
+    recording.m_extent = extent;
+    recording.m_version = g_draw_cache.m_version;
+    g_draw_cache.m_stats.m_recordings++;
+    g_draw_cache.m_stats.m_record_ms += (float)(v_now_ms() - start);
+    return recording.m_command_buffer;
+}
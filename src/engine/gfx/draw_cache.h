@@ -0,0 +1,87 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "render_queue.h"
+
+// Static draws recorded once into secondary command buffers and replayed with
+// vkCmdExecuteCommands() every frame. The static queue owns the start of the
+// indirect buffer and of the meshlet job list, which stay mapped and are only
+// rewritten when the static set changes. Meshlet culling still rewrites the
+// commands of those jobs every frame, the recordings only reference them.
+// The camera lives in the instance set, so moving it re-records nothing.
+// A recording is redone when
+//   - the static version given to v_update_draw_cache() changes,
+//     including when the instance indexes of static meshes moved,
+//   - geometry compaction replaces the pool buffers,
+//   - meshlet culling is switched, which changes the static ranges,
+//   - the render pass or the render extent changes, e.g. on resize or when
+//     dynamic resolution moves the scale,
+//   - the render graph was compiled, see v_invalidate_draw_recordings().
+
+#define DRAW_CACHE_MAX_RECORDINGS 4
+
+struct DrawRecording
+{
+    VkCommandBuffer m_command_buffer;
+    VkRenderPass m_render_pass;
+    uint32_t m_subpass;
+    VkExtent2D m_extent;
+    bool m_late;
+    // DrawCache::m_version it was recorded at
+    uint32_t m_version;
+};
+
+// CPU side of the last frame
+struct DrawCacheStats
+{
+    uint32_t m_static_draws;
+    uint32_t m_recordings;
+    // Submitting, sorting and writing the ranges of the static draws
+    float m_rebuild_ms;
+    float m_record_ms;
+};
+
+struct DrawCache
+{
+    RenderQueue m_queue;
+    // Bumped on every rebuild, older recordings are stale
+    uint32_t m_version;
+    uint64_t m_static_version;
+    bool m_built;
+    // Replaced by compaction, the ranges and recordings follow them
+    VkBuffer m_bound_vertex_buffer;
+    VkBuffer m_bound_index_buffer;
+    bool m_meshlets;
+
+    VkCommandPool m_command_pool;
+    DrawRecording m_recordings[DRAW_CACHE_MAX_RECORDINGS];
+    uint32_t m_recording_count;
+    uint32_t m_next_eviction;
+
+    // Off rebuilds and re-records every frame, to compare against
+    bool m_enabled;
+    DrawCacheStats m_stats;
+};
+
+extern DrawCache g_draw_cache;
+
+// Main API
+
+void v_init_draw_cache();
+void v_destroy_draw_cache();
+
+// Once per frame after v_acquire_frame() and before frame_queue is prepared.
+// When the cache is stale, submit refills the cleared static queue, e.g. with
+// v_submit_static_scene(). frame_queue is placed after the static ranges.
+void v_update_draw_cache(uint64_t static_version, const std::function<void(RenderQueue&)>& submit, RenderQueue& frame_queue);
+
+// After every render graph compile. The old render passes are destroyed and a
+// new one may reuse a handle value, so recordings can not be matched by it.
+void v_invalidate_draw_recordings();
+
+// Static draws for a subpass of a secondary graph pass, recorded if needed.
+// Execute it every frame; the late one only with occlusion culling active.
+VkCommandBuffer v_get_static_draws(VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent, bool late);
@@ -0,0 +1,44 @@
+#include <math.h>
+#include <HandmadeMath.h>
+#include "dynamic_resolution.h"
+
+static const float GPU_TIME_SMOOTHING = 0.25f;
+// Scales are rounded to this, so noise in the timings does not move the viewport every frame
+static const float SCALE_STEP = 0.01f;
+
+void v_init_dynamic_resolution(DynamicResolution& resolution, float target_ms, float min_scale, float max_scale)
+{
+    resolution.m_enabled = true;
+    resolution.m_target_ms = target_ms;
+    resolution.m_min_scale = min_scale;
+    resolution.m_max_scale = max_scale;
+    resolution.m_kp = 0.5f;
+    resolution.m_ki = 0.05f;
+    resolution.m_integral = max_scale * max_scale;
+    resolution.m_scale = max_scale;
+    resolution.m_gpu_ms = target_ms;
+}
+
+float v_update_dynamic_resolution(DynamicResolution& resolution, float gpu_ms)
+{
+    float min_area = resolution.m_min_scale * resolution.m_min_scale;
+    float max_area = resolution.m_max_scale * resolution.m_max_scale;
+
+    if(!resolution.m_enabled)
+    {
+        resolution.m_integral = max_area;
+        resolution.m_scale = resolution.m_max_scale;
+        return resolution.m_scale;
+    }
+    if(gpu_ms <= 0.0f || resolution.m_target_ms <= 0.0f) return resolution.m_scale;
+
+    resolution.m_gpu_ms += (gpu_ms - resolution.m_gpu_ms) * GPU_TIME_SMOOTHING;
+    float error = (resolution.m_target_ms - resolution.m_gpu_ms) / resolution.m_target_ms;
+
+    resolution.m_integral = HMM_MIN(HMM_MAX(resolution.m_integral + resolution.m_ki * error, min_area), max_area);
+    float area = HMM_MIN(HMM_MAX(resolution.m_integral + resolution.m_kp * error, min_area), max_area);
+
+    float scale = roundf(sqrtf(area) / SCALE_STEP) * SCALE_STEP;
+    resolution.m_scale = HMM_MIN(HMM_MAX(scale, resolution.m_min_scale), resolution.m_max_scale);
+    return resolution.m_scale;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// Render scale controller. GPU time grows roughly with the pixel count, so a
+// PI controller drives the rendered area (scale squared) towards the frame
+// budget and the scale is its square root. The integral term is clamped to
+// the scale range so a long stretch at a limit does not wind it up.
+
+struct DynamicResolution
+{
+    bool m_enabled;
+    float m_target_ms;
+    float m_min_scale;
+    float m_max_scale;
+    // Gains on the relative error (target - measured) / target
+    float m_kp;
+    float m_ki;
+    float m_integral;
+    float m_scale;
+    // Smoothed GPU time, a single slow frame should not halve the resolution
+    float m_gpu_ms;
+};
+
+// Main API
+
+void v_init_dynamic_resolution(DynamicResolution& resolution, float target_ms, float min_scale, float max_scale);
+
+// Call once per frame with the GPU time of the last finished frame, 0 when
+// unknown. Returns the scale to render the next frame at.
+float v_update_dynamic_resolution(DynamicResolution& resolution, float gpu_ms);
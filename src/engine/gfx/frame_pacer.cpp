@@ -0,0 +1,64 @@
+#include <chrono>
+#include <thread>
+#include "frame_pacer.h"
+
+// The OS sleep is only trusted up to this point, the rest is spun
+static const double SPIN_THRESHOLD = 0.002;
+static const double WORK_SMOOTHING = 0.1;
+
+static double v_now()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void v_init_frame_pacer(FramePacer& pacer, double target_frame_time)
+{
+    pacer.m_enabled = true;
+    pacer.m_target_frame_time = target_frame_time;
+    pacer.m_safety_margin = 0.001;
+    pacer.m_work_estimate = 0.0;
+    pacer.m_last_submit = v_now();
+    pacer.m_sample_time = pacer.m_last_submit;
+    pacer.m_slept = 0.0;
+}
+
+void v_pace_frame(FramePacer& pacer)
+{
+    double now = v_now();
+    pacer.m_slept = 0.0;
+
+    if(pacer.m_enabled && pacer.m_target_frame_time > 0.0)
+    {
+        double deadline = pacer.m_last_submit + pacer.m_target_frame_time;
+        double wake_time = deadline - pacer.m_work_estimate - pacer.m_safety_margin;
+
+        if(wake_time > now)
+        {
+            double remaining = wake_time - now;
+            if(remaining > SPIN_THRESHOLD)
+            {
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_THRESHOLD));
+            }
+            while(v_now() < wake_time) std::this_thread::yield();
+
+            now = v_now();
+            pacer.m_slept = remaining;
+        }
+    }
+
+    pacer.m_sample_time = now;
+}
+
+void v_frame_submitted(FramePacer& pacer)
+{
+    double now = v_now();
+    double work = now - pacer.m_sample_time;
+
+    // React quickly to spikes so they do not cause a missed present,
+    // but only decay slowly when the work gets cheaper.
+    if(work > pacer.m_work_estimate) pacer.m_work_estimate = work;
+    else pacer.m_work_estimate += (work - pacer.m_work_estimate) * WORK_SMOOTHING;
+
+    pacer.m_last_submit = now;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+// Latency limiter. Instead of sampling input right after the previous present
+// and then blocking in the next acquire, the loop sleeps first and samples
+// input just in time to record and submit before the next present deadline.
+
+struct FramePacer
+{
+    bool m_enabled;
+    double m_target_frame_time;   // Seconds between presents, e.g. 1/60
+    double m_safety_margin;       // Seconds of slack kept before the deadline
+    double m_work_estimate;       // Smoothed sample-to-submit CPU time
+    double m_last_submit;
+    double m_sample_time;
+    double m_slept;               // Time spent sleeping in the last v_pace_frame()
+};
+
+void v_init_frame_pacer(FramePacer& pacer, double target_frame_time);
+
+// Call right before polling input
+void v_pace_frame(FramePacer& pacer);
+
+// Call right after v_end_frame()
+void v_frame_submitted(FramePacer& pacer);
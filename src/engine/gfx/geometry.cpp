@@ -0,0 +1,250 @@
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include "geometry.h"
+
+#include "renderer.h"
+#include "memory.h"
+#include "sync.h"
+
+GeometryPool g_geometry = {};
+
+static const VkBufferUsageFlags POOL_USAGE = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+static void v_create_pool_buffers(AllocatedBuffer& vertex_buffer, AllocatedBuffer& index_buffer, AllocatedBuffer& meshlet_buffer,
+    uint32_t vertex_capacity, uint32_t index_capacity, uint32_t meshlet_capacity)
+{
+    v_create_buffer(vertex_buffer, (VkDeviceSize)vertex_capacity * sizeof(Vertex),
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | POOL_USAGE, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY, BUFFER_SHARED | BUFFER_MOVABLE);
+    v_create_buffer(index_buffer, (VkDeviceSize)index_capacity * sizeof(uint32_t),
+        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | POOL_USAGE, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY, BUFFER_SHARED | BUFFER_MOVABLE);
+    v_create_buffer(meshlet_buffer, (VkDeviceSize)meshlet_capacity * sizeof(Meshlet),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | POOL_USAGE, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_GEOMETRY, BUFFER_SHARED | BUFFER_MOVABLE);
+}
+
+void v_init_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity, uint32_t meshlet_capacity)
+{
+    v_create_pool_buffers(g_geometry.m_vertex_buffer, g_geometry.m_index_buffer, g_geometry.m_meshlet_buffer,
+        vertex_capacity, index_capacity, meshlet_capacity);
+    v_init_offset_allocator(g_geometry.m_vertex_allocator, vertex_capacity);
+    v_init_offset_allocator(g_geometry.m_index_allocator, index_capacity);
+    v_init_offset_allocator(g_geometry.m_meshlet_allocator, meshlet_capacity);
+    g_geometry.m_models.clear();
+    g_geometry.m_epoch = 0;
+}
+
+void v_destroy_geometry_pool()
+{
+    v_destroy_buffer(g_geometry.m_meshlet_buffer);
+    v_destroy_buffer(g_geometry.m_index_buffer);
+    v_destroy_buffer(g_geometry.m_vertex_buffer);
+    g_geometry.m_models.clear();
+}
+
+static bool v_try_allocate(Model& model, uint32_t vertex_count, uint32_t index_count, uint32_t meshlet_count)
+{
+    model.m_vertex_allocation = v_offset_allocate(g_geometry.m_vertex_allocator, vertex_count);
+    if(model.m_vertex_allocation.m_offset == OFFSET_ALLOCATOR_NONE) return false;
+
+    model.m_index_allocation = v_offset_allocate(g_geometry.m_index_allocator, index_count);
+    if(model.m_index_allocation.m_offset == OFFSET_ALLOCATOR_NONE)
+    {
+        v_offset_free(g_geometry.m_vertex_allocator, model.m_vertex_allocation);
+        model.m_vertex_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+        return false;
+    }
+
+    model.m_meshlet_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    if(meshlet_count == 0) return true;
+
+    model.m_meshlet_allocation = v_offset_allocate(g_geometry.m_meshlet_allocator, meshlet_count);
+    if(model.m_meshlet_allocation.m_offset == OFFSET_ALLOCATOR_NONE)
+    {
+        v_offset_free(g_geometry.m_index_allocator, model.m_index_allocation);
+        v_offset_free(g_geometry.m_vertex_allocator, model.m_vertex_allocation);
+        model.m_index_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+        model.m_vertex_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+        return false;
+    }
+
+    return true;
+}
+
+static uint32_t v_grow_capacity(const OffsetAllocator& allocator, uint32_t count)
+{
+    uint32_t capacity = allocator.m_size;
+    while(capacity - (allocator.m_size - allocator.m_free_storage) < count) capacity *= 2;
+    return capacity;
+}
+
+bool v_allocate_geometry(Model& model, const Vertex* vertices, uint32_t vertex_count,
+    const uint32_t* indices, uint32_t index_count, const Meshlet* meshlets, uint32_t meshlet_count)
+{
+    model.m_vertex_count = vertex_count;
+    model.m_index_count = index_count;
+    model.m_meshlet_count = meshlet_count;
+
+    if(!v_try_allocate(model, vertex_count, index_count, meshlet_count))
+    {
+        // Enough space in total means the pool is only fragmented
+        v_compact_geometry_pool(v_grow_capacity(g_geometry.m_vertex_allocator, vertex_count),
+            v_grow_capacity(g_geometry.m_index_allocator, index_count),
+            v_grow_capacity(g_geometry.m_meshlet_allocator, meshlet_count));
+        if(!v_try_allocate(model, vertex_count, index_count, meshlet_count)) return false;
+    }
+
+    model.m_pool_index = (uint32_t)g_geometry.m_models.size();
+    g_geometry.m_models.push_back(&model);
+
+    VkDeviceSize vertex_bytes = (VkDeviceSize)vertex_count * sizeof(Vertex);
+    VkDeviceSize index_bytes = (VkDeviceSize)index_count * sizeof(uint32_t);
+    VkDeviceSize meshlet_bytes = (VkDeviceSize)meshlet_count * sizeof(Meshlet);
+
+    AllocatedBuffer staging_buffer;
+    v_create_buffer(staging_buffer, vertex_bytes + index_bytes + meshlet_bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, staging_buffer.m_allocation, &data);
+    memcpy(data, vertices, vertex_bytes);
+    memcpy((char*)data + vertex_bytes, indices, index_bytes);
+    if(meshlet_count) memcpy((char*)data + vertex_bytes + index_bytes, meshlets, meshlet_bytes);
+    vmaUnmapMemory(g_renderer.m_allocator, staging_buffer.m_allocation);
+
+    // The upload must not land in a buffer the last frame is moving
+    v_finish_buffer_moves();
+    SyncTicket ticket = v_submit_upload([&](VkCommandBuffer command_buffer) {
+        VkBufferCopy copy{};
+        copy.srcOffset = 0;
+        copy.dstOffset = (VkDeviceSize)model.m_vertex_allocation.m_offset * sizeof(Vertex);
+        copy.size = vertex_bytes;
+        vkCmdCopyBuffer(command_buffer, staging_buffer.m_buffer, g_geometry.m_vertex_buffer.m_buffer, 1, &copy);
+
+        copy.srcOffset = vertex_bytes;
+        copy.dstOffset = (VkDeviceSize)model.m_index_allocation.m_offset * sizeof(uint32_t);
+        copy.size = index_bytes;
+        vkCmdCopyBuffer(command_buffer, staging_buffer.m_buffer, g_geometry.m_index_buffer.m_buffer, 1, &copy);
+
+        if(meshlet_count == 0) return;
+        copy.srcOffset = vertex_bytes + index_bytes;
+        copy.dstOffset = (VkDeviceSize)model.m_meshlet_allocation.m_offset * sizeof(Meshlet);
+        copy.size = meshlet_bytes;
+        vkCmdCopyBuffer(command_buffer, staging_buffer.m_buffer, g_geometry.m_meshlet_buffer.m_buffer, 1, &copy);
+    });
+
+    v_defer_destruction(ticket, [staging_buffer]() mutable { v_destroy_buffer(staging_buffer); });
+    return true;
+}
+
+void v_free_geometry(Model& model)
+{
+    if(model.m_vertex_allocation.m_offset == OFFSET_ALLOCATOR_NONE) return;
+
+    // The last frame may still draw from the ranges
+    OffsetAllocation vertex_allocation = model.m_vertex_allocation;
+    OffsetAllocation index_allocation = model.m_index_allocation;
+    OffsetAllocation meshlet_allocation = model.m_meshlet_allocation;
+    uint32_t epoch = g_geometry.m_epoch;
+    v_defer_destruction(v_get_last_ticket(QUEUE_GRAPHICS), [vertex_allocation, index_allocation, meshlet_allocation, epoch]() {
+        // Compaction rebuilt the allocators from the live models only
+        if(epoch != g_geometry.m_epoch) return;
+        v_offset_free(g_geometry.m_vertex_allocator, vertex_allocation);
+        v_offset_free(g_geometry.m_index_allocator, index_allocation);
+        if(meshlet_allocation.m_offset != OFFSET_ALLOCATOR_NONE) v_offset_free(g_geometry.m_meshlet_allocator, meshlet_allocation);
+    });
+    model.m_vertex_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_index_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_meshlet_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+
+    // Swap-remove from the live list
+    Model* last = g_geometry.m_models.back();
+    g_geometry.m_models[model.m_pool_index] = last;
+    last->m_pool_index = model.m_pool_index;
+    g_geometry.m_models.pop_back();
+}
+
+void v_compact_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity, uint32_t meshlet_capacity)
+{
+    // Range frees still pending belong to the old allocators
+    g_geometry.m_epoch++;
+
+    // The copies below must read the pool where the defragmenter left it
+    v_finish_buffer_moves();
+
+    // Movable buffers are patched where they were created, so the new pool
+    // goes straight into g_geometry
+    AllocatedBuffer old_buffers[3] = {g_geometry.m_vertex_buffer, g_geometry.m_index_buffer, g_geometry.m_meshlet_buffer};
+    v_create_pool_buffers(g_geometry.m_vertex_buffer, g_geometry.m_index_buffer, g_geometry.m_meshlet_buffer,
+        vertex_capacity, index_capacity, meshlet_capacity);
+
+    // Repacking in offset order keeps the relative layout of the old pool
+    std::vector<Model*> models = g_geometry.m_models;
+    std::sort(models.begin(), models.end(), [](const Model* a, const Model* b) {
+        return a->m_vertex_allocation.m_offset < b->m_vertex_allocation.m_offset;
+    });
+
+    v_init_offset_allocator(g_geometry.m_vertex_allocator, vertex_capacity);
+    v_init_offset_allocator(g_geometry.m_index_allocator, index_capacity);
+    v_init_offset_allocator(g_geometry.m_meshlet_allocator, meshlet_capacity);
+
+    std::vector<VkBufferCopy> vertex_copies(models.size());
+    std::vector<VkBufferCopy> index_copies(models.size());
+    std::vector<VkBufferCopy> meshlet_copies;
+    for(uint32_t i=0; i < models.size(); i++)
+    {
+        Model& model = *models[i];
+        VkBufferCopy& vertex_copy = vertex_copies[i];
+        VkBufferCopy& index_copy = index_copies[i];
+        vertex_copy.srcOffset = (VkDeviceSize)model.m_vertex_allocation.m_offset * sizeof(Vertex);
+        index_copy.srcOffset = (VkDeviceSize)model.m_index_allocation.m_offset * sizeof(uint32_t);
+
+        // A fresh allocator hands out ranges back to back, so this cannot fail
+        model.m_vertex_allocation = v_offset_allocate(g_geometry.m_vertex_allocator, model.m_vertex_count);
+        model.m_index_allocation = v_offset_allocate(g_geometry.m_index_allocator, model.m_index_count);
+
+        vertex_copy.dstOffset = (VkDeviceSize)model.m_vertex_allocation.m_offset * sizeof(Vertex);
+        vertex_copy.size = (VkDeviceSize)model.m_vertex_count * sizeof(Vertex);
+        index_copy.dstOffset = (VkDeviceSize)model.m_index_allocation.m_offset * sizeof(uint32_t);
+        index_copy.size = (VkDeviceSize)model.m_index_count * sizeof(uint32_t);
+
+        if(model.m_meshlet_count == 0) continue;
+        VkBufferCopy meshlet_copy{};
+        meshlet_copy.srcOffset = (VkDeviceSize)model.m_meshlet_allocation.m_offset * sizeof(Meshlet);
+        model.m_meshlet_allocation = v_offset_allocate(g_geometry.m_meshlet_allocator, model.m_meshlet_count);
+        meshlet_copy.dstOffset = (VkDeviceSize)model.m_meshlet_allocation.m_offset * sizeof(Meshlet);
+        meshlet_copy.size = (VkDeviceSize)model.m_meshlet_count * sizeof(Meshlet);
+        meshlet_copies.push_back(meshlet_copy);
+    }
+
+    if(!models.empty())
+    {
+        v_immediate_submit([&](VkCommandBuffer command_buffer) {
+            // Uploads into the old pool may still be running on this queue
+            VkMemoryBarrier upload_barrier{};
+            upload_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            upload_barrier.pNext = nullptr;
+            upload_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            upload_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0, 1, &upload_barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdCopyBuffer(command_buffer, old_buffers[0].m_buffer, g_geometry.m_vertex_buffer.m_buffer,
+                (uint32_t)vertex_copies.size(), vertex_copies.data());
+            vkCmdCopyBuffer(command_buffer, old_buffers[1].m_buffer, g_geometry.m_index_buffer.m_buffer,
+                (uint32_t)index_copies.size(), index_copies.data());
+            if(meshlet_copies.empty()) return;
+            vkCmdCopyBuffer(command_buffer, old_buffers[2].m_buffer, g_geometry.m_meshlet_buffer.m_buffer,
+                (uint32_t)meshlet_copies.size(), meshlet_copies.data());
+        });
+    }
+
+    // The last frame may still draw from the old pool
+    for(uint32_t i=0; i < 3; i++) v_release_buffer(old_buffers[i], v_get_last_ticket(QUEUE_GRAPHICS));
+}
+
+void v_bind_geometry_pool(VkCommandBuffer command_buffer)
+{
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &g_geometry.m_vertex_buffer.m_buffer, &offset);
+    vkCmdBindIndexBuffer(command_buffer, g_geometry.m_index_buffer.m_buffer, 0, VK_INDEX_TYPE_UINT32);
+}
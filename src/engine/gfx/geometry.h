@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "buffer.h"
+#include "model.h"
+#include "meshlet.h"
+#include "../core/offset_allocator.h"
+
+// Every model's vertices and indices live in one device-local vertex buffer
+// and one index buffer, so a whole frame binds them once and can be drawn
+// with multi-draw indirect. A third buffer holds the meshlets of every model
+// for GPU culling. Capacities are in vertices, indices and meshlets.
+// The buffers are movable, so their handles change when the defragmenter
+// relocates them and must be read from g_geometry when recording.
+
+struct GeometryPool
+{
+    AllocatedBuffer m_vertex_buffer;
+    AllocatedBuffer m_index_buffer;
+    AllocatedBuffer m_meshlet_buffer;
+    OffsetAllocator m_vertex_allocator;
+    OffsetAllocator m_index_allocator;
+    OffsetAllocator m_meshlet_allocator;
+
+    // Every live model, so compaction can move their ranges
+    std::vector<Model*> m_models;
+    // Bumped by compaction, range frees still pending from before are dropped
+    uint32_t m_epoch;
+};
+
+extern GeometryPool g_geometry;
+
+// Main API
+
+void v_init_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity, uint32_t meshlet_capacity);
+void v_destroy_geometry_pool();
+
+// Uploads through a staging buffer on the transfer queue. When the pool is
+// out of space it is compacted, or grown if compacting would not free enough.
+// meshlet_count may be 0 for models drawn without meshlet culling
+bool v_allocate_geometry(Model& model, const Vertex* vertices, uint32_t vertex_count,
+    const uint32_t* indices, uint32_t index_count, const Meshlet* meshlets, uint32_t meshlet_count);
+// The ranges are released once the last submitted frame has finished
+void v_free_geometry(Model& model);
+
+// Repacks every model to the front of new buffers with the given capacities.
+// Waits for the copy only, the old buffers are destroyed once the last
+// submitted frame has finished with them.
+void v_compact_geometry_pool(uint32_t vertex_capacity, uint32_t index_capacity, uint32_t meshlet_capacity);
+
+void v_bind_geometry_pool(VkCommandBuffer command_buffer);
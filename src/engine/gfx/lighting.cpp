@@ -0,0 +1,194 @@
+#include <math.h>
+#include "lighting.h"
+
+#include "renderer.h"
+#include "memory.h"
+
+Lighting g_lighting = {};
+
+static void v_write_buffer_descriptor(uint32_t binding, VkDescriptorType type, VkBuffer buffer)
+{
+    VkDescriptorBufferInfo descriptor_buffer_info{};
+    descriptor_buffer_info.buffer = buffer;
+    descriptor_buffer_info.offset = 0;
+    descriptor_buffer_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = g_lighting.m_set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pBufferInfo = &descriptor_buffer_info;
+
+    vkUpdateDescriptorSets(g_renderer.m_device, 1, &write, 0, nullptr);
+}
+
+void v_init_lighting(uint32_t max_lights, const char* assign_shader_path)
+{
+    g_lighting.m_max_lights = max_lights;
+    g_lighting.m_brute_force = false;
+
+    // Params, lights, cluster counts, light indices
+    VkDescriptorSetLayoutBinding bindings[4];
+    for(uint32_t i=0; i < 4; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = 4;
+    set_layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_lighting.m_set_layout);
+
+    VkDescriptorPoolSize pool_sizes[2];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[0].descriptorCount = 1;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[1].descriptorCount = 3;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_lighting.m_descriptor_pool);
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_lighting.m_descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &g_lighting.m_set_layout;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, &g_lighting.m_set);
+
+    v_create_buffer(g_lighting.m_params_buffer, sizeof(ClusterParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_lighting.m_light_buffer, max_lights * sizeof(GpuLight), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_lighting.m_cluster_buffer, CLUSTER_COUNT * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_lighting.m_light_index_buffer, CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_TRANSIENT, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, g_lighting.m_params_buffer.m_allocation, &data);
+    g_lighting.m_params = (ClusterParams*)data;
+    vmaMapMemory(g_renderer.m_allocator, g_lighting.m_light_buffer.m_allocation, &data);
+    g_lighting.m_lights = (GpuLight*)data;
+    *g_lighting.m_params = {};
+
+    v_write_buffer_descriptor(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, g_lighting.m_params_buffer.m_buffer);
+    v_write_buffer_descriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_lighting.m_light_buffer.m_buffer);
+    v_write_buffer_descriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_lighting.m_cluster_buffer.m_buffer);
+    v_write_buffer_descriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_lighting.m_light_index_buffer.m_buffer);
+
+    // Set 0 is unused by the shader but keeps the set numbers of the graphics layouts
+    VkDescriptorSetLayout set_layouts[] = {g_renderer.m_instance_set_layout, g_lighting.m_set_layout};
+    g_lighting.m_assign_pipeline = v_create_compute_pipeline(assign_shader_path, 2, set_layouts, 0);
+}
+
+void v_destroy_lighting()
+{
+    v_destroy_compute_pipeline(g_lighting.m_assign_pipeline);
+    vmaUnmapMemory(g_renderer.m_allocator, g_lighting.m_light_buffer.m_allocation);
+    vmaUnmapMemory(g_renderer.m_allocator, g_lighting.m_params_buffer.m_allocation);
+    v_destroy_buffer(g_lighting.m_light_index_buffer);
+    v_destroy_buffer(g_lighting.m_cluster_buffer);
+    v_destroy_buffer(g_lighting.m_light_buffer);
+    v_destroy_buffer(g_lighting.m_params_buffer);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_lighting.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_lighting.m_set_layout, nullptr);
+}
+
+static void v_pack_light(const Light& light, GpuLight& gpu_light)
+{
+    hmm_vec3 color = light.m_color * light.m_intensity;
+    gpu_light.m_position_range = HMM_Vec4v(light.m_position, light.m_range);
+    gpu_light.m_bounds = HMM_Vec4v(light.m_position, light.m_range);
+
+    if(light.m_type == LIGHT_POINT)
+    {
+        gpu_light.m_color_spot_scale = HMM_Vec4v(color, 0.0f);
+        gpu_light.m_direction_spot_offset = HMM_Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    float cos_inner = cosf(light.m_inner_angle);
+    float cos_outer = cosf(light.m_outer_angle);
+    float spot_scale = 1.0f / HMM_MAX(cos_inner - cos_outer, 0.001f);
+    hmm_vec3 direction = HMM_NormalizeVec3(light.m_direction);
+    gpu_light.m_color_spot_scale = HMM_Vec4v(color, spot_scale);
+    gpu_light.m_direction_spot_offset = HMM_Vec4v(direction, -cos_outer * spot_scale);
+
+    // Narrow cones fit a sphere through the apex and the cap rim, wide ones
+    // one centered on the cap disc
+    if(light.m_outer_angle < HMM_PI32 * 0.25f)
+    {
+        float radius = light.m_range / (2.0f * cos_outer);
+        gpu_light.m_bounds = HMM_Vec4v(light.m_position + direction * radius, radius);
+    } else {
+        float radius = light.m_range * sinf(light.m_outer_angle);
+        gpu_light.m_bounds = HMM_Vec4v(light.m_position + direction * (light.m_range * cos_outer), radius);
+    }
+}
+
+void v_update_lighting(const hmm_mat4& view, const hmm_mat4& projection, float near_plane, float far_plane,
+    VkExtent2D render_extent, const Light* lights, uint32_t light_count)
+{
+    light_count = HMM_MIN(light_count, g_lighting.m_max_lights);
+    for(uint32_t i=0; i < light_count; i++) v_pack_light(lights[i], g_lighting.m_lights[i]);
+
+    float width = (float)render_extent.width;
+    float height = (float)render_extent.height;
+    float log_ratio = logf(far_plane / near_plane);
+
+    ClusterParams& params = *g_lighting.m_params;
+    params.m_view = view;
+    params.m_screen = HMM_Vec4(width, height, ceilf(width / CLUSTER_X), ceilf(height / CLUSTER_Y));
+    params.m_projection = HMM_Vec4(projection.Elements[0][0], projection.Elements[1][1], near_plane, far_plane);
+    params.m_slice_scale = CLUSTER_Z / log_ratio;
+    params.m_slice_bias = CLUSTER_Z * logf(near_plane) / log_ratio;
+    params.m_light_count = light_count;
+    params.m_brute_force = g_lighting.m_brute_force ? 1 : 0;
+}
+
+void v_assign_lights(VkCommandBuffer command_buffer)
+{
+    if(g_lighting.m_brute_force) return;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, g_lighting.m_assign_pipeline.m_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, g_lighting.m_assign_pipeline.m_pipeline_layout,
+        1, 1, &g_lighting.m_set, 0, nullptr);
+    vkCmdDispatch(command_buffer, (CLUSTER_COUNT + CLUSTER_GROUP_SIZE - 1) / CLUSTER_GROUP_SIZE, 1, 1);
+
+    // Frames do not overlap, so only this frame's fragment reads need to wait
+    VkBufferMemoryBarrier barriers[2];
+    AllocatedBuffer* buffers[] = {&g_lighting.m_cluster_buffer, &g_lighting.m_light_index_buffer};
+    for(uint32_t i=0; i < 2; i++)
+    {
+        barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barriers[i].pNext = nullptr;
+        barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].buffer = buffers[i]->m_buffer;
+        barriers[i].offset = 0;
+        barriers[i].size = VK_WHOLE_SIZE;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        0, 0, nullptr, 2, barriers, 0, nullptr);
+}
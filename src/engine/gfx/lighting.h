@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <HandmadeMath.h>
+
+#include "buffer.h"
+#include "pipeline.h"
+
+// Clustered forward lighting. The view frustum is split into a froxel grid,
+// uniform in screen space and exponential in depth. A compute pass assigns
+// every light to the froxels its bounding sphere touches, and the fragment
+// shader only walks the light list of its own froxel. The grid constants
+// have to match shaders/cluster.comp and shaders/shader.frag.
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define CLUSTER_GROUP_SIZE 128
+
+enum LightType
+{
+    LIGHT_POINT,
+    LIGHT_SPOT
+};
+
+struct Light
+{
+    LightType m_type;
+    hmm_vec3 m_position;
+    hmm_vec3 m_color;
+    float m_intensity;
+    float m_range;
+    // Spot lights only, half angles in radians
+    hmm_vec3 m_direction;
+    float m_inner_angle;
+    float m_outer_angle;
+};
+
+// std430 layout of shaders/cluster.comp. Point lights use a spot scale of 0
+// and offset of 1, so the fragment shader has no branch on the light type.
+struct GpuLight
+{
+    hmm_vec4 m_position_range;
+    hmm_vec4 m_color_spot_scale;
+    hmm_vec4 m_direction_spot_offset;
+    // World space bounding sphere of the lit volume
+    hmm_vec4 m_bounds;
+};
+
+// std140 uniform shared by the compute and fragment shaders
+struct ClusterParams
+{
+    hmm_mat4 m_view;
+    // Width, height, tile width, tile height
+    hmm_vec4 m_screen;
+    // Projection [0][0] and [1][1], near and far plane
+    hmm_vec4 m_projection;
+    // slice = log(depth) * scale - bias
+    float m_slice_scale;
+    float m_slice_bias;
+    uint32_t m_light_count;
+    uint32_t m_brute_force;
+};
+
+struct Lighting
+{
+    VkDescriptorSetLayout m_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_set;
+
+    // Mapped, rewritten every frame by v_update_lighting()
+    AllocatedBuffer m_params_buffer;
+    AllocatedBuffer m_light_buffer;
+    ClusterParams* m_params;
+    GpuLight* m_lights;
+    uint32_t m_max_lights;
+
+    // Written by the assignment pass: a light count per cluster and
+    // MAX_LIGHTS_PER_CLUSTER light indices per cluster
+    AllocatedBuffer m_cluster_buffer;
+    AllocatedBuffer m_light_index_buffer;
+    ComputePipeline m_assign_pipeline;
+
+    // Shade every fragment with every light, for comparison
+    bool m_brute_force;
+};
+
+extern Lighting g_lighting;
+
+// Main API
+
+// Like the instance buffer, before any graphics pipeline is created since
+// their layouts reference the lighting set layout as set 1
+void v_init_lighting(uint32_t max_lights, const char* assign_shader_path);
+void v_destroy_lighting();
+
+// Once per frame after v_acquire_frame(). Lights past max_lights are dropped.
+// Clusters are laid out over render_extent, the viewport the scene is drawn to.
+void v_update_lighting(const hmm_mat4& view, const hmm_mat4& projection, float near_plane, float far_plane,
+    VkExtent2D render_extent, const Light* lights, uint32_t light_count);
+// Dispatches the light assignment, outside of a render pass. Ends with a
+// barrier making the cluster lists visible to fragment shaders.
+void v_assign_lights(VkCommandBuffer command_buffer);
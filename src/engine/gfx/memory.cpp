@@ -0,0 +1,425 @@
+#include <list>
+#include <deque>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+#include "memory.h"
+
+#include "renderer.h"
+
+// Moves recorded per frame, keeps the copy work of a single frame bounded
+static const uint32_t MAX_MOVES_PER_PASS = 64;
+// Defragment once this much of a heap's blocks is unused, and at least
+// FRAGMENTATION_MIN_BYTES of it
+static const float FRAGMENTATION_THRESHOLD = 0.25f;
+static const VkDeviceSize FRAGMENTATION_MIN_BYTES = 32ull * 1024 * 1024;
+static const uint32_t DEFRAGMENTATION_COOLDOWN_FRAMES = 600;
+// Usage above PRESSURE_THRESHOLD of the budget asks the callback to get
+// back down to PRESSURE_TARGET
+static const float PRESSURE_THRESHOLD = 0.9f;
+static const float PRESSURE_TARGET = 0.8f;
+
+struct PendingMove
+{
+    VmaAllocation m_allocation;
+    VkBuffer m_new_buffer;
+};
+
+struct MemorySystem
+{
+    MemoryCategoryStats m_categories[MEMORY_CATEGORY_COUNT];
+
+    // Owners of every movable allocation, patched when the allocation moves
+    std::unordered_map<VmaAllocation, AllocatedBuffer*> m_owners;
+    // Movable buffers destroyed mid-defragmentation, freed once it ends
+    std::deque<AllocatedBuffer> m_deferred;
+    // Movable buffers released by v_release_buffer() until their ticket completes
+    std::list<AllocatedBuffer> m_released;
+
+    VmaDefragmentationContext m_defrag_context;
+    VmaDefragmentationStats m_defrag_stats;
+    std::vector<PendingMove> m_moves;
+    bool m_pass_in_flight;
+    bool m_defrag_requested;
+    uint32_t m_cooldown;
+
+    MemoryPressureCallback m_pressure_callback;
+    void* m_pressure_user_data;
+    uint32_t m_frame;
+};
+
+static MemorySystem g_memory;
+
+void v_init_memory()
+{
+    for(uint32_t i=0; i < MEMORY_CATEGORY_COUNT; i++) g_memory.m_categories[i] = {};
+
+    g_memory.m_defrag_context = VK_NULL_HANDLE;
+    g_memory.m_defrag_stats = {};
+    g_memory.m_pass_in_flight = false;
+    g_memory.m_defrag_requested = false;
+    g_memory.m_cooldown = 0;
+    g_memory.m_pressure_callback = nullptr;
+    g_memory.m_pressure_user_data = nullptr;
+    g_memory.m_frame = 0;
+}
+
+static void v_free_buffer(AllocatedBuffer& buffer)
+{
+    vmaDestroyBuffer(g_renderer.m_allocator, buffer.m_buffer, buffer.m_allocation);
+
+    MemoryCategoryStats& stats = g_memory.m_categories[buffer.m_category];
+    stats.m_bytes -= buffer.m_size;
+    stats.m_buffer_count--;
+
+    buffer.m_buffer = VK_NULL_HANDLE;
+    buffer.m_allocation = VK_NULL_HANDLE;
+}
+
+// Rebinds the owners of last frame's moves, the copies have finished by now
+static VkResult v_finish_defragmentation_pass()
+{
+    VkResult result = vmaEndDefragmentationPass(g_renderer.m_allocator, g_memory.m_defrag_context);
+
+    for(const auto& move : g_memory.m_moves)
+    {
+        AllocatedBuffer* owner = g_memory.m_owners[move.m_allocation];
+        vkDestroyBuffer(g_renderer.m_device, owner->m_buffer, nullptr);
+        owner->m_buffer = move.m_new_buffer;
+    }
+    g_memory.m_moves.clear();
+    g_memory.m_pass_in_flight = false;
+
+    return result;
+}
+
+static void v_end_defragmentation()
+{
+    vmaDefragmentationEnd(g_renderer.m_allocator, g_memory.m_defrag_context);
+    g_memory.m_defrag_context = VK_NULL_HANDLE;
+    g_memory.m_cooldown = DEFRAGMENTATION_COOLDOWN_FRAMES;
+
+    for(auto& buffer : g_memory.m_deferred)
+    {
+        g_memory.m_owners.erase(buffer.m_allocation);
+        v_free_buffer(buffer);
+    }
+    g_memory.m_deferred.clear();
+}
+
+void v_destroy_memory()
+{
+    if(g_memory.m_defrag_context)
+    {
+        if(g_memory.m_pass_in_flight) v_finish_defragmentation_pass();
+        v_end_defragmentation();
+    }
+}
+
+static void v_set_sharing_mode(VkBufferCreateInfo& buffer_info, uint32_t flags)
+{
+    if((flags & BUFFER_SHARED) && g_renderer.m_queue_families.size() > 1)
+    {
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = (uint32_t)g_renderer.m_queue_families.size();
+        buffer_info.pQueueFamilyIndices = g_renderer.m_queue_families.data();
+    } else buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+}
+
+VkResult v_create_buffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+    VmaMemoryUsage memory_usage, MemoryCategory category, uint32_t flags)
+{
+    // Moves are done with buffer copies
+    if(flags & BUFFER_MOVABLE) usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.pNext = nullptr;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    v_set_sharing_mode(buffer_info, flags);
+
+    VmaAllocationCreateInfo allocation_info{};
+    allocation_info.usage = memory_usage;
+    allocation_info.flags = VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+
+    VkResult result = vmaCreateBuffer(g_renderer.m_allocator, &buffer_info, &allocation_info,
+        &buffer.m_buffer, &buffer.m_allocation, nullptr);
+
+    // Over budget, give streaming a chance to evict and then allocate anyway
+    if(result == VK_ERROR_OUT_OF_DEVICE_MEMORY && g_memory.m_pressure_callback)
+    {
+        std::vector<HeapBudget> budgets;
+        v_get_heap_budgets(budgets);
+        for(uint32_t heap=0; heap < budgets.size(); heap++)
+        {
+            VkDeviceSize target = (VkDeviceSize)(budgets[heap].m_budget * PRESSURE_TARGET);
+            if(budgets[heap].m_usage + size > target)
+            {
+                g_memory.m_pressure_callback(heap, budgets[heap].m_usage + size - target, g_memory.m_pressure_user_data);
+            }
+        }
+
+        allocation_info.flags = 0;
+        result = vmaCreateBuffer(g_renderer.m_allocator, &buffer_info, &allocation_info,
+            &buffer.m_buffer, &buffer.m_allocation, nullptr);
+    }
+
+    if(result != VK_SUCCESS)
+    {
+        buffer.m_buffer = VK_NULL_HANDLE;
+        buffer.m_allocation = VK_NULL_HANDLE;
+        return result;
+    }
+
+    buffer.m_size = size;
+    buffer.m_usage = usage;
+    buffer.m_category = (uint8_t)category;
+    buffer.m_flags = (uint8_t)flags;
+
+    MemoryCategoryStats& stats = g_memory.m_categories[category];
+    stats.m_bytes += size;
+    stats.m_buffer_count++;
+
+    if(flags & BUFFER_MOVABLE) g_memory.m_owners[buffer.m_allocation] = &buffer;
+
+    return VK_SUCCESS;
+}
+
+void v_destroy_buffer(AllocatedBuffer& buffer)
+{
+    if(buffer.m_allocation == VK_NULL_HANDLE) return;
+
+    auto owner = g_memory.m_owners.find(buffer.m_allocation);
+    if(owner != g_memory.m_owners.end())
+    {
+        // The allocation may be part of the running defragmentation
+        if(g_memory.m_defrag_context)
+        {
+            g_memory.m_deferred.push_back(buffer);
+            owner->second = &g_memory.m_deferred.back();
+            buffer.m_buffer = VK_NULL_HANDLE;
+            buffer.m_allocation = VK_NULL_HANDLE;
+            return;
+        }
+        g_memory.m_owners.erase(owner);
+    }
+
+    v_free_buffer(buffer);
+}
+
+void v_release_buffer(AllocatedBuffer& buffer, SyncTicket ticket)
+{
+    auto owner = g_memory.m_owners.find(buffer.m_allocation);
+    if(owner == g_memory.m_owners.end())
+    {
+        AllocatedBuffer released = buffer;
+        v_defer_destruction(ticket, [released]() mutable { v_destroy_buffer(released); });
+    }
+    else
+    {
+        // The defragmenter patches the owner, so it must outlive the caller's copy
+        auto released = g_memory.m_released.insert(g_memory.m_released.end(), buffer);
+        owner->second = &*released;
+        v_defer_destruction(ticket, [released]() {
+            v_destroy_buffer(*released);
+            g_memory.m_released.erase(released);
+        });
+    }
+
+    buffer.m_buffer = VK_NULL_HANDLE;
+    buffer.m_allocation = VK_NULL_HANDLE;
+}
+
+void v_track_allocation(MemoryCategory category, VkDeviceSize size)
+{
+    MemoryCategoryStats& stats = g_memory.m_categories[category];
+    stats.m_bytes += size;
+    stats.m_buffer_count++;
+}
+
+void v_untrack_allocation(MemoryCategory category, VkDeviceSize size)
+{
+    MemoryCategoryStats& stats = g_memory.m_categories[category];
+    stats.m_bytes -= size;
+    stats.m_buffer_count--;
+}
+
+MemoryCategoryStats v_get_memory_category_stats(MemoryCategory category)
+{
+    return g_memory.m_categories[category];
+}
+
+void v_get_heap_budgets(std::vector<HeapBudget>& budgets)
+{
+    const VkPhysicalDeviceMemoryProperties* memory_properties;
+    vmaGetMemoryProperties(g_renderer.m_allocator, &memory_properties);
+
+    VmaBudget vma_budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetBudget(g_renderer.m_allocator, vma_budgets);
+
+    budgets.resize(memory_properties->memoryHeapCount);
+    for(uint32_t heap=0; heap < memory_properties->memoryHeapCount; heap++)
+    {
+        budgets[heap].m_flags = memory_properties->memoryHeaps[heap].flags;
+        budgets[heap].m_block_bytes = vma_budgets[heap].blockBytes;
+        budgets[heap].m_allocation_bytes = vma_budgets[heap].allocationBytes;
+        budgets[heap].m_usage = vma_budgets[heap].usage;
+        budgets[heap].m_budget = vma_budgets[heap].budget;
+    }
+}
+
+void v_print_memory_stats()
+{
+    const char* category_names[MEMORY_CATEGORY_COUNT] = {"geometry", "textures", "staging", "transient"};
+    const double mb = 1024.0 * 1024.0;
+
+    std::vector<HeapBudget> budgets;
+    v_get_heap_budgets(budgets);
+    for(uint32_t heap=0; heap < budgets.size(); heap++)
+    {
+        const HeapBudget& budget = budgets[heap];
+        std::cout << "heap " << heap << ((budget.m_flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device)" : " (host)")
+            << ": usage " << budget.m_usage / mb << " / " << budget.m_budget / mb << " MB, blocks "
+            << budget.m_block_bytes / mb << " MB, allocations " << budget.m_allocation_bytes / mb << " MB" << std::endl;
+    }
+
+    for(uint32_t i=0; i < MEMORY_CATEGORY_COUNT; i++)
+    {
+        std::cout << category_names[i] << ": " << g_memory.m_categories[i].m_buffer_count << " buffers, "
+            << g_memory.m_categories[i].m_bytes / mb << " MB" << std::endl;
+    }
+
+    std::cout << "defragmentation: " << g_memory.m_defrag_stats.allocationsMoved << " moves, "
+        << g_memory.m_defrag_stats.bytesMoved / mb << " MB moved, "
+        << g_memory.m_defrag_stats.bytesFreed / mb << " MB freed" << std::endl;
+}
+
+void v_set_memory_pressure_callback(MemoryPressureCallback callback, void* user_data)
+{
+    g_memory.m_pressure_callback = callback;
+    g_memory.m_pressure_user_data = user_data;
+}
+
+void v_request_defragmentation()
+{
+    g_memory.m_defrag_requested = true;
+}
+
+static void v_begin_defragmentation()
+{
+    std::vector<VmaAllocation> allocations;
+    allocations.reserve(g_memory.m_owners.size());
+    for(const auto& owner : g_memory.m_owners) allocations.push_back(owner.first);
+    if(allocations.empty()) return;
+
+    // CPU moves are disabled, those may overlap and we copy with the GPU
+    VmaDefragmentationInfo2 defrag_info{};
+    defrag_info.flags = VMA_DEFRAGMENTATION_FLAG_INCREMENTAL;
+    defrag_info.allocationCount = (uint32_t)allocations.size();
+    defrag_info.pAllocations = allocations.data();
+    defrag_info.maxCpuBytesToMove = 0;
+    defrag_info.maxCpuAllocationsToMove = 0;
+    defrag_info.maxGpuBytesToMove = VK_WHOLE_SIZE;
+    defrag_info.maxGpuAllocationsToMove = UINT32_MAX;
+    defrag_info.commandBuffer = VK_NULL_HANDLE;
+
+    VkResult result = vmaDefragmentationBegin(g_renderer.m_allocator, &defrag_info,
+        &g_memory.m_defrag_stats, &g_memory.m_defrag_context);
+
+    if(result != VK_NOT_READY && g_memory.m_defrag_context) v_end_defragmentation();
+}
+
+void v_update_memory()
+{
+    vmaSetCurrentFrameIndex(g_renderer.m_allocator, ++g_memory.m_frame);
+
+    if(g_memory.m_defrag_context && g_memory.m_pass_in_flight)
+    {
+        if(v_finish_defragmentation_pass() == VK_SUCCESS) v_end_defragmentation();
+    }
+
+    std::vector<HeapBudget> budgets;
+    v_get_heap_budgets(budgets);
+
+    bool fragmented = false;
+    for(uint32_t heap=0; heap < budgets.size(); heap++)
+    {
+        const HeapBudget& budget = budgets[heap];
+        if(g_memory.m_pressure_callback && budget.m_usage > budget.m_budget * PRESSURE_THRESHOLD)
+        {
+            VkDeviceSize target = (VkDeviceSize)(budget.m_budget * PRESSURE_TARGET);
+            g_memory.m_pressure_callback(heap, budget.m_usage - target, g_memory.m_pressure_user_data);
+        }
+
+        VkDeviceSize unused = budget.m_block_bytes - budget.m_allocation_bytes;
+        if(unused > FRAGMENTATION_MIN_BYTES && unused > budget.m_block_bytes * FRAGMENTATION_THRESHOLD) fragmented = true;
+    }
+
+    if(g_memory.m_cooldown > 0) g_memory.m_cooldown--;
+    if(!g_memory.m_defrag_context && (g_memory.m_defrag_requested || (fragmented && g_memory.m_cooldown == 0)))
+    {
+        g_memory.m_defrag_requested = false;
+        v_begin_defragmentation();
+    }
+}
+
+void v_record_defragmentation(VkCommandBuffer command_buffer)
+{
+    if(!g_memory.m_defrag_context || g_memory.m_pass_in_flight) return;
+
+    VmaDefragmentationPassMoveInfo moves[MAX_MOVES_PER_PASS];
+    VmaDefragmentationPassInfo pass_info{};
+    pass_info.moveCount = MAX_MOVES_PER_PASS;
+    pass_info.pMoves = moves;
+    vmaBeginDefragmentationPass(g_renderer.m_allocator, g_memory.m_defrag_context, &pass_info);
+
+    for(uint32_t i=0; i < pass_info.moveCount; i++)
+    {
+        AllocatedBuffer* owner = g_memory.m_owners[moves[i].allocation];
+
+        VkBufferCreateInfo buffer_info{};
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.pNext = nullptr;
+        buffer_info.size = owner->m_size;
+        buffer_info.usage = owner->m_usage;
+        v_set_sharing_mode(buffer_info, owner->m_flags);
+
+        PendingMove move;
+        move.m_allocation = moves[i].allocation;
+        vkCreateBuffer(g_renderer.m_device, &buffer_info, nullptr, &move.m_new_buffer);
+        vkBindBufferMemory(g_renderer.m_device, move.m_new_buffer, moves[i].memory, moves[i].offset);
+
+        VkBufferCopy region{};
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size = owner->m_size;
+        vkCmdCopyBuffer(command_buffer, owner->m_buffer, move.m_new_buffer, 1, &region);
+
+        g_memory.m_moves.push_back(move);
+    }
+
+    if(pass_info.moveCount > 0)
+    {
+        // The moved buffers are first read by the next frame's draws
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // Even an empty pass has to be ended to commit the plan
+    g_memory.m_pass_in_flight = true;
+}
+
+void v_finish_buffer_moves()
+{
+    if(!g_memory.m_pass_in_flight) return;
+
+    v_wait_ticket(v_get_last_ticket(QUEUE_GRAPHICS));
+    if(v_finish_defragmentation_pass() == VK_SUCCESS) v_end_defragmentation();
+}
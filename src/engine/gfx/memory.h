@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "buffer.h"
+#include "sync.h"
+
+// Memory accounting, budgets and incremental defragmentation on top of VMA
+
+enum MemoryCategory
+{
+    MEMORY_GEOMETRY,
+    MEMORY_TEXTURES,
+    MEMORY_STAGING,
+    MEMORY_TRANSIENT,
+    MEMORY_CATEGORY_COUNT
+};
+
+// Movable buffers can be relocated by the defragmenter. Their AllocatedBuffer
+// is patched in place, so it must not move in memory while the buffer lives,
+// and their contents must not be written by the CPU after the initial upload.
+// GPU writes from outside the frame need v_finish_buffer_moves() first.
+#define BUFFER_MOVABLE 0x1
+// Shared buffers are concurrently owned by every queue family of the renderer,
+// so they can be written on the transfer or compute queue and read on graphics
+// without ownership transfers.
+#define BUFFER_SHARED 0x2
+
+struct MemoryCategoryStats
+{
+    VkDeviceSize m_bytes;
+    uint32_t m_buffer_count;
+};
+
+struct HeapBudget
+{
+    VkMemoryHeapFlags m_flags;
+    VkDeviceSize m_block_bytes;
+    VkDeviceSize m_allocation_bytes;
+    VkDeviceSize m_usage;
+    VkDeviceSize m_budget;
+};
+
+// Called from v_update_memory() while a heap's usage is above the pressure
+// threshold. Streaming systems should free at least bytes_to_free.
+typedef void (*MemoryPressureCallback)(uint32_t heap_index, VkDeviceSize bytes_to_free, void* user_data);
+
+// Main API
+
+void v_init_memory();
+void v_destroy_memory();
+
+VkResult v_create_buffer(AllocatedBuffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage,
+    VmaMemoryUsage memory_usage, MemoryCategory category, uint32_t flags);
+void v_destroy_buffer(AllocatedBuffer& buffer);
+// Destroys the buffer once ticket is complete and resets the AllocatedBuffer.
+// Movable buffers are kept by the memory system until then, so the caller's
+// AllocatedBuffer can be reused right away.
+void v_release_buffer(AllocatedBuffer& buffer, SyncTicket ticket);
+// Accounting for memory allocated without v_create_buffer(), e.g. images
+void v_track_allocation(MemoryCategory category, VkDeviceSize size);
+void v_untrack_allocation(MemoryCategory category, VkDeviceSize size);
+
+MemoryCategoryStats v_get_memory_category_stats(MemoryCategory category);
+void v_get_heap_budgets(std::vector<HeapBudget>& budgets);
+void v_print_memory_stats();
+
+void v_set_memory_pressure_callback(MemoryPressureCallback callback, void* user_data);
+
+// Once per frame after v_acquire_frame() waited for the previous frame.
+// Finishes the previous defragmentation pass, checks budgets and starts
+// defragmenting when too much of the allocated blocks is unused.
+void v_update_memory();
+// Records the copies for the next defragmentation pass, must be called
+// outside of a render pass.
+void v_record_defragmentation(VkCommandBuffer command_buffer);
+// Waits for the moves recorded by the last frame and rebinds their buffers.
+// Copies reading a movable buffer on another queue would otherwise miss
+// writes that land after them.
+void v_finish_buffer_moves();
+void v_request_defragmentation();
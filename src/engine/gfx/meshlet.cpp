@@ -0,0 +1,170 @@
+#include <math.h>
+#include "meshlet.h"
+
+static const uint32_t MESHLET_NONE = 0xFFFFFFFF;
+static const uint8_t LOCAL_NONE = 0xFF;
+
+static hmm_vec3 v_get_position(const hmm_vec3* positions, uint32_t stride, uint32_t index)
+{
+    return *(const hmm_vec3*)((const char*)positions + (size_t)index * stride);
+}
+
+static void v_compute_bounds(Meshlet& meshlet, const MeshletData& data, const hmm_vec3* positions, uint32_t stride,
+    const std::vector<uint32_t>& indices)
+{
+    hmm_vec3 min = v_get_position(positions, stride, data.m_vertices[meshlet.m_first_vertex]);
+    hmm_vec3 max = min;
+    for(uint32_t i=0; i < meshlet.m_vertex_count; i++)
+    {
+        hmm_vec3 position = v_get_position(positions, stride, data.m_vertices[meshlet.m_first_vertex + i]);
+        min = HMM_Vec3(HMM_MIN(min.X, position.X), HMM_MIN(min.Y, position.Y), HMM_MIN(min.Z, position.Z));
+        max = HMM_Vec3(HMM_MAX(max.X, position.X), HMM_MAX(max.Y, position.Y), HMM_MAX(max.Z, position.Z));
+    }
+
+    hmm_vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t i=0; i < meshlet.m_vertex_count; i++)
+    {
+        hmm_vec3 position = v_get_position(positions, stride, data.m_vertices[meshlet.m_first_vertex + i]);
+        radius = HMM_MAX(radius, HMM_LengthVec3(position - center));
+    }
+    meshlet.m_center_radius = HMM_Vec4v(center, radius);
+
+    // Normal cone: the average normal, opened up to the widest triangle normal
+    std::vector<hmm_vec3> normals;
+    normals.reserve(meshlet.m_index_count / 3);
+    hmm_vec3 axis = HMM_Vec3(0.0f, 0.0f, 0.0f);
+    for(uint32_t i=0; i < meshlet.m_index_count; i += 3)
+    {
+        const uint32_t* triangle = &indices[meshlet.m_first_index + i];
+        hmm_vec3 p0 = v_get_position(positions, stride, triangle[0]);
+        hmm_vec3 p1 = v_get_position(positions, stride, triangle[1]);
+        hmm_vec3 p2 = v_get_position(positions, stride, triangle[2]);
+        // Front faces are clockwise, see v_create_graphics_pipeline()
+        hmm_vec3 normal = HMM_Cross(p2 - p0, p1 - p0);
+        float length = HMM_LengthVec3(normal);
+        if(length <= 1e-12f) continue;
+
+        normals.push_back(normal / length);
+        axis += normals.back();
+    }
+
+    float axis_length = HMM_LengthVec3(axis);
+    if(normals.empty() || axis_length <= 1e-6f)
+    {
+        meshlet.m_cone_axis_cutoff = HMM_Vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        return;
+    }
+    axis = axis / axis_length;
+
+    float min_dot = 1.0f;
+    for(const auto& normal : normals) min_dot = HMM_MIN(min_dot, HMM_DotVec3(axis, normal));
+
+    // Wider than about 84 degrees the cone rejects next to nothing
+    if(min_dot <= 0.1f)
+    {
+        meshlet.m_cone_axis_cutoff = HMM_Vec4v(axis, 1.0f);
+        return;
+    }
+
+    // Back-facing means outside the normal cone widened by 90 degrees:
+    // -cos(angle + 90) = sin(angle)
+    meshlet.m_cone_axis_cutoff = HMM_Vec4v(axis, sqrtf(1.0f - min_dot * min_dot));
+}
+
+void v_build_meshlets(MeshletData& data, const hmm_vec3* positions, uint32_t stride, uint32_t vertex_count,
+    std::vector<uint32_t>& indices)
+{
+    data.m_meshlets.clear();
+    data.m_vertices.clear();
+    data.m_local_indices.clear();
+    uint32_t triangle_count = (uint32_t)indices.size() / 3;
+
+    // Triangles around each vertex
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for(uint32_t i=0; i < triangle_count * 3; i++) adjacency_offsets[indices[i] + 1]++;
+    for(uint32_t i=0; i < vertex_count; i++) adjacency_offsets[i + 1] += adjacency_offsets[i];
+
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for(uint32_t i=0; i < triangle_count * 3; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<uint8_t> local(vertex_count, LOCAL_NONE);
+    std::vector<uint32_t> reordered;
+    reordered.reserve(triangle_count * 3);
+    data.m_local_indices.reserve(triangle_count * 3);
+
+    uint32_t seed = 0;
+    while(true)
+    {
+        while(seed < triangle_count && emitted[seed]) seed++;
+        if(seed == triangle_count) break;
+
+        Meshlet meshlet{};
+        meshlet.m_first_index = (uint32_t)reordered.size();
+        meshlet.m_first_vertex = (uint32_t)data.m_vertices.size();
+
+        uint32_t triangle = seed;
+        while(triangle != MESHLET_NONE)
+        {
+            emitted[triangle] = true;
+            for(uint32_t k=0; k < 3; k++)
+            {
+                uint32_t vertex = indices[triangle * 3 + k];
+                if(local[vertex] == LOCAL_NONE)
+                {
+                    local[vertex] = (uint8_t)meshlet.m_vertex_count++;
+                    data.m_vertices.push_back(vertex);
+                }
+                reordered.push_back(vertex);
+                data.m_local_indices.push_back(local[vertex]);
+            }
+            meshlet.m_index_count += 3;
+            if(meshlet.m_index_count == MESHLET_MAX_TRIANGLES * 3) break;
+
+            // Neighbour adding the fewest new vertices, stop once none fits
+            triangle = MESHLET_NONE;
+            uint32_t best_new = 3;
+            for(uint32_t i=0; i < meshlet.m_vertex_count && best_new > 0; i++)
+            {
+                uint32_t vertex = data.m_vertices[meshlet.m_first_vertex + i];
+                for(uint32_t a=adjacency_offsets[vertex]; a < adjacency_offsets[vertex + 1]; a++)
+                {
+                    uint32_t candidate = adjacency[a];
+                    if(emitted[candidate]) continue;
+
+                    uint32_t new_vertices = 0;
+                    for(uint32_t k=0; k < 3; k++) new_vertices += local[indices[candidate * 3 + k]] == LOCAL_NONE;
+                    if(meshlet.m_vertex_count + new_vertices > MESHLET_MAX_VERTICES) continue;
+                    if(triangle == MESHLET_NONE || new_vertices < best_new)
+                    {
+                        triangle = candidate;
+                        best_new = new_vertices;
+                        if(best_new == 0) break;
+                    }
+                }
+            }
+        }
+
+        for(uint32_t i=0; i < meshlet.m_vertex_count; i++) local[data.m_vertices[meshlet.m_first_vertex + i]] = LOCAL_NONE;
+        data.m_meshlets.push_back(meshlet);
+    }
+
+    indices.swap(reordered);
+    for(auto& meshlet : data.m_meshlets) v_compute_bounds(meshlet, data, positions, stride, indices);
+}
+
+bool v_is_meshlet_visible(const Meshlet& meshlet, const hmm_vec4 planes[6], hmm_vec3 camera_position)
+{
+    hmm_vec3 center = meshlet.m_center_radius.XYZ;
+    float radius = meshlet.m_center_radius.W;
+    for(uint32_t p=0; p < 6; p++)
+    {
+        if(HMM_DotVec3(planes[p].XYZ, center) + planes[p].W < -radius) return false;
+    }
+
+    hmm_vec3 offset = center - camera_position;
+    hmm_vec3 axis = meshlet.m_cone_axis_cutoff.XYZ;
+    return HMM_DotVec3(offset, axis) < meshlet.m_cone_axis_cutoff.W * HMM_LengthVec3(offset) + radius;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <HandmadeMath.h>
+
+// Meshlets are small clusters of a mesh's triangles, culled on the GPU as a
+// unit: by bounding sphere against the frustum and by normal cone against the
+// camera position. The limits are the ones recommended for mesh shaders.
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// std430 layout of shaders/meshlet_cull.comp
+struct Meshlet
+{
+    hmm_vec4 m_center_radius;
+    // Every triangle faces away from positions p with
+    // dot(center - p, axis) >= cutoff * length(center - p) + radius.
+    // A cutoff of 1 never culls.
+    hmm_vec4 m_cone_axis_cutoff;
+    // Into the mesh's index list, which the builder orders meshlet by meshlet
+    uint32_t m_first_index;
+    uint32_t m_index_count;
+    // Into MeshletData::m_vertices
+    uint32_t m_first_vertex;
+    uint32_t m_vertex_count;
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> m_meshlets;
+    // Mesh vertices used by each meshlet, and for every entry of the index
+    // list its position in the meshlet's vertex list. This is what a mesh
+    // shader would read, the indexed path only needs the index ranges.
+    std::vector<uint32_t> m_vertices;
+    std::vector<uint8_t> m_local_indices;
+};
+
+// Main API
+
+// Positions are read with stride bytes between them. Grows each meshlet from
+// a seed triangle with the neighbours adding the fewest new vertices, then
+// reorders indices in place so every meshlet is one contiguous range.
+void v_build_meshlets(MeshletData& data, const hmm_vec3* positions, uint32_t stride, uint32_t vertex_count,
+    std::vector<uint32_t>& indices);
+
+// The test of the culling shader, with planes and camera in mesh space
+bool v_is_meshlet_visible(const Meshlet& meshlet, const hmm_vec4 planes[6], hmm_vec3 camera_position);
@@ -0,0 +1,266 @@
+#include "meshlet_culling.h"
+
+#include "renderer.h"
+#include "geometry.h"
+#include "depth_pyramid.h"
+#include "memory.h"
+
+MeshletCulling g_meshlet_culling = {};
+
+static const uint32_t BINDING_COUNT = 7;
+
+static void v_write_buffer_descriptor(uint32_t binding, VkDescriptorType type, VkBuffer buffer)
+{
+    VkDescriptorBufferInfo descriptor_buffer_info{};
+    descriptor_buffer_info.buffer = buffer;
+    descriptor_buffer_info.offset = 0;
+    descriptor_buffer_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = g_meshlet_culling.m_set;
+    write.dstBinding = binding;
+    write.descriptorCount = 1;
+    write.descriptorType = type;
+    write.pBufferInfo = &descriptor_buffer_info;
+
+    vkUpdateDescriptorSets(g_renderer.m_device, 1, &write, 0, nullptr);
+}
+
+static void v_write_pyramid_descriptor()
+{
+    g_meshlet_culling.m_bound_pyramid_view = g_depth_pyramid.m_view;
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = g_depth_pyramid.m_sampler;
+    image_info.imageView = g_depth_pyramid.m_view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.pNext = nullptr;
+    write.dstSet = g_meshlet_culling.m_set;
+    write.dstBinding = 6;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(g_renderer.m_device, 1, &write, 0, nullptr);
+}
+
+void v_init_meshlet_culling(uint32_t max_jobs, const char* shader_path)
+{
+    g_meshlet_culling.m_max_jobs = max_jobs;
+    g_meshlet_culling.m_job_count = 0;
+    g_meshlet_culling.m_enabled = true;
+    g_meshlet_culling.m_occlusion = true;
+    g_meshlet_culling.m_occlusion_active = false;
+    g_meshlet_culling.m_stats_written = false;
+    g_meshlet_culling.m_stats = {};
+
+    // Meshlets, jobs, indirect commands, occluded flags, stats, params, pyramid
+    VkDescriptorType types[BINDING_COUNT] = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    };
+    VkDescriptorSetLayoutBinding bindings[BINDING_COUNT];
+    for(uint32_t i=0; i < BINDING_COUNT; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = types[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = BINDING_COUNT;
+    set_layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_meshlet_culling.m_set_layout);
+
+    VkDescriptorPoolSize pool_sizes[3];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 5;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[1].descriptorCount = 1;
+    pool_sizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[2].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 3;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_meshlet_culling.m_descriptor_pool);
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_meshlet_culling.m_descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &g_meshlet_culling.m_set_layout;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, &g_meshlet_culling.m_set);
+
+    v_create_buffer(g_meshlet_culling.m_job_buffer, max_jobs * sizeof(MeshletCullJob), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_meshlet_culling.m_params_buffer, sizeof(MeshletCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_meshlet_culling.m_occluded_buffer, g_renderer.m_max_indirect_draws * sizeof(uint32_t),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MEMORY_TRANSIENT, 0);
+    v_create_buffer(g_meshlet_culling.m_stats_buffer, sizeof(MeshletCullStats),
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU, MEMORY_TRANSIENT, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, g_meshlet_culling.m_job_buffer.m_allocation, &data);
+    g_meshlet_culling.m_jobs = (MeshletCullJob*)data;
+    vmaMapMemory(g_renderer.m_allocator, g_meshlet_culling.m_params_buffer.m_allocation, &data);
+    g_meshlet_culling.m_params = (MeshletCullParams*)data;
+    *g_meshlet_culling.m_params = {};
+
+    g_meshlet_culling.m_bound_meshlet_buffer = g_geometry.m_meshlet_buffer.m_buffer;
+    v_write_buffer_descriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_geometry.m_meshlet_buffer.m_buffer);
+    v_write_buffer_descriptor(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_meshlet_culling.m_job_buffer.m_buffer);
+    v_write_buffer_descriptor(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_renderer.m_indirect_buffer.m_buffer);
+    v_write_buffer_descriptor(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_meshlet_culling.m_occluded_buffer.m_buffer);
+    v_write_buffer_descriptor(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_meshlet_culling.m_stats_buffer.m_buffer);
+    v_write_buffer_descriptor(5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, g_meshlet_culling.m_params_buffer.m_buffer);
+    v_write_pyramid_descriptor();
+
+    // Set 0 is the instance set for the world matrices, the phase is a push constant
+    VkDescriptorSetLayout set_layouts[] = {g_renderer.m_instance_set_layout, g_meshlet_culling.m_set_layout};
+    g_meshlet_culling.m_pipeline = v_create_compute_pipeline(shader_path, 2, set_layouts, sizeof(uint32_t));
+}
+
+void v_destroy_meshlet_culling()
+{
+    v_destroy_compute_pipeline(g_meshlet_culling.m_pipeline);
+    vmaUnmapMemory(g_renderer.m_allocator, g_meshlet_culling.m_params_buffer.m_allocation);
+    vmaUnmapMemory(g_renderer.m_allocator, g_meshlet_culling.m_job_buffer.m_allocation);
+    v_destroy_buffer(g_meshlet_culling.m_stats_buffer);
+    v_destroy_buffer(g_meshlet_culling.m_occluded_buffer);
+    v_destroy_buffer(g_meshlet_culling.m_params_buffer);
+    v_destroy_buffer(g_meshlet_culling.m_job_buffer);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_meshlet_culling.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_meshlet_culling.m_set_layout, nullptr);
+}
+
+void v_update_meshlet_culling(const hmm_mat4& view, const hmm_mat4& projection, float near_plane,
+    const hmm_vec4 frustum[6], hmm_vec3 camera_position)
+{
+    // The previous frame finished in v_acquire_frame()
+    if(g_meshlet_culling.m_stats_written)
+    {
+        void* data;
+        vmaMapMemory(g_renderer.m_allocator, g_meshlet_culling.m_stats_buffer.m_allocation, &data);
+        vmaInvalidateAllocation(g_renderer.m_allocator, g_meshlet_culling.m_stats_buffer.m_allocation, 0, VK_WHOLE_SIZE);
+        g_meshlet_culling.m_stats = *(MeshletCullStats*)data;
+        vmaUnmapMemory(g_renderer.m_allocator, g_meshlet_culling.m_stats_buffer.m_allocation);
+    }
+
+    // The depth buffer has the window extent. A resized pyramid is replaced
+    // before the culling set is bound, and is not usable until it was built.
+    v_resize_depth_pyramid(g_renderer.m_win_extent);
+    if(g_meshlet_culling.m_bound_pyramid_view != g_depth_pyramid.m_view) v_write_pyramid_descriptor();
+    g_meshlet_culling.m_occlusion_active = g_meshlet_culling.m_occlusion && v_is_depth_pyramid_usable(g_renderer.m_win_extent);
+
+    MeshletCullParams& params = *g_meshlet_culling.m_params;
+    for(uint32_t i=0; i < 6; i++) params.m_frustum[i] = frustum[i];
+    params.m_camera_position = HMM_Vec4v(camera_position, 1.0f);
+    params.m_view = view;
+    params.m_projection = HMM_Vec4(projection.Elements[0][0], projection.Elements[1][1],
+        projection.Elements[2][2], projection.Elements[3][2]);
+    params.m_pyramid = HMM_Vec4((float)g_depth_pyramid.m_extent.width, (float)g_depth_pyramid.m_extent.height,
+        (float)g_depth_pyramid.m_level_count, near_plane);
+    params.m_occlusion = g_meshlet_culling.m_occlusion_active ? 1 : 0;
+}
+
+static void v_bind_culling(VkCommandBuffer command_buffer, uint32_t phase)
+{
+    ComputePipeline& pipeline = g_meshlet_culling.m_pipeline;
+    VkDescriptorSet sets[] = {g_renderer.m_instance_set, g_meshlet_culling.m_set};
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.m_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.m_pipeline_layout,
+        0, 2, sets, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline.m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &phase);
+}
+
+static void v_commands_barrier(VkCommandBuffer command_buffer)
+{
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = g_renderer.m_indirect_buffer.m_buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    // Stats are read on the CPU once the frame has finished
+    VkMemoryBarrier stats_barrier{};
+    stats_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    stats_barrier.pNext = nullptr;
+    stats_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    stats_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &stats_barrier, 1, &barrier, 0, nullptr);
+}
+
+void v_dispatch_meshlet_culling(VkCommandBuffer command_buffer, uint32_t job_count)
+{
+    g_meshlet_culling.m_job_count = job_count;
+    if(job_count == 0) return;
+
+    // The previous frame has finished, the set is not in use
+    if(g_meshlet_culling.m_bound_meshlet_buffer != g_geometry.m_meshlet_buffer.m_buffer)
+    {
+        g_meshlet_culling.m_bound_meshlet_buffer = g_geometry.m_meshlet_buffer.m_buffer;
+        v_write_buffer_descriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, g_geometry.m_meshlet_buffer.m_buffer);
+    }
+
+    vkCmdFillBuffer(command_buffer, g_meshlet_culling.m_stats_buffer.m_buffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier clear_barrier{};
+    clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clear_barrier.pNext = nullptr;
+    clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0, 1, &clear_barrier, 0, nullptr, 0, nullptr);
+
+    v_bind_culling(command_buffer, 0);
+    vkCmdDispatch(command_buffer, job_count, 1, 1);
+    v_commands_barrier(command_buffer);
+    g_meshlet_culling.m_stats_written = true;
+}
+
+void v_dispatch_meshlet_culling_late(VkCommandBuffer command_buffer)
+{
+    if(!g_meshlet_culling.m_occlusion_active || g_meshlet_culling.m_job_count == 0) return;
+
+    // The early draws have read the commands, and the early phase's flags and
+    // stats have to be visible
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    v_bind_culling(command_buffer, 1);
+    vkCmdDispatch(command_buffer, g_meshlet_culling.m_job_count, 1, 1);
+    v_commands_barrier(command_buffer);
+}
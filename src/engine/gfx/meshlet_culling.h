@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <HandmadeMath.h>
+
+#include "buffer.h"
+#include "pipeline.h"
+
+// GPU meshlet culling. Every draw of a model with meshlets becomes a job; the
+// compute pass tests each meshlet of the job against the frustum and its
+// normal cone and writes one indexed indirect command per meshlet, with an
+// index count of 0 for rejected ones. Workgroup size has to match
+// shaders/meshlet_cull.comp.
+//
+// With occlusion culling the pass runs twice per frame. The early phase also
+// tests meshlets against the depth pyramid of the previous frame, projected
+// with the current camera, and the visible ones are drawn. After the pyramid
+// is rebuilt from that depth, the late phase re-tests only the meshlets the
+// early phase found occluded, so anything the stale pyramid hid by mistake
+// is drawn in a second pass. Meshlets only drawn late are missing from the
+// next pyramid, which only makes it more conservative.
+
+#define MESHLET_CULL_GROUP_SIZE 64
+
+// std430 layout of shaders/meshlet_cull.comp
+struct MeshletCullJob
+{
+    uint32_t m_instance;
+    // Into the geometry pool meshlet buffer
+    uint32_t m_first_meshlet;
+    uint32_t m_meshlet_count;
+    // Into the renderer indirect buffer, one command per meshlet
+    uint32_t m_first_command;
+    // Model ranges of the geometry pool
+    uint32_t m_first_index;
+    int32_t m_vertex_offset;
+    uint32_t m_pad[2];
+};
+
+// std140 uniform of shaders/meshlet_cull.comp
+struct MeshletCullParams
+{
+    // World space, see v_extract_frustum()
+    hmm_vec4 m_frustum[6];
+    hmm_vec4 m_camera_position;
+    hmm_mat4 m_view;
+    // Projection [0][0], [1][1], [2][2] and [3][2]
+    hmm_vec4 m_projection;
+    // Pyramid width, height and level count, near plane
+    hmm_vec4 m_pyramid;
+    uint32_t m_occlusion;
+    uint32_t m_pad[3];
+};
+
+// Meshlets rejected by each test, in the last finished frame
+struct MeshletCullStats
+{
+    uint32_t m_frustum_culled;
+    uint32_t m_cone_culled;
+    uint32_t m_occluded;
+    // Occluded early but visible in the late phase
+    uint32_t m_recovered;
+};
+
+struct MeshletCulling
+{
+    VkDescriptorSetLayout m_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_set;
+    // Compaction and resizes replace these, the descriptors follow them
+    VkBuffer m_bound_meshlet_buffer;
+    VkImageView m_bound_pyramid_view;
+
+    // Mapped, rewritten every frame by v_prepare_render_queue()
+    AllocatedBuffer m_job_buffer;
+    MeshletCullJob* m_jobs;
+    uint32_t m_max_jobs;
+    uint32_t m_job_count;
+
+    // Mapped, rewritten every frame by v_update_meshlet_culling()
+    AllocatedBuffer m_params_buffer;
+    MeshletCullParams* m_params;
+
+    // One flag per indirect command, set when the early phase found it occluded
+    AllocatedBuffer m_occluded_buffer;
+    // MeshletCullStats, read back one frame late
+    AllocatedBuffer m_stats_buffer;
+    bool m_stats_written;
+    MeshletCullStats m_stats;
+
+    ComputePipeline m_pipeline;
+
+    // Off draws every model as a whole
+    bool m_enabled;
+    bool m_occlusion;
+    // m_occlusion with a valid pyramid, fixed for the frame by v_update_meshlet_culling()
+    bool m_occlusion_active;
+};
+
+extern MeshletCulling g_meshlet_culling;
+
+// Main API
+
+// After v_init_instance_buffer(), v_init_indirect_buffer(), v_init_geometry_pool()
+// and v_init_depth_pyramid()
+void v_init_meshlet_culling(uint32_t max_jobs, const char* shader_path);
+void v_destroy_meshlet_culling();
+
+// Once per frame after v_acquire_frame(), also collects the last frame's stats
+void v_update_meshlet_culling(const hmm_mat4& view, const hmm_mat4& projection, float near_plane,
+    const hmm_vec4 frustum[6], hmm_vec3 camera_position);
+// Early phase, outside of a render pass with m_jobs filled. Ends with a
+// barrier making the commands visible to indirect draws.
+void v_dispatch_meshlet_culling(VkCommandBuffer command_buffer, uint32_t job_count);
+// Late phase, after v_build_depth_pyramid(). Rewrites the same commands so
+// only the recovered meshlets are drawn again. Does nothing without
+// occlusion culling this frame.
+void v_dispatch_meshlet_culling_late(VkCommandBuffer command_buffer);
@@ -1,9 +1,30 @@
 #include <string>
+#include <fstream>
+#include <unordered_map>
 #include <vk_mem_alloc.h>
 #include <tiny_obj_loader.h>
 
 #include "model.h"
-#include "renderer.h"
+#include "geometry.h"
+#include "meshlet.h"
+#include "../core/allocator.h"
+
+// Bump when the cooked layout or the meshlet builder changes
+static const uint32_t COOKED_MESH_MAGIC = 0x4853454D;
+static const uint32_t COOKED_MESH_VERSION = 1;
+
+struct CookedMeshHeader
+{
+    uint32_t m_magic;
+    uint32_t m_version;
+    uint64_t m_source_hash;
+    uint32_t m_vertex_count;
+    uint32_t m_index_count;
+    uint32_t m_meshlet_count;
+    uint32_t m_meshlet_vertex_count;
+    hmm_vec3 m_bounds_center;
+    float m_bounds_radius;
+};
 
 VertexInputDescription v_get_vertex_decription()
 {
@@ -40,60 +61,217 @@ VertexInputDescription v_get_vertex_decription()
     return description;
 }
 
-Model v_load_model(const char* file_path)
+static uint64_t v_hash_file(const char* file_path, Arena& arena)
+{
+    std::ifstream file(file_path, std::ios::ate | std::ios::binary);
+    if(!file.is_open()) return 0;
+
+    size_t file_size = (size_t)file.tellg();
+    ArenaScope scope(arena);
+    char* buffer = v_arena_push<char>(arena, file_size);
+    file.seekg(0); file.read(buffer, file_size); file.close();
+
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(size_t i=0; i < file_size; i++)
+    {
+        hash ^= (uint8_t)buffer[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64_t v_hash_file(const char* file_path)
+{
+    return v_hash_file(file_path, g_scratch_arena);
+}
+
+static bool v_read_cooked_mesh(const std::string& cooked_path, uint64_t source_hash, CookedMeshHeader& header,
+    ArenaVector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshletData& meshlets)
 {
-    Model model;
+    std::ifstream file(cooked_path, std::ios::binary);
+    if(!file.is_open()) return false;
 
+    file.read((char*)&header, sizeof(header));
+    if(!file || header.m_magic != COOKED_MESH_MAGIC || header.m_version != COOKED_MESH_VERSION) return false;
+    if(header.m_source_hash != source_hash) return false;
+
+    vertices.resize(header.m_vertex_count);
+    indices.resize(header.m_index_count);
+    meshlets.m_meshlets.resize(header.m_meshlet_count);
+    meshlets.m_vertices.resize(header.m_meshlet_vertex_count);
+    meshlets.m_local_indices.resize(header.m_index_count);
+
+    file.read((char*)vertices.data(), vertices.size() * sizeof(Vertex));
+    file.read((char*)indices.data(), indices.size() * sizeof(uint32_t));
+    file.read((char*)meshlets.m_meshlets.data(), meshlets.m_meshlets.size() * sizeof(Meshlet));
+    file.read((char*)meshlets.m_vertices.data(), meshlets.m_vertices.size() * sizeof(uint32_t));
+    file.read((char*)meshlets.m_local_indices.data(), meshlets.m_local_indices.size());
+    return (bool)file;
+}
+
+static void v_write_cooked_mesh(const std::string& cooked_path, const CookedMeshHeader& header,
+    const ArenaVector<Vertex>& vertices, const std::vector<uint32_t>& indices, const MeshletData& meshlets)
+{
+    // A missing cache is not an error, the mesh is imported again next time
+    std::ofstream file(cooked_path, std::ios::binary);
+    if(!file.is_open()) return;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)vertices.data(), vertices.size() * sizeof(Vertex));
+    file.write((const char*)indices.data(), indices.size() * sizeof(uint32_t));
+    file.write((const char*)meshlets.m_meshlets.data(), meshlets.m_meshlets.size() * sizeof(Meshlet));
+    file.write((const char*)meshlets.m_vertices.data(), meshlets.m_vertices.size() * sizeof(uint32_t));
+    file.write((const char*)meshlets.m_local_indices.data(), meshlets.m_local_indices.size());
+}
+
+static bool v_import_obj(const char* file_path, ArenaVector<Vertex>& vertices, std::vector<uint32_t>& indices, Arena& arena)
+{
     tinyobj::attrib_t vertex_attribute;
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
     std::string warning;
     std::string error;
 
-    tinyobj::LoadObj(&vertex_attribute, &shapes, &materials, &warning, &error, file_path, nullptr);
+    if(!tinyobj::LoadObj(&vertex_attribute, &shapes, &materials, &warning, &error, file_path, nullptr)) return false;
+
+    size_t index_count = 0;
+    for(const auto& shape : shapes) index_count += shape.mesh.indices.size();
+    vertices.reserve(index_count);
+    indices.reserve(index_count);
+
+    // obj indexes positions and normals separately, each unique pair becomes one vertex
+    typedef std::pair<const uint64_t, uint32_t> UniqueVertex;
+    std::unordered_map<uint64_t, uint32_t, std::hash<uint64_t>, std::equal_to<uint64_t>, ArenaAllocator<UniqueVertex>>
+        unique_vertices(index_count, std::hash<uint64_t>(), std::equal_to<uint64_t>(), ArenaAllocator<UniqueVertex>(arena));
 
     for(const auto& shape : shapes)
     {
         for(const auto& idx: shape.mesh.indices)
         {
+            uint64_t key = ((uint64_t)(uint32_t)idx.vertex_index << 32) | (uint32_t)idx.normal_index;
+            auto it = unique_vertices.find(key);
+            if(it != unique_vertices.end())
+            {
+                indices.push_back(it->second);
+                continue;
+            }
+
             Vertex new_vertex;
                 
             new_vertex.m_position.X = vertex_attribute.vertices[3 * idx.vertex_index + 0];
             new_vertex.m_position.Y = vertex_attribute.vertices[3 * idx.vertex_index + 1];
             new_vertex.m_position.Z = vertex_attribute.vertices[3 * idx.vertex_index + 2];
 
-            new_vertex.m_normal.X = vertex_attribute.normals[3 * idx.vertex_index + 0];
-            new_vertex.m_normal.Y = vertex_attribute.normals[3 * idx.vertex_index + 1];
-            new_vertex.m_normal.Z = vertex_attribute.normals[3 * idx.vertex_index + 2];
+            if(idx.normal_index >= 0)
+            {
+                new_vertex.m_normal.X = vertex_attribute.normals[3 * idx.normal_index + 0];
+                new_vertex.m_normal.Y = vertex_attribute.normals[3 * idx.normal_index + 1];
+                new_vertex.m_normal.Z = vertex_attribute.normals[3 * idx.normal_index + 2];
+            } else new_vertex.m_normal = HMM_Vec3(0.0f, 0.0f, 0.0f);
 
             new_vertex.m_color = new_vertex.m_normal;
 
-            model.m_vertices.push_back(new_vertex);
+            uint32_t index = (uint32_t)vertices.size();
+            unique_vertices[key] = index;
+            vertices.push_back(new_vertex);
+            indices.push_back(index);
+        }
+    }
+
+    return !vertices.empty();
+}
 
+bool v_load_model(Model& model, const char* file_path)
+{
+    return v_load_model(model, file_path, v_hash_file(file_path));
+}
+
+// Fills data for data.m_source_hash
+static bool v_read_model_data(ModelData& data, const char* file_path, Arena& arena)
+{
+    ArenaVector<Vertex>& vertices = data.m_vertices;
+    std::vector<uint32_t>& indices = data.m_indices;
+    MeshletData& meshlets = data.m_meshlets;
+    CookedMeshHeader header{};
+
+    std::string cooked_path = std::string(file_path) + ".mesh";
+
+    if(!v_read_cooked_mesh(cooked_path, data.m_source_hash, header, vertices, indices, meshlets))
+    {
+        vertices.clear();
+        indices.clear();
+        meshlets = MeshletData();
+        if(!v_import_obj(file_path, vertices, indices, arena)) return false;
+
+        hmm_vec3 min = vertices[0].m_position;
+        hmm_vec3 max = vertices[0].m_position;
+        for(const auto& vertex : vertices)
+        {
+            min = HMM_Vec3(HMM_MIN(min.X, vertex.m_position.X), HMM_MIN(min.Y, vertex.m_position.Y), HMM_MIN(min.Z, vertex.m_position.Z));
+            max = HMM_Vec3(HMM_MAX(max.X, vertex.m_position.X), HMM_MAX(max.Y, vertex.m_position.Y), HMM_MAX(max.Z, vertex.m_position.Z));
+        }
+        header.m_bounds_center = (min + max) * 0.5f;
+        header.m_bounds_radius = 0.0f;
+        for(const auto& vertex : vertices)
+        {
+            header.m_bounds_radius = HMM_MAX(header.m_bounds_radius, HMM_LengthVec3(vertex.m_position - header.m_bounds_center));
         }
+
+        v_build_meshlets(meshlets, &vertices[0].m_position, sizeof(Vertex), (uint32_t)vertices.size(), indices);
+
+        header.m_magic = COOKED_MESH_MAGIC;
+        header.m_version = COOKED_MESH_VERSION;
+        header.m_source_hash = data.m_source_hash;
+        header.m_vertex_count = (uint32_t)vertices.size();
+        header.m_index_count = (uint32_t)indices.size();
+        header.m_meshlet_count = (uint32_t)meshlets.m_meshlets.size();
+        header.m_meshlet_vertex_count = (uint32_t)meshlets.m_vertices.size();
+        v_write_cooked_mesh(cooked_path, header, vertices, indices, meshlets);
     }
 
-    VkBufferCreateInfo buffer_info{};
-    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    buffer_info.pNext = nullptr;
-    buffer_info.size = model.m_vertices.size() * sizeof(Vertex);
-    buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    data.m_bounds_center = header.m_bounds_center;
+    data.m_bounds_radius = header.m_bounds_radius;
+    return true;
+}
 
-    VmaAllocationCreateInfo allocation_info{};
-    allocation_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+bool v_load_model(Model& model, const char* file_path, uint64_t source_hash)
+{
+    model.m_vertex_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_index_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_meshlet_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
 
-    vmaCreateBuffer(g_renderer.m_allocator, &buffer_info, &allocation_info,
-        &model.m_vertex_buffer.m_buffer, &model.m_vertex_buffer.m_allocation, nullptr);
+    // Everything temporary comes from the scratch arena, except what tinyobj and
+    // the meshlet builder allocate themselves
+    ArenaScope scope(g_scratch_arena);
+    ModelData data(g_scratch_arena);
+    data.m_source_hash = source_hash;
+    if(!v_read_model_data(data, file_path, g_scratch_arena)) return false;
 
-    void* data;
-    vmaMapMemory(g_renderer.m_allocator, model.m_vertex_buffer.m_allocation, &data);
-    memcpy(data, model.m_vertices.data(), model.m_vertices.size() * sizeof(Vertex));
-    vmaUnmapMemory(g_renderer.m_allocator, model.m_vertex_buffer.m_allocation);
+    return v_upload_model(model, data);
+}
 
-    return model;
+bool v_read_model(ModelData& data, const char* file_path, Arena& arena)
+{
+    data.m_source_hash = v_hash_file(file_path, arena);
+    if(data.m_source_hash == 0) return false;
+
+    return v_read_model_data(data, file_path, arena);
+}
+
+bool v_upload_model(Model& model, const ModelData& data)
+{
+    model.m_vertex_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_index_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_meshlet_allocation.m_offset = OFFSET_ALLOCATOR_NONE;
+    model.m_bounds_center = data.m_bounds_center;
+    model.m_bounds_radius = data.m_bounds_radius;
+
+    return v_allocate_geometry(model, data.m_vertices.data(), (uint32_t)data.m_vertices.size(), data.m_indices.data(),
+        (uint32_t)data.m_indices.size(), data.m_meshlets.m_meshlets.data(), (uint32_t)data.m_meshlets.m_meshlets.size());
 }
 
-void v_destroy_model(Model model)
+void v_destroy_model(Model& model)
 {
-    vmaDestroyBuffer(g_renderer.m_allocator, model.m_vertex_buffer.m_buffer, model.m_vertex_buffer.m_allocation);
-}
\ No newline at end of file
+    v_free_geometry(model);
+}
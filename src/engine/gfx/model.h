@@ -6,6 +6,9 @@
 #include <HandmadeMath.h>
 
 #include "buffer.h"
+#include "meshlet.h"
+#include "../core/allocator.h"
+#include "../core/offset_allocator.h"
 
 struct VertexInputDescription
 {
@@ -21,12 +24,51 @@ struct Vertex
     hmm_vec3 m_normal;
 };
 
+// A model is a range of the shared geometry pool, drawn with
+// firstIndex = m_index_allocation.m_offset and
+// vertexOffset = m_vertex_allocation.m_offset
+// Its meshlets index relative to the model's own ranges.
 struct Model
 {
-    std::vector<Vertex> m_vertices;
-    AllocatedBuffer m_vertex_buffer;
+    OffsetAllocation m_vertex_allocation;
+    OffsetAllocation m_index_allocation;
+    OffsetAllocation m_meshlet_allocation;
+    uint32_t m_vertex_count;
+    uint32_t m_index_count;
+    uint32_t m_meshlet_count;
+    uint32_t m_pool_index;
+
+    // Bounding sphere around the vertices
+    hmm_vec3 m_bounds_center;
+    float m_bounds_radius;
+};
+
+// A model on the CPU, read but not in the geometry pool yet
+struct ModelData
+{
+    ModelData(Arena& arena) : m_vertices(ArenaAllocator<Vertex>(arena)) {}
+
+    uint64_t m_source_hash;
+    ArenaVector<Vertex> m_vertices;
+    std::vector<uint32_t> m_indices;
+    MeshletData m_meshlets;
+    hmm_vec3 m_bounds_center;
+    float m_bounds_radius;
 };
 
 VertexInputDescription v_get_vertex_decription();
-Model v_load_model(const char* file_path);
-void v_destroy_model(Model model);
\ No newline at end of file
+// FNV-1a of the file contents, 0 when it can not be read
+uint64_t v_hash_file(const char* file_path);
+// Compaction patches the ranges in place, model has to stay at the same address.
+// The imported mesh and its meshlets are cooked to file_path + ".mesh" and
+// reused as long as the source file is unchanged.
+bool v_load_model(Model& model, const char* file_path);
+// Same, with source_hash = v_hash_file(file_path) already known
+bool v_load_model(Model& model, const char* file_path, uint64_t source_hash);
+// The two halves of v_load_model(). Reading needs no device and can run on
+// any thread, with an arena only that thread uses; data lives in it until it
+// is rewound. Uploading is main thread only.
+bool v_read_model(ModelData& data, const char* file_path, Arena& arena);
+bool v_upload_model(Model& model, const ModelData& data);
+// The geometry ranges are released once the last submitted frame has finished
+void v_destroy_model(Model& model);
\ No newline at end of file
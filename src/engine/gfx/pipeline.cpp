@@ -1,11 +1,17 @@
 #include <vector>
+#include <atomic>
 #include <fstream>
 #include "pipeline.h"
 
 #include "renderer.h"
+#include "lighting.h"
 #include "model.h"
 #include "push_constant.h"
 
+// Small sequential ids that fit in the render queue sort key. Pipelines may
+// be compiled on startup workers.
+static std::atomic<uint32_t> g_next_pipeline_id(0);
+
 VkShaderModule v_load_shader_module(const char* file_path)
 {
     std::ifstream shader_code(file_path, std::ios::ate | std::ios::binary);
@@ -31,9 +37,12 @@ void v_destroy_shader_module(VkShaderModule shader_module)
     vkDestroyShaderModule(g_renderer.m_device, shader_module, nullptr);
 }
 
-GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char* fragment_path)
+GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char* fragment_path, uint32_t features,
+    VkRenderPass render_pass, uint32_t subpass)
 {
     GraphicsPipeline pipeline;
+    pipeline.m_id = g_next_pipeline_id++;
+    pipeline.m_features = features;
     VertexInputDescription description = v_get_vertex_decription();
 
     VkShaderModule vertex_shader = v_load_shader_module(vertex_path); 
@@ -53,6 +62,23 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     fragment_shader_info.module = fragment_shader;
     fragment_shader_info.pName = "main";
 
+    VkBool32 feature_values[SHADER_FEATURE_COUNT];
+    VkSpecializationMapEntry feature_entries[SHADER_FEATURE_COUNT];
+    for(uint32_t i=0; i < SHADER_FEATURE_COUNT; i++)
+    {
+        feature_values[i] = (features >> i) & 1;
+        feature_entries[i].constantID = i;
+        feature_entries[i].offset = i * sizeof(VkBool32);
+        feature_entries[i].size = sizeof(VkBool32);
+    }
+
+    VkSpecializationInfo specialization_info{};
+    specialization_info.mapEntryCount = SHADER_FEATURE_COUNT;
+    specialization_info.pMapEntries = feature_entries;
+    specialization_info.dataSize = sizeof(feature_values);
+    specialization_info.pData = feature_values;
+    fragment_shader_info.pSpecializationInfo = &specialization_info;
+
     VkPipelineShaderStageCreateInfo shader_stage_info[] = {
         vertex_shader_info, fragment_shader_info
     };
@@ -71,24 +97,14 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     input_assembly_info.primitiveRestartEnable = VK_FALSE;
 
-    VkViewport viewport{};
-    viewport.x = 0.0f; viewport.y = 0.0f;
-    viewport.width = (float)g_renderer.m_win_extent.width;
-    viewport.height = (float)g_renderer.m_win_extent.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = g_renderer.m_win_extent;
-
+    // Viewport and scissor are dynamic so the pipeline survives swapchain resizes
     VkPipelineViewportStateCreateInfo viewport_state_info{};
     viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     viewport_state_info.pNext = nullptr;
     viewport_state_info.viewportCount = 1;
-    viewport_state_info.pViewports = &viewport;
+    viewport_state_info.pViewports = nullptr;
     viewport_state_info.scissorCount = 1;
-    viewport_state_info.pScissors = &scissor;
+    viewport_state_info.pScissors = nullptr;
 
     VkPipelineRasterizationStateCreateInfo rasterization_info{};
     rasterization_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -114,6 +130,17 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     multisample_info.alphaToCoverageEnable = VK_FALSE;
     multisample_info.alphaToOneEnable = VK_FALSE;
 
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
+    depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_info.pNext = nullptr;
+    depth_stencil_info.depthTestEnable = VK_TRUE;
+    depth_stencil_info.depthWriteEnable = VK_TRUE;
+    depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_info.depthBoundsTestEnable = VK_FALSE;
+    depth_stencil_info.stencilTestEnable = VK_FALSE;
+    depth_stencil_info.minDepthBounds = 0.0f;
+    depth_stencil_info.maxDepthBounds = 1.0f;
+
     VkPipelineColorBlendAttachmentState color_blend_attachment{};
     color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
         | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -139,7 +166,7 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
 
     VkDynamicState dynamic_states[] = {
         VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_LINE_WIDTH
+        VK_DYNAMIC_STATE_SCISSOR
     };
 
     VkPipelineDynamicStateCreateInfo dynamic_state_info{};
@@ -156,8 +183,9 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     VkPipelineLayoutCreateInfo pipeline_layout_info{};
     pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipeline_layout_info.pNext = nullptr;
-    pipeline_layout_info.setLayoutCount = 0;
-    pipeline_layout_info.pSetLayouts = nullptr;
+    VkDescriptorSetLayout set_layouts[] = {g_renderer.m_instance_set_layout, g_lighting.m_set_layout};
+    pipeline_layout_info.setLayoutCount = 2;
+    pipeline_layout_info.pSetLayouts = set_layouts;
     pipeline_layout_info.pushConstantRangeCount = 1;
     pipeline_layout_info.pPushConstantRanges = &push_constant;
 
@@ -173,12 +201,12 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     pipeline_info.pViewportState = &viewport_state_info;
     pipeline_info.pRasterizationState = &rasterization_info;
     pipeline_info.pMultisampleState = &multisample_info;
-    pipeline_info.pDepthStencilState = nullptr;
+    pipeline_info.pDepthStencilState = &depth_stencil_info;
     pipeline_info.pColorBlendState = &color_blend_info;
-    pipeline_info.pDynamicState = nullptr;
+    pipeline_info.pDynamicState = &dynamic_state_info;
     pipeline_info.layout = pipeline.m_pipeline_layout;
-    pipeline_info.renderPass = g_renderer.m_render_pass;
-    pipeline_info.subpass = 0;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = subpass;
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
 
@@ -192,8 +220,187 @@ GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char*
     return pipeline;
 }
 
+// Geometry generated in the vertex shader, no vertex input, depth or culling
+static GraphicsPipeline v_create_screen_pipeline(const char* vertex_path, const char* fragment_path,
+    uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts, uint32_t push_constant_size,
+    VkShaderStageFlags push_constant_stages, VkPrimitiveTopology topology, bool alpha_blend,
+    VkRenderPass render_pass, uint32_t subpass)
+{
+    GraphicsPipeline pipeline;
+    pipeline.m_id = g_next_pipeline_id++;
+
+    VkShaderModule vertex_shader = v_load_shader_module(vertex_path);
+    VkShaderModule fragment_shader = v_load_shader_module(fragment_path);
+
+    VkPipelineShaderStageCreateInfo shader_stage_info[2] = {};
+    shader_stage_info[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stage_info[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shader_stage_info[0].module = vertex_shader;
+    shader_stage_info[0].pName = "main";
+    shader_stage_info[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stage_info[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shader_stage_info[1].module = fragment_shader;
+    shader_stage_info[1].pName = "main";
+
+    VkPipelineVertexInputStateCreateInfo vertex_input_info{};
+    vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly_info{};
+    input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly_info.topology = topology;
+
+    VkPipelineViewportStateCreateInfo viewport_state_info{};
+    viewport_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state_info.viewportCount = 1;
+    viewport_state_info.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterization_info{};
+    rasterization_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterization_info.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterization_info.lineWidth = 1.0f;
+    rasterization_info.cullMode = VK_CULL_MODE_NONE;
+    rasterization_info.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisample_info{};
+    multisample_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisample_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisample_info.minSampleShading = 1.0f;
+
+    VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
+    depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil_info.depthTestEnable = VK_FALSE;
+    depth_stencil_info.depthWriteEnable = VK_FALSE;
+    depth_stencil_info.maxDepthBounds = 1.0f;
+
+    VkPipelineColorBlendAttachmentState color_blend_attachment{};
+    color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+        | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    color_blend_attachment.blendEnable = alpha_blend ? VK_TRUE : VK_FALSE;
+    color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo color_blend_info{};
+    color_blend_info.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    color_blend_info.attachmentCount = 1;
+    color_blend_info.pAttachments = &color_blend_attachment;
+
+    VkDynamicState dynamic_states[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamic_state_info{};
+    dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamic_state_info.dynamicStateCount = 2;
+    dynamic_state_info.pDynamicStates = dynamic_states;
+
+    VkPushConstantRange push_constant{};
+    push_constant.offset = 0;
+    push_constant.size = push_constant_size;
+    push_constant.stageFlags = push_constant_stages;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.setLayoutCount = set_layout_count;
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = push_constant_size ? 1 : 0;
+    pipeline_layout_info.pPushConstantRanges = push_constant_size ? &push_constant : nullptr;
+
+    vkCreatePipelineLayout(g_renderer.m_device, &pipeline_layout_info, nullptr, &pipeline.m_pipeline_layout);
+
+    VkGraphicsPipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipeline_info.stageCount = 2;
+    pipeline_info.pStages = shader_stage_info;
+    pipeline_info.pVertexInputState = &vertex_input_info;
+    pipeline_info.pInputAssemblyState = &input_assembly_info;
+    pipeline_info.pViewportState = &viewport_state_info;
+    pipeline_info.pRasterizationState = &rasterization_info;
+    pipeline_info.pMultisampleState = &multisample_info;
+    pipeline_info.pDepthStencilState = &depth_stencil_info;
+    pipeline_info.pColorBlendState = &color_blend_info;
+    pipeline_info.pDynamicState = &dynamic_state_info;
+    pipeline_info.layout = pipeline.m_pipeline_layout;
+    pipeline_info.renderPass = render_pass;
+    pipeline_info.subpass = subpass;
+    pipeline_info.basePipelineIndex = -1;
+
+    vkCreateGraphicsPipelines(g_renderer.m_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline.m_pipeline);
+
+    v_destroy_shader_module(fragment_shader);
+    v_destroy_shader_module(vertex_shader);
+
+    return pipeline;
+}
+
+GraphicsPipeline v_create_fullscreen_pipeline(const char* vertex_path, const char* fragment_path,
+    uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts, uint32_t push_constant_size,
+    VkRenderPass render_pass, uint32_t subpass)
+{
+    return v_create_screen_pipeline(vertex_path, fragment_path, set_layout_count, set_layouts, push_constant_size,
+        VK_SHADER_STAGE_FRAGMENT_BIT, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, false, render_pass, subpass);
+}
+
+GraphicsPipeline v_create_overlay_pipeline(const char* vertex_path, const char* fragment_path,
+    uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts, uint32_t push_constant_size,
+    VkRenderPass render_pass, uint32_t subpass)
+{
+    return v_create_screen_pipeline(vertex_path, fragment_path, set_layout_count, set_layouts, push_constant_size,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP, true,
+        render_pass, subpass);
+}
+
 void v_destroy_graphics_pipeline(GraphicsPipeline pipeline)
 {
     vkDestroyPipeline(g_renderer.m_device, pipeline.m_pipeline, nullptr);
     vkDestroyPipelineLayout(g_renderer.m_device, pipeline.m_pipeline_layout, nullptr);
-}
\ No newline at end of file
+}
+
+ComputePipeline v_create_compute_pipeline(const char* shader_path, uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts,
+    uint32_t push_constant_size)
+{
+    ComputePipeline pipeline;
+    VkShaderModule shader = v_load_shader_module(shader_path);
+
+    VkPushConstantRange push_constant{};
+    push_constant.offset = 0;
+    push_constant.size = push_constant_size;
+    push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_info{};
+    pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_info.pNext = nullptr;
+    pipeline_layout_info.setLayoutCount = set_layout_count;
+    pipeline_layout_info.pSetLayouts = set_layouts;
+    pipeline_layout_info.pushConstantRangeCount = push_constant_size ? 1 : 0;
+    pipeline_layout_info.pPushConstantRanges = push_constant_size ? &push_constant : nullptr;
+
+    vkCreatePipelineLayout(g_renderer.m_device, &pipeline_layout_info, nullptr, &pipeline.m_pipeline_layout);
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.pNext = nullptr;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.pNext = nullptr;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = pipeline.m_pipeline_layout;
+    pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+    pipeline_info.basePipelineIndex = -1;
+
+    vkCreateComputePipelines(g_renderer.m_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline.m_pipeline);
+
+    v_destroy_shader_module(shader);
+    return pipeline;
+}
+
+void v_destroy_compute_pipeline(ComputePipeline pipeline)
+{
+    vkDestroyPipeline(g_renderer.m_device, pipeline.m_pipeline, nullptr);
+    vkDestroyPipelineLayout(g_renderer.m_device, pipeline.m_pipeline_layout, nullptr);
+}
@@ -2,11 +2,54 @@
 
 #include <vulkan/vulkan.h>
 
+// Feature bits of the scene shaders, baked into a pipeline as specialization
+// constants: bit i is the bool with constant_id i in shaders/shader.frag.
+// A disabled feature is compiled out instead of branched over per fragment.
+enum ShaderFeature
+{
+    // Lights looked up per cluster, otherwise every light shades every fragment
+    SHADER_FEATURE_CLUSTERED_LIGHTING = 1 << 0,
+    // World space normals as the color
+    SHADER_FEATURE_DEBUG_NORMALS = 1 << 1
+};
+
+#define SHADER_FEATURE_COUNT 2
+#define SHADER_FEATURES_DEFAULT SHADER_FEATURE_CLUSTERED_LIGHTING
+
 struct GraphicsPipeline
+{
+    uint32_t m_id;
+    uint32_t m_features;
+    VkPipelineLayout m_pipeline_layout;
+    VkPipeline m_pipeline;
+};
+
+struct ComputePipeline
 {
     VkPipelineLayout m_pipeline_layout;
     VkPipeline m_pipeline;
 };
 
-GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char* fragment_path);
-void v_destroy_graphics_pipeline(GraphicsPipeline pipeline);
\ No newline at end of file
+// render_pass and subpass come from the render graph, see v_get_graph_render_pass().
+// features is a mask of ShaderFeature bits.
+GraphicsPipeline v_create_graphics_pipeline(const char* vertex_path, const char* fragment_path, uint32_t features,
+    VkRenderPass render_pass, uint32_t subpass);
+// A single triangle covering the viewport, without vertex input, depth or
+// culling. The vertex shader generates it from gl_VertexIndex, draw 3
+// vertices. push_constant_size may be 0, the range is for the fragment shader.
+GraphicsPipeline v_create_fullscreen_pipeline(const char* vertex_path, const char* fragment_path,
+    uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts, uint32_t push_constant_size,
+    VkRenderPass render_pass, uint32_t subpass);
+// Screen space quads over what is already in the target: 4 vertex triangle
+// strips generated from gl_VertexIndex, one per instance, alpha blended.
+// Like the fullscreen pipeline otherwise, but the push constant range is
+// visible to both stages.
+GraphicsPipeline v_create_overlay_pipeline(const char* vertex_path, const char* fragment_path,
+    uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts, uint32_t push_constant_size,
+    VkRenderPass render_pass, uint32_t subpass);
+void v_destroy_graphics_pipeline(GraphicsPipeline pipeline);
+
+// Set layouts are indexed by set number. push_constant_size may be 0.
+ComputePipeline v_create_compute_pipeline(const char* shader_path, uint32_t set_layout_count, const VkDescriptorSetLayout* set_layouts,
+    uint32_t push_constant_size);
+void v_destroy_compute_pipeline(ComputePipeline pipeline);
\ No newline at end of file
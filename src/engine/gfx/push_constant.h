@@ -2,8 +2,9 @@
 
 #include <HandmadeMath.h>
 
+// The camera is in the view uniform of the instance set, so recorded draws
+// stay valid when it moves
 struct PushConstant
 {
     hmm_vec4 m_data;
-    hmm_mat4 m_render_matrix;
 };
\ No newline at end of file
@@ -0,0 +1,1151 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include "render_graph.h"
+
+#include "memory.h"
+#include "sync.h"
+#include "../core/allocator.h"
+
+struct UsageState
+{
+    VkImageLayout m_layout;
+    VkPipelineStageFlags m_stage;
+    VkAccessFlags m_access;
+    bool m_write;
+};
+
+static const char* g_usage_names[] = {
+    "color", "depth", "depth read", "input", "sampled", "storage read", "storage write", "transfer src", "transfer dst"
+};
+
+static bool v_is_depth_format(VkFormat format)
+{
+    switch(format)
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: return true;
+        default: return false;
+    }
+}
+
+static bool v_has_stencil(VkFormat format)
+{
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static VkImageAspectFlags v_get_aspect(VkFormat format)
+{
+    if(!v_is_depth_format(format)) return VK_IMAGE_ASPECT_COLOR_BIT;
+    return VK_IMAGE_ASPECT_DEPTH_BIT | (v_has_stencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+}
+
+static bool v_is_attachment(GraphUsage usage)
+{
+    return usage == GRAPH_COLOR_ATTACHMENT || usage == GRAPH_DEPTH_ATTACHMENT
+        || usage == GRAPH_DEPTH_READ || usage == GRAPH_INPUT_ATTACHMENT;
+}
+
+static bool v_is_write(GraphUsage usage)
+{
+    return usage == GRAPH_COLOR_ATTACHMENT || usage == GRAPH_DEPTH_ATTACHMENT
+        || usage == GRAPH_STORAGE_WRITE || usage == GRAPH_TRANSFER_DST;
+}
+
+static UsageState v_get_usage_state(GraphUsage usage, GraphPassType type, VkFormat format)
+{
+    VkPipelineStageFlags shader_stage = type == GRAPH_PASS_COMPUTE ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+        : VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkPipelineStageFlags depth_stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+
+    switch(usage)
+    {
+        case GRAPH_COLOR_ATTACHMENT: return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true};
+        case GRAPH_DEPTH_ATTACHMENT: return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depth_stages,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true};
+        case GRAPH_DEPTH_READ: return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, depth_stages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT, false};
+        case GRAPH_INPUT_ATTACHMENT: return {v_is_depth_format(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_INPUT_ATTACHMENT_READ_BIT, false};
+        case GRAPH_SAMPLED: return {v_is_depth_format(format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            shader_stage, VK_ACCESS_SHADER_READ_BIT, false};
+        case GRAPH_STORAGE_READ: return {VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT, false};
+        case GRAPH_STORAGE_WRITE: return {VK_IMAGE_LAYOUT_GENERAL, shader_stage, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true};
+        case GRAPH_TRANSFER_SRC: return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false};
+        default: return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true};
+    }
+}
+
+static VkImageUsageFlags v_get_image_usage(GraphUsage usage, VkFormat format)
+{
+    switch(usage)
+    {
+        case GRAPH_COLOR_ATTACHMENT: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case GRAPH_DEPTH_ATTACHMENT:
+        case GRAPH_DEPTH_READ: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case GRAPH_INPUT_ATTACHMENT: return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT
+            | (v_is_depth_format(format) ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+        case GRAPH_SAMPLED: return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case GRAPH_STORAGE_READ:
+        case GRAPH_STORAGE_WRITE: return VK_IMAGE_USAGE_STORAGE_BIT;
+        case GRAPH_TRANSFER_SRC: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        default: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+}
+
+static VkDeviceSize v_align_up(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkExtent2D v_get_image_extent(const GraphImage& image)
+{
+    if(image.m_imported) return image.m_extent;
+
+    VkExtent2D extent;
+    extent.width = HMM_MAX((uint32_t)(g_renderer.m_win_extent.width * image.m_scale), 1u);
+    extent.height = HMM_MAX((uint32_t)(g_renderer.m_win_extent.height * image.m_scale), 1u);
+    return extent;
+}
+
+static VkExtent2D v_scale_extent(VkExtent2D extent, float scale)
+{
+    extent.width = HMM_MAX((uint32_t)(extent.width * scale + 0.5f), 1u);
+    extent.height = HMM_MAX((uint32_t)(extent.height * scale + 0.5f), 1u);
+    return extent;
+}
+
+GraphResource v_create_graph_image(RenderGraph& graph, const char* name, VkFormat format, float scale)
+{
+    GraphImage image{};
+    image.m_name = name;
+    image.m_format = format;
+    image.m_scale = scale;
+    image.m_imported = false;
+    image.m_initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image.m_final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    graph.m_images.push_back(image);
+    return (GraphResource)graph.m_images.size() - 1;
+}
+
+GraphResource v_import_graph_image(RenderGraph& graph, const char* name, VkFormat format,
+    VkImageLayout initial_layout, VkPipelineStageFlags initial_stage, VkImageLayout final_layout)
+{
+    GraphImage image{};
+    image.m_name = name;
+    image.m_format = format;
+    image.m_scale = 1.0f;
+    image.m_imported = true;
+    image.m_initial_layout = initial_layout;
+    image.m_initial_stage = initial_stage;
+    image.m_final_layout = final_layout;
+    graph.m_images.push_back(image);
+    return (GraphResource)graph.m_images.size() - 1;
+}
+
+void v_set_imported_image(RenderGraph& graph, GraphResource resource, VkImage image, VkImageView view, VkExtent2D extent)
+{
+    GraphImage& graph_image = graph.m_images[resource];
+    graph_image.m_image = image;
+    graph_image.m_view = view;
+    graph_image.m_extent = extent;
+}
+
+void v_set_graph_image_dynamic(RenderGraph& graph, GraphResource resource)
+{
+    graph.m_images[resource].m_dynamic = true;
+}
+
+void v_set_graph_render_scale(RenderGraph& graph, float scale)
+{
+    graph.m_render_scale = HMM_MIN(HMM_MAX(scale, 0.01f), 1.0f);
+}
+
+GraphPass v_add_graph_pass(RenderGraph& graph, const char* name, GraphPassType type,
+    std::function<void(VkCommandBuffer)> execute)
+{
+    GraphPassData pass{};
+    pass.m_name = name;
+    pass.m_type = type;
+    pass.m_execute = std::move(execute);
+    pass.m_side_effects = false;
+    pass.m_secondary = false;
+    pass.m_group = GRAPH_NONE;
+    graph.m_passes.push_back(pass);
+    return (GraphPass)graph.m_passes.size() - 1;
+}
+
+void v_set_graph_side_effects(RenderGraph& graph, GraphPass pass)
+{
+    graph.m_passes[pass].m_side_effects = true;
+}
+
+void v_set_graph_secondary(RenderGraph& graph, GraphPass pass)
+{
+    graph.m_passes[pass].m_secondary = true;
+}
+
+void v_graph_use(RenderGraph& graph, GraphPass pass, GraphResource resource, GraphUsage usage)
+{
+    graph.m_passes[pass].m_accesses.push_back(GraphAccess{resource, usage, false, {}});
+}
+
+void v_graph_clear(RenderGraph& graph, GraphPass pass, GraphResource resource, GraphUsage usage, ClearValue clear_value)
+{
+    graph.m_passes[pass].m_accesses.push_back(GraphAccess{resource, usage, true, clear_value});
+}
+
+// Compiled objects are destroyed once the last frame that used them is done
+static void v_release_render_graph(RenderGraph& graph)
+{
+    std::vector<VkRenderPass> render_passes;
+    std::vector<VkFramebuffer> framebuffers;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    std::vector<std::pair<VmaAllocation, VkDeviceSize>> allocations;
+
+    for(auto& group : graph.m_groups)
+    {
+        if(group.m_render_pass) render_passes.push_back(group.m_render_pass);
+        for(auto& framebuffer : group.m_framebuffers) framebuffers.push_back(framebuffer.m_framebuffer);
+    }
+    for(auto& image : graph.m_images)
+    {
+        if(image.m_imported || !image.m_image) continue;
+        images.push_back(image.m_image);
+        views.push_back(image.m_view);
+        if(image.m_allocation) allocations.push_back({image.m_allocation, image.m_requirements.size});
+        image.m_image = VK_NULL_HANDLE;
+        image.m_view = VK_NULL_HANDLE;
+        image.m_allocation = VK_NULL_HANDLE;
+    }
+
+    VmaAllocation memory = graph.m_transient_memory;
+    VkDeviceSize memory_bytes = graph.m_transient_bytes;
+    VkQueryPool timestamps = graph.m_timestamps;
+
+    v_defer_destruction(v_get_last_ticket(QUEUE_GRAPHICS), [=]() {
+        for(auto framebuffer : framebuffers) vkDestroyFramebuffer(g_renderer.m_device, framebuffer, nullptr);
+        for(auto render_pass : render_passes) vkDestroyRenderPass(g_renderer.m_device, render_pass, nullptr);
+        for(auto view : views) vkDestroyImageView(g_renderer.m_device, view, nullptr);
+        for(auto image : images) vkDestroyImage(g_renderer.m_device, image, nullptr);
+        if(memory)
+        {
+            vmaFreeMemory(g_renderer.m_allocator, memory);
+            v_untrack_allocation(MEMORY_TRANSIENT, memory_bytes);
+        }
+        for(const auto& allocation : allocations)
+        {
+            vmaFreeMemory(g_renderer.m_allocator, allocation.first);
+            v_untrack_allocation(MEMORY_TRANSIENT, allocation.second);
+        }
+        if(timestamps) vkDestroyQueryPool(g_renderer.m_device, timestamps, nullptr);
+    });
+
+    graph.m_groups.clear();
+    graph.m_final_barriers.clear();
+    graph.m_transient_memory = VK_NULL_HANDLE;
+    graph.m_transient_bytes = 0;
+    graph.m_transient_bytes_unaliased = 0;
+    graph.m_timestamps = VK_NULL_HANDLE;
+    graph.m_timestamps_written = false;
+}
+
+// Walks the passes backwards keeping the set of images whose current contents
+// are still needed. A pass survives if it writes one of them, then a clear
+// ends the need for older contents and every read starts it.
+static void v_cull_passes(RenderGraph& graph)
+{
+    std::vector<bool> live(graph.m_images.size(), false);
+    for(uint32_t i=0; i < graph.m_images.size(); i++) live[i] = graph.m_images[i].m_imported;
+
+    for(uint32_t i=(uint32_t)graph.m_passes.size(); i-- > 0;)
+    {
+        GraphPassData& pass = graph.m_passes[i];
+        pass.m_culled = !pass.m_side_effects;
+        for(const auto& access : pass.m_accesses)
+        {
+            if(v_is_write(access.m_usage) && live[access.m_resource]) pass.m_culled = false;
+        }
+        if(pass.m_culled) continue;
+
+        for(const auto& access : pass.m_accesses)
+        {
+            if(access.m_clear) live[access.m_resource] = false;
+        }
+        for(const auto& access : pass.m_accesses)
+        {
+            if(!access.m_clear) live[access.m_resource] = true;
+        }
+    }
+}
+
+static VkExtent2D v_get_pass_extent(const RenderGraph& graph, const GraphPassData& pass)
+{
+    for(const auto& access : pass.m_accesses)
+    {
+        if(v_is_attachment(access.m_usage)) return v_get_image_extent(graph.m_images[access.m_resource]);
+    }
+    return VkExtent2D{0, 0};
+}
+
+static bool v_is_pass_dynamic(const RenderGraph& graph, const GraphPassData& pass)
+{
+    for(const auto& access : pass.m_accesses)
+    {
+        if(v_is_attachment(access.m_usage)) return graph.m_images[access.m_resource].m_dynamic;
+    }
+    return false;
+}
+
+// Passes sharing a render pass may only exchange data through attachments,
+// anything else needs a full barrier between them.
+static bool v_can_merge(const RenderGraph& graph, const GraphGroup& group, const GraphPassData& pass)
+{
+    if(!group.m_graphics || pass.m_type != GRAPH_PASS_GRAPHICS) return false;
+    // Timestamps and labels can not go between secondary command buffers
+    if(group.m_secondary || pass.m_secondary) return false;
+
+    VkExtent2D extent = v_get_pass_extent(graph, pass);
+    if(extent.width != group.m_extent.width || extent.height != group.m_extent.height) return false;
+    if(v_is_pass_dynamic(graph, pass) != group.m_dynamic) return false;
+
+    for(GraphPass other : group.m_passes)
+    {
+        for(const auto& other_access : graph.m_passes[other].m_accesses)
+        {
+            for(const auto& access : pass.m_accesses)
+            {
+                if(access.m_resource != other_access.m_resource) continue;
+                if(!v_is_attachment(access.m_usage) || !v_is_attachment(other_access.m_usage)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void v_build_groups(RenderGraph& graph, const std::vector<GraphPass>& order)
+{
+    for(GraphPass pass_index : order)
+    {
+        GraphPassData& pass = graph.m_passes[pass_index];
+        if(graph.m_groups.empty() || !v_can_merge(graph, graph.m_groups.back(), pass))
+        {
+            GraphGroup group{};
+            group.m_graphics = pass.m_type == GRAPH_PASS_GRAPHICS;
+            group.m_extent = v_get_pass_extent(graph, pass);
+            group.m_dynamic = group.m_graphics && v_is_pass_dynamic(graph, pass);
+            group.m_secondary = group.m_graphics && pass.m_secondary;
+            graph.m_groups.push_back(group);
+        }
+
+        GraphGroup& group = graph.m_groups.back();
+        pass.m_group = (uint32_t)graph.m_groups.size() - 1;
+        pass.m_subpass = (uint32_t)group.m_passes.size();
+        group.m_passes.push_back(pass_index);
+    }
+}
+
+// Largest first, each image goes to the lowest offset that does not overlap
+// an already placed image whose lifetime overlaps its own. Lifetimes are
+// counted in render pass groups: attachments of one render pass are all in
+// use for the whole of it, and aliasing them would need MAY_ALIAS and extra
+// subpass dependencies.
+static void v_place_transient_images(RenderGraph& graph, const std::vector<GraphPass>& order, std::vector<GraphResource>& transients,
+    VkMemoryRequirements& requirements)
+{
+    std::sort(transients.begin(), transients.end(), [&](GraphResource a, GraphResource b) {
+        return graph.m_images[a].m_requirements.size > graph.m_images[b].m_requirements.size;
+    });
+
+    requirements.size = 0;
+    requirements.alignment = 1;
+    requirements.memoryTypeBits = 0xFFFFFFFF;
+
+    std::vector<std::pair<VkDeviceSize, VkDeviceSize>> ranges;
+    for(uint32_t i=0; i < transients.size(); i++)
+    {
+        GraphImage& image = graph.m_images[transients[i]];
+        uint32_t first_group = graph.m_passes[order[image.m_first_use]].m_group;
+        uint32_t last_group = graph.m_passes[order[image.m_last_use]].m_group;
+
+        ranges.clear();
+        for(uint32_t j=0; j < i; j++)
+        {
+            const GraphImage& placed = graph.m_images[transients[j]];
+            uint32_t placed_first_group = graph.m_passes[order[placed.m_first_use]].m_group;
+            uint32_t placed_last_group = graph.m_passes[order[placed.m_last_use]].m_group;
+            if(placed_last_group < first_group || last_group < placed_first_group) continue;
+            ranges.push_back({placed.m_offset, placed.m_offset + placed.m_requirements.size});
+        }
+        std::sort(ranges.begin(), ranges.end());
+
+        VkDeviceSize offset = 0;
+        for(const auto& range : ranges)
+        {
+            if(v_align_up(offset, image.m_requirements.alignment) + image.m_requirements.size <= range.first) break;
+            offset = HMM_MAX(offset, range.second);
+        }
+        image.m_offset = v_align_up(offset, image.m_requirements.alignment);
+
+        requirements.size = HMM_MAX(requirements.size, image.m_offset + image.m_requirements.size);
+        requirements.alignment = HMM_MAX(requirements.alignment, image.m_requirements.alignment);
+        requirements.memoryTypeBits &= image.m_requirements.memoryTypeBits;
+        graph.m_transient_bytes_unaliased += image.m_requirements.size;
+    }
+}
+
+static VkResult v_create_transient_images(RenderGraph& graph, const std::vector<GraphPass>& order)
+{
+    const VkImageUsageFlags attachment_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+        | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+    std::vector<GraphResource> transients;
+    for(uint32_t i=0; i < graph.m_images.size(); i++)
+    {
+        GraphImage& image = graph.m_images[i];
+        if(image.m_imported || image.m_first_use == GRAPH_NONE) continue;
+
+        // Attachments that live and die inside one render pass never need to reach memory
+        bool single_group = graph.m_passes[order[image.m_first_use]].m_group == graph.m_passes[order[image.m_last_use]].m_group;
+        if(single_group && !(image.m_usage & ~attachment_usage)) image.m_usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+
+        VkExtent2D extent = v_get_image_extent(image);
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.pNext = nullptr;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = image.m_format;
+        image_info.extent = {extent.width, extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = image.m_usage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkResult result = vkCreateImage(g_renderer.m_device, &image_info, nullptr, &image.m_image);
+        if(result != VK_SUCCESS)
+        {
+            image.m_image = VK_NULL_HANDLE;
+            return result;
+        }
+        v_set_debug_name(VK_OBJECT_TYPE_IMAGE, (uint64_t)image.m_image, image.m_name.c_str());
+        vkGetImageMemoryRequirements(g_renderer.m_device, image.m_image, &image.m_requirements);
+        transients.push_back(i);
+    }
+    if(transients.empty()) return VK_SUCCESS;
+
+    VkMemoryRequirements requirements;
+    v_place_transient_images(graph, order, transients, requirements);
+
+    VmaAllocationCreateInfo allocation_info{};
+    allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    // Aliasing needs a memory type every image can live in, without one each
+    // image gets memory of its own
+    if(requirements.memoryTypeBits != 0)
+    {
+        VkResult result = vmaAllocateMemory(g_renderer.m_allocator, &requirements, &allocation_info, &graph.m_transient_memory, nullptr);
+        if(result != VK_SUCCESS)
+        {
+            graph.m_transient_memory = VK_NULL_HANDLE;
+            return result;
+        }
+        graph.m_transient_bytes = requirements.size;
+        v_track_allocation(MEMORY_TRANSIENT, requirements.size);
+    }
+
+    for(GraphResource resource : transients)
+    {
+        GraphImage& image = graph.m_images[resource];
+        VkResult result;
+        if(graph.m_transient_memory)
+        {
+            result = vmaBindImageMemory2(g_renderer.m_allocator, graph.m_transient_memory, image.m_offset, image.m_image, nullptr);
+        }
+        else
+        {
+            result = vmaAllocateMemoryForImage(g_renderer.m_allocator, image.m_image, &allocation_info, &image.m_allocation, nullptr);
+            if(result != VK_SUCCESS)
+            {
+                image.m_allocation = VK_NULL_HANDLE;
+                return result;
+            }
+            image.m_offset = 0;
+            graph.m_transient_bytes += image.m_requirements.size;
+            v_track_allocation(MEMORY_TRANSIENT, image.m_requirements.size);
+            result = vmaBindImageMemory(g_renderer.m_allocator, image.m_allocation, image.m_image);
+        }
+        if(result != VK_SUCCESS) return result;
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.pNext = nullptr;
+        view_info.image = image.m_image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = image.m_format;
+        view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        view_info.subresourceRange.aspectMask = v_get_aspect(image.m_format);
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        result = vkCreateImageView(g_renderer.m_device, &view_info, nullptr, &image.m_view);
+        if(result != VK_SUCCESS)
+        {
+            image.m_view = VK_NULL_HANDLE;
+            return result;
+        }
+    }
+    return VK_SUCCESS;
+}
+
+static void v_add_subpass_dependency(std::vector<VkSubpassDependency>& dependencies, uint32_t src, uint32_t dst,
+    const UsageState& from, const UsageState& to)
+{
+    if(src == dst) return;
+    if(!from.m_write && !to.m_write && from.m_layout == to.m_layout) return;
+
+    VkSubpassDependency* dependency = nullptr;
+    for(auto& existing : dependencies)
+    {
+        if(existing.srcSubpass == src && existing.dstSubpass == dst) dependency = &existing;
+    }
+    if(!dependency)
+    {
+        VkSubpassDependency new_dependency{};
+        new_dependency.srcSubpass = src;
+        new_dependency.dstSubpass = dst;
+        new_dependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+        dependencies.push_back(new_dependency);
+        dependency = &dependencies.back();
+    }
+
+    dependency->srcStageMask |= from.m_stage;
+    dependency->dstStageMask |= to.m_stage;
+    if(from.m_write) dependency->srcAccessMask |= from.m_access;
+    dependency->dstAccessMask |= to.m_access;
+}
+
+static uint64_t v_hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a, like the resource keys
+    const uint8_t* bytes = (const uint8_t*)data;
+    for(size_t i=0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// has_content tells which images hold data written before the group
+static void v_create_render_pass(RenderGraph& graph, GraphGroup& group, uint32_t group_end,
+    const std::vector<bool>& has_content)
+{
+    std::vector<uint32_t> attachment_index(graph.m_images.size(), GRAPH_NONE);
+    std::vector<VkAttachmentDescription> attachments;
+    std::vector<uint32_t> first_subpass;
+    std::vector<uint32_t> last_subpass;
+
+    for(uint32_t s=0; s < group.m_passes.size(); s++)
+    {
+        const GraphPassData& pass = graph.m_passes[group.m_passes[s]];
+        for(const auto& access : pass.m_accesses)
+        {
+            if(!v_is_attachment(access.m_usage)) continue;
+            const GraphImage& image = graph.m_images[access.m_resource];
+            UsageState usage = v_get_usage_state(access.m_usage, pass.m_type, image.m_format);
+
+            if(attachment_index[access.m_resource] == GRAPH_NONE)
+            {
+                VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                if(access.m_clear) load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                else if(has_content[access.m_resource]) load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+                VkAttachmentDescription attachment{};
+                attachment.format = image.m_format;
+                attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+                attachment.loadOp = load_op;
+                attachment.stencilLoadOp = v_has_stencil(image.m_format) ? load_op : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                // The barrier before the render pass already did the transition
+                attachment.initialLayout = usage.m_layout;
+
+                VkClearValue clear_value{};
+                if(v_is_depth_format(image.m_format)) clear_value.depthStencil = {access.m_clear_value.R, 0};
+                else clear_value.color = {{access.m_clear_value.R, access.m_clear_value.G, access.m_clear_value.B, access.m_clear_value.A}};
+
+                attachment_index[access.m_resource] = (uint32_t)attachments.size();
+                attachments.push_back(attachment);
+                first_subpass.push_back(s);
+                last_subpass.push_back(s);
+                group.m_attachments.push_back(access.m_resource);
+                group.m_clear_values.push_back(clear_value);
+            }
+
+            uint32_t index = attachment_index[access.m_resource];
+            attachments[index].finalLayout = usage.m_layout;
+            last_subpass[index] = s;
+        }
+    }
+
+    for(uint32_t i=0; i < attachments.size(); i++)
+    {
+        const GraphImage& image = graph.m_images[group.m_attachments[i]];
+        VkAttachmentDescription& attachment = attachments[i];
+
+        bool store = image.m_imported || image.m_last_use > group_end;
+        attachment.storeOp = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.stencilStoreOp = v_has_stencil(image.m_format) ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+        // Imported images leave their last render pass in the layout the owner expects
+        if(image.m_imported && image.m_last_use <= group_end && image.m_final_layout != VK_IMAGE_LAYOUT_UNDEFINED)
+        {
+            attachment.finalLayout = image.m_final_layout;
+        }
+    }
+
+    uint32_t subpass_count = (uint32_t)group.m_passes.size();
+    std::vector<std::vector<VkAttachmentReference>> color_refs(subpass_count);
+    std::vector<std::vector<VkAttachmentReference>> input_refs(subpass_count);
+    std::vector<std::vector<uint32_t>> preserve(subpass_count);
+    std::vector<VkAttachmentReference> depth_refs(subpass_count);
+    std::vector<VkSubpassDescription> subpasses(subpass_count);
+    std::vector<VkSubpassDependency> dependencies;
+
+    std::vector<uint32_t> last_user(attachments.size(), GRAPH_NONE);
+    std::vector<UsageState> last_state(attachments.size());
+
+    for(uint32_t s=0; s < subpass_count; s++)
+    {
+        const GraphPassData& pass = graph.m_passes[group.m_passes[s]];
+        std::vector<bool> used(attachments.size(), false);
+        depth_refs[s] = {VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED};
+
+        for(const auto& access : pass.m_accesses)
+        {
+            if(!v_is_attachment(access.m_usage)) continue;
+            uint32_t index = attachment_index[access.m_resource];
+            UsageState usage = v_get_usage_state(access.m_usage, pass.m_type, graph.m_images[access.m_resource].m_format);
+
+            VkAttachmentReference ref{index, usage.m_layout};
+            if(access.m_usage == GRAPH_COLOR_ATTACHMENT) color_refs[s].push_back(ref);
+            else if(access.m_usage == GRAPH_INPUT_ATTACHMENT) input_refs[s].push_back(ref);
+            else depth_refs[s] = ref;
+            used[index] = true;
+
+            if(last_user[index] != GRAPH_NONE) v_add_subpass_dependency(dependencies, last_user[index], s, last_state[index], usage);
+            last_user[index] = s;
+            last_state[index] = usage;
+        }
+
+        for(uint32_t i=0; i < attachments.size(); i++)
+        {
+            if(!used[i] && first_subpass[i] < s && last_subpass[i] > s) preserve[s].push_back(i);
+        }
+
+        VkSubpassDescription& subpass = subpasses[s];
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = (uint32_t)color_refs[s].size();
+        subpass.pColorAttachments = color_refs[s].data();
+        subpass.inputAttachmentCount = (uint32_t)input_refs[s].size();
+        subpass.pInputAttachments = input_refs[s].data();
+        subpass.pDepthStencilAttachment = depth_refs[s].attachment != VK_ATTACHMENT_UNUSED ? &depth_refs[s] : nullptr;
+        subpass.preserveAttachmentCount = (uint32_t)preserve[s].size();
+        subpass.pPreserveAttachments = preserve[s].data();
+    }
+
+    VkRenderPassCreateInfo render_pass_info{};
+    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    render_pass_info.pNext = nullptr;
+    render_pass_info.attachmentCount = (uint32_t)attachments.size();
+    render_pass_info.pAttachments = attachments.data();
+    render_pass_info.subpassCount = subpass_count;
+    render_pass_info.pSubpasses = subpasses.data();
+    render_pass_info.dependencyCount = (uint32_t)dependencies.size();
+    render_pass_info.pDependencies = dependencies.data();
+
+    vkCreateRenderPass(g_renderer.m_device, &render_pass_info, nullptr, &group.m_render_pass);
+
+    // Compatibility depends on the attachment formats and how the subpasses use
+    // them, the passes of the group fix the latter
+    uint64_t key = 0xCBF29CE484222325ull;
+    key = v_hash_bytes(key, group.m_passes.data(), group.m_passes.size() * sizeof(GraphPass));
+    for(const VkAttachmentDescription& attachment : attachments)
+    {
+        key = v_hash_bytes(key, &attachment.format, sizeof(attachment.format));
+        key = v_hash_bytes(key, &attachment.samples, sizeof(attachment.samples));
+    }
+    group.m_render_pass_key = key;
+}
+
+static bool v_memory_overlaps(const GraphImage& a, const GraphImage& b)
+{
+    if(a.m_allocation || b.m_allocation) return false;
+    return a.m_offset < b.m_offset + b.m_requirements.size && b.m_offset < a.m_offset + a.m_requirements.size;
+}
+
+// Barriers in front of every group, render passes for the graphics groups and
+// the final transitions of imported images
+static void v_build_barriers(RenderGraph& graph)
+{
+    std::vector<UsageState> state(graph.m_images.size());
+    std::vector<bool> has_content(graph.m_images.size());
+    for(uint32_t i=0; i < graph.m_images.size(); i++)
+    {
+        const GraphImage& image = graph.m_images[i];
+        if(image.m_imported) state[i] = {image.m_initial_layout, image.m_initial_stage, 0, false};
+        else state[i] = {VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, false};
+        has_content[i] = image.m_imported && image.m_initial_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    uint32_t position = 0;
+    for(auto& group : graph.m_groups)
+    {
+        uint32_t group_end = position + (uint32_t)group.m_passes.size() - 1;
+        group.m_src_stage = 0;
+        group.m_dst_stage = 0;
+
+        std::vector<bool> seen(graph.m_images.size(), false);
+        for(uint32_t p=0; p < group.m_passes.size(); p++)
+        {
+            const GraphPassData& pass = graph.m_passes[group.m_passes[p]];
+            for(const auto& access : pass.m_accesses)
+            {
+                GraphResource resource = access.m_resource;
+                if(seen[resource]) continue;
+                seen[resource] = true;
+
+                const GraphImage& image = graph.m_images[resource];
+                UsageState usage = v_get_usage_state(access.m_usage, pass.m_type, image.m_format);
+                UsageState previous = state[resource];
+
+                // Aliased memory: wait for whatever used the same bytes before
+                if(!image.m_imported && image.m_first_use == position + p)
+                {
+                    for(uint32_t i=0; i < graph.m_images.size(); i++)
+                    {
+                        const GraphImage& other = graph.m_images[i];
+                        if(other.m_imported || other.m_last_use == GRAPH_NONE || other.m_last_use >= image.m_first_use) continue;
+                        if(!v_memory_overlaps(image, other)) continue;
+                        previous.m_stage |= state[i].m_stage;
+                        if(state[i].m_write) previous.m_access |= state[i].m_access;
+                        previous.m_write |= state[i].m_write;
+                    }
+                }
+
+                bool discard = access.m_clear || !has_content[resource];
+                VkImageLayout old_layout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : previous.m_layout;
+                bool transition = old_layout != usage.m_layout;
+                if(!transition && !previous.m_write && !usage.m_write) continue;
+                if(!transition && previous.m_stage == 0) continue;
+
+                group.m_barriers.push_back(GraphBarrier{resource, old_layout, usage.m_layout,
+                    previous.m_write ? previous.m_access : 0, usage.m_access});
+                group.m_src_stage |= previous.m_stage ? previous.m_stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                group.m_dst_stage |= usage.m_stage;
+            }
+        }
+
+        if(group.m_graphics) v_create_render_pass(graph, group, group_end, has_content);
+
+        for(GraphPass pass_index : group.m_passes)
+        {
+            const GraphPassData& pass = graph.m_passes[pass_index];
+            for(const auto& access : pass.m_accesses)
+            {
+                const GraphImage& image = graph.m_images[access.m_resource];
+                UsageState usage = v_get_usage_state(access.m_usage, pass.m_type, image.m_format);
+                UsageState& current = state[access.m_resource];
+
+                // Reads in the same layout accumulate, so a later write waits for all of them
+                if(!usage.m_write && !current.m_write && current.m_layout == usage.m_layout && current.m_stage)
+                {
+                    current.m_stage |= usage.m_stage;
+                    current.m_access |= usage.m_access;
+                }
+                else current = usage;
+                if(usage.m_write) has_content[access.m_resource] = true;
+            }
+        }
+
+        if(group.m_graphics)
+        {
+            for(GraphResource resource : group.m_attachments)
+            {
+                const GraphImage& image = graph.m_images[resource];
+                if(image.m_imported && image.m_last_use <= group_end && image.m_final_layout != VK_IMAGE_LAYOUT_UNDEFINED)
+                {
+                    state[resource].m_layout = image.m_final_layout;
+                }
+            }
+        }
+
+        position = group_end + 1;
+    }
+
+    graph.m_final_src_stage = 0;
+    for(uint32_t i=0; i < graph.m_images.size(); i++)
+    {
+        const GraphImage& image = graph.m_images[i];
+        if(!image.m_imported || image.m_final_layout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+        if(state[i].m_layout == image.m_final_layout) continue;
+
+        graph.m_final_barriers.push_back(GraphBarrier{i, state[i].m_layout, image.m_final_layout,
+            state[i].m_write ? state[i].m_access : 0, 0});
+        graph.m_final_src_stage |= state[i].m_stage ? state[i].m_stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    }
+}
+
+VkResult v_compile_render_graph(RenderGraph& graph)
+{
+    v_release_render_graph(graph);
+    v_cull_passes(graph);
+
+    std::vector<GraphPass> order;
+    for(uint32_t i=0; i < graph.m_passes.size(); i++)
+    {
+        graph.m_passes[i].m_group = GRAPH_NONE;
+        graph.m_passes[i].m_subpass = 0;
+        graph.m_passes[i].m_gpu_ms = 0.0f;
+        if(!graph.m_passes[i].m_culled) order.push_back(i);
+    }
+    graph.m_gpu_ms = 0.0f;
+
+    for(auto& image : graph.m_images)
+    {
+        image.m_first_use = GRAPH_NONE;
+        image.m_last_use = GRAPH_NONE;
+        image.m_usage = 0;
+        image.m_offset = 0;
+        image.m_requirements = {};
+    }
+    for(uint32_t position=0; position < order.size(); position++)
+    {
+        for(const auto& access : graph.m_passes[order[position]].m_accesses)
+        {
+            GraphImage& image = graph.m_images[access.m_resource];
+            if(image.m_first_use == GRAPH_NONE) image.m_first_use = position;
+            image.m_last_use = position;
+            image.m_usage |= v_get_image_usage(access.m_usage, image.m_format);
+        }
+    }
+
+    v_build_groups(graph, order);
+    // The render passes do not need the images, pipelines can still be created
+    VkResult result = v_create_transient_images(graph, order);
+    v_build_barriers(graph);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(g_renderer.m_selected_device, &properties);
+    if(properties.limits.timestampComputeAndGraphics && !order.empty())
+    {
+        VkQueryPoolCreateInfo query_pool_info{};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.pNext = nullptr;
+        query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_info.queryCount = 2 * (uint32_t)order.size();
+
+        vkCreateQueryPool(g_renderer.m_device, &query_pool_info, nullptr, &graph.m_timestamps);
+        graph.m_timestamp_period = properties.limits.timestampPeriod;
+    }
+    return result;
+}
+
+void v_destroy_render_graph(RenderGraph& graph)
+{
+    v_release_render_graph(graph);
+    graph.m_images.clear();
+    graph.m_passes.clear();
+}
+
+VkRenderPass v_get_graph_render_pass(const RenderGraph& graph, GraphPass pass)
+{
+    uint32_t group = graph.m_passes[pass].m_group;
+    if(group == GRAPH_NONE) return VK_NULL_HANDLE;
+    return graph.m_groups[group].m_render_pass;
+}
+
+uint32_t v_get_graph_subpass(const RenderGraph& graph, GraphPass pass)
+{
+    return graph.m_passes[pass].m_subpass;
+}
+
+uint64_t v_get_graph_render_pass_key(const RenderGraph& graph, GraphPass pass)
+{
+    uint32_t group = graph.m_passes[pass].m_group;
+    if(group == GRAPH_NONE) return 0;
+    return graph.m_groups[group].m_render_pass_key;
+}
+
+VkImageView v_get_graph_image_view(const RenderGraph& graph, GraphResource resource)
+{
+    return graph.m_images[resource].m_view;
+}
+
+VkExtent2D v_get_graph_image_extent(const RenderGraph& graph, GraphResource resource)
+{
+    return v_get_image_extent(graph.m_images[resource]);
+}
+
+VkExtent2D v_get_graph_render_extent(const RenderGraph& graph, GraphResource resource)
+{
+    const GraphImage& image = graph.m_images[resource];
+    if(!image.m_dynamic) return v_get_image_extent(image);
+    return v_scale_extent(v_get_image_extent(image), graph.m_render_scale);
+}
+
+float v_get_graph_pass_ms(const RenderGraph& graph, GraphPass pass)
+{
+    return graph.m_passes[pass].m_gpu_ms;
+}
+
+float v_get_graph_gpu_ms(const RenderGraph& graph)
+{
+    return graph.m_gpu_ms;
+}
+
+static void v_record_barriers(const RenderGraph& graph, VkCommandBuffer command_buffer, const std::vector<GraphBarrier>& barriers,
+    VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage)
+{
+    if(barriers.empty()) return;
+
+    ArenaScope scope(g_frame_arena);
+    VkImageMemoryBarrier* image_barriers = v_arena_push<VkImageMemoryBarrier>(g_frame_arena, barriers.size());
+    for(uint32_t i=0; i < barriers.size(); i++)
+    {
+        const GraphImage& image = graph.m_images[barriers[i].m_resource];
+        VkImageMemoryBarrier& barrier = image_barriers[i];
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.srcAccessMask = barriers[i].m_src_access;
+        barrier.dstAccessMask = barriers[i].m_dst_access;
+        barrier.oldLayout = barriers[i].m_old_layout;
+        barrier.newLayout = barriers[i].m_new_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image.m_image;
+        barrier.subresourceRange.aspectMask = v_get_aspect(image.m_format);
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr,
+        (uint32_t)barriers.size(), image_barriers);
+}
+
+// Imported views change every frame, so framebuffers are cached per view set
+static VkFramebuffer v_get_framebuffer(const RenderGraph& graph, GraphGroup& group)
+{
+    for(const auto& framebuffer : group.m_framebuffers)
+    {
+        bool match = true;
+        for(uint32_t i=0; i < group.m_attachments.size() && match; i++)
+        {
+            match = framebuffer.m_views[i] == graph.m_images[group.m_attachments[i]].m_view;
+        }
+        if(match) return framebuffer.m_framebuffer;
+    }
+
+    std::vector<VkImageView> views(group.m_attachments.size());
+    for(uint32_t i=0; i < group.m_attachments.size(); i++) views[i] = graph.m_images[group.m_attachments[i]].m_view;
+
+    VkFramebufferCreateInfo fb_info{};
+    fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    fb_info.pNext = nullptr;
+    fb_info.renderPass = group.m_render_pass;
+    fb_info.attachmentCount = (uint32_t)views.size();
+    fb_info.pAttachments = views.data();
+    fb_info.width = group.m_extent.width;
+    fb_info.height = group.m_extent.height;
+    fb_info.layers = 1;
+
+    GraphFramebuffer framebuffer;
+    framebuffer.m_views = views;
+    vkCreateFramebuffer(g_renderer.m_device, &fb_info, nullptr, &framebuffer.m_framebuffer);
+    group.m_framebuffers.push_back(framebuffer);
+    return framebuffer.m_framebuffer;
+}
+
+static void v_read_timestamps(RenderGraph& graph)
+{
+    uint32_t query_count = 0;
+    for(const auto& group : graph.m_groups) query_count += 2 * (uint32_t)group.m_passes.size();
+
+    // The previous frame finished in v_acquire_frame(), so this never stalls
+    ArenaScope scope(g_frame_arena);
+    uint64_t* timestamps = v_arena_push<uint64_t>(g_frame_arena, query_count);
+    VkResult result = vkGetQueryPoolResults(g_renderer.m_device, graph.m_timestamps, 0, query_count,
+        query_count * sizeof(uint64_t), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if(result != VK_SUCCESS) return;
+
+    uint32_t query = 0;
+    for(const auto& group : graph.m_groups)
+    {
+        for(GraphPass pass : group.m_passes)
+        {
+            uint64_t ticks = timestamps[query + 1] - timestamps[query];
+            graph.m_passes[pass].m_gpu_ms = (float)(ticks * graph.m_timestamp_period / 1000000.0);
+            query += 2;
+        }
+    }
+    graph.m_gpu_ms = (float)((timestamps[query_count - 1] - timestamps[0]) * graph.m_timestamp_period / 1000000.0);
+}
+
+static void v_execute_pass(RenderGraph& graph, GraphPass pass, VkCommandBuffer command_buffer, uint32_t& query)
+{
+    if(graph.m_timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, graph.m_timestamps, query);
+    v_begin_debug_label(command_buffer, graph.m_passes[pass].m_name.c_str());
+    graph.m_passes[pass].m_execute(command_buffer);
+    v_end_debug_label(command_buffer);
+    if(graph.m_timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, graph.m_timestamps, query + 1);
+    query += 2;
+}
+
+void v_execute_render_graph(RenderGraph& graph, VkCommandBuffer command_buffer)
+{
+    if(graph.m_timestamps)
+    {
+        if(graph.m_timestamps_written) v_read_timestamps(graph);
+        uint32_t query_count = 0;
+        for(const auto& group : graph.m_groups) query_count += 2 * (uint32_t)group.m_passes.size();
+        vkCmdResetQueryPool(command_buffer, graph.m_timestamps, 0, query_count);
+    }
+
+    uint32_t query = 0;
+    for(auto& group : graph.m_groups)
+    {
+        v_record_barriers(graph, command_buffer, group.m_barriers, group.m_src_stage, group.m_dst_stage);
+
+        if(!group.m_graphics)
+        {
+            for(GraphPass pass : group.m_passes) v_execute_pass(graph, pass, command_buffer, query);
+            continue;
+        }
+
+        VkExtent2D render_extent = group.m_dynamic ? v_scale_extent(group.m_extent, graph.m_render_scale) : group.m_extent;
+
+        VkRenderPassBeginInfo renderpass_begin_info{};
+        renderpass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderpass_begin_info.pNext = nullptr;
+        renderpass_begin_info.renderPass = group.m_render_pass;
+        renderpass_begin_info.renderArea.offset.x = 0;
+        renderpass_begin_info.renderArea.offset.y = 0;
+        renderpass_begin_info.renderArea.extent = render_extent;
+        renderpass_begin_info.framebuffer = v_get_framebuffer(graph, group);
+        renderpass_begin_info.clearValueCount = (uint32_t)group.m_clear_values.size();
+        renderpass_begin_info.pClearValues = group.m_clear_values.data();
+
+        if(group.m_secondary)
+        {
+            // Timestamps and the label go around the render pass instead
+            GraphPass pass = group.m_passes[0];
+            if(graph.m_timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, graph.m_timestamps, query);
+            v_begin_debug_label(command_buffer, graph.m_passes[pass].m_name.c_str());
+            vkCmdBeginRenderPass(command_buffer, &renderpass_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            graph.m_passes[pass].m_execute(command_buffer);
+            vkCmdEndRenderPass(command_buffer);
+            v_end_debug_label(command_buffer);
+            if(graph.m_timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, graph.m_timestamps, query + 1);
+            query += 2;
+            continue;
+        }
+
+        vkCmdBeginRenderPass(command_buffer, &renderpass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport{};
+        viewport.x = 0.0f; viewport.y = 0.0f;
+        viewport.width = (float)render_extent.width;
+        viewport.height = (float)render_extent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = render_extent;
+
+        for(uint32_t i=0; i < group.m_passes.size(); i++)
+        {
+            if(i > 0) vkCmdNextSubpass(command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+            vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+            vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+            v_execute_pass(graph, group.m_passes[i], command_buffer, query);
+        }
+
+        vkCmdEndRenderPass(command_buffer);
+    }
+
+    v_record_barriers(graph, command_buffer, graph.m_final_barriers, graph.m_final_src_stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    graph.m_timestamps_written = graph.m_timestamps != VK_NULL_HANDLE;
+}
+
+bool v_dump_render_graph(const RenderGraph& graph, const char* file_path)
+{
+    std::ofstream file(file_path);
+    if(!file.is_open()) return false;
+
+    file << "digraph render_graph {" << std::endl;
+    file << "    rankdir=LR;" << std::endl;
+    file << "    node [fontname=\"Helvetica\", fontsize=10];" << std::endl;
+    file << "    label=\"transient memory " << graph.m_transient_bytes / 1024 << " KB, "
+        << graph.m_transient_bytes_unaliased / 1024 << " KB without aliasing\";" << std::endl;
+
+    for(uint32_t g=0; g < graph.m_groups.size(); g++)
+    {
+        const GraphGroup& group = graph.m_groups[g];
+        file << "    subgraph cluster_" << g << " {" << std::endl;
+        file << "        label=\"" << (group.m_graphics ? "render pass " : "compute ") << g
+            << ", " << group.m_barriers.size() << " barriers" << (group.m_dynamic ? ", dynamic" : "")
+            << (group.m_secondary ? ", secondary" : "") << "\"; style=rounded;" << std::endl;
+        for(GraphPass pass : group.m_passes) file << "        pass" << pass << ";" << std::endl;
+        file << "    }" << std::endl;
+    }
+
+    for(uint32_t i=0; i < graph.m_passes.size(); i++)
+    {
+        const GraphPassData& pass = graph.m_passes[i];
+        file << "    pass" << i << " [shape=box, label=\"" << pass.m_name;
+        if(pass.m_culled) file << "\\nculled\", style=dashed, fontcolor=gray];" << std::endl;
+        else file << "\\nsubpass " << pass.m_subpass << ", " << pass.m_gpu_ms << " ms\"];" << std::endl;
+    }
+
+    for(uint32_t i=0; i < graph.m_images.size(); i++)
+    {
+        const GraphImage& image = graph.m_images[i];
+        VkExtent2D extent = v_get_image_extent(image);
+        file << "    image" << i << " [shape=ellipse, label=\"" << image.m_name << "\\nformat " << image.m_format
+            << ", " << extent.width << "x" << extent.height;
+        if(image.m_imported) file << "\\nimported\", style=filled, fillcolor=lightgray];" << std::endl;
+        else if(image.m_first_use == GRAPH_NONE) file << "\\nunused\", style=dashed, fontcolor=gray];" << std::endl;
+        else if(image.m_allocation) file << "\\n" << image.m_requirements.size / 1024 << " KB, own memory\"];" << std::endl;
+        else file << "\\n" << image.m_requirements.size / 1024 << " KB at " << image.m_offset << "\"];" << std::endl;
+    }
+
+    for(uint32_t i=0; i < graph.m_passes.size(); i++)
+    {
+        for(const auto& access : graph.m_passes[i].m_accesses)
+        {
+            const char* style = graph.m_passes[i].m_culled ? ", style=dashed" : "";
+            if(v_is_write(access.m_usage)) file << "    pass" << i << " -> image" << access.m_resource;
+            else file << "    image" << access.m_resource << " -> pass" << i;
+            file << " [label=\"" << g_usage_names[access.m_usage] << (access.m_clear ? " clear" : "") << "\"" << style << "];" << std::endl;
+        }
+    }
+
+    file << "}" << std::endl;
+    return true;
+}
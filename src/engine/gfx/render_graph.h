@@ -0,0 +1,223 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "renderer.h"
+
+// Frame graph. Passes declare how they use named images, the compiler then
+//   - culls passes whose results never reach an imported image,
+//   - merges consecutive graphics passes into subpasses of one render pass
+//     when they only exchange data through attachments,
+//   - derives load/store ops, layout transitions and the minimal barriers
+//     between passes from the declared usages,
+//   - places transient images with disjoint lifetimes at overlapping offsets
+//     of a single allocation.
+// The graph is built once and recompiled when the swapchain is resized.
+// Execution order is declaration order.
+// Dynamic images keep their full size, render passes drawing to them only
+// cover the top left part given by the render scale, which may change every
+// frame without recompiling.
+
+#define GRAPH_NONE 0xFFFFFFFF
+
+typedef uint32_t GraphResource;
+typedef uint32_t GraphPass;
+
+enum GraphPassType
+{
+    // Runs inside a render pass, needs at least one attachment
+    GRAPH_PASS_GRAPHICS,
+    // Runs outside of render passes: compute dispatches and transfers
+    GRAPH_PASS_COMPUTE
+};
+
+enum GraphUsage
+{
+    GRAPH_COLOR_ATTACHMENT,
+    GRAPH_DEPTH_ATTACHMENT,
+    GRAPH_DEPTH_READ,
+    GRAPH_INPUT_ATTACHMENT,
+    GRAPH_SAMPLED,
+    GRAPH_STORAGE_READ,
+    GRAPH_STORAGE_WRITE,
+    GRAPH_TRANSFER_SRC,
+    GRAPH_TRANSFER_DST
+};
+
+struct GraphAccess
+{
+    GraphResource m_resource;
+    GraphUsage m_usage;
+    bool m_clear;
+    // Depth clears use R
+    ClearValue m_clear_value;
+};
+
+struct GraphImage
+{
+    std::string m_name;
+    VkFormat m_format;
+    // Transient images are m_scale times the swapchain extent
+    float m_scale;
+    VkExtent2D m_extent;
+    bool m_dynamic;
+
+    bool m_imported;
+    VkImageLayout m_initial_layout;
+    VkPipelineStageFlags m_initial_stage;
+    VkImageLayout m_final_layout;
+
+    VkImage m_image;
+    VkImageView m_view;
+    VkImageUsageFlags m_usage;
+    VkMemoryRequirements m_requirements;
+    VkDeviceSize m_offset;
+    // Memory of its own when no memory type suits every transient image,
+    // otherwise VK_NULL_HANDLE and the image is at m_offset of the shared one
+    VmaAllocation m_allocation;
+
+    // Positions in the execution order, GRAPH_NONE when unused
+    uint32_t m_first_use;
+    uint32_t m_last_use;
+};
+
+struct GraphBarrier
+{
+    GraphResource m_resource;
+    VkImageLayout m_old_layout;
+    VkImageLayout m_new_layout;
+    VkAccessFlags m_src_access;
+    VkAccessFlags m_dst_access;
+};
+
+struct GraphFramebuffer
+{
+    std::vector<VkImageView> m_views;
+    VkFramebuffer m_framebuffer;
+};
+
+struct GraphPassData
+{
+    std::string m_name;
+    GraphPassType m_type;
+    std::vector<GraphAccess> m_accesses;
+    std::function<void(VkCommandBuffer)> m_execute;
+    // Kept even when nothing reads its results
+    bool m_side_effects;
+    // Records its draws into secondary command buffers
+    bool m_secondary;
+
+    bool m_culled;
+    uint32_t m_group;
+    uint32_t m_subpass;
+    float m_gpu_ms;
+};
+
+// One VkRenderPass with its subpasses, or a single compute pass
+struct GraphGroup
+{
+    std::vector<GraphPass> m_passes;
+    bool m_graphics;
+    VkExtent2D m_extent;
+    // Renders to dynamic images
+    bool m_dynamic;
+    // A single pass with secondary command buffers
+    bool m_secondary;
+
+    std::vector<GraphBarrier> m_barriers;
+    VkPipelineStageFlags m_src_stage;
+    VkPipelineStageFlags m_dst_stage;
+
+    VkRenderPass m_render_pass;
+    // Equal for compatible render passes, see v_get_graph_render_pass_key()
+    uint64_t m_render_pass_key;
+    std::vector<GraphResource> m_attachments;
+    std::vector<VkClearValue> m_clear_values;
+    // One per distinct set of imported views, i.e. per swapchain image
+    std::vector<GraphFramebuffer> m_framebuffers;
+};
+
+struct RenderGraph
+{
+    std::vector<GraphImage> m_images;
+    std::vector<GraphPassData> m_passes;
+
+    std::vector<GraphGroup> m_groups;
+    // Transitions of imported images to their final layout after the last group
+    std::vector<GraphBarrier> m_final_barriers;
+    VkPipelineStageFlags m_final_src_stage;
+
+    VmaAllocation m_transient_memory;
+    VkDeviceSize m_transient_bytes;
+    VkDeviceSize m_transient_bytes_unaliased;
+
+    // Of dynamic images, in (0, 1]
+    float m_render_scale = 1.0f;
+
+    VkQueryPool m_timestamps;
+    float m_timestamp_period;
+    bool m_timestamps_written;
+    float m_gpu_ms;
+};
+
+// Main API
+
+GraphResource v_create_graph_image(RenderGraph& graph, const char* name, VkFormat format, float scale);
+// Images owned outside the graph, e.g. the swapchain. Their handles are set
+// every frame with v_set_imported_image().
+GraphResource v_import_graph_image(RenderGraph& graph, const char* name, VkFormat format,
+    VkImageLayout initial_layout, VkPipelineStageFlags initial_stage, VkImageLayout final_layout);
+void v_set_imported_image(RenderGraph& graph, GraphResource resource, VkImage image, VkImageView view, VkExtent2D extent);
+// Transient images only. Render passes using it as an attachment must not
+// also draw to full size images.
+void v_set_graph_image_dynamic(RenderGraph& graph, GraphResource resource);
+void v_set_graph_render_scale(RenderGraph& graph, float scale);
+
+GraphPass v_add_graph_pass(RenderGraph& graph, const char* name, GraphPassType type,
+    std::function<void(VkCommandBuffer)> execute);
+void v_set_graph_side_effects(RenderGraph& graph, GraphPass pass);
+// Graphics passes only. The render pass begins with secondary command buffer
+// contents and the execute callback may only call vkCmdExecuteCommands() on
+// the command buffer it gets; the secondaries set their own viewport and
+// scissor to v_get_graph_render_extent(). Such a pass gets a render pass of
+// its own.
+void v_set_graph_secondary(RenderGraph& graph, GraphPass pass);
+void v_graph_use(RenderGraph& graph, GraphPass pass, GraphResource resource, GraphUsage usage);
+// Attachment write that clears first instead of loading
+void v_graph_clear(RenderGraph& graph, GraphPass pass, GraphResource resource, GraphUsage usage, ClearValue clear_value);
+
+// Creates render passes, transient images and their memory. Imported images
+// only need their format here. Call again after a swapchain resize; render
+// passes stay compatible, so pipelines survive. On failure the graph must not
+// be executed until it compiled successfully.
+VkResult v_compile_render_graph(RenderGraph& graph);
+void v_destroy_render_graph(RenderGraph& graph);
+
+// For pipeline creation, valid after v_compile_render_graph()
+VkRenderPass v_get_graph_render_pass(const RenderGraph& graph, GraphPass pass);
+uint32_t v_get_graph_subpass(const RenderGraph& graph, GraphPass pass);
+// Unlike the handle, stays the same when the graph is recompiled into a
+// compatible render pass, e.g. after a resize. Built from the pass and the
+// attachment formats, so pipelines can be cached by it.
+uint64_t v_get_graph_render_pass_key(const RenderGraph& graph, GraphPass pass);
+// For passes binding images as descriptors, changes when the graph is recompiled
+VkImageView v_get_graph_image_view(const RenderGraph& graph, GraphResource resource);
+VkExtent2D v_get_graph_image_extent(const RenderGraph& graph, GraphResource resource);
+// The part of the image rendered this frame, all of it unless dynamic
+VkExtent2D v_get_graph_render_extent(const RenderGraph& graph, GraphResource resource);
+// GPU time of the pass in the last finished frame
+float v_get_graph_pass_ms(const RenderGraph& graph, GraphPass pass);
+// GPU time from the start of the first pass to the end of the last one
+float v_get_graph_gpu_ms(const RenderGraph& graph);
+
+// Records the whole graph, outside of any render pass
+void v_execute_render_graph(RenderGraph& graph, VkCommandBuffer command_buffer);
+
+// Graphviz dot file with the culled passes, subpass merges, aliasing and the
+// GPU time of every pass from the last finished frame
+bool v_dump_render_graph(const RenderGraph& graph, const char* file_path);
@@ -0,0 +1,355 @@
+#include <vector>
+#include <string.h>
+#include "render_queue.h"
+
+#include "renderer.h"
+#include "geometry.h"
+#include "lighting.h"
+#include "meshlet_culling.h"
+#include "../core/job.h"
+#include "../core/allocator.h"
+
+// Queues smaller than this are sorted on the calling thread
+static const uint32_t PARALLEL_SORT_THRESHOLD = 16384;
+static const uint32_t RADIX_BITS = 8;
+static const uint32_t RADIX_BUCKETS = 1 << RADIX_BITS;
+static const uint32_t RADIX_PASSES = 64 / RADIX_BITS;
+
+static const uint64_t PIPELINE_MASK = 0xFFF;
+static const uint64_t MATERIAL_MASK = 0xFFFF;
+static const uint64_t DEPTH_MASK = 0xFFFFFF;
+
+uint64_t v_make_sort_key(uint8_t layer, bool translucent, uint32_t pipeline_id, uint32_t material_id, float view_depth)
+{
+    if(view_depth < 0.0f) view_depth = 0.0f;
+    if(view_depth > 1.0f) view_depth = 1.0f;
+
+    uint64_t depth = (uint64_t)(view_depth * (float)DEPTH_MASK);
+    uint64_t pipeline = pipeline_id & PIPELINE_MASK;
+    uint64_t material = material_id & MATERIAL_MASK;
+    uint64_t key = (uint64_t)layer << 56;
+
+    if(translucent)
+    {
+        key |= 1ull << 55;
+        key |= (DEPTH_MASK - depth) << 31;
+        key |= pipeline << 19;
+        key |= material << 3;
+    } else {
+        key |= pipeline << 43;
+        key |= material << 27;
+        key |= depth << 3;
+    }
+
+    return key;
+}
+
+void v_clear_render_queue(RenderQueue& queue)
+{
+    queue.m_items.clear();
+    queue.m_entries.clear();
+    queue.m_ranges.clear();
+}
+
+uint32_t v_allocate_draws(RenderQueue& queue, uint32_t count)
+{
+    uint32_t first = (uint32_t)queue.m_items.size();
+    queue.m_items.resize(first + count);
+    queue.m_entries.resize(first + count);
+    return first;
+}
+
+void v_write_draw(RenderQueue& queue, uint32_t index, uint64_t sort_key, Model& model, GraphicsPipeline& pipeline, const PushConstant& constants, uint32_t instance)
+{
+    SortEntry& entry = queue.m_entries[index];
+    entry.m_key = sort_key;
+    entry.m_index = index;
+
+    DrawItem& item = queue.m_items[index];
+    item.m_model = &model;
+    item.m_pipeline = &pipeline;
+    item.m_constants = constants;
+    item.m_instance = instance;
+}
+
+void v_submit_draw(RenderQueue& queue, uint64_t sort_key, Model& model, GraphicsPipeline& pipeline, const PushConstant& constants, uint32_t instance)
+{
+    uint32_t index = v_allocate_draws(queue, 1);
+    v_write_draw(queue, index, sort_key, model, pipeline, constants, instance);
+}
+
+// Single threaded LSD radix sort. All eight histograms are built in one sweep,
+// and passes where every key shares the same digit are skipped.
+static void v_radix_sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+    uint32_t count = (uint32_t)entries.size();
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+    memset(histograms, 0, sizeof(histograms));
+
+    for(uint32_t i=0; i < count; i++)
+    {
+        uint64_t key = entries[i].m_key;
+        for(uint32_t pass=0; pass < RADIX_PASSES; pass++)
+        {
+            histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    SortEntry* src = entries.data();
+    SortEntry* dst = scratch.data();
+
+    for(uint32_t pass=0; pass < RADIX_PASSES; pass++)
+    {
+        uint32_t shift = pass * RADIX_BITS;
+        uint32_t* histogram = histograms[pass];
+        if(histogram[(src[0].m_key >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+        uint32_t offsets[RADIX_BUCKETS];
+        uint32_t sum = 0;
+        for(uint32_t bucket=0; bucket < RADIX_BUCKETS; bucket++)
+        {
+            offsets[bucket] = sum;
+            sum += histogram[bucket];
+        }
+
+        for(uint32_t i=0; i < count; i++)
+        {
+            dst[offsets[(src[i].m_key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+        }
+
+        SortEntry* swap = src; src = dst; dst = swap;
+    }
+
+    if(src != entries.data()) memcpy(entries.data(), src, count * sizeof(SortEntry));
+}
+
+// Parallel LSD radix sort. Every pass splits the keys into one chunk per worker,
+// counts each chunk, and scatters the chunks in order so the sort stays stable.
+static void v_parallel_radix_sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+    uint32_t count = (uint32_t)entries.size();
+    uint32_t chunk_count = v_get_worker_count();
+    uint32_t chunk_size = (count + chunk_count - 1) / chunk_count;
+    chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    ArenaScope scope(g_frame_arena);
+    uint32_t* histograms = v_arena_push<uint32_t>(g_frame_arena, chunk_count * RADIX_BUCKETS);
+    SortEntry* src = entries.data();
+    SortEntry* dst = scratch.data();
+
+    for(uint32_t pass=0; pass < RADIX_PASSES; pass++)
+    {
+        uint32_t shift = pass * RADIX_BITS;
+
+        v_parallel_for(count, chunk_size, [&](uint32_t begin, uint32_t end, uint32_t) {
+            uint32_t* histogram = &histograms[(begin / chunk_size) * RADIX_BUCKETS];
+            memset(histogram, 0, RADIX_BUCKETS * sizeof(uint32_t));
+            for(uint32_t i=begin; i < end; i++)
+            {
+                histogram[(src[i].m_key >> shift) & (RADIX_BUCKETS - 1)]++;
+            }
+        });
+
+        // Turn the counts into scatter offsets, bucket major then chunk order
+        bool skip_pass = false;
+        uint32_t sum = 0;
+        for(uint32_t bucket=0; bucket < RADIX_BUCKETS; bucket++)
+        {
+            uint32_t bucket_start = sum;
+            for(uint32_t chunk=0; chunk < chunk_count; chunk++)
+            {
+                uint32_t& slot = histograms[chunk * RADIX_BUCKETS + bucket];
+                uint32_t chunk_total = slot;
+                slot = sum;
+                sum += chunk_total;
+            }
+            if(sum - bucket_start == count) skip_pass = true;
+        }
+        if(skip_pass) continue;
+
+        v_parallel_for(count, chunk_size, [&](uint32_t begin, uint32_t end, uint32_t) {
+            uint32_t* offsets = &histograms[(begin / chunk_size) * RADIX_BUCKETS];
+            for(uint32_t i=begin; i < end; i++)
+            {
+                dst[offsets[(src[i].m_key >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+            }
+        });
+
+        SortEntry* swap = src; src = dst; dst = swap;
+    }
+
+    if(src != entries.data()) memcpy(entries.data(), src, count * sizeof(SortEntry));
+}
+
+void v_sort_render_queue(RenderQueue& queue)
+{
+    if(queue.m_entries.size() < 2) return;
+    queue.m_scratch.resize(queue.m_entries.size());
+
+    if(queue.m_entries.size() >= PARALLEL_SORT_THRESHOLD && v_get_worker_count() > 1)
+    {
+        v_parallel_radix_sort(queue.m_entries, queue.m_scratch);
+    } else {
+        v_radix_sort(queue.m_entries, queue.m_scratch);
+    }
+}
+
+// Each entry gets a contiguous range of the indirect buffer in sort order,
+// so the flush can batch neighbouring ranges. Models with meshlets get one
+// command per meshlet, written by the culling pass.
+void v_write_draw_ranges(RenderQueue& queue)
+{
+    queue.m_ranges.resize(queue.m_entries.size());
+    queue.m_stats.m_meshlet_draws = 0;
+    queue.m_stats.m_meshlets = 0;
+
+    uint32_t command_count = queue.m_first_command;
+    uint32_t job_count = queue.m_first_job;
+
+    for(uint32_t i=0; i < queue.m_entries.size(); i++)
+    {
+        DrawItem& item = queue.m_items[queue.m_entries[i].m_index];
+        Model& model = *item.m_model;
+        DrawRange& range = queue.m_ranges[i];
+        range.m_first_command = DRAW_RANGE_NONE;
+        range.m_command_count = 0;
+        range.m_meshlets = false;
+
+        if(!g_renderer.m_multi_draw_indirect) continue;
+        uint32_t free_commands = g_renderer.m_max_indirect_draws - command_count;
+
+        bool use_meshlets = g_meshlet_culling.m_enabled && model.m_meshlet_count > 0 &&
+            model.m_meshlet_count <= free_commands && job_count < g_meshlet_culling.m_max_jobs;
+        if(use_meshlets)
+        {
+            MeshletCullJob& job = g_meshlet_culling.m_jobs[job_count++];
+            job.m_instance = item.m_instance;
+            job.m_first_meshlet = model.m_meshlet_allocation.m_offset;
+            job.m_meshlet_count = model.m_meshlet_count;
+            job.m_first_command = command_count;
+            job.m_first_index = model.m_index_allocation.m_offset;
+            job.m_vertex_offset = (int32_t)model.m_vertex_allocation.m_offset;
+
+            range.m_first_command = command_count;
+            range.m_command_count = model.m_meshlet_count;
+            range.m_meshlets = true;
+            command_count += model.m_meshlet_count;
+            queue.m_stats.m_meshlet_draws++;
+            queue.m_stats.m_meshlets += model.m_meshlet_count;
+        } else if(free_commands > 0) {
+            VkDrawIndexedIndirectCommand& command = g_renderer.m_indirect_commands[command_count];
+            command.indexCount = model.m_index_count;
+            command.instanceCount = 1;
+            command.firstIndex = model.m_index_allocation.m_offset;
+            command.vertexOffset = (int32_t)model.m_vertex_allocation.m_offset;
+            command.firstInstance = item.m_instance;
+
+            range.m_first_command = command_count;
+            range.m_command_count = 1;
+            command_count++;
+        }
+    }
+
+    queue.m_command_end = command_count;
+    queue.m_job_end = job_count;
+}
+
+void v_prepare_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer)
+{
+    v_write_draw_ranges(queue);
+    v_dispatch_meshlet_culling(command_buffer, queue.m_job_end);
+}
+
+static void v_draw_batch(VkCommandBuffer command_buffer, uint32_t first, uint32_t count, RenderQueueStats& stats)
+{
+    if(count == 0) return;
+    vkCmdDrawIndexedIndirect(command_buffer, g_renderer.m_indirect_buffer.m_buffer,
+        first * sizeof(VkDrawIndexedIndirectCommand), count, sizeof(VkDrawIndexedIndirectCommand));
+    stats.m_indirect_draws++;
+}
+
+void v_flush_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer, bool late)
+{
+    if(late && !g_meshlet_culling.m_occlusion_active) return;
+    v_record_render_queue(queue, command_buffer, late);
+}
+
+// Every model lives in the geometry pool, so the vertex and index buffers are
+// bound once. Consecutive draws sharing a pipeline and push constants become
+// one multi-draw indirect call over their prepared ranges. Entries without a
+// range are drawn one by one.
+void v_record_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer, bool late)
+{
+    // The late flush adds to the counts of the early one
+    RenderQueueStats stats = queue.m_stats;
+    if(!late)
+    {
+        stats = {};
+        stats.m_meshlet_draws = queue.m_stats.m_meshlet_draws;
+        stats.m_meshlets = queue.m_stats.m_meshlets;
+    }
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+    const PushConstant* bound_constants = nullptr;
+
+    // Ranges follow the sort order, a batch is [batch_first, command_end)
+    uint32_t command_end = 0;
+    uint32_t batch_first = 0;
+
+    if(!queue.m_entries.empty()) v_bind_geometry_pool(command_buffer);
+
+    for(uint32_t i=0; i < queue.m_entries.size(); i++)
+    {
+        DrawItem& item = queue.m_items[queue.m_entries[i].m_index];
+        const DrawRange& range = queue.m_ranges[i];
+        GraphicsPipeline& pipeline = *item.m_pipeline;
+        Model& model = *item.m_model;
+        if(late && !range.m_meshlets) continue;
+
+        bool pipeline_changed = pipeline.m_pipeline != bound_pipeline;
+        bool constants_changed = pipeline_changed || memcmp(bound_constants, &item.m_constants, sizeof(PushConstant)) != 0;
+
+        if(constants_changed)
+        {
+            v_draw_batch(command_buffer, batch_first, command_end - batch_first, stats);
+            batch_first = command_end;
+        }
+
+        if(pipeline_changed)
+        {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.m_pipeline);
+            bound_pipeline = pipeline.m_pipeline;
+            stats.m_pipeline_binds++;
+
+            VkDescriptorSet sets[] = {g_renderer.m_instance_set, g_lighting.m_set};
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.m_pipeline_layout,
+                0, 2, sets, 0, nullptr);
+        } else stats.m_pipeline_binds_skipped++;
+
+        if(constants_changed)
+        {
+            vkCmdPushConstants(command_buffer, pipeline.m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstant), &item.m_constants);
+            bound_constants = &item.m_constants;
+        }
+
+        stats.m_draw_count++;
+        if(range.m_first_command != DRAW_RANGE_NONE)
+        {
+            // The late flush skips the ranges of whole-model draws
+            if(range.m_first_command != command_end)
+            {
+                v_draw_batch(command_buffer, batch_first, command_end - batch_first, stats);
+                batch_first = range.m_first_command;
+            }
+            command_end = range.m_first_command + range.m_command_count;
+        } else {
+            // Keep the submission order, pending indirect draws go first
+            v_draw_batch(command_buffer, batch_first, command_end - batch_first, stats);
+            batch_first = command_end;
+            vkCmdDrawIndexed(command_buffer, model.m_index_count, 1, model.m_index_allocation.m_offset,
+                (int32_t)model.m_vertex_allocation.m_offset, item.m_instance);
+        }
+    }
+
+    v_draw_batch(command_buffer, batch_first, command_end - batch_first, stats);
+    queue.m_stats = stats;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "model.h"
+#include "pipeline.h"
+#include "push_constant.h"
+
+// Sort key layout, most significant bits first:
+//   opaque:      layer(8) | 0 | pipeline(12) | material(16) | depth(24)
+//   translucent: layer(8) | 1 | inverted depth(24) | pipeline(12) | material(16)
+// Opaque draws are grouped by state and then drawn front-to-back, translucent
+// draws are drawn back-to-front.
+
+struct DrawItem
+{
+    Model* m_model;
+    GraphicsPipeline* m_pipeline;
+    PushConstant m_constants;
+    uint32_t m_instance;
+};
+
+struct SortEntry
+{
+    uint64_t m_key;
+    uint32_t m_index;
+};
+
+#define DRAW_RANGE_NONE 0xFFFFFFFF
+
+// Indirect commands of one sorted entry, DRAW_RANGE_NONE when drawn directly
+struct DrawRange
+{
+    uint32_t m_first_command;
+    uint32_t m_command_count;
+    // Written by meshlet culling, drawn again in the late phase
+    bool m_meshlets;
+};
+
+struct RenderQueueStats
+{
+    uint32_t m_draw_count;
+    uint32_t m_pipeline_binds;
+    uint32_t m_pipeline_binds_skipped;
+    // vkCmdDrawIndexedIndirect calls, each covering a run of draws
+    uint32_t m_indirect_draws;
+    // Draws culled per meshlet on the GPU, and the meshlets they cover
+    uint32_t m_meshlet_draws;
+    uint32_t m_meshlets;
+};
+
+struct RenderQueue
+{
+    std::vector<DrawItem> m_items;
+    std::vector<SortEntry> m_entries;
+    std::vector<SortEntry> m_scratch;
+    // Indexed like m_entries, filled by v_write_draw_ranges()
+    std::vector<DrawRange> m_ranges;
+    RenderQueueStats m_stats;
+
+    // Where the queue's ranges start in the indirect buffer and the meshlet
+    // job list, to place it after ranges that are kept between frames
+    uint32_t m_first_command;
+    uint32_t m_first_job;
+    // One past the last command and job written by v_write_draw_ranges()
+    uint32_t m_command_end;
+    uint32_t m_job_end;
+};
+
+// view_depth is the distance along the view axis divided by the far plane
+uint64_t v_make_sort_key(uint8_t layer, bool translucent, uint32_t pipeline_id, uint32_t material_id, float view_depth);
+
+void v_clear_render_queue(RenderQueue& queue);
+// instance indexes the renderer instance buffer, see v_get_transform_slot()
+void v_submit_draw(RenderQueue& queue, uint64_t sort_key, Model& model, GraphicsPipeline& pipeline, const PushConstant& constants, uint32_t instance);
+// For filling the queue from several threads: reserve a range up front,
+// then write each slot of it exactly once.
+uint32_t v_allocate_draws(RenderQueue& queue, uint32_t count);
+void v_write_draw(RenderQueue& queue, uint32_t index, uint64_t sort_key, Model& model, GraphicsPipeline& pipeline, const PushConstant& constants, uint32_t instance);
+void v_sort_render_queue(RenderQueue& queue);
+// After sorting. Writes the indirect commands into the mapped buffer of
+// v_init_indirect_buffer() and the meshlet culling jobs, starting at
+// m_first_command and m_first_job.
+void v_write_draw_ranges(RenderQueue& queue);
+// v_write_draw_ranges(), then the early meshlet culling phase over every job
+// below m_job_end, outside of a render pass. Jobs of ranges kept from an
+// earlier frame are culled again with this frame's camera.
+void v_prepare_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer);
+// The late flush only draws meshlet ranges, after v_dispatch_meshlet_culling_late(),
+// and does nothing without occlusion culling this frame
+void v_flush_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer, bool late);
+// Same without the occlusion check, for command buffers replayed in later frames
+void v_record_render_queue(RenderQueue& queue, VkCommandBuffer command_buffer, bool late);
@@ -3,7 +3,14 @@
 #include <iostream>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <chrono>
 #include "renderer.h"
+#include "memory.h"
+#include "sync.h"
+#include "../core/allocator.h"
 
 Renderer g_renderer = {};
 
@@ -14,7 +21,9 @@ uint32_t clamp(uint32_t d, uint32_t min, uint32_t max) {
   return t > max ? max : t;
 }
 
-#ifndef DEBUG
+static const char* VALIDATION_LAYER_NAME = "VK_LAYER_KHRONOS_validation";
+static const char* g_diagnostics_names[] = {"off", "markers", "validation", "gpu"};
+
 static VKAPI_ATTR VkBool32 VKAPI_CALL v_debug_callback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
     VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -22,27 +31,23 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL v_debug_callback(
     void* pUserData
 ) 
 {
-    if(messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
-    {
-        std::cout << pCallbackData->pMessage << std::endl;
-    }
-
+    std::cout << pCallbackData->pMessage << std::endl;
     return VK_FALSE;
 }
 
-void v_create_debug_messenger_info(VkDebugUtilsMessengerCreateInfoEXT& debug_messenger_info)
+// Verbose and info messages are not requested, the layer would format every one of them
+static void v_create_debug_messenger_info(VkDebugUtilsMessengerCreateInfoEXT& debug_messenger_info)
 {
     debug_messenger_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
     debug_messenger_info.pNext = nullptr;
     debug_messenger_info.pUserData = nullptr;
-    debug_messenger_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-        VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    debug_messenger_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
     debug_messenger_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
         VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
     debug_messenger_info.pfnUserCallback = v_debug_callback;
 }
 
-VkResult v_init_debug_messenger()
+static VkResult v_init_debug_messenger()
 {
     VkDebugUtilsMessengerCreateInfoEXT debug_messenger_info{};
     v_create_debug_messenger_info(debug_messenger_info);
@@ -53,79 +58,199 @@ VkResult v_init_debug_messenger()
     if(func != nullptr) return func(g_renderer.m_instance,
         &debug_messenger_info, nullptr, &g_renderer.m_debug_messenger
     );
-    else VK_ERROR_EXTENSION_NOT_PRESENT;
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
 }
 
-void v_destroy_debug_messenger()
+static void v_destroy_debug_messenger()
 {
     PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT)
         vkGetInstanceProcAddr(g_renderer.m_instance, "vkDestroyDebugUtilsMessengerEXT");
     
     if(func != nullptr) func(g_renderer.m_instance, g_renderer.m_debug_messenger, nullptr);
+    g_renderer.m_debug_messenger = VK_NULL_HANDLE;
+}
+
+static bool v_has_instance_extension(const char* layer_name, const char* name)
+{
+    uint32_t extension_count = 0;
+    vkEnumerateInstanceExtensionProperties(layer_name, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateInstanceExtensionProperties(layer_name, &extension_count, extensions.data());
+
+    for(const auto& extension : extensions)
+    {
+        if(strcmp(extension.extensionName, name) == 0) return true;
+    }
+    return false;
+}
+
+static bool v_has_instance_layer(const char* name)
+{
+    uint32_t layer_count = 0;
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+    std::vector<VkLayerProperties> layers(layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, layers.data());
+
+    for(const auto& layer : layers)
+    {
+        if(strcmp(layer.layerName, name) == 0) return true;
+    }
+    return false;
 }
-#endif
 
 // Main API definitions
 
-void v_init_instance(const char* app_name)
+DiagnosticsLevel v_get_diagnostics_level()
+{
+    const char* level_override = getenv("VIME_DIAGNOSTICS");
+    if(level_override)
+    {
+        for(uint32_t i=0; i < sizeof(g_diagnostics_names) / sizeof(g_diagnostics_names[0]); i++)
+        {
+            if(strcmp(level_override, g_diagnostics_names[i]) == 0) return (DiagnosticsLevel)i;
+        }
+        std::cout << "VIME_DIAGNOSTICS=" << level_override << " is not one of off, markers, validation, gpu" << std::endl;
+    }
+    return VIME_DEFAULT_DIAGNOSTICS;
+}
+
+void v_init_instance(const char* app_name, const char* const* required_extensions, uint32_t required_extension_count,
+    DiagnosticsLevel diagnostics)
 {
     VkApplicationInfo app_info{};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.pNext = nullptr;
     app_info.pEngineName = "VIME";
     app_info.pApplicationName = app_name;
-
-    uint32_t extension_count = 0;
-    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, nullptr);
-    std::vector<VkExtensionProperties> extensions(extension_count);
-    vkEnumerateInstanceExtensionProperties(nullptr, &extension_count, extensions.data());
-    std::vector<char*> extension_names(extension_count);
-    
-    for(uint32_t i=0; i < extension_count; i++)
+    app_info.apiVersion = VK_API_VERSION_1_1;
+
+    // Drop to the highest level this machine supports
+    if(diagnostics >= DIAGNOSTICS_VALIDATION && !v_has_instance_layer(VALIDATION_LAYER_NAME)) diagnostics = DIAGNOSTICS_MARKERS;
+    if(diagnostics == DIAGNOSTICS_GPU_VALIDATION
+        && !v_has_instance_extension(VALIDATION_LAYER_NAME, VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME)) diagnostics = DIAGNOSTICS_VALIDATION;
+    if(diagnostics >= DIAGNOSTICS_MARKERS && !v_has_instance_extension(nullptr, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)
+        && !(diagnostics >= DIAGNOSTICS_VALIDATION && v_has_instance_extension(VALIDATION_LAYER_NAME, VK_EXT_DEBUG_UTILS_EXTENSION_NAME)))
     {
-        extension_names[i] = _strdup(extensions[i].extensionName);
+        diagnostics = DIAGNOSTICS_OFF;
     }
+    g_renderer.m_diagnostics = diagnostics;
+    if(diagnostics != DIAGNOSTICS_OFF) std::cout << "Diagnostics: " << g_diagnostics_names[diagnostics] << std::endl;
+
+    std::vector<const char*> extension_names(required_extensions, required_extensions + required_extension_count);
+    std::vector<const char*> layer_names;
+    if(diagnostics >= DIAGNOSTICS_MARKERS) extension_names.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+    if(diagnostics >= DIAGNOSTICS_VALIDATION) layer_names.push_back(VALIDATION_LAYER_NAME);
+    if(diagnostics == DIAGNOSTICS_GPU_VALIDATION) extension_names.push_back(VK_EXT_VALIDATION_FEATURES_EXTENSION_NAME);
 
     VkInstanceCreateInfo instance_info{};
     instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pNext = nullptr;
     instance_info.pApplicationInfo = &app_info;
+    instance_info.enabledExtensionCount = (uint32_t)extension_names.size();
+    instance_info.ppEnabledExtensionNames = extension_names.data();
+    instance_info.enabledLayerCount = (uint32_t)layer_names.size();
+    instance_info.ppEnabledLayerNames = layer_names.data();
 
-#ifndef DEBUG
+    // Also reports problems of vkCreateInstance itself
     VkDebugUtilsMessengerCreateInfoEXT debug_messenger_info{};
     v_create_debug_messenger_info(debug_messenger_info);
-    instance_info.pNext = &debug_messenger_info;
+    if(diagnostics >= DIAGNOSTICS_VALIDATION) instance_info.pNext = &debug_messenger_info;
+
+    VkValidationFeatureEnableEXT validation_enables[] = {
+        VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_EXT,
+        VK_VALIDATION_FEATURE_ENABLE_GPU_ASSISTED_RESERVE_BINDING_SLOT_EXT,
+        VK_VALIDATION_FEATURE_ENABLE_SYNCHRONIZATION_VALIDATION_EXT
+    };
+
+    VkValidationFeaturesEXT validation_features{};
+    validation_features.sType = VK_STRUCTURE_TYPE_VALIDATION_FEATURES_EXT;
+    validation_features.pNext = nullptr;
+    validation_features.enabledValidationFeatureCount = 3;
+    validation_features.pEnabledValidationFeatures = validation_enables;
+    if(diagnostics == DIAGNOSTICS_GPU_VALIDATION)
+    {
+        validation_features.pNext = instance_info.pNext;
+        instance_info.pNext = &validation_features;
+    }
 
-    instance_info.enabledExtensionCount = extension_count + 1;
-    extension_names.resize(extension_count + 1);
-    extension_names[extension_count] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
-    instance_info.ppEnabledExtensionNames = extension_names.data();
+    vkCreateInstance(&instance_info, nullptr, &g_renderer.m_instance);
 
-    const char* layer_names = "VK_LAYER_KHRONOS_validation";
+    if(diagnostics >= DIAGNOSTICS_VALIDATION) v_init_debug_messenger();
+    if(diagnostics >= DIAGNOSTICS_MARKERS)
+    {
+        g_renderer.m_cmd_begin_label = (PFN_vkCmdBeginDebugUtilsLabelEXT)
+            vkGetInstanceProcAddr(g_renderer.m_instance, "vkCmdBeginDebugUtilsLabelEXT");
+        g_renderer.m_cmd_end_label = (PFN_vkCmdEndDebugUtilsLabelEXT)
+            vkGetInstanceProcAddr(g_renderer.m_instance, "vkCmdEndDebugUtilsLabelEXT");
+        g_renderer.m_set_object_name = (PFN_vkSetDebugUtilsObjectNameEXT)
+            vkGetInstanceProcAddr(g_renderer.m_instance, "vkSetDebugUtilsObjectNameEXT");
+    }
+}
 
-    instance_info.enabledLayerCount = 1;
-    instance_info.ppEnabledLayerNames = &layer_names;
-#else
-    instance_info.pNext = nullptr;
-    instance_info.enabledLayerCount = 0;
-    instance_info.ppEnabledLayerNames = nullptr;
-#endif
+void v_destroy_instance()
+{
+    if(g_renderer.m_debug_messenger) v_destroy_debug_messenger();
+    vkDestroyInstance(g_renderer.m_instance, nullptr);
+}
 
-    instance_info.enabledExtensionCount = extension_count;
-    instance_info.ppEnabledExtensionNames = extension_names.data();
+void v_begin_debug_label(VkCommandBuffer command_buffer, const char* name)
+{
+    if(!g_renderer.m_cmd_begin_label) return;
 
-    vkCreateInstance(&instance_info, nullptr, &g_renderer.m_instance);
+    VkDebugUtilsLabelEXT label{};
+    label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+    label.pNext = nullptr;
+    label.pLabelName = name;
+    g_renderer.m_cmd_begin_label(command_buffer, &label);
+}
 
-#ifndef DEBUG
-    v_init_debug_messenger();
-#endif 
+void v_end_debug_label(VkCommandBuffer command_buffer)
+{
+    if(g_renderer.m_cmd_end_label) g_renderer.m_cmd_end_label(command_buffer);
 }
 
-void v_destroy_instance()
+void v_set_debug_name(VkObjectType type, uint64_t handle, const char* name)
 {
-#ifndef DEBUG
-    v_destroy_debug_messenger();
-#endif
-    vkDestroyInstance(g_renderer.m_instance, nullptr);
+    if(!g_renderer.m_set_object_name) return;
+
+    VkDebugUtilsObjectNameInfoEXT name_info{};
+    name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+    name_info.pNext = nullptr;
+    name_info.objectType = type;
+    name_info.objectHandle = handle;
+    name_info.pObjectName = name;
+    g_renderer.m_set_object_name(g_renderer.m_device, &name_info);
+}
+
+double v_measure_call_overhead(uint32_t call_count)
+{
+    VkCommandBufferAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.pNext = nullptr;
+    allocate_info.commandPool = g_renderer.m_command_pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+
+    VkCommandBuffer command_buffer;
+    vkAllocateCommandBuffers(g_renderer.m_device, &allocate_info, &command_buffer);
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = nullptr;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    // Dynamic state is never validated against a pipeline, so the time is
+    // the dispatch through the layers and little else
+    VkViewport viewport{0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t i=0; i < call_count; i++) vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    auto end = std::chrono::steady_clock::now();
+
+    vkEndCommandBuffer(command_buffer);
+    vkFreeCommandBuffers(g_renderer.m_device, g_renderer.m_command_pool, 1, &command_buffer);
+
+    return std::chrono::duration<double, std::nano>(end - start).count() / call_count;
 }
 
 void v_init_surface(VkSurfaceKHR surface)
@@ -138,92 +263,235 @@ void v_destroy_surface()
     vkDestroySurfaceKHR(g_renderer.m_instance, g_renderer.m_surface_khr, nullptr);
 }
 
-void v_init_device()
+static const uint32_t QUEUE_FAMILY_NONE = 0xFFFFFFFF;
+
+static bool v_has_device_extension(VkPhysicalDevice device, const char* name)
+{
+    uint32_t extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, extensions.data());
+
+    for(const auto& extension : extensions)
+    {
+        if(strcmp(extension.extensionName, name) == 0) return true;
+    }
+    return false;
+}
+
+// First family with all of the required flags and none of the avoided ones
+static uint32_t v_find_queue_family(const std::vector<VkQueueFamilyProperties>& families,
+    VkQueueFlags required, VkQueueFlags avoided)
+{
+    for(uint32_t i=0; i < families.size(); i++)
+    {
+        if(families[i].queueCount == 0) continue;
+        if((families[i].queueFlags & required) == required && !(families[i].queueFlags & avoided)) return i;
+    }
+    return QUEUE_FAMILY_NONE;
+}
+
+static uint32_t v_find_present_family(VkPhysicalDevice device, uint32_t queue_family_count, uint32_t graphics_family)
+{
+    // Presenting from the graphics family avoids sharing the swapchain images
+    VkBool32 present_support = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(device, graphics_family, g_renderer.m_surface_khr, &present_support);
+    if(present_support) return graphics_family;
+
+    for(uint32_t i=0; i < queue_family_count; i++)
+    {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, g_renderer.m_surface_khr, &present_support);
+        if(present_support) return i;
+    }
+    return QUEUE_FAMILY_NONE;
+}
+
+// Negative when the device can not run the renderer at all
+static int64_t v_score_device(VkPhysicalDevice device)
+{
+    if(!v_has_device_extension(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) return -1;
+    if(!v_has_device_extension(device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) return -1;
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features{};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timeline_features;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+    if(!timeline_features.timelineSemaphore) return -1;
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+
+    uint32_t graphics_family = v_find_queue_family(queue_families, VK_QUEUE_GRAPHICS_BIT, 0);
+    if(graphics_family == QUEUE_FAMILY_NONE) return -1;
+    if(v_find_present_family(device, queue_family_count, graphics_family) == QUEUE_FAMILY_NONE) return -1;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device, &properties);
+
+    int64_t type_score = 0;
+    switch(properties.deviceType)
+    {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: type_score = 4; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: type_score = 3; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: type_score = 2; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: type_score = 1; break;
+        default: break;
+    }
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+    VkDeviceSize device_local = 0;
+    for(uint32_t i=0; i < memory_properties.memoryHeapCount; i++)
+    {
+        if(memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) device_local += memory_properties.memoryHeaps[i].size;
+    }
+
+    // The type always wins, memory in MiB only breaks ties
+    return type_score * 1000000000ll + (int64_t)(device_local >> 20);
+}
+
+static bool v_matches_device_override(const char* device_override, uint32_t index, const char* device_name)
+{
+    char* end;
+    unsigned long override_index = strtoul(device_override, &end, 10);
+    if(*device_override && *end == '\0') return override_index == index;
+
+    std::string name = device_name;
+    std::string pattern = device_override;
+    for(auto& c : name) c = (char)tolower(c);
+    for(auto& c : pattern) c = (char)tolower(c);
+    return name.find(pattern) != std::string::npos;
+}
+
+static VkPhysicalDevice v_select_physical_device()
 {
     uint32_t physical_device_count = 0;
     vkEnumeratePhysicalDevices(g_renderer.m_instance, &physical_device_count, nullptr);
     std::vector<VkPhysicalDevice> physical_devices(physical_device_count);
     vkEnumeratePhysicalDevices(g_renderer.m_instance, &physical_device_count, physical_devices.data());
-    g_renderer.m_selected_device = physical_devices[0];
 
-    uint32_t queue_family_count = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(g_renderer.m_selected_device, &queue_family_count, nullptr);
-    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
-    vkGetPhysicalDeviceQueueFamilyProperties(g_renderer.m_selected_device, &queue_family_count, queue_families.data());
+    const char* device_override = getenv("VIME_DEVICE");
+    VkPhysicalDevice selected = VK_NULL_HANDLE;
+    int64_t best_score = -1;
 
-    VkBool32 graphics_support = VK_FALSE;
-    VkBool32 present_support = VK_FALSE;
-    for(uint32_t i=0; i < queue_family_count; i++)
+    for(uint32_t i=0; i < physical_device_count; i++)
     {
-        if(!graphics_support)
-        {
-            if(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-            {
-                g_renderer.m_graphics_queue_family = i;
-                graphics_support = VK_TRUE;
-                continue;
-            }
-        }
+        int64_t score = v_score_device(physical_devices[i]);
+        if(score < 0) continue;
 
-        if(!present_support)
+        if(device_override)
         {
-            vkGetPhysicalDeviceSurfaceSupportKHR(
-                g_renderer.m_selected_device, i, g_renderer.m_surface_khr, &present_support
-            );
-            if(present_support) g_renderer.m_present_queue_family = i; continue;
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
+            if(v_matches_device_override(device_override, i, properties.deviceName)) return physical_devices[i];
         }
 
-        if(present_support && graphics_support)
+        if(score > best_score)
         {
-            break;
+            best_score = score;
+            selected = physical_devices[i];
         }
     }
 
-    float queue_priorities = 1.0f;
+    if(device_override) std::cout << "VIME_DEVICE=" << device_override << " matches no usable device, falling back to scoring" << std::endl;
+    return selected;
+}
 
-    VkDeviceQueueCreateInfo graphics_queue_info{};
-    VkDeviceQueueCreateInfo present_queue_info{};
-    
-    graphics_queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    graphics_queue_info.pNext = nullptr;
-    graphics_queue_info.queueCount = 1;
-    graphics_queue_info.queueFamilyIndex = g_renderer.m_graphics_queue_family;
-    graphics_queue_info.pQueuePriorities = &queue_priorities;
-
-    present_queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    present_queue_info.pNext = nullptr;
-    present_queue_info.queueCount = 1;
-    present_queue_info.queueFamilyIndex = g_renderer.m_present_queue_family;
-    present_queue_info.pQueuePriorities = &queue_priorities;
-    
-    VkDeviceQueueCreateInfo queue_create_infos[] = {graphics_queue_info, present_queue_info};
+void v_init_device()
+{
+    g_renderer.m_selected_device = v_select_physical_device();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(g_renderer.m_selected_device, &properties);
+    std::cout << "Device: " << properties.deviceName << std::endl;
+
+    uint32_t queue_family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(g_renderer.m_selected_device, &queue_family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(g_renderer.m_selected_device, &queue_family_count, queue_families.data());
+
+    // Dedicated families first: compute without graphics, transfer without either
+    uint32_t graphics_family = v_find_queue_family(queue_families, VK_QUEUE_GRAPHICS_BIT, 0);
+    uint32_t compute_family = v_find_queue_family(queue_families, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if(compute_family == QUEUE_FAMILY_NONE) compute_family = graphics_family;
+    uint32_t transfer_family = v_find_queue_family(queue_families, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if(transfer_family == QUEUE_FAMILY_NONE) transfer_family = v_find_queue_family(queue_families, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if(transfer_family == QUEUE_FAMILY_NONE) transfer_family = graphics_family;
+
+    g_renderer.m_graphics_queue_family = graphics_family;
+    g_renderer.m_present_queue_family = v_find_present_family(g_renderer.m_selected_device, queue_family_count, graphics_family);
+    g_renderer.m_compute_queue_family = compute_family;
+    g_renderer.m_transfer_queue_family = transfer_family;
+
+    // Every role gets its own queue while the family has queues left, then shares the last one
+    std::vector<uint32_t> queues_used(queue_family_count, 0);
+    auto take_queue = [&](uint32_t family) {
+        uint32_t index = HMM_MIN(queues_used[family], queue_families[family].queueCount - 1);
+        queues_used[family]++;
+        return index;
+    };
+    uint32_t graphics_index = take_queue(graphics_family);
+    uint32_t present_index = 0;
+    if(g_renderer.m_present_queue_family == graphics_family) present_index = graphics_index;
+    else present_index = take_queue(g_renderer.m_present_queue_family);
+    uint32_t compute_index = take_queue(compute_family);
+    uint32_t transfer_index = take_queue(transfer_family);
+
+    float queue_priorities[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
+    g_renderer.m_queue_families.clear();
+    for(uint32_t i=0; i < queue_family_count; i++)
+    {
+        if(queues_used[i] == 0) continue;
+
+        VkDeviceQueueCreateInfo queue_info{};
+        queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queue_info.pNext = nullptr;
+        queue_info.queueCount = HMM_MIN(queues_used[i], queue_families[i].queueCount);
+        queue_info.queueFamilyIndex = i;
+        queue_info.pQueuePriorities = queue_priorities;
+        queue_create_infos.push_back(queue_info);
+        g_renderer.m_queue_families.push_back(i);
+    }
+
+    // Without multi-draw indirect the render queue falls back to one draw call per item
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(g_renderer.m_selected_device, &supported_features);
+    g_renderer.m_multi_draw_indirect = supported_features.multiDrawIndirect && supported_features.drawIndirectFirstInstance;
 
     VkPhysicalDeviceFeatures device_features{};
+    device_features.multiDrawIndirect = supported_features.multiDrawIndirect;
+    device_features.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features{};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    timeline_features.pNext = nullptr;
+    timeline_features.timelineSemaphore = VK_TRUE;
+
     VkDeviceCreateInfo device_info{};
     device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    device_info.pNext = nullptr;
-    device_info.queueCreateInfoCount = 2;
-    device_info.pQueueCreateInfos = queue_create_infos;
+    device_info.pNext = &timeline_features;
+    device_info.queueCreateInfoCount = (uint32_t)queue_create_infos.size();
+    device_info.pQueueCreateInfos = queue_create_infos.data();
     device_info.pEnabledFeatures = &device_features;
 
-    const char* device_extension = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    std::vector<const char*> device_extensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME};
+    g_renderer.m_memory_budget_supported = v_has_device_extension(g_renderer.m_selected_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(g_renderer.m_memory_budget_supported) device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
 
-    device_info.enabledExtensionCount = 1;
-    device_info.ppEnabledExtensionNames = &device_extension;
+    device_info.enabledExtensionCount = (uint32_t)device_extensions.size();
+    device_info.ppEnabledExtensionNames = device_extensions.data();
     device_info.enabledLayerCount = 0;
     device_info.ppEnabledLayerNames = nullptr;
 
     vkCreateDevice(g_renderer.m_selected_device, &device_info, nullptr, &g_renderer.m_device);
-    vkGetDeviceQueue(g_renderer.m_device,
-        g_renderer.m_graphics_queue_family,
-        0,
-        &g_renderer.m_graphics_queue
-    );
-    vkGetDeviceQueue(g_renderer.m_device,
-        g_renderer.m_present_queue_family,
-        0,
-        &g_renderer.m_present_queue
-    );
+    vkGetDeviceQueue(g_renderer.m_device, graphics_family, graphics_index, &g_renderer.m_graphics_queue);
+    vkGetDeviceQueue(g_renderer.m_device, g_renderer.m_present_queue_family, present_index, &g_renderer.m_present_queue);
+    vkGetDeviceQueue(g_renderer.m_device, compute_family, compute_index, &g_renderer.m_compute_queue);
+    vkGetDeviceQueue(g_renderer.m_device, transfer_family, transfer_index, &g_renderer.m_transfer_queue);
 }
 
 void v_destroy_device()
@@ -231,12 +499,53 @@ void v_destroy_device()
     vkDestroyDevice(g_renderer.m_device, nullptr);
 }
 
+VkQueue v_get_queue(QueueType type)
+{
+    switch(type)
+    {
+        case QUEUE_COMPUTE: return g_renderer.m_compute_queue;
+        case QUEUE_TRANSFER: return g_renderer.m_transfer_queue;
+        default: return g_renderer.m_graphics_queue;
+    }
+}
+
+uint32_t v_get_queue_family(QueueType type)
+{
+    switch(type)
+    {
+        case QUEUE_COMPUTE: return g_renderer.m_compute_queue_family;
+        case QUEUE_TRANSFER: return g_renderer.m_transfer_queue_family;
+        default: return g_renderer.m_graphics_queue_family;
+    }
+}
+
+VkCommandPool v_create_command_pool(QueueType type, VkCommandPoolCreateFlags flags)
+{
+    VkCommandPoolCreateInfo cmd_pool_info{};
+    cmd_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmd_pool_info.pNext = nullptr;
+    cmd_pool_info.queueFamilyIndex = v_get_queue_family(type);
+    cmd_pool_info.flags = flags;
+
+    VkCommandPool command_pool;
+    vkCreateCommandPool(g_renderer.m_device, &cmd_pool_info, nullptr, &command_pool);
+    return command_pool;
+}
+
+void v_add_frame_wait(SyncTicket ticket, VkPipelineStageFlags wait_stage)
+{
+    g_renderer.m_frame_waits.push_back(SyncWait{ticket, wait_stage});
+}
+
 void v_init_allocator()
 {
     VmaAllocatorCreateInfo allocator_info{};
     allocator_info.physicalDevice = g_renderer.m_selected_device;
     allocator_info.device = g_renderer.m_device;
     allocator_info.instance = g_renderer.m_instance;
+    allocator_info.vulkanApiVersion = VK_API_VERSION_1_1;
+    // Without the extension VMA estimates the budget from the heap sizes
+    if(g_renderer.m_memory_budget_supported) allocator_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
     vmaCreateAllocator(&allocator_info, &g_renderer.m_allocator);
 }
 
@@ -245,16 +554,142 @@ void v_destroy_allocator()
     vmaDestroyAllocator(g_renderer.m_allocator);
 }
 
-void v_init_swapchain(uint32_t width, uint32_t height)
+void v_init_instance_buffer(uint32_t max_instances)
 {
-    VkSurfaceCapabilitiesKHR surface_capabilities;
-    std::vector<VkSurfaceFormatKHR> surface_formats;
+    g_renderer.m_max_instances = max_instances;
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = 2;
+    set_layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_renderer.m_instance_set_layout);
+
+    VkDescriptorPoolSize pool_sizes[2];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 1;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    pool_sizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_renderer.m_descriptor_pool);
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_renderer.m_descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &g_renderer.m_instance_set_layout;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, &g_renderer.m_instance_set);
+
+    v_create_buffer(g_renderer.m_instance_buffer, max_instances * sizeof(hmm_mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+
+    v_create_buffer(g_renderer.m_view_buffer, sizeof(hmm_mat4), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+
+    // Stay mapped, the transform system writes into the instances directly
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, g_renderer.m_instance_buffer.m_allocation, &data);
+    g_renderer.m_instance_data = (hmm_mat4*)data;
+    vmaMapMemory(g_renderer.m_allocator, g_renderer.m_view_buffer.m_allocation, &data);
+    g_renderer.m_view_projection = (hmm_mat4*)data;
+    *g_renderer.m_view_projection = HMM_Mat4d(1.0f);
+
+    VkDescriptorBufferInfo buffer_infos[2] = {};
+    buffer_infos[0].buffer = g_renderer.m_instance_buffer.m_buffer;
+    buffer_infos[0].offset = 0;
+    buffer_infos[0].range = VK_WHOLE_SIZE;
+    buffer_infos[1].buffer = g_renderer.m_view_buffer.m_buffer;
+    buffer_infos[1].offset = 0;
+    buffer_infos[1].range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet writes[2] = {};
+    for(uint32_t i=0; i < 2; i++)
+    {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].pNext = nullptr;
+        writes[i].dstSet = g_renderer.m_instance_set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = bindings[i].descriptorType;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
 
-    VkBool32 support = VK_FALSE;
-    vkGetPhysicalDeviceSurfaceSupportKHR(
-        g_renderer.m_selected_device, g_renderer.m_graphics_queue_family,
-        g_renderer.m_surface_khr, &support
+    vkUpdateDescriptorSets(g_renderer.m_device, 2, writes, 0, nullptr);
+}
+
+void v_destroy_instance_buffer()
+{
+    vmaUnmapMemory(g_renderer.m_allocator, g_renderer.m_instance_buffer.m_allocation);
+    v_destroy_buffer(g_renderer.m_instance_buffer);
+    vmaUnmapMemory(g_renderer.m_allocator, g_renderer.m_view_buffer.m_allocation);
+    v_destroy_buffer(g_renderer.m_view_buffer);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_renderer.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_renderer.m_instance_set_layout, nullptr);
+}
+
+void v_init_indirect_buffer(uint32_t max_draws)
+{
+    g_renderer.m_max_indirect_draws = max_draws;
+    v_create_buffer(g_renderer.m_indirect_buffer, max_draws * sizeof(VkDrawIndexedIndirectCommand),
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, g_renderer.m_indirect_buffer.m_allocation, &data);
+    g_renderer.m_indirect_commands = (VkDrawIndexedIndirectCommand*)data;
+}
+
+void v_destroy_indirect_buffer()
+{
+    vmaUnmapMemory(g_renderer.m_allocator, g_renderer.m_indirect_buffer.m_allocation);
+    v_destroy_buffer(g_renderer.m_indirect_buffer);
+}
+
+VkPresentModeKHR v_select_present_mode(VkPresentModeKHR requested)
+{
+    uint32_t mode_count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(
+        g_renderer.m_selected_device, g_renderer.m_surface_khr, &mode_count, nullptr
     );
+    std::vector<VkPresentModeKHR> present_modes(mode_count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(
+        g_renderer.m_selected_device, g_renderer.m_surface_khr, &mode_count, present_modes.data()
+    );
+
+    for(uint32_t i=0; i < mode_count; i++)
+    {
+        if(present_modes[i] == requested) return requested;
+    }
+
+    // FIFO is the only mode every implementation has to support
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void v_create_swapchain(uint32_t width, uint32_t height, VkSwapchainKHR old_swapchain)
+{
+    VkSurfaceCapabilitiesKHR surface_capabilities;
+    std::vector<VkSurfaceFormatKHR> surface_formats;
 
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
         g_renderer.m_selected_device, g_renderer.m_surface_khr, &surface_capabilities
@@ -267,7 +702,7 @@ void v_init_swapchain(uint32_t width, uint32_t height)
 
     if(format_count != 0)
     {
-        surface_formats.reserve(format_count);
+        surface_formats.resize(format_count);
         vkGetPhysicalDeviceSurfaceFormatsKHR(
             g_renderer.m_selected_device, g_renderer.m_surface_khr, &format_count, surface_formats.data()
         );
@@ -307,6 +742,8 @@ void v_init_swapchain(uint32_t width, uint32_t height)
         image_count = surface_capabilities.maxImageCount;
     }
 
+    g_renderer.m_present_mode = v_select_present_mode(g_renderer.m_requested_present_mode);
+
     VkSwapchainCreateInfoKHR swapchain_info{};
     swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     swapchain_info.pNext = nullptr;
@@ -318,13 +755,13 @@ void v_init_swapchain(uint32_t width, uint32_t height)
     swapchain_info.imageArrayLayers = 1;
     swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
+    uint32_t queue_family_indices[] = {
+        g_renderer.m_graphics_queue_family,
+        g_renderer.m_present_queue_family
+    };
+
     if(g_renderer.m_graphics_queue_family != g_renderer.m_present_queue_family)
     {
-        uint32_t queue_family_indices[] = {
-            g_renderer.m_graphics_queue_family,
-            g_renderer.m_present_queue_family
-        };
-
         swapchain_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         swapchain_info.queueFamilyIndexCount = 2;
         swapchain_info.pQueueFamilyIndices = queue_family_indices;
@@ -336,9 +773,9 @@ void v_init_swapchain(uint32_t width, uint32_t height)
 
     swapchain_info.preTransform = surface_capabilities.currentTransform;
     swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    swapchain_info.presentMode = g_renderer.m_present_mode;
     swapchain_info.clipped = VK_TRUE;
-    swapchain_info.oldSwapchain = VK_NULL_HANDLE;
+    swapchain_info.oldSwapchain = old_swapchain;
 
     vkCreateSwapchainKHR(
         g_renderer.m_device, &swapchain_info, nullptr, &g_renderer.m_swapchain
@@ -346,7 +783,7 @@ void v_init_swapchain(uint32_t width, uint32_t height)
 
     vkGetSwapchainImagesKHR(
         g_renderer.m_device, g_renderer.m_swapchain, &image_count, nullptr
-    ); g_renderer.m_swapchain_images.reserve(image_count);
+    ); g_renderer.m_swapchain_images.resize(image_count);
     
     vkGetSwapchainImagesKHR(
         g_renderer.m_device, g_renderer.m_swapchain, &image_count, g_renderer.m_swapchain_images.data()
@@ -354,6 +791,12 @@ void v_init_swapchain(uint32_t width, uint32_t height)
 
     g_renderer.m_swapchain_image_size = image_count;
     g_renderer.m_swapchain_image_format = surface_format.format;
+    g_renderer.m_swapchain_dirty = false;
+}
+
+void v_init_swapchain(uint32_t width, uint32_t height)
+{
+    v_create_swapchain(width, height, VK_NULL_HANDLE);
 }
 
 void v_destroy_swapchain()
@@ -363,41 +806,25 @@ void v_destroy_swapchain()
     );
 }
 
-void v_init_render_pass()
+void v_set_present_mode(VkPresentModeKHR present_mode)
 {
-    VkAttachmentDescription attachment{};
-    attachment.format = g_renderer.m_swapchain_image_format;
-    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    VkAttachmentReference attachment_ref{};
-    attachment_ref.attachment = 0;
-    attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpass{};
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &attachment_ref;
-
-    VkRenderPassCreateInfo render_pass_info{};
-    render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    render_pass_info.pNext = nullptr;
-    render_pass_info.attachmentCount = 1;
-    render_pass_info.pAttachments = &attachment;
-    render_pass_info.subpassCount = 1;
-    render_pass_info.pSubpasses = &subpass;
-
-    vkCreateRenderPass(g_renderer.m_device, &render_pass_info, nullptr, &g_renderer.m_render_pass);
+    if(present_mode == g_renderer.m_requested_present_mode) return;
+    g_renderer.m_requested_present_mode = present_mode;
+    g_renderer.m_swapchain_dirty = true;
 }
 
-void v_destroy_render_pass()
+void v_recreate_swapchain(uint32_t width, uint32_t height)
 {
-    vkDestroyRenderPass(g_renderer.m_device, g_renderer.m_render_pass, nullptr);
+    // The old images may still be in flight. The render graph has to be
+    // recompiled afterwards, pipelines survive since its render passes stay compatible.
+    vkDeviceWaitIdle(g_renderer.m_device);
+    v_destroy_swapchain_views();
+
+    VkSwapchainKHR old_swapchain = g_renderer.m_swapchain;
+    v_create_swapchain(width, height, old_swapchain);
+    vkDestroySwapchainKHR(g_renderer.m_device, old_swapchain, nullptr);
+
+    v_init_swapchain_views();
 }
 
 void v_init_cmd_pool()
@@ -409,10 +836,17 @@ void v_init_cmd_pool()
     cmd_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
     vkCreateCommandPool(g_renderer.m_device, &cmd_pool_info, nullptr, &g_renderer.m_command_pool);
+
+    g_renderer.m_upload_command_pool = v_create_command_pool(QUEUE_TRANSFER, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    g_renderer.m_secondary_command_pool = v_create_command_pool(QUEUE_GRAPHICS, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+    g_renderer.m_secondary_used = 0;
 }
 
 void v_destroy_cmd_pool()
 {
+    vkDestroyCommandPool(g_renderer.m_device, g_renderer.m_secondary_command_pool, nullptr);
+    g_renderer.m_secondary_command_buffers.clear();
+    vkDestroyCommandPool(g_renderer.m_device, g_renderer.m_upload_command_pool, nullptr);
     vkDestroyCommandPool(g_renderer.m_device, g_renderer.m_command_pool, nullptr);
 }
 
@@ -428,10 +862,100 @@ void v_allocate_cmd_buffer()
     vkAllocateCommandBuffers(g_renderer.m_device, &cmd_buffer_info, &g_renderer.m_command_buffer);
 }
 
-void v_init_framebuffers()
+void v_begin_secondary(VkCommandBuffer command_buffer, VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent,
+    VkCommandBufferUsageFlags flags)
+{
+    VkCommandBufferInheritanceInfo inheritance_info{};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.pNext = nullptr;
+    inheritance_info.renderPass = render_pass;
+    inheritance_info.subpass = subpass;
+    inheritance_info.framebuffer = VK_NULL_HANDLE;
+
+    VkCommandBufferBeginInfo cmd_begin_info{};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.pNext = nullptr;
+    cmd_begin_info.pInheritanceInfo = &inheritance_info;
+    cmd_begin_info.flags = flags | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &cmd_begin_info);
+
+    // Dynamic state is not inherited from the primary
+    VkViewport viewport{};
+    viewport.x = 0.0f; viewport.y = 0.0f;
+    viewport.width = (float)extent.width;
+    viewport.height = (float)extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = extent;
+
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+}
+
+VkCommandBuffer v_begin_frame_secondary(VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent)
+{
+    if(g_renderer.m_secondary_used == g_renderer.m_secondary_command_buffers.size())
+    {
+        VkCommandBufferAllocateInfo cmd_buffer_info{};
+        cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmd_buffer_info.pNext = nullptr;
+        cmd_buffer_info.commandBufferCount = 1;
+        cmd_buffer_info.commandPool = g_renderer.m_secondary_command_pool;
+        cmd_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+        VkCommandBuffer command_buffer;
+        vkAllocateCommandBuffers(g_renderer.m_device, &cmd_buffer_info, &command_buffer);
+        g_renderer.m_secondary_command_buffers.push_back(command_buffer);
+    }
+
+    VkCommandBuffer command_buffer = g_renderer.m_secondary_command_buffers[g_renderer.m_secondary_used++];
+    v_begin_secondary(command_buffer, render_pass, subpass, extent, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    return command_buffer;
+}
+
+SyncTicket v_submit_upload(const std::function<void(VkCommandBuffer)>& record)
+{
+    VkCommandBufferAllocateInfo cmd_buffer_info{};
+    cmd_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_buffer_info.pNext = nullptr;
+    cmd_buffer_info.commandBufferCount = 1;
+    cmd_buffer_info.commandPool = g_renderer.m_upload_command_pool;
+    cmd_buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    VkCommandBuffer command_buffer;
+    vkAllocateCommandBuffers(g_renderer.m_device, &cmd_buffer_info, &command_buffer);
+
+    VkCommandBufferBeginInfo cmd_begin_info{};
+    cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_begin_info.pNext = nullptr;
+    cmd_begin_info.pInheritanceInfo = nullptr;
+    cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &cmd_begin_info);
+    record(command_buffer);
+    vkEndCommandBuffer(command_buffer);
+
+    SyncTicket ticket = v_submit(QUEUE_TRANSFER, command_buffer, 0, nullptr, VK_NULL_HANDLE, 0, VK_NULL_HANDLE);
+    v_defer_destruction(ticket, [command_buffer]() {
+        vkFreeCommandBuffers(g_renderer.m_device, g_renderer.m_upload_command_pool, 1, &command_buffer);
+    });
+    v_add_frame_wait(ticket, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    return ticket;
+}
+
+void v_immediate_submit(const std::function<void(VkCommandBuffer)>& record)
 {
-    g_renderer.m_swapchain_image_views.reserve(g_renderer.m_swapchain_image_size);
-    g_renderer.m_framebuffers.reserve(g_renderer.m_swapchain_image_size);
+    v_wait_ticket(v_submit_upload(record));
+}
+
+void v_init_swapchain_views()
+{
+    g_renderer.m_swapchain_image_views.resize(g_renderer.m_swapchain_image_size);
     
     for(uint32_t i=0; i < g_renderer.m_swapchain_image_size; i++)
     {
@@ -454,31 +978,13 @@ void v_init_framebuffers()
         vkCreateImageView(
             g_renderer.m_device, &iv_info, nullptr, &g_renderer.m_swapchain_image_views[i]
         );
-
-        VkFramebufferCreateInfo fb_info{};
-        fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        fb_info.pNext = nullptr;
-        fb_info.renderPass = g_renderer.m_render_pass;
-        fb_info.attachmentCount = 1;
-        fb_info.pAttachments = &g_renderer.m_swapchain_image_views[i];
-        fb_info.width = g_renderer.m_win_extent.width;
-        fb_info.height = g_renderer.m_win_extent.height;
-        fb_info.layers = 1;
-
-        vkCreateFramebuffer(
-            g_renderer.m_device, &fb_info, nullptr, &g_renderer.m_framebuffers[i]
-        );
     }
 }
 
-void v_destroy_framebuffers()
+void v_destroy_swapchain_views()
 {
     for(uint32_t i=0; i < g_renderer.m_swapchain_image_size; i++)
     {
-        vkDestroyFramebuffer(
-            g_renderer.m_device, g_renderer.m_framebuffers[i], nullptr
-        );
-
         vkDestroyImageView(
             g_renderer.m_device, g_renderer.m_swapchain_image_views[i], nullptr
         );
@@ -487,12 +993,7 @@ void v_destroy_framebuffers()
 
 void v_init_sync_structs()
 {
-    VkFenceCreateInfo fence_info{};
-    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fence_info.pNext = nullptr;
-    fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    
-    vkCreateFence(g_renderer.m_device, &fence_info, nullptr, &g_renderer.m_render_fence);
+    g_renderer.m_frame_ticket = SYNC_TICKET_NONE;
 
     VkSemaphoreCreateInfo semaphore_info{};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -507,20 +1008,34 @@ void v_destroy_sync_structs()
 {
     vkDestroySemaphore(g_renderer.m_device, g_renderer.m_present_semaphore, nullptr);
     vkDestroySemaphore(g_renderer.m_device, g_renderer.m_render_semaphore, nullptr);
-    vkDestroyFence(g_renderer.m_device, g_renderer.m_render_fence, nullptr);
 }
 
-void v_begin_rendering(ClearValue clear_value)
+bool v_acquire_frame()
 {
-    vkWaitForFences(g_renderer.m_device, 1, &g_renderer.m_render_fence, true, 1000000000);
-    vkResetFences(g_renderer.m_device, 1, &g_renderer.m_render_fence);
+    v_wait_ticket(g_renderer.m_frame_ticket);
+    v_collect_garbage();
 
-    vkAcquireNextImageKHR(
-        g_renderer.m_device, g_renderer.m_swapchain, 1000000000,
+    VkResult result = vkAcquireNextImageKHR(
+        g_renderer.m_device, g_renderer.m_swapchain, UINT64_MAX,
         g_renderer.m_present_semaphore, nullptr, &g_renderer.m_swapchain_image_idx
     );
 
+    if(result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+        g_renderer.m_swapchain_dirty = true;
+        return false;
+    }
+    if(result == VK_SUBOPTIMAL_KHR) g_renderer.m_swapchain_dirty = true;
+
+    return true;
+}
+
+void v_begin_frame()
+{
+    v_reset_arena(g_frame_arena);
     vkResetCommandBuffer(g_renderer.m_command_buffer, 0);
+    vkResetCommandPool(g_renderer.m_device, g_renderer.m_secondary_command_pool, 0);
+    g_renderer.m_secondary_used = 0;
 
     VkCommandBufferBeginInfo cmd_begin_info{};
     cmd_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -529,45 +1044,18 @@ void v_begin_rendering(ClearValue clear_value)
     cmd_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     vkBeginCommandBuffer(g_renderer.m_command_buffer, &cmd_begin_info);
-    
-    VkClearValue vk_clear_value;
-    vk_clear_value.color = {{clear_value.R, clear_value.G, clear_value.B, clear_value.A}};
-    VkRenderPassBeginInfo renderpass_begin_info{};
-    renderpass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderpass_begin_info.pNext = nullptr;
-    renderpass_begin_info.renderPass = g_renderer.m_render_pass;
-    renderpass_begin_info.renderArea.offset.x = 0;
-    renderpass_begin_info.renderArea.offset.y = 0;
-    renderpass_begin_info.renderArea.extent = g_renderer.m_win_extent;
-    renderpass_begin_info.framebuffer = g_renderer.m_framebuffers[g_renderer.m_swapchain_image_idx];
-    renderpass_begin_info.clearValueCount = 1;
-    renderpass_begin_info.pClearValues = &vk_clear_value;
-
-    vkCmdBeginRenderPass(
-        g_renderer.m_command_buffer, &renderpass_begin_info, VK_SUBPASS_CONTENTS_INLINE
-    );
+    v_record_defragmentation(g_renderer.m_command_buffer);
 }
 
-void v_end_rendering()
+void v_end_frame()
 {
-    vkCmdEndRenderPass(g_renderer.m_command_buffer);
     vkEndCommandBuffer(g_renderer.m_command_buffer);
 
-    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext = nullptr;
-    submit_info.pWaitDstStageMask = &wait_stage;
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = &g_renderer.m_present_semaphore;
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &g_renderer.m_render_semaphore;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &g_renderer.m_command_buffer;
-    
-    vkQueueSubmit(
-        g_renderer.m_graphics_queue, 1, &submit_info, g_renderer.m_render_fence
+    g_renderer.m_frame_ticket = v_submit(QUEUE_GRAPHICS, g_renderer.m_command_buffer,
+        (uint32_t)g_renderer.m_frame_waits.size(), g_renderer.m_frame_waits.data(),
+        g_renderer.m_present_semaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, g_renderer.m_render_semaphore
     );
+    g_renderer.m_frame_waits.clear();
 
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -578,12 +1066,17 @@ void v_end_rendering()
     present_info.pWaitSemaphores = &g_renderer.m_render_semaphore;
     present_info.pImageIndices = &g_renderer.m_swapchain_image_idx;
 
-    vkQueuePresentKHR(
-        g_renderer.m_graphics_queue, &present_info
+    VkResult result = vkQueuePresentKHR(
+        g_renderer.m_present_queue, &present_info
     );
+
+    if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    {
+        g_renderer.m_swapchain_dirty = true;
+    }
 }
 
-void v_wait_for_fences()
+void v_wait_for_frame()
 {
-    vkWaitForFences(g_renderer.m_device, 1, &g_renderer.m_render_fence, true, 1000000000);
+    v_wait_ticket(g_renderer.m_frame_ticket);
 }
\ No newline at end of file
@@ -1,11 +1,37 @@
 #pragma once
 
 #include <vector>
+#include <functional>
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
+#include <HandmadeMath.h>
+
+#include "buffer.h"
+#include "sync.h"
 
 // Main API
 
+// Each level includes the ones below. Everything past OFF costs CPU time on
+// every API call, see v_measure_call_overhead().
+enum DiagnosticsLevel
+{
+    DIAGNOSTICS_OFF,
+    // Debug utils labels and object names for captures in RenderDoc or Nsight
+    DIAGNOSTICS_MARKERS,
+    // Khronos validation layer, warnings and errors printed to stdout
+    DIAGNOSTICS_VALIDATION,
+    // Also GPU-assisted and synchronization validation, much slower
+    DIAGNOSTICS_GPU_VALIDATION
+};
+
+#ifndef VIME_DEFAULT_DIAGNOSTICS
+#ifdef DEBUG
+#define VIME_DEFAULT_DIAGNOSTICS DIAGNOSTICS_VALIDATION
+#else
+#define VIME_DEFAULT_DIAGNOSTICS DIAGNOSTICS_OFF
+#endif
+#endif
+
 typedef struct
 {
     float R;
@@ -18,75 +44,168 @@ struct Renderer
 {
     VkExtent2D m_win_extent;
     VkInstance m_instance;
-    #ifndef DEBUG
+    DiagnosticsLevel m_diagnostics;
     VkDebugUtilsMessengerEXT m_debug_messenger;
-    #endif
+    // Null below DIAGNOSTICS_MARKERS
+    PFN_vkCmdBeginDebugUtilsLabelEXT m_cmd_begin_label;
+    PFN_vkCmdEndDebugUtilsLabelEXT m_cmd_end_label;
+    PFN_vkSetDebugUtilsObjectNameEXT m_set_object_name;
     VkSurfaceKHR m_surface_khr;
     VkPhysicalDevice m_selected_device;    
     VkDevice m_device;
+    bool m_multi_draw_indirect;
         
     uint32_t m_graphics_queue_family;
     uint32_t m_present_queue_family;
+    uint32_t m_compute_queue_family;
+    uint32_t m_transfer_queue_family;
     VkQueue m_graphics_queue;
     VkQueue m_present_queue;
+    VkQueue m_compute_queue;
+    VkQueue m_transfer_queue;
+    // Distinct families of the queues above, for buffers shared between them
+    std::vector<uint32_t> m_queue_families;
+
+    // Tickets the next frame submission waits on, e.g. async compute results
+    std::vector<SyncWait> m_frame_waits;
 
     VkSwapchainKHR m_swapchain;
+    VkPresentModeKHR m_requested_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+    VkPresentModeKHR m_present_mode;
+    bool m_swapchain_dirty;
     uint32_t m_swapchain_image_size;
     VkFormat m_swapchain_image_format;
     std::vector<VkImage> m_swapchain_images;
     std::vector<VkImageView> m_swapchain_image_views;
-    std::vector<VkFramebuffer> m_framebuffers;
 
-    VkRenderPass m_render_pass;
     VkCommandPool m_command_pool;
     VkCommandBuffer m_command_buffer;
+    // Secondaries of the frame being recorded, the pool is reset by v_begin_frame()
+    VkCommandPool m_secondary_command_pool;
+    std::vector<VkCommandBuffer> m_secondary_command_buffers;
+    uint32_t m_secondary_used;
 
     uint32_t m_swapchain_image_idx;
+    // Binary, the swapchain can not use timeline semaphores
     VkSemaphore m_render_semaphore;
     VkSemaphore m_present_semaphore;
-    VkFence m_render_fence;
+    SyncTicket m_frame_ticket;
+
+    // Uploads on the transfer queue, one command buffer per submission
+    VkCommandPool m_upload_command_pool;
 
     VmaAllocator m_allocator;
+    bool m_memory_budget_supported;
+
+    // One world matrix per instance, indexed with gl_InstanceIndex, and the
+    // view projection matrix of the frame
+    VkDescriptorSetLayout m_instance_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_instance_set;
+    AllocatedBuffer m_instance_buffer;
+    hmm_mat4* m_instance_data;
+    uint32_t m_max_instances;
+    AllocatedBuffer m_view_buffer;
+    hmm_mat4* m_view_projection;
+
+    // Written by v_prepare_render_queue() every frame, meshlet draws by the
+    // meshlet culling pass
+    AllocatedBuffer m_indirect_buffer;
+    VkDrawIndexedIndirectCommand* m_indirect_commands;
+    uint32_t m_max_indirect_draws;
 };
 
 extern Renderer g_renderer;
 
-void v_init_instance(const char* app_name);
+// VIME_DEFAULT_DIAGNOSTICS, unless the VIME_DIAGNOSTICS environment variable
+// names a level: off, markers, validation or gpu
+DiagnosticsLevel v_get_diagnostics_level();
+
+// Only the required extensions, e.g. from glfwGetRequiredInstanceExtensions(),
+// and the ones of the diagnostics level are enabled. Levels the machine does
+// not support fall back to the next lower one.
+void v_init_instance(const char* app_name, const char* const* required_extensions, uint32_t required_extension_count,
+    DiagnosticsLevel diagnostics);
 void v_destroy_instance();
 
-#ifndef DEBUG
-VkResult v_init_debug_messenger();
-void v_destroy_debug_messenger();
-#endif
+// No-ops below DIAGNOSTICS_MARKERS
+void v_begin_debug_label(VkCommandBuffer command_buffer, const char* name);
+void v_end_debug_label(VkCommandBuffer command_buffer);
+// After v_init_device()
+void v_set_debug_name(VkObjectType type, uint64_t handle, const char* name);
+
+// Average CPU time in nanoseconds of a trivial command recorded through the
+// enabled layers. After v_init_cmd_pool(), outside of frame recording.
+double v_measure_call_overhead(uint32_t call_count);
 
 void v_init_surface(VkSurfaceKHR surface);
 void v_destroy_surface();
 
+// Picks the highest scoring device: discrete over integrated over CPU, then by
+// device local memory. Devices without graphics, present, swapchain or timeline
+// semaphore support are skipped. The VIME_DEVICE environment variable forces a device, either by
+// index or by a case insensitive part of its name (e.g. VIME_DEVICE=llvmpipe).
 void v_init_device();
 void v_destroy_device();
 
+VkQueue v_get_queue(QueueType type);
+uint32_t v_get_queue_family(QueueType type);
+
 void v_init_allocator();
 void v_destroy_allocator();
 
 void v_init_swapchain(uint32_t width, uint32_t height);
 void v_destroy_swapchain();
 
-void v_init_render_pass();
-void v_destroy_render_pass();
+// Falls back to FIFO when the surface does not support the requested mode.
+// The change is applied on the next v_recreate_swapchain().
+void v_set_present_mode(VkPresentModeKHR present_mode);
+void v_recreate_swapchain(uint32_t width, uint32_t height);
+
+// Has to be called before any pipeline is created, the pipeline
+// layouts reference the instance set layout.
+void v_init_instance_buffer(uint32_t max_instances);
+void v_destroy_instance_buffer();
+
+void v_init_indirect_buffer(uint32_t max_draws);
+void v_destroy_indirect_buffer();
 
 void v_init_cmd_pool();
 void v_destroy_cmd_pool();
 
 void v_allocate_cmd_buffer();
 
-void v_init_framebuffers();
-void v_destroy_framebuffers();
+VkCommandPool v_create_command_pool(QueueType type, VkCommandPoolCreateFlags flags);
+
+// Begins a secondary command buffer continuing subpass of render_pass, with
+// the viewport and scissor set to extent. The framebuffer is left unknown, so
+// the recording works with every framebuffer of the render pass.
+void v_begin_secondary(VkCommandBuffer command_buffer, VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent,
+    VkCommandBufferUsageFlags flags);
+// Same with a command buffer that is only valid until the next v_begin_frame()
+VkCommandBuffer v_begin_frame_secondary(VkRenderPass render_pass, uint32_t subpass, VkExtent2D extent);
+
+// Records and submits on the transfer queue without waiting. The next frame
+// waits for the upload. Buffers written this way need BUFFER_SHARED.
+SyncTicket v_submit_upload(const std::function<void(VkCommandBuffer)>& record);
+// Same, but blocks until the upload finished
+void v_immediate_submit(const std::function<void(VkCommandBuffer)>& record);
+
+// Makes the next v_end_frame() submission wait on work from another queue
+void v_add_frame_wait(SyncTicket ticket, VkPipelineStageFlags wait_stage);
+
+void v_init_swapchain_views();
+void v_destroy_swapchain_views();
 
 void v_init_sync_structs();
 void v_destroy_sync_structs();
 
 // Drawing code
 
-void v_begin_rendering(ClearValue clear_value);
-void v_end_rendering();
-void v_wait_for_fences();
\ No newline at end of file
+// Returns false when the swapchain is out of date and has to be recreated
+bool v_acquire_frame();
+// Begins the frame command buffer, render passes are recorded by the render graph.
+// Resets g_frame_arena.
+void v_begin_frame();
+void v_end_frame();
+void v_wait_for_frame();
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <fstream>
+#include "resources.h"
+
+#include "sync.h"
+
+Resources g_resources;
+
+static const uint32_t RESOURCE_BLOCKS_PER_CHUNK = 64;
+
+template<typename T>
+static void v_init_resource_pool(ResourcePool<T>& pool, const char* name)
+{
+    v_init_pool(pool.m_storage, name, sizeof(T), RESOURCE_BLOCKS_PER_CHUNK);
+    pool.m_resources.clear();
+    pool.m_generations.clear();
+    pool.m_references.clear();
+    pool.m_keys.clear();
+    pool.m_free_slots.clear();
+    pool.m_lookup.clear();
+}
+
+template<typename T>
+static uint32_t v_find_resource(ResourcePool<T>& pool, uint64_t key)
+{
+    auto it = pool.m_lookup.find(key);
+    if(it == pool.m_lookup.end()) return RESOURCE_NONE;
+
+    pool.m_references[it->second]++;
+    g_resources.m_stats.m_shared_acquires++;
+    return it->second;
+}
+
+template<typename T>
+static uint32_t v_insert_resource(ResourcePool<T>& pool, uint64_t key)
+{
+    uint32_t slot;
+    if(!pool.m_free_slots.empty())
+    {
+        slot = pool.m_free_slots.back();
+        pool.m_free_slots.pop_back();
+    } else {
+        slot = (uint32_t)pool.m_resources.size();
+        pool.m_resources.push_back(nullptr);
+        pool.m_generations.push_back(0);
+        pool.m_references.push_back(0);
+        pool.m_keys.push_back(0);
+    }
+
+    pool.m_resources[slot] = v_pool_new<T>(pool.m_storage);
+    pool.m_references[slot] = 1;
+    pool.m_keys[slot] = key;
+    pool.m_lookup[key] = slot;
+    return slot;
+}
+
+template<typename T>
+static T* v_resolve(ResourcePool<T>& pool, uint32_t index, uint32_t generation)
+{
+    if(index >= pool.m_resources.size() || pool.m_generations[index] != generation) return nullptr;
+    return pool.m_resources[index];
+}
+
+// Returns the resource when this was the last reference. The handle stops
+// resolving right away, the slot stays taken until v_free_slot().
+template<typename T>
+static T* v_drop_reference(ResourcePool<T>& pool, uint32_t index, uint32_t generation)
+{
+    T* resource = v_resolve(pool, index, generation);
+    if(!resource || --pool.m_references[index] > 0) return nullptr;
+
+    pool.m_lookup.erase(pool.m_keys[index]);
+    pool.m_generations[index]++;
+    return resource;
+}
+
+template<typename T>
+static void v_free_slot(ResourcePool<T>& pool, uint32_t index)
+{
+    v_pool_delete(pool.m_storage, pool.m_resources[index]);
+    pool.m_resources[index] = nullptr;
+    pool.m_free_slots.push_back(index);
+}
+
+// Undoes v_insert_resource() when loading failed
+template<typename T>
+static void v_discard_resource(ResourcePool<T>& pool, uint32_t slot)
+{
+    pool.m_lookup.erase(pool.m_keys[slot]);
+    pool.m_generations[slot]++;
+    v_free_slot(pool, slot);
+}
+
+static uint64_t v_hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    // FNV-1a, like v_hash_file()
+    const uint8_t* bytes = (const uint8_t*)data;
+    for(size_t i=0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+void v_init_resources()
+{
+    v_init_resource_pool(g_resources.m_models, "models");
+    v_init_resource_pool(g_resources.m_pipelines, "pipelines");
+    g_resources.m_stats = {};
+    g_resources.m_variant_list_path.clear();
+    g_resources.m_precompiled.clear();
+}
+
+void v_destroy_resources()
+{
+    for(PipelineHandle handle : g_resources.m_precompiled) v_release_pipeline(handle);
+    g_resources.m_precompiled.clear();
+
+    // Releases whose frame has finished
+    v_collect_garbage();
+
+    ResourcePool<Model>& models = g_resources.m_models;
+    for(uint32_t i=0; i < models.m_resources.size(); i++)
+    {
+        if(!models.m_resources[i]) continue;
+        v_destroy_model(*models.m_resources[i]);
+        v_free_slot(models, i);
+    }
+    ResourcePool<GraphicsPipeline>& pipelines = g_resources.m_pipelines;
+    for(uint32_t i=0; i < pipelines.m_resources.size(); i++)
+    {
+        if(!pipelines.m_resources[i]) continue;
+        v_destroy_graphics_pipeline(*pipelines.m_resources[i]);
+        v_free_slot(pipelines, i);
+    }
+
+    v_destroy_pool(models.m_storage);
+    v_destroy_pool(pipelines.m_storage);
+    g_resources.m_stats = {};
+}
+
+ModelHandle v_acquire_model(const char* file_path)
+{
+    ResourcePool<Model>& pool = g_resources.m_models;
+
+    // By contents, the cooked mesh check reads the file anyway
+    uint64_t source_hash = v_hash_file(file_path);
+    if(source_hash == 0) return ModelHandle{RESOURCE_NONE, 0};
+
+    uint32_t slot = v_find_resource(pool, source_hash);
+    if(slot == RESOURCE_NONE)
+    {
+        slot = v_insert_resource(pool, source_hash);
+        if(!v_load_model(*pool.m_resources[slot], file_path, source_hash))
+        {
+            v_discard_resource(pool, slot);
+            return ModelHandle{RESOURCE_NONE, 0};
+        }
+        g_resources.m_stats.m_models++;
+    }
+    return ModelHandle{slot, pool.m_generations[slot]};
+}
+
+ModelHandle v_acquire_model(const ModelData& data)
+{
+    ResourcePool<Model>& pool = g_resources.m_models;
+
+    uint32_t slot = v_find_resource(pool, data.m_source_hash);
+    if(slot == RESOURCE_NONE)
+    {
+        slot = v_insert_resource(pool, data.m_source_hash);
+        if(!v_upload_model(*pool.m_resources[slot], data))
+        {
+            v_discard_resource(pool, slot);
+            return ModelHandle{RESOURCE_NONE, 0};
+        }
+        g_resources.m_stats.m_models++;
+    }
+    return ModelHandle{slot, pool.m_generations[slot]};
+}
+
+void v_release_model(ModelHandle handle)
+{
+    Model* model = v_drop_reference(g_resources.m_models, handle.m_index, handle.m_generation);
+    if(!model) return;
+
+    // The geometry ranges are deferred by v_destroy_model(), the Model itself
+    // is kept until then as well
+    v_destroy_model(*model);
+    uint32_t slot = handle.m_index;
+    g_resources.m_stats.m_models--;
+    g_resources.m_stats.m_pending_destroys++;
+    v_defer_destruction(v_get_last_ticket(QUEUE_GRAPHICS), [slot]() {
+        v_free_slot(g_resources.m_models, slot);
+        g_resources.m_stats.m_pending_destroys--;
+    });
+}
+
+Model* v_get_model(ModelHandle handle)
+{
+    return v_resolve(g_resources.m_models, handle.m_index, handle.m_generation);
+}
+
+PipelineHandle v_acquire_graphics_pipeline(const char* vertex_path, const char* fragment_path, uint32_t features,
+    VkRenderPass render_pass, uint64_t render_pass_key, uint32_t subpass)
+{
+    ResourcePool<GraphicsPipeline>& pool = g_resources.m_pipelines;
+
+    uint64_t key = 0xCBF29CE484222325ull;
+    key = v_hash_bytes(key, vertex_path, strlen(vertex_path) + 1);
+    key = v_hash_bytes(key, fragment_path, strlen(fragment_path) + 1);
+    key = v_hash_bytes(key, &features, sizeof(features));
+    key = v_hash_bytes(key, &render_pass_key, sizeof(render_pass_key));
+    key = v_hash_bytes(key, &subpass, sizeof(subpass));
+
+    uint32_t slot = v_find_resource(pool, key);
+    if(slot == RESOURCE_NONE)
+    {
+        slot = v_insert_resource(pool, key);
+        *pool.m_resources[slot] = v_create_graphics_pipeline(vertex_path, fragment_path, features, render_pass, subpass);
+        g_resources.m_stats.m_pipelines++;
+
+        if(!g_resources.m_variant_list_path.empty())
+        {
+            std::ofstream list(g_resources.m_variant_list_path, std::ios::app);
+            list << vertex_path << " " << fragment_path << " " << features << "\n";
+        }
+    }
+    return PipelineHandle{slot, pool.m_generations[slot]};
+}
+
+void v_release_pipeline(PipelineHandle handle)
+{
+    GraphicsPipeline* pipeline = v_drop_reference(g_resources.m_pipelines, handle.m_index, handle.m_generation);
+    if(!pipeline) return;
+
+    uint32_t slot = handle.m_index;
+    g_resources.m_stats.m_pipelines--;
+    g_resources.m_stats.m_pending_destroys++;
+    v_defer_destruction(v_get_last_ticket(QUEUE_GRAPHICS), [slot]() {
+        v_destroy_graphics_pipeline(*g_resources.m_pipelines.m_resources[slot]);
+        v_free_slot(g_resources.m_pipelines, slot);
+        g_resources.m_stats.m_pending_destroys--;
+    });
+}
+
+GraphicsPipeline* v_get_pipeline(PipelineHandle handle)
+{
+    return v_resolve(g_resources.m_pipelines, handle.m_index, handle.m_generation);
+}
+
+void v_record_pipeline_variants(const char* list_path)
+{
+    g_resources.m_variant_list_path = list_path;
+}
+
+uint32_t v_precompile_pipeline_variants(const char* list_path, VkRenderPass render_pass, uint64_t render_pass_key,
+    uint32_t subpass)
+{
+    // No list yet on the first run
+    std::ifstream list(list_path);
+    if(!list.is_open()) return 0;
+
+    uint32_t compiled = 0;
+    std::string vertex_path, fragment_path;
+    uint32_t features;
+    while(list >> vertex_path >> fragment_path >> features)
+    {
+        uint32_t pipelines = g_resources.m_stats.m_pipelines;
+        PipelineHandle handle = v_acquire_graphics_pipeline(vertex_path.c_str(), fragment_path.c_str(), features, render_pass,
+            render_pass_key, subpass);
+        g_resources.m_precompiled.push_back(handle);
+        if(g_resources.m_stats.m_pipelines != pipelines) compiled++;
+    }
+    return compiled;
+}
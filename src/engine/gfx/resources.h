@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "model.h"
+#include "pipeline.h"
+#include "../core/allocator.h"
+
+// Shared models and pipelines behind reference counted handles. A handle is
+// a slot index plus the slot's generation, like a scene entity, so handles of
+// released resources stop resolving even after their slot is reused.
+// Acquiring something that is already loaded returns the same resource:
+// models are matched by the contents of their file, so two paths to the same
+// mesh share one copy in the geometry pool, and pipelines by their shaders,
+// feature mask and render pass. Every feature mask is its own pipeline,
+// compiled the first time it is acquired; a variant list records the ones a
+// run used so the next run can compile them at startup instead of mid-frame.
+// When the last reference is released, the resource is destroyed once the
+// last submitted frame has finished with it; nothing waits for the device.
+// Release before the frame's render queue is filled, the queue keeps raw
+// pointers.
+
+#define RESOURCE_NONE 0xFFFFFFFF
+
+struct ModelHandle
+{
+    uint32_t m_index;
+    uint32_t m_generation;
+};
+
+struct PipelineHandle
+{
+    uint32_t m_index;
+    uint32_t m_generation;
+};
+
+// Resources live in pool blocks that never move, geometry compaction and the
+// render queue keep pointers to them. The rest is indexed by slot.
+template<typename T>
+struct ResourcePool
+{
+    Pool m_storage;
+    std::vector<T*> m_resources;
+    std::vector<uint32_t> m_generations;
+    std::vector<uint32_t> m_references;
+    std::vector<uint64_t> m_keys;
+    // Slots are only reused after their resource was destroyed
+    std::vector<uint32_t> m_free_slots;
+    // Key of every live resource to its slot
+    std::unordered_map<uint64_t, uint32_t> m_lookup;
+};
+
+struct ResourceStats
+{
+    uint32_t m_models;
+    uint32_t m_pipelines;
+    // Acquires served by a resource that was already loaded
+    uint32_t m_shared_acquires;
+    // Released, waiting for the GPU to finish with them
+    uint32_t m_pending_destroys;
+};
+
+struct Resources
+{
+    ResourcePool<Model> m_models;
+    ResourcePool<GraphicsPipeline> m_pipelines;
+    ResourceStats m_stats;
+
+    // Newly compiled pipeline variants are appended here, empty when off
+    std::string m_variant_list_path;
+    // References taken by v_precompile_pipeline_variants()
+    std::vector<PipelineHandle> m_precompiled;
+};
+
+extern Resources g_resources;
+
+// Main API
+
+void v_init_resources();
+// After v_wait_for_frame(), destroys whatever is still referenced
+void v_destroy_resources();
+
+// { RESOURCE_NONE, 0 } when the file can not be loaded
+ModelHandle v_acquire_model(const char* file_path);
+// Same, for a model read by v_read_model(), e.g. on a startup worker
+ModelHandle v_acquire_model(const ModelData& data);
+void v_release_model(ModelHandle handle);
+// Null for stale handles
+Model* v_get_model(ModelHandle handle);
+
+// See v_create_graphics_pipeline(). Pipelines are shared by render_pass_key,
+// which must be equal exactly for compatible render passes, like
+// v_get_graph_render_pass_key(); render_pass is only used to compile.
+PipelineHandle v_acquire_graphics_pipeline(const char* vertex_path, const char* fragment_path, uint32_t features,
+    VkRenderPass render_pass, uint64_t render_pass_key, uint32_t subpass);
+void v_release_pipeline(PipelineHandle handle);
+GraphicsPipeline* v_get_pipeline(PipelineHandle handle);
+
+// A variant list holds one "vertex_path fragment_path features" line per
+// pipeline, for a single render pass and subpass. From now on every pipeline
+// that is compiled, not shared, is appended to list_path.
+void v_record_pipeline_variants(const char* list_path);
+// Acquires every variant of list_path, held until v_destroy_resources().
+// Call before v_record_pipeline_variants() on the same list, so the listed
+// variants are not appended again. Returns how many were compiled.
+uint32_t v_precompile_pipeline_variants(const char* list_path, VkRenderPass render_pass, uint64_t render_pass_key,
+    uint32_t subpass);
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sprite_batch.h"
+
+void v_init_sprite_batch(SpriteBatch& batch, uint32_t capacity)
+{
+    batch.m_chunk_count = (capacity + SPRITE_CHUNK_SIZE - 1) / SPRITE_CHUNK_SIZE + 256;
+    batch.m_chunks = (SpriteChunk*)malloc(sizeof(SpriteChunk) * batch.m_chunk_count);
+    batch.m_capacity = capacity;
+    v_clear_sprite_batch(batch);
+}
+
+void v_destroy_sprite_batch(SpriteBatch& batch)
+{
+    free(batch.m_chunks);
+    batch.m_chunks = nullptr;
+    batch.m_chunk_count = 0;
+    batch.m_capacity = 0;
+    batch.m_count = 0;
+}
+
+void v_clear_sprite_batch(SpriteBatch& batch)
+{
+    batch.m_used_chunks = 0;
+    batch.m_count = 0;
+    batch.m_dropped = 0;
+    memset(batch.m_first_chunk, 0xff, sizeof(batch.m_first_chunk));
+    memset(batch.m_last_chunk, 0xff, sizeof(batch.m_last_chunk));
+    for(uint32_t layer=0; layer < 256; layer++) batch.m_last_count[layer] = SPRITE_CHUNK_SIZE;
+}
+
+static uint16_t v_to_unorm16(uint32_t value, uint32_t size)
+{
+    return (uint16_t)(((uint64_t)value * 65535 + size / 2) / size);
+}
+
+SpriteRegion v_make_sprite_region(uint32_t texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t atlas_size)
+{
+    SpriteRegion region;
+    region.m_uv[0] = v_to_unorm16(x, atlas_size);
+    region.m_uv[1] = v_to_unorm16(y, atlas_size);
+    region.m_uv[2] = v_to_unorm16(x + width, atlas_size);
+    region.m_uv[3] = v_to_unorm16(y + height, atlas_size);
+    region.m_texture = texture;
+    return region;
+}
+
+void v_add_rect(SpriteBatch& batch, float x, float y, float width, float height, uint32_t color, uint8_t layer)
+{
+    // With clamp to edge addressing, UV (0, 0) only ever reads texel (0, 0)
+    SpriteRegion region = {{0, 0, 0, 0}, SPRITE_SOLID_TEXTURE};
+    v_add_sprite(batch, x, y, width, height, region, color, layer);
+}
+
+uint32_t v_write_sprite_batch(SpriteBatch& batch, Sprite* destination)
+{
+    uint32_t written = 0;
+    for(uint32_t layer=0; layer < 256; layer++)
+    {
+        for(uint32_t i=batch.m_first_chunk[layer]; i != SPRITE_CHUNK_NONE; i = batch.m_chunks[i].m_next)
+        {
+            uint32_t count = i == batch.m_last_chunk[layer] ? batch.m_last_count[layer] : SPRITE_CHUNK_SIZE;
+            memcpy(destination + written, batch.m_chunks[i].m_sprites, sizeof(Sprite) * count);
+            written += count;
+        }
+    }
+    return written;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// CPU side of the 2D renderer, free of Vulkan so it can be benchmarked alone.
+// Sprites are screen space quads in pixels, top left origin. Every texture is
+// a layer of one array texture, so a whole batch shares a single binding and
+// only the draw layer decides the order: sprites of a lower layer are drawn
+// first, and within a layer they keep the order they were added in.
+// Instead of sorting, sprites are appended to fixed size chunks chained per
+// layer, and writing the batch copies the chunks layer by layer. Chunks are
+// small so the open chunks of many layers share few pages.
+
+// Matches the storage buffer in shaders/sprite.vert
+struct Sprite
+{
+    // x0, y0, x1, y1 in pixels
+    float m_rect[4];
+    // u0, v0, u1, v1 in unorm16
+    uint16_t m_uv[4];
+    // RGBA8, red in the low byte
+    uint32_t m_color;
+    // Layer of the atlas array texture
+    uint32_t m_texture;
+};
+
+struct SpriteRegion
+{
+    uint16_t m_uv[4];
+    uint32_t m_texture;
+};
+
+#define SPRITE_CHUNK_SIZE 32
+#define SPRITE_CHUNK_NONE 0xffffffff
+
+struct SpriteChunk
+{
+    Sprite m_sprites[SPRITE_CHUNK_SIZE];
+    uint32_t m_next;
+};
+
+struct SpriteBatch
+{
+    // Enough for the capacity plus a partly filled chunk in every layer
+    SpriteChunk* m_chunks;
+    uint32_t m_chunk_count;
+    uint32_t m_used_chunks;
+    uint32_t m_first_chunk[256];
+    uint32_t m_last_chunk[256];
+    // Sprites in the last chunk of each layer, kept here rather than in the
+    // chunk so adding only touches the sprite's own cache line
+    uint32_t m_last_count[256];
+
+    uint32_t m_capacity;
+    uint32_t m_count;
+    // Sprites that did not fit since the last clear
+    uint32_t m_dropped;
+};
+
+// Texel (0, 0) of this layer is white, for untextured rectangles
+#define SPRITE_SOLID_TEXTURE 0
+
+inline uint32_t v_pack_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+}
+
+// Main API
+
+void v_init_sprite_batch(SpriteBatch& batch, uint32_t capacity);
+void v_destroy_sprite_batch(SpriteBatch& batch);
+void v_clear_sprite_batch(SpriteBatch& batch);
+
+// Pixel rectangle of an atlas layer, atlas_size is the width and height of a layer
+SpriteRegion v_make_sprite_region(uint32_t texture, uint32_t x, uint32_t y, uint32_t width, uint32_t height, uint32_t atlas_size);
+
+// Inline, it runs for every sprite of every frame
+inline void v_add_sprite(SpriteBatch& batch, float x, float y, float width, float height, const SpriteRegion& region,
+    uint32_t color, uint8_t layer)
+{
+    if(batch.m_count == batch.m_capacity)
+    {
+        batch.m_dropped++;
+        return;
+    }
+
+    uint32_t chunk_index = batch.m_last_chunk[layer];
+    uint32_t slot = batch.m_last_count[layer];
+    if(slot == SPRITE_CHUNK_SIZE)
+    {
+        uint32_t new_index = batch.m_used_chunks++;
+        batch.m_chunks[new_index].m_next = SPRITE_CHUNK_NONE;
+        if(chunk_index == SPRITE_CHUNK_NONE) batch.m_first_chunk[layer] = new_index;
+        else batch.m_chunks[chunk_index].m_next = new_index;
+        batch.m_last_chunk[layer] = new_index;
+        chunk_index = new_index;
+        slot = 0;
+    }
+    batch.m_last_count[layer] = slot + 1;
+
+    Sprite& sprite = batch.m_chunks[chunk_index].m_sprites[slot];
+    sprite.m_rect[0] = x;
+    sprite.m_rect[1] = y;
+    sprite.m_rect[2] = x + width;
+    sprite.m_rect[3] = y + height;
+    memcpy(sprite.m_uv, region.m_uv, sizeof(sprite.m_uv));
+    sprite.m_color = color;
+    sprite.m_texture = region.m_texture;
+    batch.m_count++;
+}
+
+void v_add_rect(SpriteBatch& batch, float x, float y, float width, float height, uint32_t color, uint8_t layer);
+
+// Writes the sprites in layer order to destination, front to back since
+// mapped memory is usually write-combined. Returns how many were written,
+// destination needs room for the batch capacity. The batch is unchanged.
+uint32_t v_write_sprite_batch(SpriteBatch& batch, Sprite* destination);
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "sprite_renderer.h"
+
+#include "renderer.h"
+#include "memory.h"
+#include "sync.h"
+
+SpriteRenderer g_sprite_renderer = {};
+
+// Pixels to clip space, y points down in both
+struct SpriteConstants
+{
+    float m_scale[2];
+    float m_offset[2];
+};
+
+static void v_transition_atlas(VkCommandBuffer command_buffer, uint32_t base_layer, uint32_t layer_count,
+    VkImageLayout old_layout, VkImageLayout new_layout, VkAccessFlags src_access, VkAccessFlags dst_access,
+    VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = g_sprite_renderer.m_atlas;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = base_layer;
+    barrier.subresourceRange.layerCount = layer_count;
+
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// Copies one layer worth of pixels from the staging buffer into layer_count
+// layers, then makes them readable. The frame waits for the upload ticket.
+static SyncTicket v_upload_atlas_layers(const uint32_t* pixels, uint32_t base_layer, uint32_t layer_count, VkImageLayout old_layout)
+{
+    uint32_t size = g_sprite_renderer.m_atlas_size;
+    VkDeviceSize layer_bytes = (VkDeviceSize)size * size * sizeof(uint32_t);
+
+    AllocatedBuffer staging_buffer;
+    v_create_buffer(staging_buffer, layer_bytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MEMORY_STAGING, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, staging_buffer.m_allocation, &data);
+    memcpy(data, pixels, layer_bytes);
+    vmaUnmapMemory(g_renderer.m_allocator, staging_buffer.m_allocation);
+
+    SyncTicket ticket = v_submit_upload([&](VkCommandBuffer command_buffer) {
+        // Ordered after earlier uploads to the same layers on this queue
+        v_transition_atlas(command_buffer, base_layer, layer_count, old_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+        // Every layer reads the same staging pixels
+        VkBufferImageCopy copies[64];
+        for(uint32_t i=0; i < layer_count; i += 64)
+        {
+            uint32_t count = layer_count - i < 64 ? layer_count - i : 64;
+            for(uint32_t j=0; j < count; j++)
+            {
+                VkBufferImageCopy& copy = copies[j];
+                copy = {};
+                copy.bufferOffset = 0;
+                copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                copy.imageSubresource.mipLevel = 0;
+                copy.imageSubresource.baseArrayLayer = base_layer + i + j;
+                copy.imageSubresource.layerCount = 1;
+                copy.imageExtent = {size, size, 1};
+            }
+            vkCmdCopyBufferToImage(command_buffer, staging_buffer.m_buffer, g_sprite_renderer.m_atlas,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, count, copies);
+        }
+
+        // The frame's semaphore wait makes the layers visible to the fragment shader
+        v_transition_atlas(command_buffer, base_layer, layer_count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    });
+
+    v_defer_destruction(ticket, [staging_buffer]() mutable { v_destroy_buffer(staging_buffer); });
+    return ticket;
+}
+
+static void v_create_atlas(uint32_t atlas_size, uint32_t atlas_layers)
+{
+    g_sprite_renderer.m_atlas_size = atlas_size;
+    g_sprite_renderer.m_atlas_layers = atlas_layers;
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.pNext = nullptr;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    image_info.extent = {atlas_size, atlas_size, 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = atlas_layers;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // Written on the transfer queue and sampled on graphics, like BUFFER_SHARED
+    if(g_renderer.m_queue_families.size() > 1)
+    {
+        image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        image_info.queueFamilyIndexCount = (uint32_t)g_renderer.m_queue_families.size();
+        image_info.pQueueFamilyIndices = g_renderer.m_queue_families.data();
+    } else image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocation_info{};
+    allocation_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocationInfo allocation_result;
+    vmaCreateImage(g_renderer.m_allocator, &image_info, &allocation_info, &g_sprite_renderer.m_atlas,
+        &g_sprite_renderer.m_atlas_allocation, &allocation_result);
+    g_sprite_renderer.m_atlas_bytes = allocation_result.size;
+    v_track_allocation(MEMORY_TEXTURES, g_sprite_renderer.m_atlas_bytes);
+    v_set_debug_name(VK_OBJECT_TYPE_IMAGE, (uint64_t)g_sprite_renderer.m_atlas, "sprite atlas");
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.pNext = nullptr;
+    view_info.image = g_sprite_renderer.m_atlas;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = atlas_layers;
+
+    vkCreateImageView(g_renderer.m_device, &view_info, nullptr, &g_sprite_renderer.m_atlas_view);
+
+    std::vector<uint32_t> white((size_t)atlas_size * atlas_size, 0xffffffff);
+    v_upload_atlas_layers(white.data(), 0, atlas_layers, VK_IMAGE_LAYOUT_UNDEFINED);
+}
+
+void v_init_sprite_renderer(uint32_t capacity, uint32_t atlas_size, uint32_t atlas_layers,
+    const char* vertex_path, const char* fragment_path, VkRenderPass render_pass, uint32_t subpass)
+{
+    g_sprite_renderer.m_capacity = capacity;
+    g_sprite_renderer.m_count = 0;
+    v_create_buffer(g_sprite_renderer.m_sprite_buffer, (VkDeviceSize)capacity * sizeof(Sprite), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VMA_MEMORY_USAGE_CPU_TO_GPU, MEMORY_TRANSIENT, 0);
+
+    void* data;
+    vmaMapMemory(g_renderer.m_allocator, g_sprite_renderer.m_sprite_buffer.m_allocation, &data);
+    g_sprite_renderer.m_sprites = (Sprite*)data;
+
+    v_create_atlas(atlas_size, atlas_layers);
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.pNext = nullptr;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = 0.0f;
+
+    vkCreateSampler(g_renderer.m_device, &sampler_info, nullptr, &g_sprite_renderer.m_sampler);
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = 2;
+    set_layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_sprite_renderer.m_set_layout);
+
+    VkDescriptorPoolSize pool_sizes[2];
+    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pool_sizes[0].descriptorCount = 1;
+    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_sizes[1].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 2;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_sprite_renderer.m_descriptor_pool);
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_sprite_renderer.m_descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &g_sprite_renderer.m_set_layout;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, &g_sprite_renderer.m_set);
+
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = g_sprite_renderer.m_sprite_buffer.m_buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = VK_WHOLE_SIZE;
+
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = g_sprite_renderer.m_sampler;
+    image_info.imageView = g_sprite_renderer.m_atlas_view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = g_sprite_renderer.m_set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &buffer_info;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = g_sprite_renderer.m_set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[1].pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(g_renderer.m_device, 2, writes, 0, nullptr);
+
+    g_sprite_renderer.m_pipeline = v_create_overlay_pipeline(vertex_path, fragment_path, 1, &g_sprite_renderer.m_set_layout,
+        sizeof(SpriteConstants), render_pass, subpass);
+}
+
+void v_destroy_sprite_renderer()
+{
+    v_destroy_graphics_pipeline(g_sprite_renderer.m_pipeline);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_sprite_renderer.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_sprite_renderer.m_set_layout, nullptr);
+    vkDestroySampler(g_renderer.m_device, g_sprite_renderer.m_sampler, nullptr);
+    vkDestroyImageView(g_renderer.m_device, g_sprite_renderer.m_atlas_view, nullptr);
+    vmaDestroyImage(g_renderer.m_allocator, g_sprite_renderer.m_atlas, g_sprite_renderer.m_atlas_allocation);
+    v_untrack_allocation(MEMORY_TEXTURES, g_sprite_renderer.m_atlas_bytes);
+    vmaUnmapMemory(g_renderer.m_allocator, g_sprite_renderer.m_sprite_buffer.m_allocation);
+    v_destroy_buffer(g_sprite_renderer.m_sprite_buffer);
+}
+
+void v_upload_sprite_texture(uint32_t texture, const uint32_t* pixels)
+{
+    if(texture >= g_sprite_renderer.m_atlas_layers)
+    {
+        fprintf(stderr, "Sprite texture %u is outside the atlas\n", texture);
+        return;
+    }
+
+    // The layer goes back to a transfer layout, nothing may still sample it
+    v_wait_ticket(v_get_last_ticket(QUEUE_GRAPHICS));
+    v_upload_atlas_layers(pixels, texture, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
+
+void v_flush_sprite_batch(SpriteBatch& batch)
+{
+    // The mapped memory is write-combined, the batch writes it front to back
+    g_sprite_renderer.m_count = v_write_sprite_batch(batch, g_sprite_renderer.m_sprites);
+}
+
+void v_draw_sprites(VkCommandBuffer command_buffer, VkExtent2D extent)
+{
+    if(g_sprite_renderer.m_count == 0) return;
+
+    SpriteConstants constants;
+    constants.m_scale[0] = 2.0f / (float)extent.width;
+    constants.m_scale[1] = 2.0f / (float)extent.height;
+    constants.m_offset[0] = -1.0f;
+    constants.m_offset[1] = -1.0f;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_sprite_renderer.m_pipeline.m_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_sprite_renderer.m_pipeline.m_pipeline_layout,
+        0, 1, &g_sprite_renderer.m_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, g_sprite_renderer.m_pipeline.m_pipeline_layout,
+        VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+    vkCmdDraw(command_buffer, 4, g_sprite_renderer.m_count, 0, 0);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include "buffer.h"
+#include "pipeline.h"
+#include "sprite_batch.h"
+
+// GPU side of the 2D renderer. A sprite batch is copied into a persistently
+// mapped storage buffer and drawn over the target with a single instanced
+// draw, one 4 vertex strip per sprite. Textures are the layers of one array
+// texture, so there is nothing to rebind between sprites. With one frame in
+// flight the buffer is only read by the frame being recorded.
+
+struct SpriteRenderer
+{
+    AllocatedBuffer m_sprite_buffer;
+    Sprite* m_sprites;
+    uint32_t m_capacity;
+    // Written by the last flush
+    uint32_t m_count;
+
+    VkImage m_atlas;
+    VmaAllocation m_atlas_allocation;
+    VkImageView m_atlas_view;
+    VkDeviceSize m_atlas_bytes;
+    uint32_t m_atlas_size;
+    uint32_t m_atlas_layers;
+
+    VkSampler m_sampler;
+    VkDescriptorSetLayout m_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_set;
+    GraphicsPipeline m_pipeline;
+};
+
+extern SpriteRenderer g_sprite_renderer;
+
+// Main API
+
+// Every atlas layer starts out white. render_pass and subpass of the pass
+// drawing the sprites, see v_get_graph_render_pass().
+void v_init_sprite_renderer(uint32_t capacity, uint32_t atlas_size, uint32_t atlas_layers,
+    const char* vertex_path, const char* fragment_path, VkRenderPass render_pass, uint32_t subpass);
+void v_destroy_sprite_renderer();
+
+// Replaces a whole layer with atlas_size * atlas_size RGBA8 pixels, see
+// v_pack_color(). Waits for the last frame, so not for every frame.
+void v_upload_sprite_texture(uint32_t texture, const uint32_t* pixels);
+
+// After v_acquire_frame(). The batch capacity must not be above the renderer's.
+void v_flush_sprite_batch(SpriteBatch& batch);
+// Inside a graphics pass, draws the last flush over a target of extent
+void v_draw_sprites(VkCommandBuffer command_buffer, VkExtent2D extent);
@@ -0,0 +1,195 @@
+#include <deque>
+#include <vector>
+#include "sync.h"
+
+#include "renderer.h"
+#include "../core/allocator.h"
+
+struct DeferredDestruction
+{
+    uint64_t m_value;
+    std::function<void()> m_destroy;
+};
+
+struct Timeline
+{
+    VkSemaphore m_semaphore;
+    uint64_t m_submitted;
+    // Last value the driver reported as reached
+    uint64_t m_completed;
+    // Ordered by value, since values only grow per queue
+    std::deque<DeferredDestruction> m_deferred;
+};
+
+struct SyncSystem
+{
+    Timeline m_timelines[QUEUE_TYPE_COUNT];
+    PFN_vkGetSemaphoreCounterValueKHR m_get_counter_value;
+    PFN_vkWaitSemaphoresKHR m_wait_semaphores;
+};
+
+static SyncSystem g_sync;
+
+void v_init_sync()
+{
+    g_sync.m_get_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)
+        vkGetDeviceProcAddr(g_renderer.m_device, "vkGetSemaphoreCounterValueKHR");
+    g_sync.m_wait_semaphores = (PFN_vkWaitSemaphoresKHR)
+        vkGetDeviceProcAddr(g_renderer.m_device, "vkWaitSemaphoresKHR");
+
+    VkSemaphoreTypeCreateInfoKHR type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    type_info.pNext = nullptr;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    semaphore_info.flags = 0;
+
+    for(uint32_t i=0; i < QUEUE_TYPE_COUNT; i++)
+    {
+        Timeline& timeline = g_sync.m_timelines[i];
+        vkCreateSemaphore(g_renderer.m_device, &semaphore_info, nullptr, &timeline.m_semaphore);
+        timeline.m_submitted = 0;
+        timeline.m_completed = 0;
+    }
+}
+
+void v_destroy_sync()
+{
+    for(uint32_t i=0; i < QUEUE_TYPE_COUNT; i++) v_wait_ticket(v_get_last_ticket((QueueType)i));
+    v_collect_garbage();
+
+    for(uint32_t i=0; i < QUEUE_TYPE_COUNT; i++)
+    {
+        vkDestroySemaphore(g_renderer.m_device, g_sync.m_timelines[i].m_semaphore, nullptr);
+    }
+}
+
+SyncTicket v_submit(QueueType type, VkCommandBuffer command_buffer, uint32_t wait_count, const SyncWait* waits,
+    VkSemaphore binary_wait, VkPipelineStageFlags binary_wait_stage, VkSemaphore binary_signal)
+{
+    Timeline& timeline = g_sync.m_timelines[type];
+
+    ArenaScope scope(g_frame_arena);
+    VkSemaphore* wait_semaphores = v_arena_push<VkSemaphore>(g_frame_arena, wait_count + 1);
+    VkPipelineStageFlags* wait_stages = v_arena_push<VkPipelineStageFlags>(g_frame_arena, wait_count + 1);
+    uint64_t* wait_values = v_arena_push<uint64_t>(g_frame_arena, wait_count + 1);
+    uint32_t wait_semaphore_count = 0;
+    for(uint32_t i=0; i < wait_count; i++)
+    {
+        QueueType wait_queue = v_get_ticket_queue(waits[i].m_ticket);
+        uint64_t wait_value = v_get_ticket_value(waits[i].m_ticket);
+        // Same queue submissions are already ordered, completed ones need no wait
+        if(wait_queue == type || wait_value <= g_sync.m_timelines[wait_queue].m_completed) continue;
+
+        wait_semaphores[wait_semaphore_count] = g_sync.m_timelines[wait_queue].m_semaphore;
+        wait_stages[wait_semaphore_count] = waits[i].m_stage;
+        wait_values[wait_semaphore_count++] = wait_value;
+    }
+    if(binary_wait != VK_NULL_HANDLE)
+    {
+        // The value is ignored for binary semaphores
+        wait_semaphores[wait_semaphore_count] = binary_wait;
+        wait_stages[wait_semaphore_count] = binary_wait_stage;
+        wait_values[wait_semaphore_count++] = 0;
+    }
+
+    uint64_t value = ++timeline.m_submitted;
+    VkSemaphore signal_semaphores[] = {timeline.m_semaphore, binary_signal};
+    uint64_t signal_values[] = {value, 0};
+    uint32_t signal_count = binary_signal != VK_NULL_HANDLE ? 2 : 1;
+
+    VkTimelineSemaphoreSubmitInfoKHR timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+    timeline_info.pNext = nullptr;
+    timeline_info.waitSemaphoreValueCount = wait_semaphore_count;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = signal_count;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = wait_semaphore_count;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+    submit_info.signalSemaphoreCount = signal_count;
+    submit_info.pSignalSemaphores = signal_semaphores;
+    submit_info.commandBufferCount = command_buffer != VK_NULL_HANDLE ? 1 : 0;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    vkQueueSubmit(v_get_queue(type), 1, &submit_info, VK_NULL_HANDLE);
+    return v_make_ticket(type, value);
+}
+
+bool v_is_complete(SyncTicket ticket)
+{
+    Timeline& timeline = g_sync.m_timelines[v_get_ticket_queue(ticket)];
+    uint64_t value = v_get_ticket_value(ticket);
+    if(value <= timeline.m_completed) return true;
+
+    g_sync.m_get_counter_value(g_renderer.m_device, timeline.m_semaphore, &timeline.m_completed);
+    return value <= timeline.m_completed;
+}
+
+void v_wait_ticket(SyncTicket ticket)
+{
+    if(v_is_complete(ticket)) return;
+
+    Timeline& timeline = g_sync.m_timelines[v_get_ticket_queue(ticket)];
+    uint64_t value = v_get_ticket_value(ticket);
+
+    VkSemaphoreWaitInfoKHR wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    wait_info.pNext = nullptr;
+    wait_info.flags = 0;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline.m_semaphore;
+    wait_info.pValues = &value;
+
+    g_sync.m_wait_semaphores(g_renderer.m_device, &wait_info, UINT64_MAX);
+    timeline.m_completed = value;
+}
+
+SyncTicket v_get_last_ticket(QueueType type)
+{
+    return v_make_ticket(type, g_sync.m_timelines[type].m_submitted);
+}
+
+void v_defer_destruction(SyncTicket ticket, std::function<void()> destroy)
+{
+    if(v_is_complete(ticket))
+    {
+        destroy();
+        return;
+    }
+
+    Timeline& timeline = g_sync.m_timelines[v_get_ticket_queue(ticket)];
+    uint64_t value = v_get_ticket_value(ticket);
+
+    // Tickets of a queue usually arrive in order, keep the deque sorted anyway
+    auto it = timeline.m_deferred.end();
+    while(it != timeline.m_deferred.begin() && (it - 1)->m_value > value) it--;
+    timeline.m_deferred.insert(it, DeferredDestruction{value, std::move(destroy)});
+}
+
+void v_collect_garbage()
+{
+    for(uint32_t i=0; i < QUEUE_TYPE_COUNT; i++)
+    {
+        Timeline& timeline = g_sync.m_timelines[i];
+        if(timeline.m_deferred.empty()) continue;
+        if(!v_is_complete(v_make_ticket((QueueType)i, timeline.m_deferred.front().m_value))) continue;
+
+        while(!timeline.m_deferred.empty() && timeline.m_deferred.front().m_value <= timeline.m_completed)
+        {
+            // Pop first, destroy callbacks may defer more work
+            std::function<void()> destroy = std::move(timeline.m_deferred.front().m_destroy);
+            timeline.m_deferred.pop_front();
+            destroy();
+        }
+    }
+}
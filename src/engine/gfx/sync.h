@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Synchronization on top of VK_KHR_timeline_semaphore. Every queue owns one
+// timeline that counts its submissions, and every submission returns a ticket
+// naming the value it signals. Waiting on work from another queue, checking
+// whether the GPU is done with something and deferring destruction are all
+// expressed with tickets instead of fences.
+
+// Queues the renderer submits to. Compute and transfer fall back to the
+// graphics queue when the device has no dedicated family for them.
+enum QueueType
+{
+    QUEUE_GRAPHICS,
+    QUEUE_COMPUTE,
+    QUEUE_TRANSFER,
+    QUEUE_TYPE_COUNT
+};
+
+// Queue in the top 2 bits, timeline value below. Value 0 is never submitted,
+// so SYNC_TICKET_NONE is always complete.
+typedef uint64_t SyncTicket;
+
+#define SYNC_TICKET_NONE 0
+
+struct SyncWait
+{
+    SyncTicket m_ticket;
+    // Stages of the waiting submission that must not start before the ticket
+    VkPipelineStageFlags m_stage;
+};
+
+inline SyncTicket v_make_ticket(QueueType queue, uint64_t value) { return ((uint64_t)queue << 62) | value; }
+inline QueueType v_get_ticket_queue(SyncTicket ticket) { return (QueueType)(ticket >> 62); }
+inline uint64_t v_get_ticket_value(SyncTicket ticket) { return ticket & ~(3ull << 62); }
+
+// Main API
+
+// After v_init_device(). Destroying waits for every queue and runs all
+// remaining deferred destruction.
+void v_init_sync();
+void v_destroy_sync();
+
+// The binary semaphores are only needed for the swapchain and may be
+// VK_NULL_HANDLE. command_buffer may be VK_NULL_HANDLE for a pure signal.
+SyncTicket v_submit(QueueType type, VkCommandBuffer command_buffer, uint32_t wait_count, const SyncWait* waits,
+    VkSemaphore binary_wait, VkPipelineStageFlags binary_wait_stage, VkSemaphore binary_signal);
+
+// Non-blocking, only queries the driver when the cached value is behind
+bool v_is_complete(SyncTicket ticket);
+void v_wait_ticket(SyncTicket ticket);
+// Latest ticket submitted to the queue
+SyncTicket v_get_last_ticket(QueueType type);
+
+// Runs destroy once the ticket is complete, checked by v_collect_garbage()
+void v_defer_destruction(SyncTicket ticket, std::function<void()> destroy);
+void v_collect_garbage();
@@ -0,0 +1,123 @@
+#include "upscale.h"
+
+#include "renderer.h"
+
+Upscale g_upscale = {};
+
+struct UpscaleConstants
+{
+    // Rendered part of the source in UV, and the UV clamp keeping bilinear
+    // taps out of the texels that were not rendered this frame
+    float m_uv_scale[2];
+    float m_uv_max[2];
+    float m_texel_size[2];
+    float m_sharpness;
+    float m_pad;
+};
+
+void v_init_upscale(const char* vertex_path, const char* fragment_path, VkRenderPass render_pass, uint32_t subpass)
+{
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.pNext = nullptr;
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = 0.0f;
+
+    vkCreateSampler(g_renderer.m_device, &sampler_info, nullptr, &g_upscale.m_sampler);
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = 1;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo set_layout_info{};
+    set_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    set_layout_info.pNext = nullptr;
+    set_layout_info.bindingCount = 1;
+    set_layout_info.pBindings = &binding;
+
+    vkCreateDescriptorSetLayout(g_renderer.m_device, &set_layout_info, nullptr, &g_upscale.m_set_layout);
+
+    VkDescriptorPoolSize pool_size;
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+
+    vkCreateDescriptorPool(g_renderer.m_device, &pool_info, nullptr, &g_upscale.m_descriptor_pool);
+
+    VkDescriptorSetAllocateInfo set_info{};
+    set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    set_info.pNext = nullptr;
+    set_info.descriptorPool = g_upscale.m_descriptor_pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &g_upscale.m_set_layout;
+
+    vkAllocateDescriptorSets(g_renderer.m_device, &set_info, &g_upscale.m_set);
+
+    g_upscale.m_bound_view = VK_NULL_HANDLE;
+    g_upscale.m_pipeline = v_create_fullscreen_pipeline(vertex_path, fragment_path, 1, &g_upscale.m_set_layout,
+        sizeof(UpscaleConstants), render_pass, subpass);
+}
+
+void v_destroy_upscale()
+{
+    v_destroy_graphics_pipeline(g_upscale.m_pipeline);
+    vkDestroyDescriptorPool(g_renderer.m_device, g_upscale.m_descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(g_renderer.m_device, g_upscale.m_set_layout, nullptr);
+    vkDestroySampler(g_renderer.m_device, g_upscale.m_sampler, nullptr);
+}
+
+void v_upscale(VkCommandBuffer command_buffer, VkImageView source_view, VkExtent2D source_extent, VkExtent2D rendered_extent)
+{
+    // The previous frame has finished, the set is not in use
+    if(g_upscale.m_bound_view != source_view)
+    {
+        g_upscale.m_bound_view = source_view;
+
+        VkDescriptorImageInfo image_info{};
+        image_info.sampler = g_upscale.m_sampler;
+        image_info.imageView = source_view;
+        image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstSet = g_upscale.m_set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &image_info;
+
+        vkUpdateDescriptorSets(g_renderer.m_device, 1, &write, 0, nullptr);
+    }
+
+    UpscaleConstants constants{};
+    constants.m_uv_scale[0] = (float)rendered_extent.width / (float)source_extent.width;
+    constants.m_uv_scale[1] = (float)rendered_extent.height / (float)source_extent.height;
+    constants.m_texel_size[0] = 1.0f / (float)source_extent.width;
+    constants.m_texel_size[1] = 1.0f / (float)source_extent.height;
+    constants.m_uv_max[0] = constants.m_uv_scale[0] - 0.5f * constants.m_texel_size[0];
+    constants.m_uv_max[1] = constants.m_uv_scale[1] - 0.5f * constants.m_texel_size[1];
+    constants.m_sharpness = g_upscale.m_sharpness;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_upscale.m_pipeline.m_pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, g_upscale.m_pipeline.m_pipeline_layout,
+        0, 1, &g_upscale.m_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, g_upscale.m_pipeline.m_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
+        0, sizeof(constants), &constants);
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "pipeline.h"
+
+// Final pass of dynamic resolution: stretches the rendered top left part of
+// the scene color image over the whole swapchain image with bilinear
+// filtering, optionally sharpened. The sharpening is a 5 tap unsharp mask
+// clamped to the neighbourhood's range so edges do not ring.
+
+struct Upscale
+{
+    VkSampler m_sampler;
+    VkDescriptorSetLayout m_set_layout;
+    VkDescriptorPool m_descriptor_pool;
+    VkDescriptorSet m_set;
+    VkImageView m_bound_view;
+    GraphicsPipeline m_pipeline;
+
+    // 0 is plain bilinear, 1 is the strongest
+    float m_sharpness;
+};
+
+extern Upscale g_upscale;
+
+// Main API
+
+// render_pass and subpass of the upscale pass, see v_get_graph_render_pass()
+void v_init_upscale(const char* vertex_path, const char* fragment_path, VkRenderPass render_pass, uint32_t subpass);
+void v_destroy_upscale();
+
+// Inside the upscale pass. source_view is sampled in
+// VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rendered_extent is the part of
+// source_extent holding this frame's image.
+void v_upscale(VkCommandBuffer command_buffer, VkImageView source_view, VkExtent2D source_extent, VkExtent2D rendered_extent);
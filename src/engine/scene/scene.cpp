@@ -0,0 +1,95 @@
+#include "scene.h"
+
+template<typename T>
+static void v_reserve_components(ComponentArray<T>& array, uint32_t capacity)
+{
+    array.m_sparse.reserve(capacity);
+    array.m_entities.reserve(capacity);
+    array.m_data.reserve(capacity);
+}
+
+void v_init_scene(Scene& scene, uint32_t capacity)
+{
+    scene.m_entity_count = 0;
+    scene.m_static_version = 0;
+    scene.m_generations.reserve(capacity);
+
+    v_init_transform_system(scene.m_transform_system, capacity);
+    v_reserve_components(scene.m_transforms, capacity);
+    v_reserve_components(scene.m_meshes, capacity);
+    v_reserve_components(scene.m_materials, capacity);
+    v_reserve_components(scene.m_bounds, capacity);
+}
+
+Entity v_create_entity(Scene& scene)
+{
+    Entity entity;
+    if(!scene.m_free_indices.empty())
+    {
+        entity.m_index = scene.m_free_indices.back();
+        scene.m_free_indices.pop_back();
+    } else {
+        entity.m_index = (uint32_t)scene.m_generations.size();
+        scene.m_generations.push_back(0);
+    }
+
+    entity.m_generation = scene.m_generations[entity.m_index];
+    scene.m_entity_count++;
+    return entity;
+}
+
+void v_destroy_entity(Scene& scene, Entity entity)
+{
+    if(!v_is_alive(scene, entity)) return;
+
+    TransformComponent* transform = v_get_component(scene.m_transforms, entity);
+    if(transform) v_destroy_transform(scene.m_transform_system, transform->m_transform);
+    MeshComponent* mesh = v_get_component(scene.m_meshes, entity);
+    if(mesh && mesh->m_static) v_mark_static_changed(scene);
+
+    v_remove_component(scene.m_transforms, entity);
+    v_remove_component(scene.m_meshes, entity);
+    v_remove_component(scene.m_materials, entity);
+    v_remove_component(scene.m_bounds, entity);
+
+    scene.m_generations[entity.m_index]++;
+    scene.m_free_indices.push_back(entity.m_index);
+    scene.m_entity_count--;
+}
+
+bool v_is_alive(const Scene& scene, Entity entity)
+{
+    return entity.m_index < scene.m_generations.size()
+        && scene.m_generations[entity.m_index] == entity.m_generation;
+}
+
+void v_mark_static_changed(Scene& scene)
+{
+    scene.m_static_version++;
+}
+
+uint64_t v_get_static_version(const Scene& scene)
+{
+    return ((uint64_t)scene.m_static_version << 32) | scene.m_transform_system.m_slot_version;
+}
+
+TransformComponent& v_add_transform(Scene& scene, Entity entity, Entity parent)
+{
+    uint32_t parent_transform = TRANSFORM_NONE;
+    if(parent.m_index != ENTITY_NONE)
+    {
+        TransformComponent* parent_component = v_get_component(scene.m_transforms, parent);
+        if(parent_component) parent_transform = parent_component->m_transform;
+    }
+
+    TransformComponent* existing = v_get_component(scene.m_transforms, entity);
+    if(existing)
+    {
+        v_set_parent(scene.m_transform_system, existing->m_transform, parent_transform);
+        return *existing;
+    }
+
+    TransformComponent component;
+    component.m_transform = v_create_transform(scene.m_transform_system, parent_transform);
+    return v_add_component(scene.m_transforms, entity, component);
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <HandmadeMath.h>
+
+#include "transform.h"
+
+// Entity/component storage. Every component type lives in its own sparse set:
+// a dense, tightly packed array of components plus a sparse table mapping
+// entity index to dense index. Systems walk the dense arrays directly.
+// Entities are generational handles, a destroyed entity's handle stays invalid
+// even after its index is reused.
+
+#define ENTITY_NONE 0xFFFFFFFF
+#define SCENE_MAX_LODS 4
+
+struct Model;
+struct GraphicsPipeline;
+
+struct Entity
+{
+    uint32_t m_index;
+    uint32_t m_generation;
+};
+
+// Main API
+
+struct TransformComponent
+{
+    uint32_t m_transform;
+};
+
+struct MeshComponent
+{
+    // m_lod_distances[i] is the furthest distance m_lods[i] is used at,
+    // anything further than the last one is not drawn
+    Model* m_lods[SCENE_MAX_LODS];
+    float m_lod_distances[SCENE_MAX_LODS];
+    uint32_t m_lod_count;
+    // Never moves, changes material or gets removed without
+    // v_mark_static_changed(). Drawn at LOD 0 from a cache, culled on the GPU.
+    bool m_static;
+};
+
+struct MaterialComponent
+{
+    uint32_t m_material_id;
+    GraphicsPipeline* m_pipeline;
+};
+
+// Bounding sphere in local space
+struct BoundsComponent
+{
+    hmm_vec3 m_center;
+    float m_radius;
+};
+
+template<typename T>
+struct ComponentArray
+{
+    std::vector<uint32_t> m_sparse;
+    std::vector<uint32_t> m_entities;
+    std::vector<T> m_data;
+};
+
+struct Scene
+{
+    std::vector<uint32_t> m_generations;
+    std::vector<uint32_t> m_free_indices;
+    uint32_t m_entity_count;
+
+    TransformSystem m_transform_system;
+    ComponentArray<TransformComponent> m_transforms;
+    ComponentArray<MeshComponent> m_meshes;
+    ComponentArray<MaterialComponent> m_materials;
+    ComponentArray<BoundsComponent> m_bounds;
+
+    // Bumped whenever the set of static meshes may have changed
+    uint32_t m_static_version;
+};
+
+void v_init_scene(Scene& scene, uint32_t capacity);
+
+Entity v_create_entity(Scene& scene);
+// Removes every component, including the transform
+void v_destroy_entity(Scene& scene, Entity entity);
+bool v_is_alive(const Scene& scene, Entity entity);
+// After adding, removing or editing static meshes. Destroying an entity
+// with a static mesh does this already.
+void v_mark_static_changed(Scene& scene);
+// Changes with m_static_version and whenever the transform slots, which the
+// static draws use as instance indexes, were reassigned
+uint64_t v_get_static_version(const Scene& scene);
+
+// Creates a transform in the scene's transform system. parent can be an
+// entity with a transform or { ENTITY_NONE, 0 }. An existing transform is
+// reparented, unless parent is one of its descendants.
+TransformComponent& v_add_transform(Scene& scene, Entity entity, Entity parent);
+
+// The component functions expect a live entity, use v_is_alive() on
+// handles that may be stale.
+
+template<typename T>
+bool v_has_component(const ComponentArray<T>& array, Entity entity)
+{
+    return entity.m_index < array.m_sparse.size() && array.m_sparse[entity.m_index] != ENTITY_NONE;
+}
+
+// Takes a bare index so systems can join arrays through m_entities
+template<typename T>
+T* v_get_component(ComponentArray<T>& array, uint32_t entity_index)
+{
+    if(entity_index >= array.m_sparse.size() || array.m_sparse[entity_index] == ENTITY_NONE) return nullptr;
+    return &array.m_data[array.m_sparse[entity_index]];
+}
+
+template<typename T>
+T* v_get_component(ComponentArray<T>& array, Entity entity)
+{
+    return v_get_component(array, entity.m_index);
+}
+
+template<typename T>
+T& v_add_component(ComponentArray<T>& array, Entity entity, const T& component)
+{
+    if(entity.m_index >= array.m_sparse.size()) array.m_sparse.resize(entity.m_index + 1, ENTITY_NONE);
+
+    uint32_t dense = array.m_sparse[entity.m_index];
+    if(dense != ENTITY_NONE)
+    {
+        array.m_data[dense] = component;
+        return array.m_data[dense];
+    }
+
+    array.m_sparse[entity.m_index] = (uint32_t)array.m_data.size();
+    array.m_entities.push_back(entity.m_index);
+    array.m_data.push_back(component);
+    return array.m_data.back();
+}
+
+// Swaps the last component into the hole, so dense order is not stable
+template<typename T>
+void v_remove_component(ComponentArray<T>& array, Entity entity)
+{
+    if(!v_has_component(array, entity)) return;
+
+    uint32_t dense = array.m_sparse[entity.m_index];
+    uint32_t last = (uint32_t)array.m_data.size() - 1;
+    if(dense != last)
+    {
+        array.m_data[dense] = array.m_data[last];
+        array.m_entities[dense] = array.m_entities[last];
+        array.m_sparse[array.m_entities[dense]] = dense;
+    }
+
+    array.m_data.pop_back();
+    array.m_entities.pop_back();
+    array.m_sparse[entity.m_index] = ENTITY_NONE;
+}
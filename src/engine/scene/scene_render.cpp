@@ -0,0 +1,71 @@
+#include <vector>
+#include "scene_render.h"
+
+#include "../core/job.h"
+#include "../core/allocator.h"
+
+static const uint32_t SUBMIT_BATCH_SIZE = 4096;
+
+void v_submit_scene(Scene& scene, SceneView& view, RenderQueue& queue, float far_plane)
+{
+    uint32_t count = (uint32_t)scene.m_meshes.m_data.size();
+    uint32_t batch_count = (count + SUBMIT_BATCH_SIZE - 1) / SUBMIT_BATCH_SIZE;
+
+    // Count per batch, then every batch writes its own range of the queue
+    ArenaScope scope(g_frame_arena);
+    uint32_t* batch_offsets = v_arena_push<uint32_t>(g_frame_arena, batch_count + 1);
+    batch_offsets[0] = 0;
+    v_parallel_for(count, SUBMIT_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+        uint32_t visible = 0;
+        for(uint32_t i=begin; i < end; i++) visible += view.m_lod[i] != LOD_CULLED;
+        batch_offsets[begin / SUBMIT_BATCH_SIZE + 1] = visible;
+    });
+    for(uint32_t batch=0; batch < batch_count; batch++) batch_offsets[batch + 1] += batch_offsets[batch];
+
+    uint32_t first = v_allocate_draws(queue, batch_offsets[batch_count]);
+
+    PushConstant constants;
+    constants.m_data = HMM_Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+
+    v_parallel_for(count, SUBMIT_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+        uint32_t index = first + batch_offsets[begin / SUBMIT_BATCH_SIZE];
+        for(uint32_t i=begin; i < end; i++)
+        {
+            uint8_t lod = view.m_lod[i];
+            if(lod == LOD_CULLED) continue;
+
+            uint32_t entity = scene.m_meshes.m_entities[i];
+            MaterialComponent* material = v_get_component(scene.m_materials, entity);
+            TransformComponent* transform = v_get_component(scene.m_transforms, entity);
+            Model& model = *scene.m_meshes.m_data[i].m_lods[lod];
+
+            uint64_t sort_key = v_make_sort_key(0, false,
+                material->m_pipeline->m_id, material->m_material_id, view.m_distance[i] / far_plane
+            );
+            uint32_t instance = v_get_transform_slot(scene.m_transform_system, transform->m_transform);
+            v_write_draw(queue, index++, sort_key, model, *material->m_pipeline, constants, instance);
+        }
+    });
+}
+
+void v_submit_static_scene(Scene& scene, RenderQueue& queue)
+{
+    PushConstant constants;
+    constants.m_data = HMM_Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+
+    for(uint32_t i=0; i < scene.m_meshes.m_data.size(); i++)
+    {
+        const MeshComponent& mesh = scene.m_meshes.m_data[i];
+        if(!mesh.m_static || mesh.m_lod_count == 0) continue;
+
+        uint32_t entity = scene.m_meshes.m_entities[i];
+        MaterialComponent* material = v_get_component(scene.m_materials, entity);
+        TransformComponent* transform = v_get_component(scene.m_transforms, entity);
+        if(!material || !transform) continue;
+
+        // No camera, so only grouped by state
+        uint64_t sort_key = v_make_sort_key(0, false, material->m_pipeline->m_id, material->m_material_id, 0.0f);
+        uint32_t instance = v_get_transform_slot(scene.m_transform_system, transform->m_transform);
+        v_submit_draw(queue, sort_key, *mesh.m_lods[0], *material->m_pipeline, constants, instance);
+    }
+}
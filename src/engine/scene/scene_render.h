@@ -0,0 +1,11 @@
+#pragma once
+
+#include "scene_systems.h"
+#include "../gfx/render_queue.h"
+
+// Pushes every mesh left visible by v_cull_scene()/v_select_lods() into the
+// queue, using the transform slot as the instance index.
+void v_submit_scene(Scene& scene, SceneView& view, RenderQueue& queue, float far_plane);
+// Pushes every static mesh at LOD 0, independent of the camera. Only needed
+// when v_get_static_version() changes, see v_update_draw_cache().
+void v_submit_static_scene(Scene& scene, RenderQueue& queue);
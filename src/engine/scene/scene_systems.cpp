@@ -0,0 +1,117 @@
+#include <atomic>
+#include <math.h>
+#include "scene_systems.h"
+
+#include "../core/job.h"
+
+static const uint32_t SYSTEM_BATCH_SIZE = 4096;
+
+void v_extract_frustum(const hmm_mat4& m, hmm_vec4 planes[6])
+{
+    hmm_vec4 rows[4];
+    for(int row=0; row < 4; row++)
+    {
+        rows[row] = HMM_Vec4(m.Elements[0][row], m.Elements[1][row], m.Elements[2][row], m.Elements[3][row]);
+    }
+
+    planes[0] = HMM_AddVec4(rows[3], rows[0]);
+    planes[1] = HMM_SubtractVec4(rows[3], rows[0]);
+    planes[2] = HMM_AddVec4(rows[3], rows[1]);
+    planes[3] = HMM_SubtractVec4(rows[3], rows[1]);
+    planes[4] = HMM_AddVec4(rows[3], rows[2]);
+    planes[5] = HMM_SubtractVec4(rows[3], rows[2]);
+
+    for(int i=0; i < 6; i++)
+    {
+        float length = HMM_LengthVec3(planes[i].XYZ);
+        planes[i] = HMM_DivideVec4f(planes[i], length);
+    }
+}
+
+void v_cull_scene(Scene& scene, SceneView& view)
+{
+    uint32_t count = (uint32_t)scene.m_meshes.m_data.size();
+    view.m_distance.resize(count);
+    view.m_lod.resize(count);
+
+    hmm_vec4* planes = view.m_frustum;
+    v_extract_frustum(view.m_view_projection, planes);
+
+    std::atomic<uint32_t> visible(0);
+    v_parallel_for(count, SYSTEM_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+        uint32_t batch_visible = 0;
+        for(uint32_t i=begin; i < end; i++)
+        {
+            uint32_t entity = scene.m_meshes.m_entities[i];
+            TransformComponent* transform = v_get_component(scene.m_transforms, entity);
+            if(!transform || !v_get_component(scene.m_materials, entity) || scene.m_meshes.m_data[i].m_static)
+            {
+                view.m_lod[i] = LOD_CULLED;
+                continue;
+            }
+
+            const hmm_mat4& world = v_get_world_matrix(scene.m_transform_system, transform->m_transform);
+            BoundsComponent* bounds = v_get_component(scene.m_bounds, entity);
+
+            hmm_vec3 center;
+            float radius;
+            if(bounds)
+            {
+                center = HMM_MultiplyMat4ByVec4(world, HMM_Vec4v(bounds->m_center, 1.0f)).XYZ;
+                float scale_x = HMM_LengthSquaredVec3(HMM_Vec3(world.Elements[0][0], world.Elements[0][1], world.Elements[0][2]));
+                float scale_y = HMM_LengthSquaredVec3(HMM_Vec3(world.Elements[1][0], world.Elements[1][1], world.Elements[1][2]));
+                float scale_z = HMM_LengthSquaredVec3(HMM_Vec3(world.Elements[2][0], world.Elements[2][1], world.Elements[2][2]));
+                radius = bounds->m_radius * sqrtf(HMM_MAX(scale_x, HMM_MAX(scale_y, scale_z)));
+            } else {
+                center = HMM_Vec3(world.Elements[3][0], world.Elements[3][1], world.Elements[3][2]);
+                radius = INFINITY;
+            }
+
+            bool inside = true;
+            for(int p=0; p < 6 && inside; p++)
+            {
+                inside = HMM_DotVec3(planes[p].XYZ, center) + planes[p].W >= -radius;
+            }
+
+            view.m_distance[i] = HMM_LengthVec3(HMM_SubtractVec3(center, view.m_camera_position));
+            view.m_lod[i] = inside ? 0 : LOD_CULLED;
+            batch_visible += inside;
+        }
+        visible += batch_visible;
+    });
+
+    view.m_stats.m_tested = count;
+    view.m_stats.m_visible = visible;
+}
+
+void v_select_lods(Scene& scene, SceneView& view)
+{
+    uint32_t count = (uint32_t)scene.m_meshes.m_data.size();
+
+    std::atomic<uint32_t> lod_counts[SCENE_MAX_LODS];
+    for(uint32_t lod=0; lod < SCENE_MAX_LODS; lod++) lod_counts[lod] = 0;
+
+    v_parallel_for(count, SYSTEM_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+        uint32_t batch_counts[SCENE_MAX_LODS] = {};
+        for(uint32_t i=begin; i < end; i++)
+        {
+            if(view.m_lod[i] == LOD_CULLED) continue;
+
+            const MeshComponent& mesh = scene.m_meshes.m_data[i];
+            uint32_t lod = 0;
+            while(lod < mesh.m_lod_count && view.m_distance[i] > mesh.m_lod_distances[lod]) lod++;
+
+            if(lod == mesh.m_lod_count)
+            {
+                view.m_lod[i] = LOD_CULLED;
+                continue;
+            }
+
+            view.m_lod[i] = (uint8_t)lod;
+            batch_counts[lod]++;
+        }
+        for(uint32_t lod=0; lod < SCENE_MAX_LODS; lod++) lod_counts[lod] += batch_counts[lod];
+    });
+
+    for(uint32_t lod=0; lod < SCENE_MAX_LODS; lod++) view.m_stats.m_lod_counts[lod] = lod_counts[lod];
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <HandmadeMath.h>
+
+#include "scene.h"
+
+// Per-frame systems over the scene's mesh array. Results are stored per dense
+// mesh slot in the SceneView, so each system is a flat parallel loop.
+
+#define LOD_CULLED 0xFF
+
+struct SceneViewStats
+{
+    uint32_t m_tested;
+    uint32_t m_visible;
+    uint32_t m_lod_counts[SCENE_MAX_LODS];
+};
+
+struct SceneView
+{
+    hmm_mat4 m_view_projection;
+    hmm_vec3 m_camera_position;
+    // World space, filled by v_cull_scene()
+    hmm_vec4 m_frustum[6];
+
+    // Indexed like scene.m_meshes.m_data
+    std::vector<float> m_distance;
+    std::vector<uint8_t> m_lod;
+
+    SceneViewStats m_stats;
+};
+
+// Frustum planes from a GL style clip matrix, normal in XYZ, distance in W
+void v_extract_frustum(const hmm_mat4& m, hmm_vec4 planes[6]);
+// Expects v_update_transforms() to have run this frame. Meshes without a
+// transform or material are always culled, meshes without bounds never are.
+// Static meshes are left to v_submit_static_scene() and also count as culled.
+void v_cull_scene(Scene& scene, SceneView& view);
+// Picks a LOD for every mesh that survived culling
+void v_select_lods(Scene& scene, SceneView& view);
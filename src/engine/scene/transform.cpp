@@ -0,0 +1,508 @@
+#include <atomic>
+#include <assert.h>
+#include <string.h>
+#include "transform.h"
+
+#include "../core/job.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define TRANSFORM_LANES 8
+#elif defined(HANDMADE_MATH__USE_SSE)
+#define TRANSFORM_LANES 4
+#else
+#define TRANSFORM_LANES 1
+#endif
+
+static const uint8_t DIRTY_LOCAL = 1 << 0;
+static const uint8_t DIRTY_WORLD = 1 << 1;
+
+// Slots are padded so the widest kernel never reads past the end
+static const uint32_t SLOT_PADDING = 8;
+static const uint32_t LOCAL_BATCH_SIZE = 1024;
+static const uint32_t WORLD_BATCH_SIZE = 256;
+
+static uint32_t v_padded(uint32_t count)
+{
+    return (count + SLOT_PADDING - 1) / SLOT_PADDING * SLOT_PADDING;
+}
+
+static void v_resize_slots(TransformSystem& system, uint32_t slot_count)
+{
+    uint32_t padded = v_padded(slot_count);
+    if(padded <= system.m_dirty.size()) return;
+
+    system.m_position_x.resize(padded, 0.0f);
+    system.m_position_y.resize(padded, 0.0f);
+    system.m_position_z.resize(padded, 0.0f);
+    system.m_rotation_x.resize(padded, 0.0f);
+    system.m_rotation_y.resize(padded, 0.0f);
+    system.m_rotation_z.resize(padded, 0.0f);
+    system.m_rotation_w.resize(padded, 1.0f);
+    system.m_scale_x.resize(padded, 1.0f);
+    system.m_scale_y.resize(padded, 1.0f);
+    system.m_scale_z.resize(padded, 1.0f);
+    system.m_parent.resize(padded, TRANSFORM_NONE);
+    system.m_dirty.resize(padded, 0);
+    system.m_local.resize(padded, HMM_Mat4d(1.0f));
+    system.m_world.resize(padded, HMM_Mat4d(1.0f));
+    system.m_slot_to_id.resize(padded, TRANSFORM_NONE);
+}
+
+void v_init_transform_system(TransformSystem& system, uint32_t capacity)
+{
+    system.m_count = 0;
+    system.m_hierarchy_dirty = false;
+    system.m_slot_version = 0;
+    system.m_level_start.clear();
+    v_resize_slots(system, capacity);
+    system.m_id_to_slot.reserve(capacity);
+    system.m_id_parent.reserve(capacity);
+}
+
+uint32_t v_create_transform(TransformSystem& system, uint32_t parent_id)
+{
+    uint32_t id;
+    if(!system.m_free_ids.empty())
+    {
+        id = system.m_free_ids.back();
+        system.m_free_ids.pop_back();
+    } else {
+        id = (uint32_t)system.m_id_to_slot.size();
+        system.m_id_to_slot.push_back(TRANSFORM_NONE);
+        system.m_id_parent.push_back(TRANSFORM_NONE);
+    }
+
+    uint32_t slot = system.m_count++;
+    v_resize_slots(system, system.m_count);
+
+    system.m_position_x[slot] = 0.0f;
+    system.m_position_y[slot] = 0.0f;
+    system.m_position_z[slot] = 0.0f;
+    system.m_rotation_x[slot] = 0.0f;
+    system.m_rotation_y[slot] = 0.0f;
+    system.m_rotation_z[slot] = 0.0f;
+    system.m_rotation_w[slot] = 1.0f;
+    system.m_scale_x[slot] = 1.0f;
+    system.m_scale_y[slot] = 1.0f;
+    system.m_scale_z[slot] = 1.0f;
+    system.m_dirty[slot] = DIRTY_LOCAL | DIRTY_WORLD;
+
+    system.m_slot_to_id[slot] = id;
+    system.m_id_to_slot[id] = slot;
+    system.m_id_parent[id] = parent_id;
+    system.m_hierarchy_dirty = true;
+
+    return id;
+}
+
+static void v_move_slot(TransformSystem& system, uint32_t from, uint32_t to)
+{
+    system.m_position_x[to] = system.m_position_x[from];
+    system.m_position_y[to] = system.m_position_y[from];
+    system.m_position_z[to] = system.m_position_z[from];
+    system.m_rotation_x[to] = system.m_rotation_x[from];
+    system.m_rotation_y[to] = system.m_rotation_y[from];
+    system.m_rotation_z[to] = system.m_rotation_z[from];
+    system.m_rotation_w[to] = system.m_rotation_w[from];
+    system.m_scale_x[to] = system.m_scale_x[from];
+    system.m_scale_y[to] = system.m_scale_y[from];
+    system.m_scale_z[to] = system.m_scale_z[from];
+    system.m_dirty[to] = system.m_dirty[from];
+    system.m_slot_to_id[to] = system.m_slot_to_id[from];
+    system.m_id_to_slot[system.m_slot_to_id[to]] = to;
+}
+
+void v_destroy_transform(TransformSystem& system, uint32_t id)
+{
+    uint32_t slot = system.m_id_to_slot[id];
+    uint32_t last = --system.m_count;
+    if(slot != last) v_move_slot(system, last, slot);
+
+    system.m_slot_to_id[last] = TRANSFORM_NONE;
+    system.m_id_to_slot[id] = TRANSFORM_NONE;
+    system.m_id_parent[id] = TRANSFORM_NONE;
+    system.m_pending_free_ids.push_back(id);
+    system.m_hierarchy_dirty = true;
+}
+
+bool v_set_parent(TransformSystem& system, uint32_t id, uint32_t parent_id)
+{
+    // The depth sort walks up to the roots, a cycle would never end
+    for(uint32_t ancestor=parent_id; ancestor != TRANSFORM_NONE; ancestor = system.m_id_parent[ancestor])
+    {
+        if(ancestor == id) return false;
+    }
+
+    system.m_id_parent[id] = parent_id;
+    system.m_hierarchy_dirty = true;
+    return true;
+}
+
+void v_set_transform(TransformSystem& system, uint32_t id, hmm_vec3 position, hmm_quaternion rotation, hmm_vec3 scale)
+{
+    uint32_t slot = system.m_id_to_slot[id];
+    system.m_position_x[slot] = position.X;
+    system.m_position_y[slot] = position.Y;
+    system.m_position_z[slot] = position.Z;
+    system.m_rotation_x[slot] = rotation.X;
+    system.m_rotation_y[slot] = rotation.Y;
+    system.m_rotation_z[slot] = rotation.Z;
+    system.m_rotation_w[slot] = rotation.W;
+    system.m_scale_x[slot] = scale.X;
+    system.m_scale_y[slot] = scale.Y;
+    system.m_scale_z[slot] = scale.Z;
+    system.m_dirty[slot] |= DIRTY_LOCAL | DIRTY_WORLD;
+}
+
+void v_set_position(TransformSystem& system, uint32_t id, hmm_vec3 position)
+{
+    uint32_t slot = system.m_id_to_slot[id];
+    system.m_position_x[slot] = position.X;
+    system.m_position_y[slot] = position.Y;
+    system.m_position_z[slot] = position.Z;
+    system.m_dirty[slot] |= DIRTY_LOCAL | DIRTY_WORLD;
+}
+
+void v_set_rotation(TransformSystem& system, uint32_t id, hmm_quaternion rotation)
+{
+    uint32_t slot = system.m_id_to_slot[id];
+    system.m_rotation_x[slot] = rotation.X;
+    system.m_rotation_y[slot] = rotation.Y;
+    system.m_rotation_z[slot] = rotation.Z;
+    system.m_rotation_w[slot] = rotation.W;
+    system.m_dirty[slot] |= DIRTY_LOCAL | DIRTY_WORLD;
+}
+
+uint32_t v_get_transform_slot(const TransformSystem& system, uint32_t id)
+{
+    return system.m_id_to_slot[id];
+}
+
+const hmm_mat4& v_get_world_matrix(const TransformSystem& system, uint32_t id)
+{
+    return system.m_world[system.m_id_to_slot[id]];
+}
+
+// Reorders all slots by hierarchy depth with a stable counting sort
+static void v_sort_transforms(TransformSystem& system)
+{
+    uint32_t count = system.m_count;
+    uint32_t id_count = (uint32_t)system.m_id_to_slot.size();
+
+    // Children of destroyed transforms become roots
+    for(uint32_t slot=0; slot < count; slot++)
+    {
+        uint32_t& parent_id = system.m_id_parent[system.m_slot_to_id[slot]];
+        if(parent_id != TRANSFORM_NONE && system.m_id_to_slot[parent_id] == TRANSFORM_NONE) parent_id = TRANSFORM_NONE;
+    }
+    system.m_free_ids.insert(system.m_free_ids.end(), system.m_pending_free_ids.begin(), system.m_pending_free_ids.end());
+    system.m_pending_free_ids.clear();
+
+    std::vector<uint32_t> depth(id_count, TRANSFORM_NONE);
+    std::vector<uint32_t> chain;
+    uint32_t max_depth = 0;
+
+    for(uint32_t slot=0; slot < count; slot++)
+    {
+        uint32_t id = system.m_slot_to_id[slot];
+        chain.clear();
+        while(id != TRANSFORM_NONE && depth[id] == TRANSFORM_NONE)
+        {
+            chain.push_back(id);
+            id = system.m_id_parent[id];
+        }
+
+        uint32_t current = id == TRANSFORM_NONE ? 0 : depth[id] + 1;
+        for(size_t i=chain.size(); i > 0; i--)
+        {
+            depth[chain[i - 1]] = current++;
+        }
+        if(current > max_depth + 1) max_depth = current - 1;
+    }
+
+    system.m_level_start.assign(max_depth + 2, 0);
+    for(uint32_t slot=0; slot < count; slot++)
+    {
+        system.m_level_start[depth[system.m_slot_to_id[slot]] + 1]++;
+    }
+    for(uint32_t level=1; level < system.m_level_start.size(); level++)
+    {
+        system.m_level_start[level] += system.m_level_start[level - 1];
+    }
+
+    std::vector<uint32_t> order(count);
+    std::vector<uint32_t> next(system.m_level_start.begin(), system.m_level_start.end() - 1);
+    for(uint32_t slot=0; slot < count; slot++)
+    {
+        order[next[depth[system.m_slot_to_id[slot]]]++] = slot;
+    }
+
+    TransformSystem sorted;
+    sorted.m_count = 0;
+    v_resize_slots(sorted, (uint32_t)system.m_dirty.size());
+    for(uint32_t new_slot=0; new_slot < count; new_slot++)
+    {
+        uint32_t old_slot = order[new_slot];
+        sorted.m_position_x[new_slot] = system.m_position_x[old_slot];
+        sorted.m_position_y[new_slot] = system.m_position_y[old_slot];
+        sorted.m_position_z[new_slot] = system.m_position_z[old_slot];
+        sorted.m_rotation_x[new_slot] = system.m_rotation_x[old_slot];
+        sorted.m_rotation_y[new_slot] = system.m_rotation_y[old_slot];
+        sorted.m_rotation_z[new_slot] = system.m_rotation_z[old_slot];
+        sorted.m_rotation_w[new_slot] = system.m_rotation_w[old_slot];
+        sorted.m_scale_x[new_slot] = system.m_scale_x[old_slot];
+        sorted.m_scale_y[new_slot] = system.m_scale_y[old_slot];
+        sorted.m_scale_z[new_slot] = system.m_scale_z[old_slot];
+        sorted.m_slot_to_id[new_slot] = system.m_slot_to_id[old_slot];
+        system.m_id_to_slot[sorted.m_slot_to_id[new_slot]] = new_slot;
+    }
+
+    system.m_position_x.swap(sorted.m_position_x);
+    system.m_position_y.swap(sorted.m_position_y);
+    system.m_position_z.swap(sorted.m_position_z);
+    system.m_rotation_x.swap(sorted.m_rotation_x);
+    system.m_rotation_y.swap(sorted.m_rotation_y);
+    system.m_rotation_z.swap(sorted.m_rotation_z);
+    system.m_rotation_w.swap(sorted.m_rotation_w);
+    system.m_scale_x.swap(sorted.m_scale_x);
+    system.m_scale_y.swap(sorted.m_scale_y);
+    system.m_scale_z.swap(sorted.m_scale_z);
+    system.m_slot_to_id.swap(sorted.m_slot_to_id);
+
+    // Every slot may have moved, so every instance has to be rewritten
+    for(uint32_t slot=0; slot < count; slot++)
+    {
+        uint32_t parent_id = system.m_id_parent[system.m_slot_to_id[slot]];
+        system.m_parent[slot] = parent_id == TRANSFORM_NONE ? TRANSFORM_NONE : system.m_id_to_slot[parent_id];
+        system.m_dirty[slot] = DIRTY_LOCAL | DIRTY_WORLD;
+    }
+
+    system.m_hierarchy_dirty = false;
+    system.m_slot_version++;
+}
+
+// Local matrix kernels. Each builds T * R * S for a run of consecutive slots
+// straight from the SoA arrays, one transform per SIMD lane.
+
+#if TRANSFORM_LANES >= 4
+static inline void v_store_column(hmm_mat4* out, uint32_t column, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(out[0].Elements[column], x);
+    _mm_storeu_ps(out[1].Elements[column], y);
+    _mm_storeu_ps(out[2].Elements[column], z);
+    _mm_storeu_ps(out[3].Elements[column], w);
+}
+#endif
+
+#if TRANSFORM_LANES == 8
+static inline __m128 v_low(__m256 value) { return _mm256_castps256_ps128(value); }
+static inline __m128 v_high(__m256 value) { return _mm256_extractf128_ps(value, 1); }
+
+static void v_compose_locals(TransformSystem& system, uint32_t first)
+{
+    __m256 qx = _mm256_loadu_ps(&system.m_rotation_x[first]);
+    __m256 qy = _mm256_loadu_ps(&system.m_rotation_y[first]);
+    __m256 qz = _mm256_loadu_ps(&system.m_rotation_z[first]);
+    __m256 qw = _mm256_loadu_ps(&system.m_rotation_w[first]);
+    __m256 sx = _mm256_loadu_ps(&system.m_scale_x[first]);
+    __m256 sy = _mm256_loadu_ps(&system.m_scale_y[first]);
+    __m256 sz = _mm256_loadu_ps(&system.m_scale_z[first]);
+    __m256 px = _mm256_loadu_ps(&system.m_position_x[first]);
+    __m256 py = _mm256_loadu_ps(&system.m_position_y[first]);
+    __m256 pz = _mm256_loadu_ps(&system.m_position_z[first]);
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 zero = _mm256_setzero_ps();
+
+    __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+    __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+    __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+
+    __m256 c0x = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+    __m256 c0y = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+    __m256 c0z = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+    __m256 c1x = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+    __m256 c1y = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+    __m256 c1z = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+    __m256 c2x = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+    __m256 c2y = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+    __m256 c2z = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+
+    hmm_mat4* out = &system.m_local[first];
+    v_store_column(out, 0, v_low(c0x), v_low(c0y), v_low(c0z), v_low(zero));
+    v_store_column(out, 1, v_low(c1x), v_low(c1y), v_low(c1z), v_low(zero));
+    v_store_column(out, 2, v_low(c2x), v_low(c2y), v_low(c2z), v_low(zero));
+    v_store_column(out, 3, v_low(px), v_low(py), v_low(pz), v_low(one));
+    v_store_column(out + 4, 0, v_high(c0x), v_high(c0y), v_high(c0z), v_low(zero));
+    v_store_column(out + 4, 1, v_high(c1x), v_high(c1y), v_high(c1z), v_low(zero));
+    v_store_column(out + 4, 2, v_high(c2x), v_high(c2y), v_high(c2z), v_low(zero));
+    v_store_column(out + 4, 3, v_high(px), v_high(py), v_high(pz), v_low(one));
+}
+
+// Two result columns per instruction, in-lane shuffles broadcast the factors
+static inline void v_multiply(const hmm_mat4& left, const hmm_mat4& right, hmm_mat4& result)
+{
+    __m256 l0 = _mm256_broadcast_ps((const __m128*)left.Elements[0]);
+    __m256 l1 = _mm256_broadcast_ps((const __m128*)left.Elements[1]);
+    __m256 l2 = _mm256_broadcast_ps((const __m128*)left.Elements[2]);
+    __m256 l3 = _mm256_broadcast_ps((const __m128*)left.Elements[3]);
+
+    for(uint32_t column=0; column < 4; column += 2)
+    {
+        __m256 r = _mm256_loadu_ps(right.Elements[column]);
+        __m256 sum = _mm256_mul_ps(l0, _mm256_permute_ps(r, 0x00));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(l1, _mm256_permute_ps(r, 0x55)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(l2, _mm256_permute_ps(r, 0xAA)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(l3, _mm256_permute_ps(r, 0xFF)));
+        _mm256_storeu_ps(result.Elements[column], sum);
+    }
+}
+#elif TRANSFORM_LANES == 4
+static void v_compose_locals(TransformSystem& system, uint32_t first)
+{
+    for(uint32_t half=0; half < 8; half += 4)
+    {
+        uint32_t slot = first + half;
+        __m128 qx = _mm_loadu_ps(&system.m_rotation_x[slot]);
+        __m128 qy = _mm_loadu_ps(&system.m_rotation_y[slot]);
+        __m128 qz = _mm_loadu_ps(&system.m_rotation_z[slot]);
+        __m128 qw = _mm_loadu_ps(&system.m_rotation_w[slot]);
+        __m128 sx = _mm_loadu_ps(&system.m_scale_x[slot]);
+        __m128 sy = _mm_loadu_ps(&system.m_scale_y[slot]);
+        __m128 sz = _mm_loadu_ps(&system.m_scale_z[slot]);
+
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 two = _mm_set1_ps(2.0f);
+        __m128 zero = _mm_setzero_ps();
+
+        __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+        __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+        __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+        hmm_mat4* out = &system.m_local[slot];
+        v_store_column(out, 0,
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx), zero);
+        v_store_column(out, 1,
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy), zero);
+        v_store_column(out, 2,
+            _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz),
+            _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), zero);
+        v_store_column(out, 3,
+            _mm_loadu_ps(&system.m_position_x[slot]),
+            _mm_loadu_ps(&system.m_position_y[slot]),
+            _mm_loadu_ps(&system.m_position_z[slot]), one);
+    }
+}
+
+static inline void v_multiply(const hmm_mat4& left, const hmm_mat4& right, hmm_mat4& result)
+{
+    __m128 l0 = _mm_loadu_ps(left.Elements[0]);
+    __m128 l1 = _mm_loadu_ps(left.Elements[1]);
+    __m128 l2 = _mm_loadu_ps(left.Elements[2]);
+    __m128 l3 = _mm_loadu_ps(left.Elements[3]);
+
+    for(uint32_t column=0; column < 4; column++)
+    {
+        __m128 r = _mm_loadu_ps(right.Elements[column]);
+        __m128 sum = _mm_mul_ps(l0, _mm_shuffle_ps(r, r, 0x00));
+        sum = _mm_add_ps(sum, _mm_mul_ps(l1, _mm_shuffle_ps(r, r, 0x55)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(l2, _mm_shuffle_ps(r, r, 0xAA)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(l3, _mm_shuffle_ps(r, r, 0xFF)));
+        _mm_storeu_ps(result.Elements[column], sum);
+    }
+}
+#else
+static void v_compose_locals(TransformSystem& system, uint32_t first)
+{
+    for(uint32_t slot=first; slot < first + 8; slot++)
+    {
+        hmm_quaternion rotation = HMM_Quaternion(
+            system.m_rotation_x[slot], system.m_rotation_y[slot], system.m_rotation_z[slot], system.m_rotation_w[slot]
+        );
+        hmm_mat4 local = HMM_QuaternionToMat4(rotation);
+        for(int row=0; row < 3; row++)
+        {
+            local.Elements[0][row] *= system.m_scale_x[slot];
+            local.Elements[1][row] *= system.m_scale_y[slot];
+            local.Elements[2][row] *= system.m_scale_z[slot];
+        }
+        local.Elements[3][0] = system.m_position_x[slot];
+        local.Elements[3][1] = system.m_position_y[slot];
+        local.Elements[3][2] = system.m_position_z[slot];
+        system.m_local[slot] = local;
+    }
+}
+
+static inline void v_multiply(const hmm_mat4& left, const hmm_mat4& right, hmm_mat4& result)
+{
+    result = HMM_MultiplyMat4(left, right);
+}
+#endif
+
+TransformStats v_update_transforms(TransformSystem& system, hmm_mat4* instance_data, uint32_t instance_capacity)
+{
+    if(system.m_hierarchy_dirty) v_sort_transforms(system);
+    assert(instance_data == nullptr || system.m_count <= instance_capacity);
+
+    std::atomic<uint32_t> locals_updated(0);
+    std::atomic<uint32_t> worlds_updated(0);
+    uint32_t count = system.m_count;
+
+    // Locals only depend on their own TRS, so all levels are built at once.
+    // Runs of 8 slots are rebuilt together if any of them changed.
+    v_parallel_for(count, LOCAL_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+        uint32_t updated = 0;
+        for(uint32_t first=begin; first < end; first += 8)
+        {
+            uint64_t flags;
+            memcpy(&flags, &system.m_dirty[first], sizeof(flags));
+            if((flags & 0x0101010101010101ull) == 0) continue;
+
+            v_compose_locals(system, first);
+            updated++;
+        }
+        locals_updated += updated * 8;
+    });
+
+    // Worlds go level by level, a slot is dirty if it or its parent changed
+    for(uint32_t level=0; level + 1 < system.m_level_start.size(); level++)
+    {
+        uint32_t level_start = system.m_level_start[level];
+        uint32_t level_size = system.m_level_start[level + 1] - level_start;
+
+        v_parallel_for(level_size, WORLD_BATCH_SIZE, [&](uint32_t begin, uint32_t end, uint32_t) {
+            uint32_t updated = 0;
+            for(uint32_t slot=level_start + begin; slot < level_start + end; slot++)
+            {
+                uint32_t parent = system.m_parent[slot];
+                if(parent != TRANSFORM_NONE && (system.m_dirty[parent] & DIRTY_WORLD))
+                {
+                    system.m_dirty[slot] |= DIRTY_WORLD;
+                }
+                if(!(system.m_dirty[slot] & DIRTY_WORLD)) continue;
+
+                if(parent == TRANSFORM_NONE) system.m_world[slot] = system.m_local[slot];
+                else v_multiply(system.m_world[parent], system.m_local[slot], system.m_world[slot]);
+
+                if(instance_data && slot < instance_capacity) memcpy(&instance_data[slot], &system.m_world[slot], sizeof(hmm_mat4));
+                updated++;
+            }
+            worlds_updated += updated;
+        });
+    }
+
+    memset(system.m_dirty.data(), 0, system.m_dirty.size());
+
+    TransformStats stats;
+    stats.m_locals_updated = locals_updated;
+    stats.m_worlds_updated = worlds_updated;
+    return stats;
+}
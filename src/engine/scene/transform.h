@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <HandmadeMath.h>
+
+// Batch transform system. Local TRS is kept in SoA arrays ordered by hierarchy
+// depth so every parent is resolved before its children. Transforms are
+// referenced by stable ids, their slot (and instance index) can change
+// whenever the hierarchy changes.
+
+#define TRANSFORM_NONE 0xFFFFFFFF
+
+struct TransformSystem
+{
+    uint32_t m_count;
+
+    // Indexed by slot, padded to a multiple of 8 for the SIMD kernels
+    std::vector<float> m_position_x, m_position_y, m_position_z;
+    std::vector<float> m_rotation_x, m_rotation_y, m_rotation_z, m_rotation_w;
+    std::vector<float> m_scale_x, m_scale_y, m_scale_z;
+    std::vector<uint32_t> m_parent;
+    std::vector<uint8_t> m_dirty;
+    std::vector<hmm_mat4> m_local;
+    std::vector<hmm_mat4> m_world;
+
+    // First slot of every depth level, plus the end slot
+    std::vector<uint32_t> m_level_start;
+
+    std::vector<uint32_t> m_slot_to_id;
+    std::vector<uint32_t> m_id_to_slot;
+    std::vector<uint32_t> m_id_parent;
+    std::vector<uint32_t> m_free_ids;
+    // Destroyed ids are only recycled after their children were detached
+    std::vector<uint32_t> m_pending_free_ids;
+    bool m_hierarchy_dirty;
+    // Bumped whenever slots were reassigned, instance indexes kept from before are stale
+    uint32_t m_slot_version;
+};
+
+struct TransformStats
+{
+    uint32_t m_locals_updated;
+    uint32_t m_worlds_updated;
+};
+
+void v_init_transform_system(TransformSystem& system, uint32_t capacity);
+
+uint32_t v_create_transform(TransformSystem& system, uint32_t parent_id);
+// Children of a destroyed transform become roots
+void v_destroy_transform(TransformSystem& system, uint32_t id);
+// Returns false and keeps the old parent when parent_id is id or one of its descendants
+bool v_set_parent(TransformSystem& system, uint32_t id, uint32_t parent_id);
+
+// rotation must be a unit quaternion
+void v_set_transform(TransformSystem& system, uint32_t id, hmm_vec3 position, hmm_quaternion rotation, hmm_vec3 scale);
+void v_set_position(TransformSystem& system, uint32_t id, hmm_vec3 position);
+void v_set_rotation(TransformSystem& system, uint32_t id, hmm_quaternion rotation);
+
+// Recomputes dirty subtrees. When instance_data is not null, every world matrix
+// that changed is also written to instance_data[slot], usually a mapped GPU buffer.
+// Slots from instance_capacity on are not written.
+TransformStats v_update_transforms(TransformSystem& system, hmm_mat4* instance_data, uint32_t instance_capacity);
+
+uint32_t v_get_transform_slot(const TransformSystem& system, uint32_t id);
+const hmm_mat4& v_get_world_matrix(const TransformSystem& system, uint32_t id);
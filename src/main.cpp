@@ -1,24 +1,306 @@
 #define GLFW_INCLUDE_VULKAN
 
 #include <iostream>
+#include <chrono>
+#include <stdlib.h>
+#include <random>
+#include <vector>
 #include <GLFW/glfw3.h>
 
 #include "engine/gfx/renderer.h"
 #include "engine/gfx/model.h"
 #include "engine/gfx/pipeline.h"
 #include "engine/gfx/push_constant.h"
+#include "engine/gfx/render_queue.h"
+#include "engine/gfx/frame_pacer.h"
+#include "engine/gfx/memory.h"
+#include "engine/gfx/geometry.h"
+#include "engine/gfx/render_graph.h"
+#include "engine/gfx/lighting.h"
+#include "engine/gfx/meshlet_culling.h"
+#include "engine/gfx/depth_pyramid.h"
+#include "engine/gfx/dynamic_resolution.h"
+#include "engine/gfx/upscale.h"
+#include "engine/gfx/sprite_renderer.h"
+#include "engine/gfx/draw_cache.h"
+#include "engine/gfx/resources.h"
+#include "engine/core/job.h"
+#include "engine/core/init_graph.h"
+#include "engine/core/allocator.h"
+#include "engine/scene/scene.h"
+#include "engine/scene/scene_systems.h"
+#include "engine/scene/scene_render.h"
 
 GLFWwindow* g_window;
 VkSurfaceKHR g_surface;
-GraphicsPipeline g_pipeline;
+RenderQueue g_render_queue;
+FramePacer g_frame_pacer;
+DynamicResolution g_resolution;
+Scene g_scene;
+SceneView g_scene_view;
+RenderGraph g_render_graph;
+GraphResource g_backbuffer;
+GraphResource g_scene_color;
+GraphResource g_depth;
+GraphPass g_main_pass;
+GraphPass g_late_pass;
+GraphPass g_pyramid_pass;
+GraphPass g_upscale_pass;
+GraphPass g_overlay_pass;
+SpriteBatch g_sprites;
+bool g_show_pass_times = false;
+bool g_sprite_stress = false;
+float g_sprite_ms = 0.0f;
+// CPU time of the frame's own draws: submit and sort, then recording
+float g_submit_ms = 0.0f;
+float g_record_ms = 0.0f;
+// ShaderFeature mask of the scene materials, switched by the keys
+uint32_t g_scene_features = SHADER_FEATURES_DEFAULT;
+// Every variant used so far, kept so switching back compiles nothing
+PipelineHandle g_scene_variants[1 << SHADER_FEATURE_COUNT];
+HeapStats g_frame_heap;
 
-void draw(Model& model, GraphicsPipeline& pipeline, PushConstant constants)
+// Frames after startup or a resize before the loop must stop allocating
+static const uint32_t HEAP_WARMUP_FRAMES = 120;
+
+static const uint32_t SPRITE_CAPACITY = 1 << 17;
+static const uint32_t SPRITE_STRESS_COUNT = 100000;
+static const uint32_t ATLAS_SIZE = 256;
+static const uint32_t ATLAS_DOT_TEXTURE = 1;
+
+static const char* SCENE_VARIANT_LIST = "pipeline_variants.txt";
+
+// A floor of static copies behind the spinning meshes
+static const uint32_t STATIC_GRID_SIZE = 32;
+
+static const uint32_t g_pass_colors[] = {
+    0xff4080ff, 0xff40ff80, 0xffff8040, 0xff40ffff, 0xffff40ff, 0xffffff40, 0xff8080ff, 0xffc0c0c0
+};
+
+void framebuffer_resized(GLFWwindow* window, int width, int height)
 {
-    vkCmdBindPipeline(g_renderer.m_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.m_pipeline);
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(g_renderer.m_command_buffer, 0, 1, &model.m_vertex_buffer.m_buffer, &offset);
-    vkCmdPushConstants(g_renderer.m_command_buffer, pipeline.m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstant), &constants);
-    vkCmdDraw(g_renderer.m_command_buffer, (uint32_t)model.m_vertices.size(), 1, 0, 0);
+    g_renderer.m_swapchain_dirty = true;
+}
+
+void key_pressed(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if(action != GLFW_PRESS) return;
+
+    switch(key)
+    {
+        case GLFW_KEY_ESCAPE: glfwSetWindowShouldClose(window, GLFW_TRUE); break;
+        case GLFW_KEY_1: v_set_present_mode(VK_PRESENT_MODE_FIFO_KHR); break;
+        case GLFW_KEY_2: v_set_present_mode(VK_PRESENT_MODE_MAILBOX_KHR); break;
+        case GLFW_KEY_3: v_set_present_mode(VK_PRESENT_MODE_IMMEDIATE_KHR); break;
+        case GLFW_KEY_4: v_set_present_mode(VK_PRESENT_MODE_FIFO_RELAXED_KHR); break;
+        case GLFW_KEY_L: g_frame_pacer.m_enabled = !g_frame_pacer.m_enabled; break;
+        case GLFW_KEY_M: v_print_memory_stats(); break;
+        case GLFW_KEY_A: std::cout << "API call overhead: " << v_measure_call_overhead(100000) << " ns" << std::endl; break;
+        case GLFW_KEY_F: v_request_defragmentation(); break;
+        case GLFW_KEY_G: v_dump_render_graph(g_render_graph, "render_graph.dot"); break;
+        case GLFW_KEY_C:
+            g_lighting.m_brute_force = !g_lighting.m_brute_force;
+            g_scene_features ^= SHADER_FEATURE_CLUSTERED_LIGHTING;
+            std::cout << (g_lighting.m_brute_force ? "Brute force" : "Clustered") << " lighting" << std::endl;
+            break;
+        case GLFW_KEY_N:
+            g_scene_features ^= SHADER_FEATURE_DEBUG_NORMALS;
+            std::cout << "Debug normals " << ((g_scene_features & SHADER_FEATURE_DEBUG_NORMALS) ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_K:
+            g_meshlet_culling.m_enabled = !g_meshlet_culling.m_enabled;
+            std::cout << "Meshlet culling " << (g_meshlet_culling.m_enabled ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_O:
+            g_meshlet_culling.m_occlusion = !g_meshlet_culling.m_occlusion;
+            std::cout << "Occlusion culling " << (g_meshlet_culling.m_occlusion ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_R:
+            g_resolution.m_enabled = !g_resolution.m_enabled;
+            std::cout << "Dynamic resolution " << (g_resolution.m_enabled ? "on" : "off") << ", scale " << g_resolution.m_scale
+                << ", GPU " << v_get_graph_gpu_ms(g_render_graph) << " ms" << std::endl;
+            break;
+        case GLFW_KEY_T:
+            g_upscale.m_sharpness = g_upscale.m_sharpness > 0.0f ? 0.0f : 0.5f;
+            std::cout << "Upscale sharpening " << (g_upscale.m_sharpness > 0.0f ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_B:
+            g_sprite_stress = !g_sprite_stress;
+            std::cout << "Sprite stress " << (g_sprite_stress ? "on" : "off") << ", last frame " << g_sprite_renderer.m_count
+                << " sprites in " << g_sprite_ms << " ms CPU, 1 draw" << std::endl;
+            break;
+        case GLFW_KEY_V:
+            g_show_pass_times = !g_show_pass_times;
+            if(!g_show_pass_times) break;
+            // The bars have no labels, their order and colors match this list
+            for(uint32_t i=0, bar=0; i < g_render_graph.m_passes.size(); i++)
+            {
+                if(g_render_graph.m_passes[i].m_culled) continue;
+                std::cout << "Bar " << bar << " (" << std::hex << g_pass_colors[bar % 8] << std::dec << "): "
+                    << g_render_graph.m_passes[i].m_name << ", " << v_get_graph_pass_ms(g_render_graph, i) << " ms" << std::endl;
+                bar++;
+            }
+            break;
+        case GLFW_KEY_X:
+        {
+            // Off rebuilds and re-records the static draws every frame, like the dynamic ones
+            const DrawCacheStats& stats = g_draw_cache.m_stats;
+            std::cout << "Last frame: " << stats.m_static_draws << " static draws, rebuild " << stats.m_rebuild_ms
+                << " ms, " << stats.m_recordings << " recordings in " << stats.m_record_ms << " ms. "
+                << g_render_queue.m_entries.size() << " dynamic draws, submit " << g_submit_ms << " ms, record "
+                << g_record_ms << " ms" << std::endl;
+            g_draw_cache.m_enabled = !g_draw_cache.m_enabled;
+            std::cout << "Static draw cache " << (g_draw_cache.m_enabled ? "on" : "off") << std::endl;
+            break;
+        }
+        case GLFW_KEY_H:
+            std::cout << "Last frame: " << g_frame_heap.m_allocations << " heap allocations, " << g_frame_heap.m_bytes
+                << " bytes. Arena peaks: frame " << g_frame_arena.m_peak / 1024 << " KB, scratch "
+                << g_scratch_arena.m_peak / 1024 << " KB" << std::endl;
+            break;
+        case GLFW_KEY_P:
+        {
+            const MeshletCullStats& stats = g_meshlet_culling.m_stats;
+            std::cout << g_render_queue.m_stats.m_meshlets << " meshlets: " << stats.m_frustum_culled << " outside the frustum, "
+                << stats.m_cone_culled << " backfacing, " << stats.m_occluded << " occluded, " << stats.m_recovered
+                << " of them recovered late. Depth pyramid " << v_get_graph_pass_ms(g_render_graph, g_pyramid_pass) << " ms" << std::endl;
+            break;
+        }
+    }
+}
+
+// GPU time of every pass as a bar, 100 pixels per millisecond, over a
+// panel as wide as the frame budget
+void add_pass_time_bars()
+{
+    const float pixels_per_ms = 100.0f;
+    float budget_ms = g_resolution.m_target_ms;
+    float y = 10.0f;
+    uint32_t bar_count = 0;
+    for(uint32_t i=0; i < g_render_graph.m_passes.size(); i++) bar_count += g_render_graph.m_passes[i].m_culled ? 0 : 1;
+
+    v_add_rect(g_sprites, 5.0f, 5.0f, budget_ms * pixels_per_ms + 10.0f, bar_count * 12.0f + 10.0f, v_pack_color(0, 0, 0, 160), 0);
+    for(uint32_t i=0, bar=0; i < g_render_graph.m_passes.size(); i++)
+    {
+        if(g_render_graph.m_passes[i].m_culled) continue;
+        float width = HMM_MAX(v_get_graph_pass_ms(g_render_graph, i) * pixels_per_ms, 1.0f);
+        v_add_rect(g_sprites, 10.0f, y, width, 8.0f, g_pass_colors[bar % 8], 1);
+        y += 12.0f;
+        bar++;
+    }
+}
+
+// Dots drifting across the window, added in no particular layer order
+void add_stress_sprites(float time)
+{
+    SpriteRegion dot = v_make_sprite_region(ATLAS_DOT_TEXTURE, 0, 0, ATLAS_SIZE, ATLAS_SIZE, ATLAS_SIZE);
+    float width = (float)g_renderer.m_win_extent.width;
+    float height = (float)g_renderer.m_win_extent.height;
+    for(uint32_t i=0; i < SPRITE_STRESS_COUNT; i++)
+    {
+        uint32_t hash = i * 2654435761u;
+        float x = (float)(hash & 0xffff) / 65535.0f + time * 0.05f * (float)(1 + (hash >> 28));
+        float y = (float)((hash >> 12) & 0xffff) / 65535.0f;
+        x -= (float)(uint32_t)x;
+        v_add_sprite(g_sprites, x * width, y * height, 6.0f, 6.0f, dot, g_pass_colors[hash >> 29] & 0x80ffffff, (uint8_t)(hash >> 30));
+    }
+}
+
+// Static draws are replayed from the cache, the dynamic ones recorded for this frame only
+void execute_scene_draws(VkCommandBuffer command_buffer, GraphPass pass, bool late)
+{
+    if(late && !g_meshlet_culling.m_occlusion_active) return;
+
+    VkRenderPass render_pass = v_get_graph_render_pass(g_render_graph, pass);
+    uint32_t subpass = v_get_graph_subpass(g_render_graph, pass);
+    VkExtent2D extent = v_get_graph_render_extent(g_render_graph, g_scene_color);
+
+    VkCommandBuffer secondaries[2];
+    secondaries[0] = v_get_static_draws(render_pass, subpass, extent, late);
+
+    double record_start = glfwGetTime();
+    secondaries[1] = v_begin_frame_secondary(render_pass, subpass, extent);
+    v_record_render_queue(g_render_queue, secondaries[1], late);
+    vkEndCommandBuffer(secondaries[1]);
+    g_record_ms += (float)((glfwGetTime() - record_start) * 1000.0);
+
+    vkCmdExecuteCommands(command_buffer, 2, secondaries);
+}
+
+// Compiling the graph recreates its render passes, so the current one is
+// looked up on every acquire. Its key survives the recompile, so variants
+// compiled before a resize are shared instead of compiled again.
+PipelineHandle acquire_scene_pipeline(uint32_t features)
+{
+    return v_acquire_graphics_pipeline("shaders/vertex.spv", "shaders/frag.spv", features,
+        v_get_graph_render_pass(g_render_graph, g_main_pass), v_get_graph_render_pass_key(g_render_graph, g_main_pass),
+        v_get_graph_subpass(g_render_graph, g_main_pass));
+}
+
+VkResult build_render_graph()
+{
+    g_backbuffer = v_import_graph_image(g_render_graph, "backbuffer", g_renderer.m_swapchain_image_format,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    // The scene is drawn to the top left part of full size targets, the upscale pass stretches it over the backbuffer
+    g_scene_color = v_create_graph_image(g_render_graph, "scene color", g_renderer.m_swapchain_image_format, 1.0f);
+    g_depth = v_create_graph_image(g_render_graph, "depth", VK_FORMAT_D32_SFLOAT, 1.0f);
+    v_set_graph_image_dynamic(g_render_graph, g_scene_color);
+    v_set_graph_image_dynamic(g_render_graph, g_depth);
+
+    // Culling and light assignment write buffers only, which the graph does not track
+    GraphPass light_pass = v_add_graph_pass(g_render_graph, "light assignment", GRAPH_PASS_COMPUTE, [](VkCommandBuffer command_buffer) {
+        v_assign_lights(command_buffer);
+    });
+    v_set_graph_side_effects(g_render_graph, light_pass);
+
+    GraphPass meshlet_pass = v_add_graph_pass(g_render_graph, "meshlet culling", GRAPH_PASS_COMPUTE, [](VkCommandBuffer command_buffer) {
+        v_prepare_render_queue(g_render_queue, command_buffer);
+    });
+    v_set_graph_side_effects(g_render_graph, meshlet_pass);
+
+    g_main_pass = v_add_graph_pass(g_render_graph, "main", GRAPH_PASS_GRAPHICS, [](VkCommandBuffer command_buffer) {
+        execute_scene_draws(command_buffer, g_main_pass, false);
+    });
+    v_set_graph_secondary(g_render_graph, g_main_pass);
+    v_graph_clear(g_render_graph, g_main_pass, g_scene_color, GRAPH_COLOR_ATTACHMENT, {0.4f, 0.5f, 0.6f, 1.0f});
+    v_graph_clear(g_render_graph, g_main_pass, g_depth, GRAPH_DEPTH_ATTACHMENT, {1.0f, 0.0f, 0.0f, 0.0f});
+
+    // Occlusion culling: rebuild the pyramid from the early draws, then draw
+    // what the previous frame's pyramid hid by mistake
+    g_pyramid_pass = v_add_graph_pass(g_render_graph, "depth pyramid", GRAPH_PASS_COMPUTE, [](VkCommandBuffer command_buffer) {
+        v_build_depth_pyramid(command_buffer, v_get_graph_image_view(g_render_graph, g_depth),
+            v_get_graph_image_extent(g_render_graph, g_depth), v_get_graph_render_extent(g_render_graph, g_depth));
+    });
+    v_graph_use(g_render_graph, g_pyramid_pass, g_depth, GRAPH_SAMPLED);
+    v_set_graph_side_effects(g_render_graph, g_pyramid_pass);
+
+    GraphPass late_culling_pass = v_add_graph_pass(g_render_graph, "meshlet culling late", GRAPH_PASS_COMPUTE, [](VkCommandBuffer command_buffer) {
+        v_dispatch_meshlet_culling_late(command_buffer);
+    });
+    v_set_graph_side_effects(g_render_graph, late_culling_pass);
+
+    g_late_pass = v_add_graph_pass(g_render_graph, "main late", GRAPH_PASS_GRAPHICS, [](VkCommandBuffer command_buffer) {
+        execute_scene_draws(command_buffer, g_late_pass, true);
+    });
+    v_set_graph_secondary(g_render_graph, g_late_pass);
+    v_graph_use(g_render_graph, g_late_pass, g_scene_color, GRAPH_COLOR_ATTACHMENT);
+    v_graph_use(g_render_graph, g_late_pass, g_depth, GRAPH_DEPTH_ATTACHMENT);
+
+    g_upscale_pass = v_add_graph_pass(g_render_graph, "upscale", GRAPH_PASS_GRAPHICS, [](VkCommandBuffer command_buffer) {
+        v_upscale(command_buffer, v_get_graph_image_view(g_render_graph, g_scene_color),
+            v_get_graph_image_extent(g_render_graph, g_scene_color), v_get_graph_render_extent(g_render_graph, g_scene_color));
+    });
+    v_graph_use(g_render_graph, g_upscale_pass, g_scene_color, GRAPH_SAMPLED);
+    v_graph_use(g_render_graph, g_upscale_pass, g_backbuffer, GRAPH_COLOR_ATTACHMENT);
+
+    g_overlay_pass = v_add_graph_pass(g_render_graph, "overlay", GRAPH_PASS_GRAPHICS, [](VkCommandBuffer command_buffer) {
+        v_draw_sprites(command_buffer, v_get_graph_image_extent(g_render_graph, g_backbuffer));
+    });
+    v_graph_use(g_render_graph, g_overlay_pass, g_backbuffer, GRAPH_COLOR_ATTACHMENT);
+
+    v_set_imported_image(g_render_graph, g_backbuffer, g_renderer.m_swapchain_images[0],
+        g_renderer.m_swapchain_image_views[0], g_renderer.m_win_extent);
+    return v_compile_render_graph(g_render_graph);
 }
 
 int main()
@@ -27,64 +309,361 @@ int main()
     int height = 600;
     const char* app_name = "Engine";
 
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    g_window = glfwCreateWindow(width, height, app_name, NULL, NULL);
-
-    v_init_instance(app_name);
-    
-    glfwCreateWindowSurface(g_renderer.m_instance, g_window, NULL, &g_surface);
-    
-    v_init_surface(g_surface);
-    v_init_device();
-    v_init_allocator();
-    v_init_swapchain((uint32_t)width, (uint32_t)height);
-    v_init_render_pass();
-    v_init_cmd_pool();
-    v_allocate_cmd_buffer();
-    v_init_framebuffers();
-    v_init_sync_structs();
-    
-    g_pipeline = v_create_graphics_pipeline(
-        "shaders/vertex.spv",
-        "shaders/frag.spv"
-    );
-
-    Model mesh = v_load_model("assets/model.obj");
-    PushConstant constants;
+    auto process_start = std::chrono::steady_clock::now();
+    v_init_job_system(0);
+    v_init_arena(g_frame_arena, "frame", 1 << 20);
+    v_init_arena(g_scratch_arena, "scratch", 64 << 20);
+
+    // The model is read on a worker, into an arena of its own
+    Arena load_arena;
+    v_init_arena(load_arena, "load", 16 << 20);
+    ModelData mesh_data(load_arena);
+    bool mesh_read = false;
+    VkResult graph_result = VK_SUCCESS;
+    std::vector<uint32_t> dot(ATLAS_SIZE * ATLAS_SIZE);
+    uint32_t precompiled = 0;
+    ModelHandle mesh_handle{RESOURCE_NONE, 0};
+
+    // Reading the model and drawing the atlas need no device, they start right away.
+    // The scene pipelines compile while the main thread sets up the overlay, the
+    // model is uploaded after them so only one thread at a time uses g_resources.
+    InitGraph init;
+    InitTask read_mesh = v_add_init_task(init, "read model", INIT_WORKER_THREAD, {}, [&] {
+        mesh_read = v_read_model(mesh_data, "assets/model.obj", load_arena);
+    });
+    InitTask draw_atlas = v_add_init_task(init, "draw atlas", INIT_WORKER_THREAD, {}, [&] {
+        // A soft round dot, white so sprites tint it
+        for(uint32_t y=0; y < ATLAS_SIZE; y++)
+        {
+            for(uint32_t x=0; x < ATLAS_SIZE; x++)
+            {
+                float dx = ((float)x + 0.5f) / ATLAS_SIZE * 2.0f - 1.0f;
+                float dy = ((float)y + 0.5f) / ATLAS_SIZE * 2.0f - 1.0f;
+                float alpha = HMM_Clamp(0.0f, (1.0f - sqrtf(dx * dx + dy * dy)) * 4.0f, 1.0f);
+                dot[y * ATLAS_SIZE + x] = v_pack_color(255, 255, 255, (uint8_t)(alpha * 255.0f));
+            }
+        }
+    });
+    InitTask window = v_add_init_task(init, "window", INIT_MAIN_THREAD, {}, [&] {
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        g_window = glfwCreateWindow(width, height, app_name, NULL, NULL);
+        glfwSetFramebufferSizeCallback(g_window, framebuffer_resized);
+        glfwSetKeyCallback(g_window, key_pressed);
+    });
+    InitTask device = v_add_init_task(init, "device", INIT_MAIN_THREAD, {window}, [&] {
+        uint32_t glfw_extension_count = 0;
+        const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+        v_init_instance(app_name, glfw_extensions, glfw_extension_count, v_get_diagnostics_level());
+
+        glfwCreateWindowSurface(g_renderer.m_instance, g_window, NULL, &g_surface);
+
+        v_init_surface(g_surface);
+        v_init_device();
+        v_init_sync();
+        v_init_allocator();
+        v_init_memory();
+    });
+    InitTask swapchain = v_add_init_task(init, "swapchain", INIT_MAIN_THREAD, {device}, [&] {
+        v_init_swapchain((uint32_t)width, (uint32_t)height);
+        v_init_cmd_pool();
+        v_allocate_cmd_buffer();
+        v_init_swapchain_views();
+        v_init_sync_structs();
+    });
+    InitTask systems = v_add_init_task(init, "buffers and compute", INIT_MAIN_THREAD, {device}, [&] {
+        v_init_instance_buffer(2048);
+        v_init_indirect_buffer(1 << 18);
+        v_init_geometry_pool(1 << 20, 1 << 21, 1 << 15);
+        v_init_lighting(4096, "shaders/cluster.spv");
+        v_init_depth_pyramid("shaders/depth_reduce.spv");
+        v_init_meshlet_culling(2048, "shaders/meshlet_cull.spv");
+        v_init_draw_cache();
+        v_init_resources();
+    });
+    InitTask graph = v_add_init_task(init, "render graph", INIT_MAIN_THREAD, {swapchain, systems}, [&] {
+        graph_result = build_render_graph();
+    });
+    InitTask scene_pipelines = v_add_init_task(init, "scene pipelines", INIT_WORKER_THREAD, {graph}, [&] {
+        precompiled = v_precompile_pipeline_variants(SCENE_VARIANT_LIST, v_get_graph_render_pass(g_render_graph, g_main_pass),
+            v_get_graph_render_pass_key(g_render_graph, g_main_pass), v_get_graph_subpass(g_render_graph, g_main_pass));
+        v_record_pipeline_variants(SCENE_VARIANT_LIST);
+        for(PipelineHandle& variant : g_scene_variants) variant = PipelineHandle{RESOURCE_NONE, 0};
+        // Shares the precompiled pipelines, so switching features never compiles them again
+        for(PipelineHandle handle : g_resources.m_precompiled)
+        {
+            uint32_t features = v_get_pipeline(handle)->m_features;
+            if(features >= (1 << SHADER_FEATURE_COUNT) || v_get_pipeline(g_scene_variants[features])) continue;
+            g_scene_variants[features] = acquire_scene_pipeline(features);
+        }
+        PipelineHandle& variant = g_scene_variants[g_scene_features];
+        if(!v_get_pipeline(variant)) variant = acquire_scene_pipeline(g_scene_features);
+    });
+    v_add_init_task(init, "overlay", INIT_MAIN_THREAD, {graph, draw_atlas}, [&] {
+        v_init_upscale("shaders/fullscreen.spv", "shaders/upscale.spv", v_get_graph_render_pass(g_render_graph, g_upscale_pass),
+            v_get_graph_subpass(g_render_graph, g_upscale_pass));
+        v_init_sprite_renderer(SPRITE_CAPACITY, ATLAS_SIZE, 16, "shaders/sprite_vert.spv", "shaders/sprite_frag.spv",
+            v_get_graph_render_pass(g_render_graph, g_overlay_pass), v_get_graph_subpass(g_render_graph, g_overlay_pass));
+        v_init_sprite_batch(g_sprites, SPRITE_CAPACITY);
+        v_upload_sprite_texture(ATLAS_DOT_TEXTURE, dot.data());
+    });
+    v_add_init_task(init, "upload model", INIT_MAIN_THREAD, {read_mesh, scene_pipelines}, [&] {
+        if(mesh_read) mesh_handle = v_acquire_model(mesh_data);
+    });
+    v_run_init_graph(init);
+    uint32_t scene_features = g_scene_features;
+
+    if(graph_result != VK_SUCCESS)
+    {
+        std::cerr << "Could not create the render targets: VkResult " << graph_result << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(!v_get_model(mesh_handle))
+    {
+        std::cerr << "Could not load assets/model.obj" << std::endl;
+        return EXIT_FAILURE;
+    }
+    Model& mesh = *v_get_model(mesh_handle);
+    std::cout << "Loaded assets/model.obj: " << load_arena.m_peak / 1024 << " KB temporary" << std::endl;
+    v_destroy_arena(load_arena);
     float rotation = 0.0f;
+    float far_plane = 200.0f;
+
+    MeshComponent mesh_component{};
+    mesh_component.m_lods[0] = &mesh;
+    mesh_component.m_lod_distances[0] = far_plane;
+    mesh_component.m_lod_count = 1;
+
+    MaterialComponent material_component{};
+    material_component.m_material_id = 0;
+    material_component.m_pipeline = v_get_pipeline(g_scene_variants[scene_features]);
+
+    BoundsComponent bounds_component{};
+    bounds_component.m_center = mesh.m_bounds_center;
+    bounds_component.m_radius = mesh.m_bounds_radius;
+
+    // A spinning mesh with two smaller copies orbiting it
+    v_init_scene(g_scene, 16 + STATIC_GRID_SIZE * STATIC_GRID_SIZE);
+    Entity entities[3];
+    for(uint32_t i=0; i < 3; i++)
+    {
+        entities[i] = v_create_entity(g_scene);
+        v_add_transform(g_scene, entities[i], i == 0 ? Entity{ENTITY_NONE, 0} : entities[0]);
+        v_add_component(g_scene.m_meshes, entities[i], mesh_component);
+        v_add_component(g_scene.m_materials, entities[i], material_component);
+        v_add_component(g_scene.m_bounds, entities[i], bounds_component);
+    }
+    for(uint32_t i=1; i < 3; i++)
+    {
+        uint32_t transform = v_get_component(g_scene.m_transforms, entities[i])->m_transform;
+        v_set_transform(g_scene.m_transform_system, transform,
+            HMM_Vec3(i == 1 ? 1.5f : -1.5f, 0.0f, 0.0f), HMM_Quaternion(0.0f, 0.0f, 0.0f, 1.0f), HMM_Vec3(0.3f, 0.3f, 0.3f)
+        );
+    }
+    uint32_t mesh_transform = v_get_component(g_scene.m_transforms, entities[0])->m_transform;
 
+    // Mostly static scene: the floor never changes, so its draws are recorded once.
+    // Acquiring the model and pipeline again shares the loaded ones.
+    ModelHandle floor_mesh = v_acquire_model("assets/model.obj");
+    PipelineHandle floor_pipeline = acquire_scene_pipeline(scene_features);
+    MeshComponent static_mesh_component = mesh_component;
+    static_mesh_component.m_lods[0] = v_get_model(floor_mesh);
+    static_mesh_component.m_static = true;
+    MaterialComponent static_material_component = material_component;
+    static_material_component.m_pipeline = v_get_pipeline(floor_pipeline);
+    for(uint32_t i=0; i < STATIC_GRID_SIZE * STATIC_GRID_SIZE; i++)
+    {
+        Entity entity = v_create_entity(g_scene);
+        uint32_t transform = v_add_transform(g_scene, entity, Entity{ENTITY_NONE, 0}).m_transform;
+        v_add_component(g_scene.m_meshes, entity, static_mesh_component);
+        v_add_component(g_scene.m_materials, entity, static_material_component);
+        v_add_component(g_scene.m_bounds, entity, bounds_component);
+        float x = ((float)(i % STATIC_GRID_SIZE) - STATIC_GRID_SIZE * 0.5f) * 0.6f;
+        float z = ((float)(i / STATIC_GRID_SIZE) - STATIC_GRID_SIZE * 0.5f) * 0.6f;
+        v_set_transform(g_scene.m_transform_system, transform,
+            HMM_Vec3(x, -1.5f, z), HMM_Quaternion(0.0f, 0.0f, 0.0f, 1.0f), HMM_Vec3(0.2f, 0.2f, 0.2f));
+    }
+    v_mark_static_changed(g_scene);
+    std::cout << "Resources: " << g_resources.m_stats.m_models << " models, " << g_resources.m_stats.m_pipelines
+        << " pipelines, " << g_resources.m_stats.m_shared_acquires << " acquires shared, "
+        << precompiled << " pipeline variants precompiled" << std::endl;
+
+    // Small lights circling the meshes, every fourth one a spot pointing at the center
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<Light> lights(4096);
+    std::vector<hmm_vec3> light_orbits(lights.size());
+    for(uint32_t i=0; i < lights.size(); i++)
+    {
+        Light& light = lights[i];
+        light.m_type = i % 4 == 0 ? LIGHT_SPOT : LIGHT_POINT;
+        light.m_color = HMM_Vec3(unit(rng), unit(rng), unit(rng));
+        light.m_intensity = 0.5f;
+        light.m_range = 0.2f + 0.3f * unit(rng);
+        light.m_inner_angle = 0.3f;
+        light.m_outer_angle = 0.5f;
+        // Radius, height and angular speed
+        light_orbits[i] = HMM_Vec3(0.5f + 2.5f * unit(rng), -1.5f + 3.0f * unit(rng), 0.2f + unit(rng));
+    }
+
+    const GLFWvidmode* video_mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    v_init_frame_pacer(g_frame_pacer, 1.0 / (video_mode ? video_mode->refreshRate : 60));
+    // Some headroom below the refresh period, the measured time lags a frame behind
+    v_init_dynamic_resolution(g_resolution, 900.0f / (video_mode ? video_mode->refreshRate : 60), 0.5f, 1.0f);
+
+    // VIME_HEAP_ASSERT aborts on any heap allocation of the steady state frame loop
+    bool heap_assert = getenv("VIME_HEAP_ASSERT") != nullptr;
+    uint32_t steady_frames = 0;
+
+    bool graph_dirty = false;
+    bool first_frame = true;
     while(!glfwWindowShouldClose(g_window))
     {
+        if(g_renderer.m_swapchain_dirty)
+        {
+            glfwGetFramebufferSize(g_window, &width, &height);
+            if(width == 0 || height == 0)
+            {
+                glfwWaitEvents(); // Minimized
+                continue;
+            }
+            v_recreate_swapchain((uint32_t)width, (uint32_t)height);
+            graph_dirty = true;
+            steady_frames = 0;
+        }
+
+        if(!v_acquire_frame()) continue;
+        v_update_memory();
+
+        uint32_t image_idx = g_renderer.m_swapchain_image_idx;
+        v_set_imported_image(g_render_graph, g_backbuffer, g_renderer.m_swapchain_images[image_idx],
+            g_renderer.m_swapchain_image_views[image_idx], g_renderer.m_win_extent);
+        if(graph_dirty)
+        {
+            VkResult result = v_compile_render_graph(g_render_graph);
+            if(result != VK_SUCCESS)
+            {
+                std::cerr << "Could not recreate the render targets: VkResult " << result << std::endl;
+                break;
+            }
+            v_invalidate_draw_recordings();
+            graph_dirty = false;
+        }
+
+        // Input is sampled as late as possible, right before recording
+        v_pace_frame(g_frame_pacer);
         glfwPollEvents();
-        if(glfwGetKey(g_window, GLFW_KEY_ESCAPE)) break;
+
+        if(scene_features != g_scene_features)
+        {
+            PipelineHandle& variant = g_scene_variants[g_scene_features];
+            if(!v_get_pipeline(variant)) variant = acquire_scene_pipeline(g_scene_features);
+            GraphicsPipeline* variant_pipeline = v_get_pipeline(variant);
+            for(MaterialComponent& material : g_scene.m_materials.m_data) material.m_pipeline = variant_pipeline;
+            // The static recordings bind the old pipeline
+            v_mark_static_changed(g_scene);
+            scene_features = g_scene_features;
+            steady_frames = 0;
+        }
+
+        // Input handling may allocate, the rest of the frame should not
+        HeapStats frame_start = v_get_heap_stats();
+        if(heap_assert && steady_frames >= HEAP_WARMUP_FRAMES) v_forbid_heap(true);
 
         if(rotation >= 360.0f) rotation = 0.0f;
         rotation += 2.0f;
 
         hmm_vec3 cam_pos = {0.0f, 0.0f, -2.0f};
         hmm_mat4 view = HMM_Translate(cam_pos);
-        hmm_mat4 projection = HMM_Perspective(70.0f, float(width / height), 0.1f, 200.0f);
-        hmm_mat4 model = HMM_Rotate(rotation, HMM_Vec3(0, 1, 0));
-        hmm_mat4 mesh_matrix = projection * view * model;
-        constants.m_render_matrix = mesh_matrix;
+        float aspect = (float)g_renderer.m_win_extent.width / (float)g_renderer.m_win_extent.height;
+        hmm_mat4 projection = HMM_Perspective(70.0f, aspect, 0.1f, far_plane);
+        g_scene_view.m_view_projection = projection * view;
+        *g_renderer.m_view_projection = g_scene_view.m_view_projection;
+        g_scene_view.m_camera_position = -cam_pos;
+
+        v_set_rotation(g_scene.m_transform_system, mesh_transform, HMM_QuaternionFromAxisAngle(HMM_Vec3(0, 1, 0), HMM_ToRadians(rotation)));
+
+        float time = (float)glfwGetTime();
+        for(uint32_t i=0; i < lights.size(); i++)
+        {
+            float angle = time * light_orbits[i].Z + (float)i;
+            lights[i].m_position = HMM_Vec3(cosf(angle) * light_orbits[i].X, light_orbits[i].Y, sinf(angle) * light_orbits[i].X);
+            lights[i].m_direction = -lights[i].m_position;
+        }
+        float render_scale = v_update_dynamic_resolution(g_resolution, v_get_graph_gpu_ms(g_render_graph));
+        v_set_graph_render_scale(g_render_graph, render_scale);
+        VkExtent2D render_extent = v_get_graph_render_extent(g_render_graph, g_scene_color);
+
+        v_update_lighting(view, projection, 0.1f, far_plane, render_extent, lights.data(), (uint32_t)lights.size());
 
-        v_begin_rendering({0.4f, 0.5f, 0.6f, 1.0f});
+        double sprite_start = glfwGetTime();
+        v_clear_sprite_batch(g_sprites);
+        if(g_sprite_stress) add_stress_sprites(time);
+        if(g_show_pass_times) add_pass_time_bars();
+        v_flush_sprite_batch(g_sprites);
+        g_sprite_ms = (float)((glfwGetTime() - sprite_start) * 1000.0);
+        v_update_transforms(g_scene.m_transform_system, g_renderer.m_instance_data, g_renderer.m_max_instances);
 
-        draw(mesh, g_pipeline, constants);
+        v_cull_scene(g_scene, g_scene_view);
+        v_select_lods(g_scene, g_scene_view);
+        v_update_meshlet_culling(view, projection, 0.1f, g_scene_view.m_frustum, g_scene_view.m_camera_position);
 
-        v_end_rendering();
+        v_update_draw_cache(v_get_static_version(g_scene), [](RenderQueue& queue) {
+            v_submit_static_scene(g_scene, queue);
+        }, g_render_queue);
+
+        double submit_start = glfwGetTime();
+        v_clear_render_queue(g_render_queue);
+        v_submit_scene(g_scene, g_scene_view, g_render_queue, far_plane);
+        v_sort_render_queue(g_render_queue);
+        g_submit_ms = (float)((glfwGetTime() - submit_start) * 1000.0);
+        g_record_ms = 0.0f;
+
+        v_begin_frame();
+        v_execute_render_graph(g_render_graph, g_renderer.m_command_buffer);
+        v_end_frame();
+        v_frame_submitted(g_frame_pacer);
+
+        if(first_frame)
+        {
+            v_print_init_report(init);
+            std::cout << "First frame presented after "
+                << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - process_start).count()
+                << " ms" << std::endl;
+            first_frame = false;
+        }
+
+        v_forbid_heap(false);
+        HeapStats frame_end = v_get_heap_stats();
+        g_frame_heap.m_allocations = frame_end.m_allocations - frame_start.m_allocations;
+        g_frame_heap.m_bytes = frame_end.m_bytes - frame_start.m_bytes;
+        steady_frames++;
     }
 
-    v_wait_for_fences();
-    v_destroy_model(mesh);
-    v_destroy_graphics_pipeline(g_pipeline);
+    v_wait_for_frame();
+    v_release_model(floor_mesh);
+    v_release_model(mesh_handle);
+    v_release_pipeline(floor_pipeline);
+    for(PipelineHandle variant : g_scene_variants) v_release_pipeline(variant);
+    v_destroy_resources();
+    v_destroy_sprite_batch(g_sprites);
+    v_destroy_sprite_renderer();
+    v_destroy_draw_cache();
+    v_destroy_upscale();
+    v_destroy_render_graph(g_render_graph);
+    v_destroy_meshlet_culling();
+    v_destroy_depth_pyramid();
+    v_destroy_lighting();
 
+    v_destroy_geometry_pool();
+    v_destroy_indirect_buffer();
+    v_destroy_instance_buffer();
+    v_destroy_sync();
     v_destroy_sync_structs();
-    v_destroy_framebuffers();
+    v_destroy_swapchain_views();
     v_destroy_cmd_pool();
-    v_destroy_render_pass();
     v_destroy_swapchain();
+    v_destroy_memory();
     v_destroy_allocator();
     v_destroy_device();
     v_destroy_surface();
@@ -93,5 +672,9 @@ int main()
     glfwDestroyWindow(g_window);
     glfwTerminate();
 
+    v_destroy_job_system();
+    v_destroy_arena(g_scratch_arena);
+    v_destroy_arena(g_frame_arena);
+
     return 0;
 }
\ No newline at end of file